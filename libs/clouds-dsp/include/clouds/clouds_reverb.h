@@ -6,31 +6,158 @@
 // This wrapper provides:
 // - Self-contained memory management (no external buffer needed)
 // - Simplified API for common use cases
-// - Support for different sample rates
+// - Support for different sample rates (delay lengths scale with the rate)
 // - Both mono and stereo processing
+// - Denormal-free processing whatever the host's FPU mode (see denormals.h)
+// - Optionally, a tank running at half or a quarter of high host rates
 
 #ifndef CLOUDS_CLOUDS_REVERB_H_
 #define CLOUDS_CLOUDS_REVERB_H_
 
 #include <cstdint>
 #include <cstddef>
-#include <cstring>
 #include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <new>
 
+#include "clouds/delay_memory.h"
+#include "clouds/delay_network.h"
+#include "clouds/denormals.h"
 #include "clouds/frame.h"
 #include "clouds/fx_engine.h"
+#include "clouds/half_band.h"
+#include "clouds/reverb_stats.h"
 #include "stmlib/stmlib.h"
 
 namespace clouds {
 
+namespace clouds_network {
+
+using namespace network;
+
+// Delay lines of the Clouds network
+struct Ap1; struct Ap2; struct Ap3; struct Ap4;
+struct Dap1a; struct Dap1b; struct Del1;
+struct Dap2a; struct Dap2b; struct Del2;
+
+// Four input diffusers feeding a figure-of-eight tank: each branch reads the
+// other's delay, filters it and runs it through two allpasses into its own.
+// Lengths are at CloudsReverb::kReferenceSampleRate.
+typedef DelayNetwork<
+    Lines<
+        Line<Ap1, 150>, Line<Ap2, 214>, Line<Ap3, 319>, Line<Ap4, 527>,
+        Line<Dap1a, 2182>, Line<Dap1b, 2690>, Line<Del1, 4501>,
+        Line<Dap2a, 2525>, Line<Dap2b, 2197>, Line<Del2, 6312> >,
+    Diffuser<AllPass<Ap1>, AllPass<Ap2>, AllPass<Ap3>, AllPass<Ap4> >,
+    Branch<
+        ModulatedRead<Del2, 6200, 40, LFO_2>, LowPass<0>,
+        AllPass<Dap1a, true>, AllPass<Dap1b>, WriteDelay<Del1> >,
+    Branch<
+        ModulatedRead<Del1, 4400, 30, LFO_1>, LowPass<1>,
+        AllPass<Dap2a>, AllPass<Dap2b, true>, WriteDelay<Del2> > > Network;
+
+}  // namespace clouds_network
+
+typedef clouds_network::Network CloudsNetwork;
+
+enum ProcessingMode {
+  // Runs the whole network once per sample through FxEngine::Context. This is
+  // the reference implementation ported from Clouds.
+  PROCESSING_MODE_SAMPLE,
+  // Runs the network stage by stage over blocks of up to kBlockSize samples
+  // through FxEngine::BlockContext. Matches PROCESSING_MODE_SAMPLE to within
+  // kBlockModeTolerance (bit-identical unless the compiler contracts
+  // multiply-adds).
+  PROCESSING_MODE_BLOCK
+};
+
 // CloudsReverb provides a high-level interface to the Clouds reverb effect.
 // It manages its own memory and provides a simple, platform-agnostic API.
-class CloudsReverb {
+//
+// The delay memory is stored in `format` (see FxEngine). FORMAT_32_BIT is
+// the reference; the 16-bit formats halve the memory of an instance (64 KB
+// instead of 128 KB at 48 kHz) at the cost of an error floor, tabulated by
+// benchmark_reverb.cpp. On white noise at -17 dBFS it is about -65 dB
+// relative to the output for FORMAT_16_BIT_FLOAT, -48 dB for FORMAT_16_BIT
+// (which also clips the tank at 1.0) and -30 dB for FORMAT_12_BIT, the
+// format of the original module. Only the half-float floor does not depend
+// on the level.
+//
+// `ring` picks the layout of the delay memory. By default the lines share
+// one power-of-2 ring. With RING_PACKED every line has a ring of its own
+// length instead, which takes about 30% less memory (90 KB at 48 kHz with
+// FORMAT_32_BIT) and helps when many instances compete for cache, at the
+// cost of a few percent in block mode and more in PROCESSING_MODE_SAMPLE.
+//
+// At high sample rates the network can run at a fraction of the host rate
+// (see Init()), between half-band filters that take the summed input down to
+// the tank rate and the wet outputs back up. The original module ran at
+// 32 kHz, and the tank low-passes its content anyway, so the wet signal only
+// loses what is above about 18 kHz. The filters delay the output by
+// GetLatency() samples, dry signal included. They cost close to what they
+// save against the block kernels at half rate (about 5% less CPU at 96 kHz)
+// and 15% less at a quarter rate; in PROCESSING_MODE_SAMPLE the cost drops
+// by 40% and 60%.
+//
+// An instance is not thread-safe: the setters write members that Process()
+// reads. Hosts that change parameters from other threads post them to a
+// ParameterMailbox (see parameter_mailbox.h) and apply them on the audio
+// thread between calls.
+template<Format format = FORMAT_32_BIT, RingLayout ring = RING_MIRRORED>
+class BasicCloudsReverb {
  public:
-  // Buffer size for the delay lines (must be power of 2)
-  static constexpr size_t kBufferSize = 32768;
+  // Sample rate the delay lengths below are tuned for. At other rates they
+  // are scaled so that the room keeps the same size in seconds.
+  static constexpr float kReferenceSampleRate = 48000.0f;
+
+  // Buffer size for the delay lines at kReferenceSampleRate. Init() allocates
+  // the smallest power of 2 that fits the scaled lines, or with RING_PACKED
+  // just their rings (see GetBufferSize()).
+  static constexpr size_t kBufferSize = CloudsNetwork::kBufferSize;
+
+  // Samples processed per stage in PROCESSING_MODE_BLOCK. The only
+  // cross-stage feedback in the network is the del1/del2 loop, whose shortest
+  // read (CloudsNetwork::kMinFeedbackLatency) is far longer, so blocks give
+  // the same result as the per-sample path. At very low sample rates, blocks
+  // are shortened to keep this true.
+  static constexpr size_t kBlockSize = 128;
 
-  CloudsReverb()
+  // Maximum absolute difference between PROCESSING_MODE_BLOCK and
+  // PROCESSING_MODE_SAMPLE output.
+  static constexpr float kBlockModeTolerance = 1e-6f;
+
+  // Level (about -100 dBFS) below which input and tail count as silence for
+  // sleeping (see SetSleepEnabled()) and tail length estimates.
+  static constexpr float kSleepThreshold = 1e-5f;
+
+  // Largest rate reduction of the tank (see Init()), and the lowest tank
+  // rate RecommendedDecimation() picks.
+  static constexpr size_t kMaxDecimation = 4;
+  static constexpr float kMinTankSampleRate = 44100.0f;
+
+  // Level (about +160 dBFS) at or above which the wet signal or the state of
+  // the network counts as runaway. Finite input never gets near it.
+  static constexpr float kFaultLevel = 1e8f;
+
+  // Audio-rate modulation for one Process() call, e.g. from CV inputs. Each
+  // buffer that is not null holds one value per sample, which is added to the
+  // parameter; the sum is clamped to [0.0, 1.0].
+  struct Modulation {
+    const float* amount = nullptr;
+    const float* input_gain = nullptr;
+    const float* time = nullptr;
+    const float* diffusion = nullptr;
+    const float* lp = nullptr;
+  };
+
+  BasicCloudsReverb() : BasicCloudsReverb(HeapAllocator::Default()) { }
+
+  // Takes the delay memory from `allocator` (see delay_memory.h), which must
+  // outlive the instance.
+  explicit BasicCloudsReverb(DelayMemoryAllocator* allocator)
       : sample_rate_(48000.0f),
         amount_(0.5f),
         input_gain_(0.5f),
@@ -38,90 +165,291 @@ class CloudsReverb {
         diffusion_(0.625f),
         lp_(0.7f),
         lp_decay_1_(0.0f),
-        lp_decay_2_(0.0f) {
-    std::memset(buffer_, 0, sizeof(buffer_));
+        lp_decay_2_(0.0f),
+        amount_target_(0.5f),
+        input_gain_target_(0.5f),
+        reverb_time_target_(0.5f),
+        diffusion_target_(0.625f),
+        lp_target_(0.7f),
+        ramp_pending_(false),
+        sleep_enabled_(true),
+        sleeping_(true),
+        tank_level_(0.0f),
+        quiet_samples_(0),
+        num_faults_(0),
+        diffuser_length_(1210.0f),
+        branch_length_(10203.5f),
+        allocator_(allocator),
+        buffer_size_(0),
+        max_block_size_(kBlockSize),
+        decimation_(1),
+        num_stages_(0),
+        latency_(0),
+        phase_(0),
+        processing_mode_(PROCESSING_MODE_BLOCK) {
   }
 
-  ~CloudsReverb() = default;
+  ~BasicCloudsReverb() = default;
+
+  // Moving hands the delay memory over without copying it (the rest of the
+  // state, about 13 KB, is copied). A moved-from instance must be
+  // initialized again before use.
+  BasicCloudsReverb(BasicCloudsReverb&&) = default;
+  BasicCloudsReverb& operator=(BasicCloudsReverb&&) = default;
+
+  // Bytes of delay memory Init() takes from the allocator for a sample rate
+  // and decimation, rounded up to kDelayMemoryAlignment: n times this sizes
+  // an ArenaAllocator for n instances.
+  static size_t MemorySize(float sample_rate, size_t decimation = 1) {
+    int32_t lengths[kNumDelayLines];
+    typename E::DynamicDelayLine lines[kNumDelayLines];
+    const size_t size = E::StorageSize(
+        LayOut(sample_rate, decimation, lengths, lines)) * sizeof(T);
+    return (size + kDelayMemoryAlignment - 1) & ~(kDelayMemoryAlignment - 1);
+  }
 
-  // Initialize the reverb with the given sample rate
-  void Init(float sample_rate = 48000.0f) {
+  // Initialize the reverb with the given sample rate. Allocates the delay
+  // memory, so call it outside the audio thread. The buffer is only
+  // reallocated when the sample rate needs a different size.
+  //
+  // With `decimation` 2 or 4 the network runs at that fraction of the sample
+  // rate, with delay lines sized for the lower rate (other values are rounded
+  // down to 1, 2 or 4). Output is then delayed by GetLatency() samples.
+  void Init(float sample_rate = 48000.0f, size_t decimation = 1) {
     sample_rate_ = sample_rate;
-    engine_.Init(buffer_);
+    decimation_ = Decimation(decimation);
+    num_stages_ = decimation_ == 4 ? 2 : decimation_ == 2 ? 1 : 0;
+    // The stage next to the tank has the steeper filter, and so does all of
+    // the work at half rate. At a quarter rate the stage at the host rate
+    // only has to keep what will pass the other one. A tank-rate sample is
+    // only complete at the last host sample of its group.
+    if (num_stages_ == 2) {
+      latency_ = half_band::Latency<half_band::Wide>() +
+          2 * half_band::Latency<half_band::Narrow>() + 3;
+    } else if (num_stages_ == 1) {
+      latency_ = half_band::Latency<half_band::Narrow>() + 1;
+    } else {
+      latency_ = 0;
+    }
+
+    int32_t lengths[kNumDelayLines];
+    const size_t buffer_size = LayOut(sample_rate, decimation_, lengths, lines_);
+    const float scale = tank_sample_rate() / kReferenceSampleRate;
+
+    // Memory fresh from a zeroing allocator is already silent.
+    bool zeroed = false;
+    if (!buffer_ || buffer_size != buffer_size_) {
+      const size_t bytes = E::StorageSize(buffer_size) * sizeof(T);
+      buffer_.reset();
+      buffer_ = Memory(static_cast<T*>(allocator_->Allocate(bytes)),
+                       FreeMemory{allocator_, bytes});
+      buffer_size_ = buffer_size;
+      zeroed = allocator_->zeroed();
+    }
+    if constexpr (ring == RING_PACKED) {
+      engine_.Init(buffer_.get(), lines_, kNumDelayLines, zeroed);
+    } else {
+      engine_.Init(buffer_.get(), buffer_size_, zeroed);
+    }
+
+    max_block_size_ = std::clamp(
+        static_cast<size_t>(CloudsNetwork::kMinFeedbackLatency * scale),
+        size_t(1), kBlockSize);
+
+    // Tank branches (dap1a, dap1b, del1 and dap2a, dap2b, del2) each scale
+    // the signal by Time once. Their mean length sets the decay rate; a full
+    // pass through the diffusers and both branches bounds how long anything
+    // still in the network takes to reach the output. Both are counted in
+    // samples at the host rate.
+    const float to_host = static_cast<float>(decimation_);
+    diffuser_length_ = to_host * static_cast<float>(
+        lengths[0] + lengths[1] + lengths[2] + lengths[3]);
+    branch_length_ = to_host * 0.5f * static_cast<float>(
+        lengths[4] + lengths[5] + lengths[6] + lengths[7] + lengths[8] + lengths[9]);
 
     // Set LFO frequencies (very slow for subtle modulation)
-    // These are already multiplied by 32 inside SetLFOFrequency
-    engine_.SetLFOFrequency(LFO_1, 0.5f / sample_rate_);
-    engine_.SetLFOFrequency(LFO_2, 0.3f / sample_rate_);
+    // SetLFOFrequency takes cycles per sample
+    engine_.SetLFOFrequency(LFO_1, 0.5f / tank_sample_rate());
+    engine_.SetLFOFrequency(LFO_2, 0.3f / tank_sample_rate());
+    ResetResampling();
+    ClearDryDelay();
 
     // Default parameters
-    amount_ = 0.5f;
-    input_gain_ = 0.5f;
-    reverb_time_ = 0.5f;
-    diffusion_ = 0.625f;
-    lp_ = 0.7f;
+    SetParameters(0.5f, 0.5f, 0.5f, 0.625f, 0.7f);
     lp_decay_1_ = 0.0f;
     lp_decay_2_ = 0.0f;
+    ResetTail();
+    num_faults_ = 0;
+#ifdef CLOUDS_ENABLE_STATS
+    if (stats_) {
+      stats_->Reset();
+    }
+#endif
   }
 
-  // Clear all delay buffers (removes any lingering reverb tail)
+  // Clear all delay buffers (removes any lingering reverb tail). The reverb
+  // then renders exactly as after Init() with the current parameters. Takes
+  // constant time: the delay memory is only invalidated (see
+  // FxEngine::Invalidate()), so any number of instances can clear in one
+  // audio callback.
   void Clear() {
-    engine_.Clear();
+    engine_.Invalidate();
     lp_decay_1_ = 0.0f;
     lp_decay_2_ = 0.0f;
+    ResetResampling();
+    ClearDryDelay();
+    ResetTail();
+    CountEvent(ReverbStats::EVENT_CLEAR);
+  }
+
+  // Largest decimation (1, 2 or 4) that keeps the tank at or above
+  // kMinTankSampleRate: 2 at 88.2 and 96 kHz, 4 at 176.4 and 192 kHz.
+  static size_t RecommendedDecimation(float sample_rate) {
+    size_t decimation = 1;
+    while (decimation < kMaxDecimation &&
+           sample_rate / static_cast<float>(2 * decimation) >= kMinTankSampleRate) {
+      decimation *= 2;
+    }
+    return decimation;
   }
 
+  // All Process() variants take an optional per-sample modulation (see
+  // Modulation), and apply any ramp set up with RampParameters().
+
   // Process stereo audio frames in-place
-  void Process(FloatFrame* in_out, size_t size) {
-    ProcessInternal(in_out, size);
+  void Process(FloatFrame* in_out, size_t size,
+               const Modulation* modulation = nullptr) {
+    ProcessInternal(FrameIO(in_out, in_out), size, modulation);
   }
 
-  // Process separate left/right channel buffers
-  void Process(float* left, float* right, size_t size) {
-    while (size--) {
-      FloatFrame frame = { *left, *right };
-      ProcessInternal(&frame, 1);
-      *left++ = frame.l;
-      *right++ = frame.r;
-    }
+  // Process stereo audio frames from in to out (which may be the same buffer)
+  void Process(const FloatFrame* in, FloatFrame* out, size_t size,
+               const Modulation* modulation = nullptr) {
+    ProcessInternal(FrameIO(in, out), size, modulation);
+  }
+
+  // Process separate left/right channel buffers in-place
+  void Process(float* left, float* right, size_t size,
+               const Modulation* modulation = nullptr) {
+    ProcessInternal(PlanarIO(left, right, left, right), size, modulation);
+  }
+
+  // Process separate left/right channel buffers out-of-place. Each output may
+  // be the same buffer as the input of its channel.
+  void Process(const float* in_left, const float* in_right,
+               float* out_left, float* out_right, size_t size,
+               const Modulation* modulation = nullptr) {
+    ProcessInternal(
+        PlanarIO(in_left, in_right, out_left, out_right), size, modulation);
   }
 
   // Process mono input to stereo output
-  void ProcessMono(const float* input, float* left, float* right, size_t size) {
-    while (size--) {
-      FloatFrame frame = { *input, *input };
-      ProcessInternal(&frame, 1);
-      *left++ = frame.l;
-      *right++ = frame.r;
-      ++input;
+  void ProcessMono(const float* input, float* left, float* right, size_t size,
+                   const Modulation* modulation = nullptr) {
+    ProcessInternal(PlanarIO(input, input, left, right), size, modulation);
+  }
+
+  // Select the per-sample reference kernel or the block-major kernel.
+  void SetProcessingMode(ProcessingMode mode) {
+    processing_mode_ = mode;
+  }
+
+  ProcessingMode GetProcessingMode() const { return processing_mode_; }
+
+  // With sleep enabled (the default), the reverb tracks its input level and
+  // an estimate of the tank level, and goes to sleep once both have stayed
+  // below kSleepThreshold for as long as any signal takes to cross the
+  // network. While asleep Process() only scales the input by the dry part of
+  // the mix, which is what the network outputs for an empty tank. A call
+  // whose input reaches the threshold wakes the reverb and is processed in
+  // full. The reverb also starts asleep after Init() and Clear().
+  void SetSleepEnabled(bool enabled) {
+    sleep_enabled_ = enabled;
+    if (!enabled) {
+      sleeping_ = false;
     }
   }
 
+  bool IsSleepEnabled() const { return sleep_enabled_; }
+  bool IsSleeping() const { return sleeping_; }
+
+  // Seconds for the tail of a full-scale input to decay below
+  // kSleepThreshold at the current Time; infinite when Time is 1. The decay
+  // per pass through a tank branch is exactly Time at DC. The low-pass only
+  // shortens the decay of higher frequencies, so it does not enter the
+  // estimate.
+  float GetTailLength() const { return DecayTime(1.0f); }
+
+  // Seconds until the current tail is expected to fall below
+  // kSleepThreshold (0 while asleep).
+  float GetRemainingTail() const {
+    return sleeping_ ? 0.0f : DecayTime(tank_level_);
+  }
+
+  // Process() calls since Init() whose wet signal or low-pass state was not
+  // finite or reached kFaultLevel, e.g. after a NaN in the input or
+  // modulation. Such a value would otherwise circulate in the tank for good.
+  // The call zeroes the affected output samples, and silences the delay
+  // lines and filters holding such values, leaving the others as they are.
+  // The check is one compare per call, on the wet peak the kernels track
+  // anyway.
+  uint32_t GetFaultCount() const { return num_faults_; }
+
+#ifdef CLOUDS_ENABLE_STATS
+  // Run-time statistics (see reverb_stats.h): the time taken by each
+  // Process() call, and counts of sleeps, clears and faults, since Init().
+  // Off by default. EnableStats() allocates, so call it outside the audio
+  // thread, and not while another thread reads the statistics.
+  void EnableStats(bool enabled) {
+    if (enabled != IsStatsEnabled()) {
+      stats_.reset(enabled ? new ReverbStats() : nullptr);
+    }
+  }
+  bool IsStatsEnabled() const { return stats_ != nullptr; }
+
+  // Any thread. Copies the statistics to `stats`, or returns false if they
+  // are not enabled.
+  bool GetStats(ReverbStats::Snapshot* stats) const {
+    if (!stats_) {
+      return false;
+    }
+    stats_->Read(stats);
+    return true;
+  }
+
+  // Any thread. Restarts the statistics from the next Process() call.
+  void ResetStats() {
+    if (stats_) {
+      stats_->RequestReset();
+    }
+  }
+#endif  // CLOUDS_ENABLE_STATS
+
   // Parameter setters with range clamping [0.0, 1.0]
 
   // Wet/dry mix (0 = fully dry, 1 = fully wet)
   void SetAmount(float amount) {
-    amount_ = std::clamp(amount, 0.0f, 1.0f);
+    amount_ = amount_target_ = std::clamp(amount, 0.0f, 1.0f);
   }
 
   // Input gain to the reverb
   void SetInputGain(float input_gain) {
-    input_gain_ = std::clamp(input_gain, 0.0f, 1.0f);
+    input_gain_ = input_gain_target_ = std::clamp(input_gain, 0.0f, 1.0f);
   }
 
   // Reverb decay time (0 = short, 1 = infinite)
   void SetTime(float time) {
-    reverb_time_ = std::clamp(time, 0.0f, 1.0f);
+    reverb_time_ = reverb_time_target_ = std::clamp(time, 0.0f, 1.0f);
   }
 
   // Diffusion amount (0 = sparse, 1 = dense)
   void SetDiffusion(float diffusion) {
-    diffusion_ = std::clamp(diffusion, 0.0f, 1.0f);
+    diffusion_ = diffusion_target_ = std::clamp(diffusion, 0.0f, 1.0f);
   }
 
   // Low-pass filter cutoff in feedback (0 = dark, 1 = bright)
   void SetLowpassCutoff(float lp) {
-    lp_ = std::clamp(lp, 0.0f, 1.0f);
+    lp_ = lp_target_ = std::clamp(lp, 0.0f, 1.0f);
   }
 
   // Convenience method to set all parameters at once
@@ -133,6 +461,19 @@ class CloudsReverb {
     SetLowpassCutoff(lp);
   }
 
+  // Ramps all parameters linearly from their current values to the given
+  // ones over the next Process() call, reaching them on its last sample.
+  // Values are clamped as in SetParameters(). The getters return the new
+  // values once the call has run.
+  void RampParameters(float amount, float input_gain, float time, float diffusion, float lp) {
+    amount_target_ = std::clamp(amount, 0.0f, 1.0f);
+    input_gain_target_ = std::clamp(input_gain, 0.0f, 1.0f);
+    reverb_time_target_ = std::clamp(time, 0.0f, 1.0f);
+    diffusion_target_ = std::clamp(diffusion, 0.0f, 1.0f);
+    lp_target_ = std::clamp(lp, 0.0f, 1.0f);
+    ramp_pending_ = true;
+  }
+
   // Parameter getters
   float GetAmount() const { return amount_; }
   float GetInputGain() const { return input_gain_; }
@@ -141,97 +482,920 @@ class CloudsReverb {
   float GetLowpassCutoff() const { return lp_; }
   float GetSampleRate() const { return sample_rate_; }
 
+  // Rate reduction of the tank set by Init(), and the delay in samples it
+  // adds to the output (0 without decimation). Hosts should report it as the
+  // latency of the effect.
+  size_t GetDecimation() const { return decimation_; }
+  size_t GetLatency() const { return latency_; }
+
+  // Number of samples of delay memory allocated by Init()
+  size_t GetBufferSize() const { return buffer_size_; }
+
+  // Bytes of delay memory allocated by Init()
+  size_t GetMemorySize() const {
+    return E::StorageSize(buffer_size_) * sizeof(T);
+  }
+
+  // Complete state of an instance, for jumping back to a point of a render
+  // or for starting copies of a warmed-up instance: delay memory, LFO
+  // phases, filter states, parameters (including a ramp not yet run) and
+  // sleep state. The settings (processing mode, sleep enabled) are not part
+  // of it. A snapshot is one flat block of GetSnapshotSize() bytes, which
+  // can be copied or stored as is; it only restores into an instance of the
+  // same type initialized with the same sample rate and decimation, on a
+  // machine with the same byte order.
+  class Snapshot {
+   public:
+    Snapshot() : size_(0) { }
+    ~Snapshot() { }
+
+    // Sizes the snapshot for instances configured like `reverb`. Allocates,
+    // so call it outside the audio thread.
+    void Allocate(const BasicCloudsReverb& reverb) {
+      const size_t size = reverb.GetSnapshotSize();
+      if (size != size_) {
+        data_.reset(new uint8_t[size]);
+        size_ = size;
+      }
+      std::fill(data_.get(), data_.get() + size_, uint8_t(0));
+    }
+
+    const uint8_t* data() const { return data_.get(); }
+    uint8_t* data() { return data_.get(); }
+    size_t size() const { return size_; }
+
+   private:
+    std::unique_ptr<uint8_t[]> data_;
+    size_t size_;
+
+    DISALLOW_COPY_AND_ASSIGN(Snapshot);
+  };
+
+  size_t GetSnapshotSize() const {
+    return sizeof(SnapshotHeader) + GetMemorySize();
+  }
+
+  // Copies the state to `snapshot`, or returns false if it was not
+  // allocated for an instance of this size. Neither call allocates, so both
+  // are safe on the audio thread; they cost a copy of the delay memory.
+  bool SaveSnapshot(Snapshot* snapshot) const {
+    if (snapshot->size() != GetSnapshotSize()) {
+      return false;
+    }
+    SaveHeader(kSnapshotMagic, snapshot->data());
+    std::memcpy(snapshot->data() + sizeof(SnapshotHeader), buffer_.get(),
+                GetMemorySize());
+    return true;
+  }
+
+  // Restores the state saved in `snapshot`, or returns false (and leaves the
+  // instance as it is) if it comes from another configuration.
+  bool RestoreSnapshot(const Snapshot& snapshot) {
+    if (snapshot.size() != GetSnapshotSize() ||
+        !RestoreHeader(kSnapshotMagic, snapshot.data())) {
+      return false;
+    }
+    std::memcpy(buffer_.get(), snapshot.data() + sizeof(SnapshotHeader),
+                GetMemorySize());
+    return true;
+  }
+
+  // Compact form of a snapshot, for storage: only the samples each delay
+  // line can still read are kept, which leaves out the unused part of the
+  // ring and the guard zones (a third of the snapshot at 48 kHz; a few KB
+  // with RING_PACKED). It restores exactly the same state, at the cost of
+  // clearing the delay memory first.
+  size_t GetCompactSnapshotSize() const {
+    size_t samples = 0;
+    for (const auto& line : lines_) {
+      samples += static_cast<size_t>(line.length) + 1;
+    }
+    return sizeof(SnapshotHeader) + samples * sizeof(T);
+  }
+
+  // Writes the compact form to `out` and returns its size, or returns 0 if
+  // `capacity` is too small. Does not allocate.
+  size_t SaveCompactSnapshot(void* out, size_t capacity) const {
+    const size_t size = GetCompactSnapshotSize();
+    if (capacity < size) {
+      return 0;
+    }
+    uint8_t* bytes = static_cast<uint8_t*>(out);
+    SaveHeader(kCompactSnapshotMagic, bytes);
+    T* samples = reinterpret_cast<T*>(bytes + sizeof(SnapshotHeader));
+    for (const auto& line : lines_) {
+      engine_.SaveLine(line, samples);
+      samples += line.length + 1;
+    }
+    return size;
+  }
+
+  // Restores a compact snapshot of `size` bytes, or returns false (and
+  // leaves the instance as it is) if it comes from another configuration.
+  bool RestoreCompactSnapshot(const void* in, size_t size) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(in);
+    if (size != GetCompactSnapshotSize() ||
+        !RestoreHeader(kCompactSnapshotMagic, bytes)) {
+      return false;
+    }
+    std::fill(buffer_.get(), buffer_.get() + E::StorageSize(buffer_size_), T(0));
+    const T* samples = reinterpret_cast<const T*>(bytes + sizeof(SnapshotHeader));
+    for (const auto& line : lines_) {
+      engine_.RestoreLine(line, samples);
+      samples += line.length + 1;
+    }
+    return true;
+  }
+
  private:
-  void ProcessInternal(FloatFrame* in_out, size_t size) {
-    // Define memory layout for delay lines
-    typedef E::Reserve<150,
-      E::Reserve<214,
-      E::Reserve<319,
-      E::Reserve<527,
-      E::Reserve<2182,
-      E::Reserve<2690,
-      E::Reserve<4501,
-      E::Reserve<2525,
-      E::Reserve<2197,
-      E::Reserve<6312> > > > > > > > > > Memory;
-    E::DelayLine<Memory, 0> ap1;
-    E::DelayLine<Memory, 1> ap2;
-    E::DelayLine<Memory, 2> ap3;
-    E::DelayLine<Memory, 3> ap4;
-    E::DelayLine<Memory, 4> dap1a;
-    E::DelayLine<Memory, 5> dap1b;
-    E::DelayLine<Memory, 6> del1;
-    E::DelayLine<Memory, 7> dap2a;
-    E::DelayLine<Memory, 8> dap2b;
-    E::DelayLine<Memory, 9> del2;
-    E::Context c;
-
-    const float kap = diffusion_;
-    const float klp = lp_;
-    const float krt = reverb_time_;
-    const float amount = amount_;
-    const float gain = input_gain_;
-
-    float lp_1 = lp_decay_1_;
-    float lp_2 = lp_decay_2_;
-
-    while (size--) {
-      float wet;
-      float apout = 0.0f;
-      engine_.Start(&c);
+  // The buffer is sized at runtime from the sample rate. Both mirrored
+  // layouts let every block stage run over plain pointers, even across the
+  // end of a ring.
+  typedef FxEngine<kDynamicSize, format, ring> E;
+  static_assert(ring != RING_PLAIN, "CloudsReverb needs a mirrored ring");
+  typedef typename E::T T;
+
+  // Delay line lengths at kReferenceSampleRate, in CloudsNetwork order
+  static constexpr size_t kNumDelayLines = CloudsNetwork::kNumLines;
+  static constexpr const int32_t* kDelayLengths = CloudsNetwork::kLengths;
+
+  typedef CloudsNetwork::ScaledLayout<typename E::DynamicDelayLine> Layout;
+
+  static_assert(kBlockSize <= E::kMaxBlockSize, "Block size exceeds FxEngine limit");
+  static_assert(E::kCacheLineSize <= kDelayMemoryAlignment,
+                "Allocators do not align packed rings");
+
+  // Latency of the longest chain of decimation stages (see Init()).
+  static constexpr size_t kMaxLatency = half_band::Latency<half_band::Wide>() +
+      2 * half_band::Latency<half_band::Narrow>() + kMaxDecimation - 1;
+  // Host samples per chunk of the decimated path, enough for a full block of
+  // the network at the tank rate.
+  static constexpr size_t kMaxChunkSize = kBlockSize * kMaxDecimation;
+
+  static_assert(kBlockSize < CloudsNetwork::kMinFeedbackLatency,
+                "Block longer than the shortest tank feedback path");
+
+  typedef HalfBandDecimator<kMaxChunkSize, half_band::Wide> HostDecimator;
+  typedef HalfBandDecimator<kMaxChunkSize> TankDecimator;
+  typedef HalfBandInterpolator<kMaxChunkSize / 2, half_band::Wide> HostInterpolator;
+  typedef HalfBandInterpolator<kBlockSize> TankInterpolator;
+
+  // Leading part of a snapshot: the configuration it was taken in, and all
+  // of the state outside the delay memory. Compact snapshots have their own
+  // magic number, and their delay memory is laid out line by line.
+  static constexpr uint32_t kSnapshotMagic = 0x31534c43;  // "CLS1"
+  static constexpr uint32_t kCompactSnapshotMagic = 0x31434c43;  // "CLC1"
+
+  struct SnapshotHeader {
+    uint32_t magic;
+    uint32_t storage_format;
+    uint32_t ring_layout;
+    uint32_t buffer_size;
+    float sample_rate;
+    uint32_t decimation;
+
+    typename E::State engine;
+    float lp_decay[2];
+    float parameters[5];
+    float targets[5];
+    uint32_t ramp_pending;
+    uint32_t sleeping;
+    float tank_level;
+    uint64_t quiet_samples;
+
+    uint32_t phase;
+    float pending_wet[2][kMaxDecimation];
+    float dry[2][kMaxLatency];
+    typename HostDecimator::State host_decimator;
+    typename TankDecimator::State tank_decimator;
+    typename HostInterpolator::State host_interpolators[2];
+    typename TankInterpolator::State tank_interpolators[2];
+  };
+
+  // I/O layouts the kernels are instantiated for. Both read the input frame
+  // before writing the output frame at the same index, so the output may
+  // alias the input.
+
+  // Interleaved FloatFrame buffers
+  struct FrameIO {
+    FrameIO(const FloatFrame* in, FloatFrame* out) : in(in), out(out) { }
+
+    inline float l(size_t i) const { return in[i].l; }
+    inline float r(size_t i) const { return in[i].r; }
+    inline float stored_l(size_t i) const { return out[i].l; }
+    inline float stored_r(size_t i) const { return out[i].r; }
+    inline void Store(size_t i, float l, float r) const {
+      out[i].l = l;
+      out[i].r = r;
+    }
+    inline void Advance(size_t n) {
+      in += n;
+      out += n;
+    }
+
+    const FloatFrame* in;
+    FloatFrame* out;
+  };
+
+  // Separate channel buffers
+  struct PlanarIO {
+    PlanarIO(const float* in_l, const float* in_r, float* out_l, float* out_r)
+        : in_l(in_l), in_r(in_r), out_l(out_l), out_r(out_r) { }
+
+    inline float l(size_t i) const { return in_l[i]; }
+    inline float r(size_t i) const { return in_r[i]; }
+    inline float stored_l(size_t i) const { return out_l[i]; }
+    inline float stored_r(size_t i) const { return out_r[i]; }
+    inline void Store(size_t i, float l, float r) const {
+      out_l[i] = l;
+      out_r[i] = r;
+    }
+    inline void Advance(size_t n) {
+      in_l += n;
+      in_r += n;
+      out_l += n;
+      out_r += n;
+    }
+
+    const float* in_l;
+    const float* in_r;
+    float* out_l;
+    float* out_r;
+  };
+
+  // Parameter sources the kernels are instantiated for. Each exposes the
+  // coefficients of the network for the next Next(n) samples, either as one
+  // value (ConstantParameters) or as one value per sample
+  // (ModulatedParameters), read with CoefficientAt().
+
+  // Parameters that stay put for the whole call (the common case)
+  struct ConstantParameters {
+    explicit ConstantParameters(const BasicCloudsReverb& r)
+        : kap(r.diffusion_),
+          minus_kap(-r.diffusion_),
+          klp(r.lp_),
+          krt(r.reverb_time_),
+          amount(r.amount_),
+          gain(r.input_gain_) { }
+
+    inline void Next(size_t) { }
+
+    float kap;
+    float minus_kap;
+    float klp;
+    float krt;
+    float amount;
+    float gain;
+  };
+
+  // Parameters ramping towards their targets and/or modulated per sample
+  class ModulatedParameters {
+   public:
+    ModulatedParameters(const BasicCloudsReverb& r, const Modulation* modulation, size_t size)
+        : modulation_(modulation ? *modulation : Modulation()) {
+      const float step = 1.0f / static_cast<float>(size);
+      diffusion_.Init(r.diffusion_, r.diffusion_target_, step);
+      lp_.Init(r.lp_, r.lp_target_, step);
+      reverb_time_.Init(r.reverb_time_, r.reverb_time_target_, step);
+      amount_.Init(r.amount_, r.amount_target_, step);
+      input_gain_.Init(r.input_gain_, r.input_gain_target_, step);
+    }
+
+    inline void Next(size_t n) {
+      diffusion_.Render(&modulation_.diffusion, kap, n);
+      lp_.Render(&modulation_.lp, klp, n);
+      reverb_time_.Render(&modulation_.time, krt, n);
+      amount_.Render(&modulation_.amount, amount, n);
+      input_gain_.Render(&modulation_.input_gain, gain, n);
+      for (size_t i = 0; i < n; ++i) {
+        minus_kap[i] = -kap[i];
+      }
+    }
+
+    float kap[kMaxChunkSize];
+    float minus_kap[kMaxChunkSize];
+    float klp[kMaxChunkSize];
+    float krt[kMaxChunkSize];
+    float amount[kMaxChunkSize];
+    float gain[kMaxChunkSize];
+
+   private:
+    // Linear ramp, reaching the target on the last sample of the call.
+    struct Ramp {
+      inline void Init(float start, float target, float step) {
+        value = start;
+        increment = (target - start) * step;
+      }
+
+      inline void Render(const float** modulation, float* out, size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+          out[i] = value + increment * static_cast<float>(i + 1);
+        }
+        value += increment * static_cast<float>(n);
+        if (*modulation) {
+          for (size_t i = 0; i < n; ++i) {
+            out[i] = std::clamp(out[i] + (*modulation)[i], 0.0f, 1.0f);
+          }
+          *modulation += n;
+        }
+      }
+
+      float value;
+      float increment;
+    };
+
+    Modulation modulation_;
+    Ramp diffusion_;
+    Ramp lp_;
+    Ramp reverb_time_;
+    Ramp amount_;
+    Ramp input_gain_;
+
+    DISALLOW_COPY_AND_ASSIGN(ModulatedParameters);
+  };
+
+  template<typename IO>
+  void ProcessInternal(IO io, size_t size, const Modulation* modulation) {
+    if (!size) {
+      return;
+    }
+#ifdef CLOUDS_ENABLE_STATS
+    ReverbStats::Timer timer(stats_.get(), size, sample_rate_);
+#endif
+    ScopedNoDenormals no_denormals;
+
+    // Peak of the signal fed to the tank, bounded over any gain ramp or
+    // modulation. Input that is not finite wakes the reverb too, so that the
+    // fault check below sees it.
+    float input_level = 0.0f;
+    if (sleep_enabled_) {
+      float gain = modulation && modulation->input_gain
+          ? 1.0f : std::max(input_gain_, input_gain_target_);
+      input_level = InputPeak(io, size) * gain;
+      if (sleeping_ && !(input_level < kSleepThreshold)) {
+        sleeping_ = false;
+      }
+    }
+
+    float wet_level;
+    if (modulation || ramp_pending_) {
+      ModulatedParameters parameters(*this, modulation, size);
+      wet_level = ProcessInternal(io, &parameters, size);
+      // Land exactly on the targets, whatever the rounding of the ramps.
+      amount_ = amount_target_;
+      input_gain_ = input_gain_target_;
+      reverb_time_ = reverb_time_target_;
+      diffusion_ = diffusion_target_;
+      lp_ = lp_target_;
+      ramp_pending_ = false;
+    } else {
+      ConstantParameters parameters(*this);
+      wet_level = ProcessInternal(io, &parameters, size);
+    }
+
+    // NaN compares false, and its bit pattern tracks above infinity.
+    if (!(wet_level < kFaultLevel) ||
+        Faulty(lp_decay_1_) || Faulty(lp_decay_2_)) {
+      Recover();
+      MuteFaults(io, size);
+      input_level = kFaultLevel;
+      wet_level = 0.0f;
+    }
+
+    if (sleep_enabled_ && !sleeping_) {
+      UpdateTail(input_level, wet_level, size);
+    }
+  }
+
+  static inline bool Faulty(float x) {
+    return !(std::abs(x) < kFaultLevel);
+  }
+
+  // Silences the delay lines, filters and dry samples holding values that
+  // are not finite or reach kFaultLevel, and counts the fault.
+  void Recover() {
+    for (const auto& line : lines_) {
+      engine_.Sanitize(line, kFaultLevel);
+    }
+    for (float* lp : { &lp_decay_1_, &lp_decay_2_ }) {
+      if (Faulty(*lp)) {
+        *lp = 0.0f;
+      }
+    }
+    if (num_stages_) {
+      ResetResampling();
+      for (float& x : dry_[0]) {
+        x = Faulty(x) ? 0.0f : x;
+      }
+      for (float& x : dry_[1]) {
+        x = Faulty(x) ? 0.0f : x;
+      }
+    }
+    ++num_faults_;
+    CountEvent(ReverbStats::EVENT_FAULT);
+  }
+
+  void CountEvent(ReverbStats::Event event) {
+#ifdef CLOUDS_ENABLE_STATS
+    if (stats_) {
+      stats_->Count(event);
+    }
+#else
+    static_cast<void>(event);
+#endif
+  }
+
+  // Zeroes the output samples of the call that are not finite or reach
+  // kFaultLevel.
+  template<typename IO>
+  static void MuteFaults(IO io, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+      const float l = io.stored_l(i);
+      const float r = io.stored_r(i);
+      io.Store(i, Faulty(l) ? 0.0f : l, Faulty(r) ? 0.0f : r);
+    }
+  }
+
+  // Returns the peak level of the wet signal.
+  template<typename IO, typename P>
+  float ProcessInternal(IO io, P* parameters, size_t size) {
+    if (sleeping_) {
+      ProcessDry(io, parameters, size);
+      return 0.0f;
+    } else if (num_stages_) {
+      return ProcessDecimated(io, parameters, size);
+    } else if (processing_mode_ == PROCESSING_MODE_BLOCK) {
+      return ProcessBlocks(io, parameters, size);
+    } else {
+      return ProcessSamples(io, parameters, size);
+    }
+  }
+
+  // Peak levels are tracked on the bit patterns of |x|, which order like the
+  // values themselves, so that the max reductions vectorize.
+  static inline uint32_t LevelBits(float x) {
+    uint32_t bits;
+    std::memcpy(&bits, &x, sizeof(bits));
+    return bits & 0x7fffffff;
+  }
+
+  static inline float Level(uint32_t bits) {
+    float x;
+    std::memcpy(&x, &bits, sizeof(x));
+    return x;
+  }
+
+  template<typename IO>
+  static float InputPeak(IO io, size_t size) {
+    uint32_t peak = 0;
+    for (size_t i = 0; i < size; ++i) {
+      peak = std::max(peak, LevelBits(io.l(i) + io.r(i)));
+    }
+    return Level(peak);
+  }
+
+  // Output of the network with an empty tank: the dry part of the mix.
+  template<typename IO, typename P>
+  void ProcessDry(IO io, P* parameters, size_t size) {
+    while (size) {
+      size_t n = std::min(size, kBlockSize);
+      parameters->Next(n);
+      if (latency_) {
+        for (size_t i = 0; i < n; ++i) {
+          dry_[0][latency_ + i] = io.l(i);
+          dry_[1][latency_ + i] = io.r(i);
+        }
+        for (size_t i = 0; i < n; ++i) {
+          const float dry_l = dry_[0][i];
+          const float dry_r = dry_[1][i];
+          const float a = CoefficientAt(parameters->amount, i);
+          io.Store(i, dry_l - dry_l * a, dry_r - dry_r * a);
+        }
+        AdvanceDryDelay(n);
+      } else {
+        for (size_t i = 0; i < n; ++i) {
+          const float in_l = io.l(i);
+          const float in_r = io.r(i);
+          const float a = CoefficientAt(parameters->amount, i);
+          io.Store(i, in_l - in_l * a, in_r - in_r * a);
+        }
+      }
+      io.Advance(n);
+      size -= n;
+    }
+  }
+
+  // The dry signal is delayed by latency_ samples in a linear buffer: the
+  // input of a chunk of n samples goes to dry_[c][latency_ + i], and the
+  // delayed signal is dry_[c][i]. Then the last latency_ samples are moved
+  // to the front for the next chunk.
+  void AdvanceDryDelay(size_t n) {
+    std::copy(&dry_[0][n], &dry_[0][n + latency_], &dry_[0][0]);
+    std::copy(&dry_[1][n], &dry_[1][n + latency_], &dry_[1][0]);
+  }
+
+  void ClearDryDelay() {
+    std::fill(&dry_[0][0], &dry_[0][kMaxLatency], 0.0f);
+    std::fill(&dry_[1][0], &dry_[1][kMaxLatency], 0.0f);
+  }
+
+  // Empties the half-band filters, and restarts the grouping of host samples
+  // into tank-rate samples.
+  void ResetResampling() {
+    host_decimator_.Init();
+    tank_decimator_.Init();
+    for (size_t c = 0; c < 2; ++c) {
+      host_interpolators_[c].Init();
+      tank_interpolators_[c].Init();
+    }
+    std::fill(&pending_wet_[0][0], &pending_wet_[0][0] + 2 * kMaxDecimation, 0.0f);
+    phase_ = 0;
+  }
+
+  // Writes a snapshot header for the current state to `out` (not aligned).
+  void SaveHeader(uint32_t magic, uint8_t* out) const {
+    SnapshotHeader h;
+    std::memset(&h, 0, sizeof(h));
+    h.magic = magic;
+    h.storage_format = format;
+    h.ring_layout = ring;
+    h.buffer_size = static_cast<uint32_t>(buffer_size_);
+    h.sample_rate = sample_rate_;
+    h.decimation = static_cast<uint32_t>(decimation_);
+
+    engine_.SaveState(&h.engine);
+    h.lp_decay[0] = lp_decay_1_;
+    h.lp_decay[1] = lp_decay_2_;
+    const float parameters[] = {
+      amount_, input_gain_, reverb_time_, diffusion_, lp_
+    };
+    const float targets[] = {
+      amount_target_, input_gain_target_, reverb_time_target_,
+      diffusion_target_, lp_target_
+    };
+    std::copy(parameters, parameters + 5, h.parameters);
+    std::copy(targets, targets + 5, h.targets);
+    h.ramp_pending = ramp_pending_ ? 1 : 0;
+    h.sleeping = sleeping_ ? 1 : 0;
+    h.tank_level = tank_level_;
+    h.quiet_samples = quiet_samples_;
+
+    h.phase = static_cast<uint32_t>(phase_);
+    std::copy(&pending_wet_[0][0], &pending_wet_[0][0] + 2 * kMaxDecimation,
+              &h.pending_wet[0][0]);
+    for (size_t c = 0; c < 2; ++c) {
+      std::copy(&dry_[c][0], &dry_[c][kMaxLatency], &h.dry[c][0]);
+      host_interpolators_[c].Save(&h.host_interpolators[c]);
+      tank_interpolators_[c].Save(&h.tank_interpolators[c]);
+    }
+    host_decimator_.Save(&h.host_decimator);
+    tank_decimator_.Save(&h.tank_decimator);
+    std::memcpy(out, &h, sizeof(h));
+  }
+
+  // Restores the state in a snapshot header, or returns false if it was
+  // written in another configuration.
+  bool RestoreHeader(uint32_t magic, const uint8_t* in) {
+    SnapshotHeader h;
+    std::memcpy(&h, in, sizeof(h));
+    if (h.magic != magic || h.storage_format != format || h.ring_layout != ring ||
+        h.buffer_size != buffer_size_ || h.sample_rate != sample_rate_ ||
+        h.decimation != decimation_) {
+      return false;
+    }
+
+    engine_.RestoreState(h.engine);
+    lp_decay_1_ = h.lp_decay[0];
+    lp_decay_2_ = h.lp_decay[1];
+    amount_ = h.parameters[0];
+    input_gain_ = h.parameters[1];
+    reverb_time_ = h.parameters[2];
+    diffusion_ = h.parameters[3];
+    lp_ = h.parameters[4];
+    amount_target_ = h.targets[0];
+    input_gain_target_ = h.targets[1];
+    reverb_time_target_ = h.targets[2];
+    diffusion_target_ = h.targets[3];
+    lp_target_ = h.targets[4];
+    ramp_pending_ = h.ramp_pending != 0;
+    sleeping_ = sleep_enabled_ && h.sleeping != 0;
+    tank_level_ = h.tank_level;
+    quiet_samples_ = static_cast<size_t>(h.quiet_samples);
+
+    phase_ = h.phase;
+    std::copy(&h.pending_wet[0][0], &h.pending_wet[0][0] + 2 * kMaxDecimation,
+              &pending_wet_[0][0]);
+    for (size_t c = 0; c < 2; ++c) {
+      std::copy(&h.dry[c][0], &h.dry[c][kMaxLatency], &dry_[c][0]);
+      host_interpolators_[c].Restore(h.host_interpolators[c]);
+      tank_interpolators_[c].Restore(h.tank_interpolators[c]);
+    }
+    host_decimator_.Restore(h.host_decimator);
+    tank_decimator_.Restore(h.tank_decimator);
+    return true;
+  }
+
+  // Decays the tank level estimate over `size` samples, raises it to what
+  // went in or came out, and goes to sleep once it and the output have been
+  // quiet for long enough.
+  void UpdateTail(float input_level, float wet_level, size_t size) {
+    const float level = std::max(input_level, wet_level);
+    tank_level_ = std::max(tank_level_ * Decay(size), level);
+    if (level >= kSleepThreshold) {
+      quiet_samples_ = 0;
+    } else {
+      quiet_samples_ += size;
+    }
+    const float settle_length = diffuser_length_ + 2.0f * branch_length_ +
+        static_cast<float>(latency_);
+    if (tank_level_ < kSleepThreshold &&
+        static_cast<float>(quiet_samples_) >= settle_length) {
+      // Drop what is left (all below the threshold) so that waking up
+      // starts from an empty tank.
+      engine_.Invalidate();
+      lp_decay_1_ = 0.0f;
+      lp_decay_2_ = 0.0f;
+      ResetResampling();
+      ResetTail();
+      CountEvent(ReverbStats::EVENT_SLEEP);
+    }
+  }
+
+  void ResetTail() {
+    sleeping_ = sleep_enabled_;
+    tank_level_ = 0.0f;
+    quiet_samples_ = 0;
+  }
+
+  // Gain of the tank over `size` samples at the current Time.
+  float Decay(size_t size) const {
+    return std::exp(static_cast<float>(size) / branch_length_ *
+                    std::log(reverb_time_));
+  }
+
+  // Seconds for a tank level of `level` to decay below kSleepThreshold.
+  float DecayTime(float level) const {
+    if (level < kSleepThreshold) {
+      return 0.0f;
+    } else if (reverb_time_ >= 1.0f) {
+      return std::numeric_limits<float>::infinity();
+    }
+    float passes = reverb_time_ > 0.0f
+        ? std::log(kSleepThreshold / level) / std::log(reverb_time_) : 1.0f;
+    return (diffuser_length_ + std::max(passes, 1.0f) * branch_length_ +
+            static_cast<float>(latency_)) / sample_rate_;
+  }
+
+  float tank_sample_rate() const {
+    return sample_rate_ / static_cast<float>(decimation_);
+  }
+
+  static size_t Decimation(size_t decimation) {
+    return decimation >= 4 ? 4 : decimation >= 2 ? 2 : 1;
+  }
+
+  // Scales the delay lines to the tank rate into `lengths`, lays them out in
+  // `lines`, and returns the buffer size for them. Modulated reads are
+  // scaled by the same factor when the kernels run (see layout()).
+  static size_t LayOut(float sample_rate, size_t decimation,
+                       int32_t* lengths, typename E::DynamicDelayLine* lines) {
+    const float scale = sample_rate / static_cast<float>(
+        Decimation(decimation)) / kReferenceSampleRate;
+    for (size_t i = 0; i < kNumDelayLines; ++i) {
+      lengths[i] = std::max(
+          static_cast<int32_t>(std::lround(kDelayLengths[i] * scale)), int32_t(1));
+    }
+    const size_t used = static_cast<size_t>(
+        E::Allocate(lengths, kNumDelayLines, lines));
+    size_t buffer_size = used;
+    if constexpr (ring != RING_PACKED) {
+      buffer_size = 1;
+      while (buffer_size < std::max(used, 2 * E::kGuardSize)) {
+        buffer_size <<= 1;
+      }
+    }
+    return buffer_size;
+  }
+
+  // Lines laid out by Init(), with modulated reads scaled to the tank rate
+  Layout layout() const {
+    return Layout{ lines_, tank_sample_rate() / kReferenceSampleRate };
+  }
+
+  template<typename IO, typename P>
+  float ProcessSamples(IO io, P* parameters, size_t size) {
+    const Layout layout = this->layout();
+    typename E::Context c;
+
+    float lp[CloudsNetwork::kNumLowPass] = { lp_decay_1_, lp_decay_2_ };
+    uint32_t wet_peak = 0;
+
+    while (size) {
+      size_t n = std::min(size, kBlockSize);
+      parameters->Next(n);
+      for (size_t i = 0; i < n; ++i) {
+        const auto k = network::MakeCoefficients(
+            CoefficientAt(parameters->gain, i),
+            CoefficientAt(parameters->kap, i),
+            CoefficientAt(parameters->minus_kap, i),
+            CoefficientAt(parameters->krt, i),
+            CoefficientAt(parameters->klp, i));
+        const float amount = CoefficientAt(parameters->amount, i);
+
+        float wet[CloudsNetwork::kNumOutputs];
+        const float in_l = io.l(i);
+        const float in_r = io.r(i);
+        engine_.Start(&c);
+        CloudsNetwork::Process(&c, layout, k, in_l + in_r, lp, wet);
+
+        const float out_l = in_l + (wet[0] - in_l) * amount;
+        const float out_r = in_r + (wet[1] - in_r) * amount;
+        wet_peak = std::max({wet_peak, LevelBits(wet[0]), LevelBits(wet[1])});
+        io.Store(i, out_l, out_r);
+      }
+      io.Advance(n);
+      size -= n;
+    }
+
+    lp_decay_1_ = lp[0];
+    lp_decay_2_ = lp[1];
+    return Level(wet_peak);
+  }
+
+  // Same network as ProcessSamples(), one stage at a time over sub-blocks.
+  template<typename IO, typename P>
+  float ProcessBlocks(IO io, P* parameters, size_t size) {
+    const Layout layout = this->layout();
+    typename E::BlockContext c;
+
+    const auto k = network::MakeCoefficients(
+        +parameters->gain, +parameters->kap, +parameters->minus_kap,
+        +parameters->krt, +parameters->klp);
+    const auto& amount = parameters->amount;
+    const auto& gain = parameters->gain;
+
+    float lp[CloudsNetwork::kNumLowPass] = { lp_decay_1_, lp_decay_2_ };
+    float apout[kBlockSize];
+    float wet_l[kBlockSize];
+    float wet_r[kBlockSize];
+    float* const wet[CloudsNetwork::kNumOutputs] = { wet_l, wet_r };
+    uint32_t wet_peak = 0;
+
+    while (size) {
+      size_t n = std::min(size, max_block_size_);
+      engine_.StartBlock(&c, n);
+      parameters->Next(n);
 
       // Sum stereo input and apply input gain
-      c.Read(in_out->l + in_out->r, gain);
-
-      // 4 input allpass diffusers
-      c.Read(ap1 TAIL, kap);
-      c.WriteAllPass(ap1, -kap);
-      c.Read(ap2 TAIL, kap);
-      c.WriteAllPass(ap2, -kap);
-      c.Read(ap3 TAIL, kap);
-      c.WriteAllPass(ap3, -kap);
-      c.Read(ap4 TAIL, kap);
-      c.WriteAllPass(ap4, -kap);
-      c.Write(apout);
-
-      // Left channel: read from del2, through AP pair, to del1
-      c.Load(apout);
-      // Use safer delay offsets that stay within buffer bounds
-      c.Interpolate(del2, 6200.0f, LFO_2, 40.0f, krt);
-      c.Lp(lp_1, klp);
-      c.Read(dap1a TAIL, -kap);
-      c.WriteAllPass(dap1a, kap);
-      c.Read(dap1b TAIL, kap);
-      c.WriteAllPass(dap1b, -kap);
-      c.Write(del1, 1.0f);
-      c.Write(wet, 0.0f);
-
-      in_out->l += (wet - in_out->l) * amount;
-
-      // Right channel: read from del1, through AP pair, to del2
-      c.Load(apout);
-      c.Interpolate(del1, 4400.0f, LFO_1, 30.0f, krt);
-      c.Lp(lp_2, klp);
-      c.Read(dap2a TAIL, kap);
-      c.WriteAllPass(dap2a, -kap);
-      c.Read(dap2b TAIL, -kap);
-      c.WriteAllPass(dap2b, kap);
-      c.Write(del2, 1.0f);
-      c.Write(wet, 0.0f);
-
-      in_out->r += (wet - in_out->r) * amount;
-
-      ++in_out;
-    }
-
-    lp_decay_1_ = lp_1;
-    lp_decay_2_ = lp_2;
-  }
-
-  // Use 32-bit float format for desktop platforms
-  typedef FxEngine<kBufferSize, FORMAT_32_BIT> E;
+      for (size_t i = 0; i < n; ++i) {
+        apout[i] = (io.l(i) + io.r(i)) * CoefficientAt(gain, i);
+      }
+      CloudsNetwork::ProcessBlock(&c, layout, k, apout, lp, wet);
+
+      for (size_t i = 0; i < n; ++i) {
+        const float in_l = io.l(i);
+        const float in_r = io.r(i);
+        const float a = CoefficientAt(amount, i);
+        io.Store(i, in_l + (wet_l[i] - in_l) * a, in_r + (wet_r[i] - in_r) * a);
+        wet_peak = std::max({wet_peak, LevelBits(wet_l[i]), LevelBits(wet_r[i])});
+      }
+
+      io.Advance(n);
+      size -= n;
+    }
+
+    lp_decay_1_ = lp[0];
+    lp_decay_2_ = lp[1];
+    return Level(wet_peak);
+  }
+
+  // Network coefficients for the tank-rate samples of a chunk of host
+  // samples, which complete at host samples first, first + stride...: the
+  // value itself, or the per-sample values at those samples.
+  static inline float Subsample(float value, size_t, size_t, size_t, float*) {
+    return value;
+  }
+
+  static inline const float* Subsample(
+      const float* values, size_t first, size_t stride, size_t size, float* out) {
+    for (size_t j = 0; j < size; ++j) {
+      out[j] = values[first + j * stride];
+    }
+    return out;
+  }
+
+  // The network of ProcessSamples() or ProcessBlocks() at 1 / decimation_ of
+  // the host rate. The summed input is decimated, the wet outputs are
+  // interpolated back and the dry signal is delayed to match. Host samples
+  // are taken in groups of decimation_, each giving one tank-rate sample once
+  // complete, so interpolated output lags by up to decimation_ - 1 samples;
+  // they are kept in pending_wet_ across calls.
+  template<typename IO, typename P>
+  float ProcessDecimated(IO io, P* parameters, size_t size) {
+    const Layout layout = this->layout();
+    const size_t decimation = decimation_;
+    // As many host samples per chunk as the tank-rate samples they complete
+    // fit in one block of the network.
+    const size_t chunk_size = max_block_size_ * decimation - (decimation - 1);
+
+    float lp[CloudsNetwork::kNumLowPass] = { lp_decay_1_, lp_decay_2_ };
+    float tank_in[kMaxChunkSize];
+    float tank_l[kBlockSize];
+    float tank_r[kBlockSize];
+    float* const tank_wet[CloudsNetwork::kNumOutputs] = { tank_l, tank_r };
+    float wet_l[kMaxChunkSize + kMaxDecimation];
+    float wet_r[kMaxChunkSize + kMaxDecimation];
+    float k_buffer[5][kBlockSize];
+    uint32_t wet_peak = 0;
+
+    while (size) {
+      const size_t n = std::min(size, chunk_size);
+      parameters->Next(n);
+
+      // Down to the tank rate.
+      for (size_t i = 0; i < n; ++i) {
+        const float in_l = io.l(i);
+        const float in_r = io.r(i);
+        dry_[0][latency_ + i] = in_l;
+        dry_[1][latency_ + i] = in_r;
+        tank_in[i] = (in_l + in_r) * CoefficientAt(parameters->gain, i);
+      }
+      size_t m = n;
+      if (num_stages_ == 2) {
+        m = host_decimator_.Process(tank_in, m, tank_in);
+      }
+      m = tank_decimator_.Process(tank_in, m, tank_in);
+      // The first tank-rate sample completes at host sample `lag`, and as
+      // many interpolated samples are pending from the last chunk.
+      const size_t lag = decimation - 1 - phase_;
+      phase_ = (phase_ + n) & (decimation - 1);
+
+      if (m) {
+        const auto k = network::MakeCoefficients(
+            Subsample(+parameters->gain, lag, decimation, m, k_buffer[0]),
+            Subsample(+parameters->kap, lag, decimation, m, k_buffer[1]),
+            Subsample(+parameters->minus_kap, lag, decimation, m, k_buffer[2]),
+            Subsample(+parameters->krt, lag, decimation, m, k_buffer[3]),
+            Subsample(+parameters->klp, lag, decimation, m, k_buffer[4]));
+        if (processing_mode_ == PROCESSING_MODE_BLOCK) {
+          typename E::BlockContext c;
+          engine_.StartBlock(&c, m);
+          CloudsNetwork::ProcessBlock(&c, layout, k, tank_in, lp, tank_wet);
+        } else {
+          typename E::Context c;
+          for (size_t j = 0; j < m; ++j) {
+            // The input gain was applied before decimation.
+            const auto k_j = network::MakeCoefficients(
+                1.0f, CoefficientAt(k.kap, j), CoefficientAt(k.minus_kap, j),
+                CoefficientAt(k.krt, j), CoefficientAt(k.klp, j));
+            float wet[CloudsNetwork::kNumOutputs];
+            engine_.Start(&c);
+            CloudsNetwork::Process(&c, layout, k_j, tank_in[j], lp, wet);
+            tank_l[j] = wet[0];
+            tank_r[j] = wet[1];
+          }
+        }
+      }
+
+      // Back to the host rate, after what was pending from the last chunk.
+      std::copy(&pending_wet_[0][0], &pending_wet_[0][lag], wet_l);
+      std::copy(&pending_wet_[1][0], &pending_wet_[1][lag], wet_r);
+      Interpolate(0, tank_l, m, wet_l + lag);
+      Interpolate(1, tank_r, m, wet_r + lag);
+      const size_t next_pending = decimation - 1 - phase_;
+      std::copy(wet_l + n, wet_l + n + next_pending, &pending_wet_[0][0]);
+      std::copy(wet_r + n, wet_r + n + next_pending, &pending_wet_[1][0]);
+
+      for (size_t i = 0; i < n; ++i) {
+        const float dry_l = dry_[0][i];
+        const float dry_r = dry_[1][i];
+        const float a = CoefficientAt(parameters->amount, i);
+        io.Store(i, dry_l + (wet_l[i] - dry_l) * a, dry_r + (wet_r[i] - dry_r) * a);
+        wet_peak = std::max({wet_peak, LevelBits(wet_l[i]), LevelBits(wet_r[i])});
+      }
+      AdvanceDryDelay(n);
+
+      io.Advance(n);
+      size -= n;
+    }
+
+    lp_decay_1_ = lp[0];
+    lp_decay_2_ = lp[1];
+    return Level(wet_peak);
+  }
+
+  // Interpolates `size` tank-rate samples of `channel` to the host rate.
+  void Interpolate(size_t channel, const float* in, size_t size, float* out) {
+    if (num_stages_ == 1) {
+      tank_interpolators_[channel].Process(in, size, out);
+    } else {
+      float half_rate[kMaxChunkSize / 2];
+      tank_interpolators_[channel].Process(in, size, half_rate);
+      host_interpolators_[channel].Process(half_rate, 2 * size, out);
+    }
+  }
+
   E engine_;
-  float buffer_[kBufferSize];
 
   float sample_rate_;
   float amount_;
@@ -242,9 +1406,70 @@ class CloudsReverb {
   float lp_decay_1_;
   float lp_decay_2_;
 
-  DISALLOW_COPY_AND_ASSIGN(CloudsReverb);
+  // Values reached at the end of the next Process() call (see
+  // RampParameters()). Equal to the current values when not ramping.
+  float amount_target_;
+  float input_gain_target_;
+  float reverb_time_target_;
+  float diffusion_target_;
+  float lp_target_;
+  bool ramp_pending_;
+
+  // Sleep state (see SetSleepEnabled()). tank_level_ is an upper estimate of
+  // the level in the tank; quiet_samples_ counts samples since input or
+  // output last reached kSleepThreshold.
+  bool sleep_enabled_;
+  bool sleeping_;
+  float tank_level_;
+  size_t quiet_samples_;
+  uint32_t num_faults_;
+  float diffuser_length_;
+  float branch_length_;
+
+  // Returns the delay memory to its allocator.
+  struct FreeMemory {
+    DelayMemoryAllocator* allocator;
+    size_t size;
+
+    void operator()(T* buffer) const {
+      allocator->Free(buffer, size);
+    }
+  };
+  typedef std::unique_ptr<T[], FreeMemory> Memory;
+
+  DelayMemoryAllocator* allocator_;
+  Memory buffer_;
+  size_t buffer_size_;
+  typename E::DynamicDelayLine lines_[kNumDelayLines];
+  size_t max_block_size_;
+
+  // Reduced-rate tank (see Init()). The tank stages of the decimator and of
+  // the interpolators run between the tank rate and twice that; the host
+  // stages, used at a quarter rate, between half the host rate and the host
+  // rate. phase_ counts the host samples of the current group; pending_wet_
+  // holds the interpolated output not yet due.
+  size_t decimation_;
+  size_t num_stages_;
+  size_t latency_;
+  size_t phase_;
+  HostDecimator host_decimator_;
+  TankDecimator tank_decimator_;
+  HostInterpolator host_interpolators_[2];
+  TankInterpolator tank_interpolators_[2];
+  float pending_wet_[2][kMaxDecimation];
+  float dry_[2][kMaxLatency + kMaxChunkSize];
+
+  ProcessingMode processing_mode_;
+
+#ifdef CLOUDS_ENABLE_STATS
+  std::unique_ptr<ReverbStats> stats_;
+#endif
+
+  DISALLOW_COPY_AND_ASSIGN(BasicCloudsReverb);
 };
 
+typedef BasicCloudsReverb<> CloudsReverb;
+
 }  // namespace clouds
 
 #endif  // CLOUDS_CLOUDS_REVERB_H_
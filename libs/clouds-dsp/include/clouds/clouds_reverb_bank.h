@@ -0,0 +1,266 @@
+// CloudsReverbBank - N independent Clouds reverbs processed side by side
+//
+// Runs the CloudsReverb network on N stereo streams at once, one stream per
+// vector lane of FxEngineBank. Every lane has its own parameters, filter
+// state and delay memory, and produces the same output as a CloudsReverb in
+// PROCESSING_MODE_SAMPLE fed with the same stream, so a bank can stand in for
+// N separate instances that share a sample rate. Like CloudsReverb, Init()
+// scales the delay lines to the sample rate, up to kMaxSampleRate; above it,
+// the lines stop growing and the room gets shorter.
+//
+// The bank owns kBufferSize * N floats of delay memory, enough for
+// kMaxSampleRate (4 MB for N = 16), so it should be allocated on the heap.
+
+#ifndef CLOUDS_CLOUDS_REVERB_BANK_H_
+#define CLOUDS_CLOUDS_REVERB_BANK_H_
+
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+
+#include "clouds/clouds_reverb.h"
+#include "clouds/denormals.h"
+#include "clouds/frame.h"
+#include "clouds/fx_engine_bank.h"
+#include "stmlib/stmlib.h"
+
+namespace clouds {
+
+template<size_t N>
+class CloudsReverbBank {
+ public:
+  static constexpr size_t kNumLanes = N;
+
+  // Highest sample rate the delay memory is sized for. A CloudsReverb at a
+  // higher rate would decimate its tank (see RecommendedDecimation()), which
+  // the bank does not.
+  static constexpr float kMaxSampleRate = 96000.0f;
+
+  // Delay memory per lane: the lines of CloudsNetwork scaled to
+  // kMaxSampleRate, rounded up to a power of 2.
+  static constexpr size_t kBufferSize = [] {
+    constexpr float kMaxScale = kMaxSampleRate / CloudsReverb::kReferenceSampleRate;
+    size_t memory = 0;
+    for (int32_t length : CloudsNetwork::kLengths) {
+      // Rounded up, plus the sample between lines
+      memory += static_cast<size_t>(static_cast<float>(length) * kMaxScale) + 2;
+    }
+    size_t size = 1;
+    while (size < memory) {
+      size <<= 1;
+    }
+    return size;
+  }();
+
+  // Samples transposed in and out of lane order at a time.
+  static constexpr size_t kBlockSize = 64;
+
+  CloudsReverbBank() : sample_rate_(48000.0f) {
+    std::memset(buffer_, 0, sizeof(buffer_));
+    LayOut(sample_rate_);
+    for (size_t k = 0; k < N; ++k) {
+      ResetLane(k);
+    }
+  }
+
+  ~CloudsReverbBank() = default;
+
+  // Initialize every lane with the given sample rate and default parameters
+  void Init(float sample_rate = 48000.0f) {
+    sample_rate_ = sample_rate;
+    LayOut(sample_rate_);
+    engine_.Init(buffer_);
+    engine_.SetLFOFrequency(LFO_1, 0.5f / sample_rate_);
+    engine_.SetLFOFrequency(LFO_2, 0.3f / sample_rate_);
+    for (size_t k = 0; k < N; ++k) {
+      ResetLane(k);
+    }
+  }
+
+  // Clear the delay buffers of every lane
+  void Clear() {
+    engine_.Clear();
+    std::fill(lp_decay_1_, lp_decay_1_ + N, 0.0f);
+    std::fill(lp_decay_2_, lp_decay_2_ + N, 0.0f);
+  }
+
+  // Clear the delay buffers of one lane, e.g. when it is reassigned to a new
+  // stream. The other lanes are unaffected.
+  void Clear(size_t lane) {
+    engine_.Clear(lane);
+    lp_decay_1_[lane] = 0.0f;
+    lp_decay_2_[lane] = 0.0f;
+  }
+
+  // Process N stereo streams in-place. in_out[k] is the buffer of lane k;
+  // every buffer holds `size` frames.
+  void Process(FloatFrame* const* in_out, size_t size) {
+    size_t done = 0;
+    while (done < size) {
+      size_t n = std::min(size - done, kBlockSize);
+      for (size_t i = 0; i < n; ++i) {
+        for (size_t k = 0; k < N; ++k) {
+          left_[i][k] = in_out[k][done + i].l;
+          right_[i][k] = in_out[k][done + i].r;
+        }
+      }
+      ProcessInternal(n);
+      for (size_t i = 0; i < n; ++i) {
+        for (size_t k = 0; k < N; ++k) {
+          in_out[k][done + i].l = left_[i][k];
+          in_out[k][done + i].r = right_[i][k];
+        }
+      }
+      done += n;
+    }
+  }
+
+  // Process N streams held as separate left/right channel buffers in-place.
+  void Process(float* const* left, float* const* right, size_t size) {
+    size_t done = 0;
+    while (done < size) {
+      size_t n = std::min(size - done, kBlockSize);
+      for (size_t i = 0; i < n; ++i) {
+        for (size_t k = 0; k < N; ++k) {
+          left_[i][k] = left[k][done + i];
+          right_[i][k] = right[k][done + i];
+        }
+      }
+      ProcessInternal(n);
+      for (size_t i = 0; i < n; ++i) {
+        for (size_t k = 0; k < N; ++k) {
+          left[k][done + i] = left_[i][k];
+          right[k][done + i] = right_[i][k];
+        }
+      }
+      done += n;
+    }
+  }
+
+  // Per-lane parameter setters with range clamping [0.0, 1.0]. See
+  // CloudsReverb for their meaning.
+
+  void SetAmount(size_t lane, float amount) {
+    amount_[lane] = std::clamp(amount, 0.0f, 1.0f);
+  }
+
+  void SetInputGain(size_t lane, float input_gain) {
+    input_gain_[lane] = std::clamp(input_gain, 0.0f, 1.0f);
+  }
+
+  void SetTime(size_t lane, float time) {
+    reverb_time_[lane] = std::clamp(time, 0.0f, 1.0f);
+  }
+
+  void SetDiffusion(size_t lane, float diffusion) {
+    diffusion_[lane] = std::clamp(diffusion, 0.0f, 1.0f);
+  }
+
+  void SetLowpassCutoff(size_t lane, float lp) {
+    lp_[lane] = std::clamp(lp, 0.0f, 1.0f);
+  }
+
+  void SetParameters(
+      size_t lane, float amount, float input_gain, float time, float diffusion, float lp) {
+    SetAmount(lane, amount);
+    SetInputGain(lane, input_gain);
+    SetTime(lane, time);
+    SetDiffusion(lane, diffusion);
+    SetLowpassCutoff(lane, lp);
+  }
+
+  // Parameter getters
+  float GetAmount(size_t lane) const { return amount_[lane]; }
+  float GetInputGain(size_t lane) const { return input_gain_[lane]; }
+  float GetTime(size_t lane) const { return reverb_time_[lane]; }
+  float GetDiffusion(size_t lane) const { return diffusion_[lane]; }
+  float GetLowpassCutoff(size_t lane) const { return lp_[lane]; }
+  float GetSampleRate() const { return sample_rate_; }
+
+ private:
+  typedef FxEngineBank<kBufferSize, N> E;
+  typedef typename E::L L;
+
+  // Lines laid out by Init() for the sample rate
+  typedef CloudsNetwork::ScaledLayout<typename E::DynamicDelayLine> Layout;
+
+  // Scales the lines to `sample_rate` as CloudsReverb::Init() does without
+  // decimation, and lays them out in lines_.
+  void LayOut(float sample_rate) {
+    scale_ = std::min(sample_rate, kMaxSampleRate) /
+        CloudsReverb::kReferenceSampleRate;
+    int32_t lengths[CloudsNetwork::kNumLines];
+    for (size_t i = 0; i < CloudsNetwork::kNumLines; ++i) {
+      lengths[i] = std::max(static_cast<int32_t>(std::lround(
+          CloudsNetwork::kLengths[i] * scale_)), int32_t(1));
+    }
+    E::Allocate(lengths, CloudsNetwork::kNumLines, lines_);
+  }
+
+  void ResetLane(size_t lane) {
+    amount_[lane] = 0.5f;
+    input_gain_[lane] = 0.5f;
+    reverb_time_[lane] = 0.5f;
+    diffusion_[lane] = 0.625f;
+    lp_[lane] = 0.7f;
+    lp_decay_1_[lane] = 0.0f;
+    lp_decay_2_[lane] = 0.0f;
+  }
+
+  // Runs the network over the first `size` frames of left_ and right_.
+  void ProcessInternal(size_t size) {
+    ScopedNoDenormals no_denormals;
+    typename E::Context c;
+    const Layout layout{ lines_, scale_ };
+
+    const L kap = L::Load(diffusion_);
+    const auto k = network::MakeCoefficients(
+        L::Load(input_gain_), kap, -kap, L::Load(reverb_time_), L::Load(lp_));
+    const L amount = L::Load(amount_);
+
+    L lp[CloudsNetwork::kNumLowPass] = {
+      L::Load(lp_decay_1_), L::Load(lp_decay_2_)
+    };
+
+    for (size_t i = 0; i < size; ++i) {
+      L wet[CloudsNetwork::kNumOutputs];
+      engine_.Start(&c);
+
+      const L in_l = L::Load(left_[i]);
+      const L in_r = L::Load(right_[i]);
+      CloudsNetwork::Process(&c, layout, k, in_l + in_r, lp, wet);
+
+      (in_l + (wet[0] - in_l) * amount).Store(left_[i]);
+      (in_r + (wet[1] - in_r) * amount).Store(right_[i]);
+    }
+
+    lp[0].Store(lp_decay_1_);
+    lp[1].Store(lp_decay_2_);
+  }
+
+  E engine_;
+  alignas(L::kAlignment) float buffer_[kBufferSize * N];
+
+  // Frames of the current block, in lane order.
+  alignas(L::kAlignment) float left_[kBlockSize][N];
+  alignas(L::kAlignment) float right_[kBlockSize][N];
+
+  float sample_rate_;
+  float scale_;
+  typename E::DynamicDelayLine lines_[CloudsNetwork::kNumLines];
+  alignas(L::kAlignment) float amount_[N];
+  alignas(L::kAlignment) float input_gain_[N];
+  alignas(L::kAlignment) float reverb_time_[N];
+  alignas(L::kAlignment) float diffusion_[N];
+  alignas(L::kAlignment) float lp_[N];
+  alignas(L::kAlignment) float lp_decay_1_[N];
+  alignas(L::kAlignment) float lp_decay_2_[N];
+
+  DISALLOW_COPY_AND_ASSIGN(CloudsReverbBank);
+};
+
+}  // namespace clouds
+
+#endif  // CLOUDS_CLOUDS_REVERB_BANK_H_
@@ -0,0 +1,202 @@
+// DelayMemoryAllocator - where CloudsReverb instances get their delay memory
+//
+// By default each instance allocates its own block on the heap in Init(), and
+// clears it. Hosts that run many instances pass an allocator to the
+// constructor instead:
+//
+//   // One region for 500 reverbs, mapped once, on huge pages where the
+//   // kernel has them. Init() neither allocates nor clears: the pages come
+//   // zeroed from the OS, and are only committed once the reverbs run.
+//   clouds::PageAllocator pages(true);
+//   clouds::ArenaAllocator arena(&pages, 500 * clouds::CloudsReverb::MemorySize(48000.0f));
+//   std::vector<clouds::CloudsReverb> reverbs;
+//   for (int i = 0; i < 500; ++i) {
+//     reverbs.emplace_back(&arena);
+//     reverbs.back().Init(48000.0f);
+//   }
+//
+// An allocator must outlive the instances using it. Like new, allocators
+// throw std::bad_alloc when they run out of memory.
+
+#ifndef CLOUDS_DELAY_MEMORY_H_
+#define CLOUDS_DELAY_MEMORY_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <unistd.h>
+#define CLOUDS_HAVE_PAGE_ALLOCATOR 1
+#endif
+
+#include "stmlib/stmlib.h"
+
+namespace clouds {
+
+// Alignment of every block an allocator returns: a cache line.
+constexpr size_t kDelayMemoryAlignment = 64;
+
+class DelayMemoryAllocator {
+ public:
+  DelayMemoryAllocator() { }
+  virtual ~DelayMemoryAllocator() { }
+
+  // Returns `size` bytes aligned to kDelayMemoryAlignment.
+  virtual void* Allocate(size_t size) = 0;
+
+  // Returns a block from Allocate(), with the same size.
+  virtual void Free(void* memory, size_t size) = 0;
+
+  // True if Allocate() returns zero-filled memory, which CloudsReverb then
+  // does not clear.
+  virtual bool zeroed() const { return false; }
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(DelayMemoryAllocator);
+};
+
+// Aligned operator new. The default.
+class HeapAllocator : public DelayMemoryAllocator {
+ public:
+  HeapAllocator() { }
+  ~HeapAllocator() override { }
+
+  void* Allocate(size_t size) override {
+    return ::operator new(size, std::align_val_t(kDelayMemoryAlignment));
+  }
+
+  void Free(void* memory, size_t) override {
+    ::operator delete(memory, std::align_val_t(kDelayMemoryAlignment));
+  }
+
+  // Shared by all instances constructed without an allocator.
+  static HeapAllocator* Default() {
+    static HeapAllocator allocator;
+    return &allocator;
+  }
+};
+
+#ifdef CLOUDS_HAVE_PAGE_ALLOCATOR
+
+// Maps fresh pages for every block. They read as zero and only take physical
+// memory once written. With `huge_pages`, blocks of 2 MB and more are aligned
+// to 2 MB and offered to the kernel as transparent huge pages (Linux), for
+// fewer TLB misses when many instances run.
+class PageAllocator : public DelayMemoryAllocator {
+ public:
+  explicit PageAllocator(bool huge_pages = false) : huge_pages_(huge_pages) { }
+  ~PageAllocator() override { }
+
+  void* Allocate(size_t size) override {
+    const size_t alignment = Alignment(size);
+    const size_t mapped = RoundUp(size, alignment) + alignment - page_size();
+    void* map = mmap(nullptr, mapped, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (map == MAP_FAILED) {
+      throw std::bad_alloc();
+    }
+    // Trim the mapping down to an aligned block.
+    uint8_t* start = static_cast<uint8_t*>(map);
+    uint8_t* block = reinterpret_cast<uint8_t*>(
+        RoundUp(reinterpret_cast<uintptr_t>(start), alignment));
+    uint8_t* end = block + RoundUp(size, alignment);
+    if (block != start) {
+      munmap(start, static_cast<size_t>(block - start));
+    }
+    if (end != start + mapped) {
+      munmap(end, static_cast<size_t>(start + mapped - end));
+    }
+#ifdef MADV_HUGEPAGE
+    if (alignment == kHugePageSize) {
+      madvise(block, static_cast<size_t>(end - block), MADV_HUGEPAGE);
+    }
+#endif
+    return block;
+  }
+
+  void Free(void* memory, size_t size) override {
+    munmap(memory, RoundUp(size, Alignment(size)));
+  }
+
+  bool zeroed() const override { return true; }
+
+ private:
+  static constexpr size_t kHugePageSize = size_t(2) << 20;
+
+  static size_t page_size() {
+    return static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  }
+
+  size_t Alignment(size_t size) const {
+    return huge_pages_ && size >= kHugePageSize ? kHugePageSize : page_size();
+  }
+
+  static size_t RoundUp(size_t x, size_t alignment) {
+    return (x + alignment - 1) / alignment * alignment;
+  }
+
+  bool huge_pages_;
+};
+
+#endif  // CLOUDS_HAVE_PAGE_ALLOCATOR
+
+// Hands out consecutive slices of one block, so that a set of instances is
+// set up without a system call or heap lock each, and shares one contiguous
+// region. The block is the caller's, or taken from an upstream allocator for
+// the lifetime of the arena. Slices are not reused: Free() only returns the
+// memory with the arena, which is sized for the instances it serves (see
+// CloudsReverb::MemorySize()).
+class ArenaAllocator : public DelayMemoryAllocator {
+ public:
+  // `memory` is aligned to kDelayMemoryAlignment and holds `size` bytes,
+  // zero-filled if `zeroed`.
+  ArenaAllocator(void* memory, size_t size, bool zeroed)
+      : upstream_(nullptr),
+        memory_(static_cast<uint8_t*>(memory)),
+        size_(size),
+        used_(0),
+        zeroed_(zeroed) { }
+
+  ArenaAllocator(DelayMemoryAllocator* upstream, size_t size)
+      : upstream_(upstream),
+        memory_(static_cast<uint8_t*>(upstream->Allocate(size))),
+        size_(size),
+        used_(0),
+        zeroed_(upstream->zeroed()) { }
+
+  ~ArenaAllocator() override {
+    if (upstream_) {
+      upstream_->Free(memory_, size_);
+    }
+  }
+
+  void* Allocate(size_t size) override {
+    size = (size + kDelayMemoryAlignment - 1) & ~(kDelayMemoryAlignment - 1);
+    if (size > size_ - used_) {
+      throw std::bad_alloc();
+    }
+    void* slice = memory_ + used_;
+    used_ += size;
+    return slice;
+  }
+
+  void Free(void*, size_t) override { }
+
+  bool zeroed() const override { return zeroed_; }
+
+  // Bytes handed out so far.
+  size_t used() const { return used_; }
+
+ private:
+  DelayMemoryAllocator* upstream_;
+  uint8_t* memory_;
+  size_t size_;
+  size_t used_;
+  bool zeroed_;
+};
+
+}  // namespace clouds
+
+#endif  // CLOUDS_DELAY_MEMORY_H_
@@ -0,0 +1,523 @@
+// Compile-time description of FxEngine delay networks
+//
+// A network is declared as a list of named delay lines, an input diffuser and
+// a number of tank branches, each a sequence of stages:
+//
+//   DelayNetwork<
+//       Lines<Line<Ap1, 150>, ..., Line<Del1, 4501>, Line<Del2, 6312> >,
+//       Diffuser<AllPass<Ap1>, ...>,
+//       Branch<ModulatedRead<Del2, 6200, 40, LFO_2>, LowPass<0>, ...,
+//              WriteDelay<Del1> >,
+//       Branch<...> >
+//
+// The stereo input is summed, scaled by the input gain and run through the
+// diffuser. Every branch then starts from the diffused signal, runs its
+// stages, and its final value is the wet signal of output channel b (branch b).
+// Branches feed each other through the delays they write and read, which is
+// how figure-of-eight tanks are built.
+//
+// From the declaration, DelayNetwork derives at compile time the memory
+// layout (the same one FxEngine::Reserve or FxEngine::Allocate would give),
+// the power-of-2 buffer it needs, the shortest feedback path across stages
+// (the longest legal block for FxEngine::BlockContext) and per-sample
+// operation counts. Process() and ProcessBlock() expand the declaration into
+// a fully inlined per-sample or block-major kernel; they work with
+// FxEngine::Context, FxEngineBank::Context and FxEngine::BlockContext. With
+// FxEngine::Context, two branches of the same shape run side by side in the
+// lanes of a FxEngine::PairContext.
+//
+// Stage coefficients are symbolic (diffusion, reverb time, low-pass) and bound
+// to values per call through NetworkCoefficients, which may hold scalars,
+// per-sample arrays (see CoefficientAt()) or vectors of lanes.
+
+#ifndef CLOUDS_DELAY_NETWORK_H_
+#define CLOUDS_DELAY_NETWORK_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "clouds/fx_engine.h"
+
+namespace clouds {
+
+namespace network {
+
+// Feedback latency of stages that do not read what a later stage writes.
+constexpr int32_t kNoFeedback = std::numeric_limits<int32_t>::max();
+
+// Values of the symbolic coefficients for one call. T is float, const float*
+// (one value per sample) or a vector of lanes.
+template<typename T>
+struct NetworkCoefficients {
+  T gain;
+  T kap;
+  T minus_kap;
+  T krt;
+  T klp;
+};
+
+template<typename T>
+inline NetworkCoefficients<T> MakeCoefficients(
+    T gain, T kap, T minus_kap, T krt, T klp) {
+  return NetworkCoefficients<T>{ gain, kap, minus_kap, krt, klp };
+}
+
+// Delay line `Tag` (any type, used only as a name) of `length` samples.
+template<typename Tag, int32_t length>
+struct Line {
+  typedef Tag Name;
+  static constexpr int32_t kLength = length;
+};
+
+template<typename... L>
+struct Lines { };
+
+// Stages. Each has per-sample costs, the feedback latency it introduces and
+// the number of filter states it uses, and runs per sample (Run) or over a
+// block (RunBlock).
+
+// Allpass diffuser on line Tag: reads the tail scaled by the diffusion, and
+// writes back with the opposite sign. `invert` swaps the signs.
+template<typename Tag, bool invert = false>
+struct AllPass {
+  static constexpr int kLoads = 1;
+  static constexpr int kStores = 1;
+  static constexpr int kMultiplyAdds = 2;
+  static constexpr int32_t kFeedbackLatency = kNoFeedback;
+  static constexpr size_t kNumLowPass = 0;
+
+  template<typename C, typename Layout, typename K, typename S>
+  static inline void Run(C* c, const Layout& layout, const K& k, S*) {
+    auto line = layout.template line<Tag>();
+    if constexpr (invert) {
+      c->AllPass(line, k.minus_kap, k.kap);
+    } else {
+      c->AllPass(line, k.kap, k.minus_kap);
+    }
+  }
+
+  template<typename C, typename Layout, typename K>
+  static inline void RunBlock(C* c, const Layout& layout, const K& k, float* io, float*) {
+    auto line = layout.template line<Tag>();
+    c->AllPass(line, io, invert ? k.minus_kap : k.kap);
+  }
+};
+
+// Adds line Tag, read `offset` samples back plus `amplitude` times the LFO,
+// scaled by the reverb time. This is the only stage that reads what another
+// stage writes, so its shortest read sets the feedback latency.
+template<typename Tag, int32_t offset, int32_t amplitude, LFOIndex lfo>
+struct ModulatedRead {
+  static constexpr int kLoads = 2;
+  static constexpr int kStores = 0;
+  static constexpr int kMultiplyAdds = 3;
+  static constexpr int32_t kFeedbackLatency = offset - amplitude;
+  static constexpr size_t kNumLowPass = 0;
+
+  template<typename C, typename Layout, typename K, typename S>
+  static inline void Run(C* c, const Layout& layout, const K& k, S*) {
+    auto line = layout.template line<Tag>();
+    c->Interpolate(
+        line, layout.Scale(float(offset)), lfo, layout.Scale(float(amplitude)),
+        k.krt);
+  }
+
+  template<typename C, typename Layout, typename K>
+  static inline void RunBlock(C* c, const Layout& layout, const K& k, float* io, float*) {
+    auto line = layout.template line<Tag>();
+    c->Interpolate(
+        line, io, layout.Scale(float(offset)), lfo,
+        layout.Scale(float(amplitude)), k.krt);
+  }
+};
+
+// One-pole low-pass using filter state `index`.
+template<size_t index>
+struct LowPass {
+  static constexpr int kLoads = 0;
+  static constexpr int kStores = 0;
+  static constexpr int kMultiplyAdds = 1;
+  static constexpr int32_t kFeedbackLatency = kNoFeedback;
+  static constexpr size_t kNumLowPass = index + 1;
+
+  template<typename C, typename Layout, typename K, typename S>
+  static inline void Run(C* c, const Layout&, const K& k, S* lp) {
+    c->Lp(lp[index], k.klp);
+  }
+
+  template<typename C, typename Layout, typename K>
+  static inline void RunBlock(C* c, const Layout&, const K& k, float* io, float* lp) {
+    c->Lp(io, lp[index], k.klp);
+  }
+};
+
+// Writes the signal to the head of line Tag.
+template<typename Tag>
+struct WriteDelay {
+  static constexpr int kLoads = 0;
+  static constexpr int kStores = 1;
+  static constexpr int kMultiplyAdds = 0;
+  static constexpr int32_t kFeedbackLatency = kNoFeedback;
+  static constexpr size_t kNumLowPass = 0;
+
+  template<typename C, typename Layout, typename K, typename S>
+  static inline void Run(C* c, const Layout& layout, const K&, S*) {
+    auto line = layout.template line<Tag>();
+    c->Write(line, 1.0f);
+  }
+
+  template<typename C, typename Layout, typename K>
+  static inline void RunBlock(C* c, const Layout& layout, const K&, float* io, float*) {
+    auto line = layout.template line<Tag>();
+    c->Write(line, io, 1.0f);
+  }
+};
+
+template<typename S>
+struct IsLowPass { static constexpr bool value = false; };
+
+template<size_t index>
+struct IsLowPass<LowPass<index> > { static constexpr bool value = true; };
+
+// Stages in the same position of two branches, run together by a
+// FxEngine::PairContext when they are of the same kind: lane 0 runs A, lane
+// 1 runs B.
+template<typename A, typename B>
+struct StagePair {
+  static constexpr bool kPaired = false;
+};
+
+template<typename TagA, bool invert_a, typename TagB, bool invert_b>
+struct StagePair<AllPass<TagA, invert_a>, AllPass<TagB, invert_b> > {
+  static constexpr bool kPaired = true;
+
+  template<typename P, typename Layout, typename K>
+  static inline void Run(P* p, const Layout& layout, const K& k, float*) {
+    typedef typename P::L L;
+    auto a = layout.template line<TagA>();
+    auto b = layout.template line<TagB>();
+    p->AllPass(a, b,
+               L(invert_a ? k.minus_kap : k.kap, invert_b ? k.minus_kap : k.kap),
+               L(invert_a ? k.kap : k.minus_kap, invert_b ? k.kap : k.minus_kap));
+  }
+};
+
+template<typename TagA, int32_t offset_a, int32_t amplitude_a, LFOIndex lfo_a,
+         typename TagB, int32_t offset_b, int32_t amplitude_b, LFOIndex lfo_b>
+struct StagePair<ModulatedRead<TagA, offset_a, amplitude_a, lfo_a>,
+                 ModulatedRead<TagB, offset_b, amplitude_b, lfo_b> > {
+  static constexpr bool kPaired = true;
+
+  template<typename P, typename Layout, typename K>
+  static inline void Run(P* p, const Layout& layout, const K& k, float*) {
+    typedef typename P::L L;
+    auto a = layout.template line<TagA>();
+    auto b = layout.template line<TagB>();
+    p->Interpolate(
+        a, b, L(layout.Scale(float(offset_a)), layout.Scale(float(offset_b))),
+        lfo_a, lfo_b,
+        L(layout.Scale(float(amplitude_a)), layout.Scale(float(amplitude_b))),
+        k.krt);
+  }
+};
+
+template<size_t index_a, size_t index_b>
+struct StagePair<LowPass<index_a>, LowPass<index_b> > {
+  static constexpr bool kPaired = true;
+
+  template<typename P, typename Layout, typename K>
+  static inline void Run(P* p, const Layout&, const K& k, float* lp) {
+    typename P::L state(lp[index_a], lp[index_b]);
+    p->Lp(state, k.klp);
+    lp[index_a] = state[0];
+    lp[index_b] = state[1];
+  }
+};
+
+template<typename TagA, typename TagB>
+struct StagePair<WriteDelay<TagA>, WriteDelay<TagB> > {
+  static constexpr bool kPaired = true;
+
+  template<typename P, typename Layout, typename K>
+  static inline void Run(P* p, const Layout& layout, const K&, float*) {
+    auto a = layout.template line<TagA>();
+    auto b = layout.template line<TagB>();
+    p->Write(a, b, 1.0f);
+  }
+};
+
+template<typename C, typename Enable = void>
+struct HasPairContext { static constexpr bool value = false; };
+
+template<typename C>
+struct HasPairContext<C, std::void_t<typename C::Pair> > {
+  static constexpr bool value = true;
+};
+
+// A sequence of stages.
+template<typename... Stages>
+struct Branch {
+  static constexpr size_t kNumStages = sizeof...(Stages);
+  static constexpr int kLoads = (0 + ... + Stages::kLoads);
+  static constexpr int kStores = (0 + ... + Stages::kStores);
+  static constexpr int kMultiplyAdds = (0 + ... + Stages::kMultiplyAdds);
+  static constexpr int32_t kFeedbackLatency =
+      std::min({ kNoFeedback, Stages::kFeedbackLatency... });
+  static constexpr size_t kNumLowPass =
+      std::max({ size_t(0), Stages::kNumLowPass... });
+
+  template<size_t i>
+  using Stage = std::tuple_element_t<i, std::tuple<Stages...> >;
+
+  template<typename C, typename Layout, typename K, typename S>
+  static inline void Run(C* c, const Layout& layout, const K& k, S* lp) {
+    (Stages::Run(c, layout, k, lp), ...);
+  }
+
+  template<typename C, typename Layout, typename K>
+  static inline void RunBlock(C* c, const Layout& layout, const K& k, float* io, float* lp) {
+    (Stages::RunBlock(c, layout, k, io, lp), ...);
+  }
+};
+
+template<typename... Stages>
+struct Diffuser : Branch<Stages...> { };
+
+template<typename A, typename B, size_t... i>
+constexpr bool PairedStages(std::index_sequence<i...>) {
+  return (StagePair<typename A::template Stage<i>,
+                    typename B::template Stage<i> >::kPaired && ...);
+}
+
+// Whether Branches are two branches whose stages pair up one for one.
+template<typename... Branches>
+struct PairedBranches { static constexpr bool value = false; };
+
+template<typename A, typename B>
+struct PairedBranches<A, B> {
+  static constexpr bool value = [] {
+    if constexpr (A::kNumStages == B::kNumStages) {
+      return PairedStages<A, B>(std::make_index_sequence<A::kNumStages>());
+    } else {
+      return false;
+    }
+  }();
+};
+
+template<typename Tag, typename... Names>
+struct IndexOf;
+
+template<typename Tag, typename... Names>
+struct IndexOf<Tag, Tag, Names...> {
+  static constexpr size_t value = 0;
+};
+
+template<typename Tag, typename First, typename... Names>
+struct IndexOf<Tag, First, Names...> {
+  static constexpr size_t value = 1 + IndexOf<Tag, Names...>::value;
+};
+
+template<typename LineList, typename InputDiffuser, typename... Branches>
+class DelayNetwork;
+
+template<typename... L, typename InputDiffuser, typename... Branches>
+class DelayNetwork<Lines<L...>, InputDiffuser, Branches...> {
+ public:
+  static constexpr size_t kNumLines = sizeof...(L);
+  static constexpr size_t kNumOutputs = sizeof...(Branches);
+  static constexpr int32_t kLengths[kNumLines] = { L::kLength... };
+
+  template<typename Tag>
+  static constexpr size_t kIndex = IndexOf<Tag, typename L::Name...>::value;
+
+  // Start of line `index` in the delay memory. Lines are laid out in order,
+  // one sample apart, as by FxEngine::Reserve.
+  static constexpr int32_t Base(size_t index) {
+    int32_t base = 0;
+    for (size_t i = 0; i < index; ++i) {
+      base += kLengths[i] + 1;
+    }
+    return base;
+  }
+
+  // Samples of delay memory spanned by the lines, and the power-of-2 buffer
+  // FxEngine needs to hold them.
+  static constexpr size_t kMemory = static_cast<size_t>(Base(kNumLines) - 1);
+  static constexpr size_t kBufferSize = [] {
+    size_t size = 1;
+    while (size < kMemory) {
+      size <<= 1;
+    }
+    return size;
+  }();
+
+  // Shortest path, in samples, from a write to a read of the same line by
+  // an earlier stage. Blocks up to this long give the per-sample result.
+  static constexpr int32_t kMinFeedbackLatency = std::min({
+      InputDiffuser::kFeedbackLatency, Branches::kFeedbackLatency... });
+
+  static constexpr size_t kNumLowPass = std::max({
+      InputDiffuser::kNumLowPass, Branches::kNumLowPass... });
+
+  // Per-sample cost: delay memory loads and stores, and multiply-adds
+  // including the input gain and the wet/dry mix of every output.
+  static constexpr int kLoadsPerSample =
+      InputDiffuser::kLoads + (0 + ... + Branches::kLoads);
+  static constexpr int kStoresPerSample =
+      InputDiffuser::kStores + (0 + ... + Branches::kStores);
+  static constexpr int kMultiplyAddsPerSample = 1 + InputDiffuser::kMultiplyAdds +
+      (0 + ... + Branches::kMultiplyAdds) + int(kNumOutputs);
+
+  // Compile-time line, usable as an FxEngine DelayLine.
+  template<typename Tag>
+  struct DelayLine {
+    static constexpr int32_t base = Base(kIndex<Tag>);
+    static constexpr int32_t length = kLengths[kIndex<Tag> ];
+  };
+
+  // Layout with the declared lengths, resolved at compile time.
+  struct StaticLayout {
+    template<typename Tag>
+    inline DelayLine<Tag> line() const { return DelayLine<Tag>(); }
+
+    inline float Scale(float samples) const { return samples; }
+  };
+
+  // Layout whose lines were laid out at runtime (FxEngine::Allocate() on
+  // kLengths scaled by `scale`), for networks resized to the sample rate.
+  template<typename D>
+  struct ScaledLayout {
+    template<typename Tag>
+    inline const D& line() const { return lines[kIndex<Tag> ]; }
+
+    inline float Scale(float samples) const { return samples * scale; }
+
+    const D* lines;
+    float scale;
+  };
+
+  // Whether the network has two branches whose stages pair up (see
+  // StagePair), which Process() then runs side by side in the two lanes of
+  // a FxEngine::PairContext.
+  static constexpr bool kPairedBranches = PairedBranches<Branches...>::value;
+
+  // Runs the network for one sample of `input` (the summed stereo input),
+  // using filter states lp[kNumLowPass] and writing wet[kNumOutputs].
+  template<typename C, typename Layout, typename K, typename S>
+  static inline void Process(
+      C* c, const Layout& layout, const K& k, const S& input, S* lp, S* wet) {
+    S diffused;
+    c->Read(input, k.gain);
+    InputDiffuser::Run(c, layout, k, lp);
+    c->Write(diffused);
+    if constexpr (kPairedBranches && HasPairContext<C>::value) {
+      ProcessPairedBranches(c, layout, k, diffused, lp, wet,
+                            std::make_index_sequence<Stages::kNumStages>());
+    } else {
+      ProcessBranches(c, layout, k, diffused, lp, wet,
+                      std::index_sequence_for<Branches...>());
+    }
+  }
+
+  // Process() with the branches always run one after the other, as the
+  // reference for the paired kernel.
+  template<typename C, typename Layout, typename K, typename S>
+  static inline void ProcessUnpaired(
+      C* c, const Layout& layout, const K& k, const S& input, S* lp, S* wet) {
+    S diffused;
+    c->Read(input, k.gain);
+    InputDiffuser::Run(c, layout, k, lp);
+    c->Write(diffused);
+    ProcessBranches(c, layout, k, diffused, lp, wet,
+                    std::index_sequence_for<Branches...>());
+  }
+
+  // Block-major counterpart of Process(). `io` holds the summed input of the
+  // block, scaled by the input gain, and is overwritten with the diffused
+  // signal; wet[b] receives the block of output b. The block must not be
+  // longer than kMinFeedbackLatency.
+  template<typename C, typename Layout, typename K>
+  static inline void ProcessBlock(
+      C* c, const Layout& layout, const K& k, float* io, float* lp,
+      float* const* wet) {
+    const size_t n = c->block_size();
+    InputDiffuser::RunBlock(c, layout, k, io, lp);
+    for (size_t b = 0; b < kNumOutputs; ++b) {
+      std::copy(io, io + n, wet[b]);
+    }
+    if constexpr (((Branches::kNumStages == Stages::kNumStages) && ...)) {
+      // Interleave the branches stage by stage, so that filters in the same
+      // position of every branch run as one loop.
+      ProcessStages(c, layout, k, lp, wet,
+                    std::make_index_sequence<Stages::kNumStages>());
+    } else {
+      ProcessBranchBlocks(c, layout, k, lp, wet,
+                          std::index_sequence_for<Branches...>());
+    }
+  }
+
+ private:
+  typedef std::tuple_element_t<0, std::tuple<Branches...> > Stages;
+
+  template<typename C, typename Layout, typename K, size_t... i>
+  static inline void ProcessPairedBranches(
+      C* c, const Layout& layout, const K& k, float diffused, float* lp,
+      float* wet, std::index_sequence<i...>) {
+    typedef std::tuple_element_t<1, std::tuple<Branches...> > Other;
+    typename C::Pair p(*c);
+    p.Load(diffused);
+    (StagePair<typename Stages::template Stage<i>,
+               typename Other::template Stage<i> >::Run(&p, layout, k, lp), ...);
+    p.Write(wet[0], wet[1]);
+  }
+
+  template<typename C, typename Layout, typename K, typename S, size_t... b>
+  static inline void ProcessBranches(
+      C* c, const Layout& layout, const K& k, const S& diffused, S* lp, S* wet,
+      std::index_sequence<b...>) {
+    ((c->Load(diffused),
+      Branches::Run(c, layout, k, lp),
+      c->Write(wet[b], 0.0f)), ...);
+  }
+
+  template<typename C, typename Layout, typename K, size_t... b>
+  static inline void ProcessBranchBlocks(
+      C* c, const Layout& layout, const K& k, float* lp, float* const* wet,
+      std::index_sequence<b...>) {
+    (Branches::RunBlock(c, layout, k, wet[b], lp), ...);
+  }
+
+  template<typename C, typename Layout, typename K, size_t... i>
+  static inline void ProcessStages(
+      C* c, const Layout& layout, const K& k, float* lp, float* const* wet,
+      std::index_sequence<i...>) {
+    (ProcessStage<i>(c, layout, k, lp, wet,
+                     std::index_sequence_for<Branches...>()), ...);
+  }
+
+  template<size_t i, typename C, typename Layout, typename K, size_t... b>
+  static inline void ProcessStage(
+      C* c, const Layout& layout, const K& k, float* lp, float* const* wet,
+      std::index_sequence<b...>) {
+    if constexpr (kNumOutputs == 2 &&
+                  (IsLowPass<typename Branches::template Stage<i> >::value && ...)) {
+      // Each recursion is latency bound; two in one loop hide half the cost.
+      typedef typename std::tuple_element_t<0, std::tuple<Branches...> >::template Stage<i> A;
+      typedef typename std::tuple_element_t<1, std::tuple<Branches...> >::template Stage<i> B;
+      c->Lp(wet[0], lp[A::kNumLowPass - 1], wet[1], lp[B::kNumLowPass - 1], k.klp);
+    } else {
+      (Branches::template Stage<i>::RunBlock(c, layout, k, wet[b], lp), ...);
+    }
+  }
+};
+
+}  // namespace network
+
+}  // namespace clouds
+
+#endif  // CLOUDS_DELAY_NETWORK_H_
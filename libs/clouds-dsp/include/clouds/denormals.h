@@ -0,0 +1,98 @@
+// ScopedNoDenormals - flushes denormal floats to zero on the calling thread
+// for the lifetime of an instance.
+//
+// As a tail decays, the delay memory and filter states of a reverb go
+// through the denormal range, where x86 cores (and ARM cores without
+// flush-to-zero) take a slow path on every operation: a silent tail then costs
+// several times the CPU of a loud one. The guard turns on flush-to-zero, and
+// denormals-are-zero where the FPU has it, and restores the previous mode when
+// it goes out of scope, so guards nest and the host's settings are left alone.
+// On targets without a known FPU control register it does nothing.
+
+#ifndef CLOUDS_DENORMALS_H_
+#define CLOUDS_DENORMALS_H_
+
+#include <cstdint>
+
+#if defined(__SSE__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define CLOUDS_DENORMALS_SSE 1
+#elif defined(__aarch64__) || \
+    (defined(__arm__) && defined(__VFP_FP__) && !defined(__SOFTFP__))
+#define CLOUDS_DENORMALS_ARM 1
+#endif
+
+#include "stmlib/stmlib.h"
+
+namespace clouds {
+
+class ScopedNoDenormals {
+ public:
+  ScopedNoDenormals() : previous_(Get()) {
+    if ((previous_ & kFlushMask) != kFlushMask) {
+      Set(previous_ | kFlushMask);
+    }
+  }
+
+  ~ScopedNoDenormals() {
+    if ((previous_ & kFlushMask) != kFlushMask) {
+      Set(previous_);
+    }
+  }
+
+ private:
+#if defined(CLOUDS_DENORMALS_SSE)
+  typedef uint32_t Mode;
+  // MXCSR flush-to-zero (bit 15) and denormals-are-zero (bit 6)
+  static constexpr Mode kFlushMask = 0x8040;
+
+  static inline Mode Get() { return _mm_getcsr(); }
+  static inline void Set(Mode mode) { _mm_setcsr(mode); }
+#elif defined(CLOUDS_DENORMALS_ARM) && defined(__aarch64__)
+  typedef uint64_t Mode;
+  // FPCR.FZ
+  static constexpr Mode kFlushMask = Mode(1) << 24;
+
+  static inline Mode Get() {
+    Mode mode;
+    __asm__ __volatile__("mrs %0, fpcr" : "=r"(mode));
+    return mode;
+  }
+  static inline void Set(Mode mode) {
+    __asm__ __volatile__("msr fpcr, %0" : : "r"(mode));
+  }
+#elif defined(CLOUDS_DENORMALS_ARM)
+  typedef uint32_t Mode;
+  // FPSCR.FZ
+  static constexpr Mode kFlushMask = Mode(1) << 24;
+
+  static inline Mode Get() {
+    Mode mode;
+    __asm__ __volatile__("vmrs %0, fpscr" : "=r"(mode));
+    return mode;
+  }
+  static inline void Set(Mode mode) {
+    __asm__ __volatile__("vmsr fpscr, %0" : : "r"(mode));
+  }
+#else
+  typedef uint32_t Mode;
+  static constexpr Mode kFlushMask = 0;
+
+  static inline Mode Get() { return 0; }
+  static inline void Set(Mode) { }
+#endif
+
+ public:
+  // Whether the guard flushes anything on this target.
+  static constexpr bool kSupported = kFlushMask != 0;
+
+ private:
+  Mode previous_;
+
+  DISALLOW_COPY_AND_ASSIGN(ScopedNoDenormals);
+};
+
+}  // namespace clouds
+
+#endif  // CLOUDS_DENORMALS_H_
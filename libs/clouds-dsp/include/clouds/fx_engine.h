@@ -26,7 +26,16 @@
 #define CLOUDS_DSP_FX_FX_ENGINE_H_
 
 #include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <type_traits>
 
+#if defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+#include "clouds/lanes.h"
+#include "clouds/sample_conversion.h"
 #include "stmlib/stmlib.h"
 #include "stmlib/dsp/dsp.h"
 #include "stmlib/dsp/cosine_oscillator.h"
@@ -43,7 +52,11 @@ namespace clouds {
 enum Format {
   FORMAT_12_BIT,
   FORMAT_16_BIT,
-  FORMAT_32_BIT
+  FORMAT_32_BIT,
+  // IEEE 754 half precision: same footprint as FORMAT_16_BIT, but with 11
+  // bits of mantissa at any level instead of a fixed step and a clip at 1.0.
+  // Uses F16C conversions when the target has them (-mf16c).
+  FORMAT_16_BIT_FLOAT
 };
 
 enum LFOIndex {
@@ -51,6 +64,117 @@ enum LFOIndex {
   LFO_2
 };
 
+// The two LFOs of an FxEngine, stepped together. Each runs the recursion of
+// stmlib::CosineOscillator (COSINE_OSCILLATOR_APPROXIMATE) once every kPeriod
+// samples. Between steps, the output ramps linearly from the value before
+// the last step to the value after it, so that modulated reads glide instead
+// of moving in kPeriod-sample stairs, at the cost of one period of latency.
+class LFOPair {
+ public:
+  static constexpr int32_t kPeriod = 32;
+
+  LFOPair() {
+    for (int k = 0; k < 2; ++k) {
+      coefficient_[k] = 0.0f;
+      initial_amplitude_[k] = 0.0f;
+    }
+    Start();
+  }
+
+  LFOPair(LFOPair&&) = default;
+  LFOPair& operator=(LFOPair&&) = default;
+
+  // frequency is in cycles per sample.
+  inline void Init(LFOIndex index, float frequency) {
+    frequency *= static_cast<float>(kPeriod);
+    float sign = 16.0f;
+    frequency -= 0.25f;
+    if (frequency < 0.0f) {
+      frequency = -frequency;
+    } else {
+      if (frequency > 0.5f) {
+        frequency -= 0.5f;
+      } else {
+        sign = -16.0f;
+      }
+    }
+    coefficient_[index] = sign * frequency * (1.0f - 2.0f * frequency);
+    initial_amplitude_[index] = coefficient_[index] * 0.25f;
+    Start(index);
+  }
+
+  inline void Start() {
+    Start(LFO_1);
+    Start(LFO_2);
+  }
+
+  // Steps both oscillators when step is true, without branching.
+  inline void Tick(bool step) {
+    for (int k = 0; k < 2; ++k) {
+      const float y0 = y0_[k];
+      const float y1 = y1_[k];
+      const float next = coefficient_[k] * y0 - y1;
+      base_[k] = step ? y1 + 0.5f : base_[k];
+      delta_[k] = step ? (y0 + 0.5f) - (y1 + 0.5f) : delta_[k];
+      y1_[k] = step ? y0 : y1;
+      y0_[k] = step ? next : y0;
+    }
+  }
+
+  // Output phase samples (0 to kPeriod - 1) after the last step.
+  inline float value(LFOIndex index, int32_t phase) const {
+    return base_[index] +
+        delta_[index] * (static_cast<float>(phase) * (1.0f / kPeriod));
+  }
+
+  // Position of both oscillators. The frequencies are set by Init().
+  struct State {
+    float y0[2];
+    float y1[2];
+    float base[2];
+    float delta[2];
+  };
+
+  void Save(State* state) const {
+    for (int k = 0; k < 2; ++k) {
+      state->y0[k] = y0_[k];
+      state->y1[k] = y1_[k];
+      state->base[k] = base_[k];
+      state->delta[k] = delta_[k];
+    }
+  }
+
+  void Restore(const State& state) {
+    for (int k = 0; k < 2; ++k) {
+      y0_[k] = state.y0[k];
+      y1_[k] = state.y1[k];
+      base_[k] = state.base[k];
+      delta_[k] = state.delta[k];
+    }
+  }
+
+ private:
+  inline void Start(LFOIndex index) {
+    y1_[index] = initial_amplitude_[index];
+    y0_[index] = 0.5f;
+    base_[index] = y1_[index] + 0.5f;
+    delta_[index] = 0.0f;
+  }
+
+  float y0_[2];
+  float y1_[2];
+  float coefficient_[2];
+  float initial_amplitude_[2];
+  // Value before the last step, and change at the last step.
+  float base_[2];
+  float delta_[2];
+
+  DISALLOW_COPY_AND_ASSIGN(LFOPair);
+};
+
+// Conversions between float and the storage type T of a format, one sample
+// at a time (Compress, Decompress) or over a span (CompressN, DecompressN,
+// vectorized where the target allows and bit-exact with the former).
 template<Format format>
 struct DataType { };
 
@@ -66,6 +190,19 @@ struct DataType<FORMAT_12_BIT> {
     return static_cast<uint16_t>(
         stmlib::Clip16(static_cast<int32_t>(value * 4096.0f)));
   }
+  static inline void CompressN(const float* in, T* out, size_t n) {
+    size_t i = conversion::FloatToFixed(in, out, n, 4096.0f);
+    for (; i < n; ++i) {
+      out[i] = Compress(in[i]);
+    }
+  }
+
+  static inline void DecompressN(const T* in, float* out, size_t n) {
+    size_t i = conversion::FixedToFloat(in, out, n, 1.0f / 4096.0f);
+    for (; i < n; ++i) {
+      out[i] = Decompress(in[i]);
+    }
+  }
 };
 
 template<>
@@ -80,6 +217,19 @@ struct DataType<FORMAT_16_BIT> {
     return static_cast<uint16_t>(
         stmlib::Clip16(static_cast<int32_t>(value * 32768.0f)));
   }
+  static inline void CompressN(const float* in, T* out, size_t n) {
+    size_t i = conversion::FloatToFixed(in, out, n, 32768.0f);
+    for (; i < n; ++i) {
+      out[i] = Compress(in[i]);
+    }
+  }
+
+  static inline void DecompressN(const T* in, float* out, size_t n) {
+    size_t i = conversion::FixedToFloat(in, out, n, 1.0f / 32768.0f);
+    for (; i < n; ++i) {
+      out[i] = Decompress(in[i]);
+    }
+  }
 };
 
 template<>
@@ -93,25 +243,282 @@ struct DataType<FORMAT_32_BIT> {
   static inline T Compress(float value) {
     return value;
   }
+
+  static inline void CompressN(const float* in, T* out, size_t n) {
+    std::copy(in, in + n, out);
+  }
+
+  static inline void DecompressN(const T* in, float* out, size_t n) {
+    std::copy(in, in + n, out);
+  }
+};
+
+template<>
+struct DataType<FORMAT_16_BIT_FLOAT> {
+  typedef uint16_t T;
+
+#if defined(__F16C__)
+  static inline float Decompress(T value) {
+    return _cvtsh_ss(value);
+  }
+
+  static inline T Compress(float value) {
+    return _cvtss_sh(value, _MM_FROUND_TO_NEAREST_INT);
+  }
+#else
+  // Portable conversions, rounding to nearest even like F16C.
+  static inline float Decompress(T value) {
+    uint32_t sign = static_cast<uint32_t>(value & 0x8000) << 16;
+    uint32_t exponent = (value >> 10) & 0x1f;
+    uint32_t mantissa = value & 0x3ff;
+    uint32_t bits;
+    if (exponent == 0x1f) {
+      bits = sign | 0x7f800000 | (mantissa << 13);
+    } else if (exponent) {
+      bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    } else if (mantissa) {
+      // Subnormal: mantissa * 2^-24, exact in single precision.
+      float f = static_cast<float>(mantissa) * 5.9604645e-8f;
+      std::memcpy(&bits, &f, sizeof(bits));
+      bits |= sign;
+    } else {
+      bits = sign;
+    }
+    float f;
+    std::memcpy(&f, &bits, sizeof(f));
+    return f;
+  }
+
+  static inline T Compress(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    uint32_t sign = (bits >> 16) & 0x8000;
+    uint32_t magnitude = bits & 0x7fffffff;
+    if (magnitude >= 0x7f800000) {
+      // Inf stays Inf; NaN stays a (quiet) NaN.
+      return static_cast<T>(
+          sign | 0x7c00 | (magnitude > 0x7f800000 ? 0x200 : 0));
+    } else if (magnitude >= 0x477ff000) {
+      return static_cast<T>(sign | 0x7c00);  // Rounds past the largest half.
+    } else if (magnitude >= 0x38800000) {
+      // Normal: rebias the exponent, round the 13 dropped bits.
+      uint32_t rounded = magnitude + 0xfff + ((magnitude >> 13) & 1);
+      return static_cast<T>(sign | ((rounded - 0x38000000) >> 13));
+    } else if (magnitude >= 0x33000000) {
+      // Subnormal: shift the mantissa (with its implicit bit) into place.
+      uint32_t shift = 126 - (magnitude >> 23);
+      uint32_t mantissa = (magnitude & 0x7fffff) | 0x800000;
+      uint32_t half = mantissa >> shift;
+      uint32_t remainder = mantissa & ((1u << shift) - 1);
+      uint32_t midpoint = 1u << (shift - 1);
+      if (remainder > midpoint || (remainder == midpoint && (half & 1))) {
+        ++half;
+      }
+      return static_cast<T>(sign | half);
+    }
+    return static_cast<T>(sign);
+  }
+#endif
+
+  static inline void CompressN(const float* in, T* out, size_t n) {
+    size_t i = conversion::FloatToHalf(in, out, n);
+    for (; i < n; ++i) {
+      out[i] = Compress(in[i]);
+    }
+  }
+
+  static inline void DecompressN(const T* in, float* out, size_t n) {
+    size_t i = conversion::HalfToFloat(in, out, n);
+    for (; i < n; ++i) {
+      out[i] = Decompress(in[i]);
+    }
+  }
+};
+
+// BlockContext coefficients are either one value for the whole block or one
+// value per sample.
+inline float CoefficientAt(float coefficient, size_t) {
+  return coefficient;
+}
+
+inline float CoefficientAt(const float* coefficient, size_t i) {
+  return coefficient[i];
+}
+
+// Passed as the size of an FxEngine whose buffer size is only known at
+// runtime (see FxEngine::Init(T*, size_t)).
+constexpr size_t kDynamicSize = 0;
+
+// How FxEngine lays out its delay memory.
+enum RingLayout {
+  // size samples, shared by all delay lines. Spans of delay memory that cross
+  // the end of the ring are accessed one masked sample at a time.
+  RING_PLAIN,
+  // size samples followed by a guard zone mirroring the first kGuardSize.
+  // Writes to the start of the ring are repeated in the guard zone, so any
+  // span of up to kGuardSize + 1 samples, and in particular every span
+  // BlockContext touches, is contiguous in memory.
+  RING_MIRRORED,
+  // Every delay line is a ring of its own, sized to the line rather than to
+  // a power of 2 and mirrored as with RING_MIRRORED. The rings are laid out
+  // back to back, in declaration order, each starting on a cache line. Only
+  // for FxEngine<kDynamicSize> and DynamicDelayLine (see Allocate()).
+  RING_PACKED
 };
 
 template<
     size_t size,
-    Format format = FORMAT_12_BIT>
+    Format format = FORMAT_12_BIT,
+    RingLayout ring = RING_PLAIN>
 class FxEngine {
  public:
   typedef typename DataType<format>::T T;
-  FxEngine() : write_ptr_(0), buffer_(nullptr) { }
+  FxEngine()
+      : write_ptr_(0),
+        mask_(kMask),
+        buffer_(nullptr),
+        written_(0),
+        num_lines_(0),
+        packed_size_(0) { }
   ~FxEngine() { }
 
+  // Moves hand over the buffer pointer; the memory stays the caller's.
+  FxEngine(FxEngine&&) = default;
+  FxEngine& operator=(FxEngine&&) = default;
+
+  // Longest block accepted by StartBlock().
+  static constexpr size_t kMaxBlockSize = 128;
+
+  // Samples mirrored after the end of each ring: one more than the longest
+  // block, for the second tap of interpolated reads.
+  static constexpr size_t kGuardSize =
+      ring == RING_PLAIN ? 0 : kMaxBlockSize + 1;
+
+  // Alignment, in bytes, of the rings of RING_PACKED lines.
+  static constexpr size_t kCacheLineSize = 64;
+
+  // Most lines a RING_PACKED engine can hold.
+  static constexpr size_t kMaxLines = 16;
+
+  STATIC_ASSERT(size == kDynamicSize || size >= 2 * kGuardSize, ring_too_small);
+  STATIC_ASSERT(ring != RING_PACKED || size == kDynamicSize, packed_size_is_dynamic);
+
+  // Samples of memory the buffer given to Init() must hold for buffer_size
+  // samples of delay memory.
+  static constexpr size_t StorageSize(size_t buffer_size) {
+    return ring == RING_PACKED ? buffer_size : buffer_size + kGuardSize;
+  }
+
+  // buffer holds StorageSize(size) samples.
   void Init(T* buffer) {
+    STATIC_ASSERT(size != kDynamicSize, buffer_size_required);
     buffer_ = buffer;
     Clear();
   }
 
+  // For FxEngine<kDynamicSize>. buffer_size must be a power of 2 (at least
+  // 2 * kGuardSize with RING_MIRRORED), and buffer holds
+  // StorageSize(buffer_size) samples. If `zeroed`, the buffer is already
+  // silent and is not cleared, so its pages are left untouched.
+  void Init(T* buffer, size_t buffer_size, bool zeroed = false) {
+    STATIC_ASSERT(size == kDynamicSize, buffer_size_is_fixed);
+    STATIC_ASSERT(ring != RING_PACKED, packed_rings_required);
+    buffer_ = buffer;
+    mask_ = static_cast<int32_t>(buffer_size) - 1;
+    zeroed ? Rewind() : Clear();
+  }
+
+  // Silences the delay memory and rewinds the write pointer and LFOs, so the
+  // engine runs exactly as it did after Init().
   void Clear() {
-    std::fill(&buffer_[0], &buffer_[size], T(0));
+    std::fill(&buffer_[0], &buffer_[StorageSize(buffer_size())], T(0));
+    Rewind();
+  }
+
+  // Same as Clear(), in constant time: the delay memory is left as it is,
+  // and reads return zero until the lines have been written over up to the
+  // offset they read. Every line is written once per sample, so a read at
+  // offset n is valid once n + 1 samples have run since. The cost is a
+  // compare per read, and a slower path in the blocks that reach samples
+  // not yet written.
+  void Invalidate() {
+    Rewind();
+    written_ = 0;
+  }
+
+  // Rewinds the write pointer and LFOs only, over silent delay memory.
+  void Rewind() {
     write_ptr_ = 0;
+    std::fill(&heads_[0], &heads_[kMaxLines], 0);
+    lfo_.Start();
+    written_ = settled();
+  }
+
+  // Samples of delay memory: the ring, or all the rings with RING_PACKED.
+  inline size_t buffer_size() const {
+    return ring == RING_PACKED ? packed_size_ : static_cast<size_t>(mask()) + 1;
+  }
+
+  // Running state other than the delay memory: write positions, LFOs, and
+  // samples written since Invalidate().
+  struct State {
+    int32_t write_ptr;
+    int32_t written;
+    int32_t heads[kMaxLines];
+    LFOPair::State lfo;
+  };
+
+  void SaveState(State* state) const {
+    state->write_ptr = write_ptr_;
+    state->written = written_;
+    std::copy(&heads_[0], &heads_[kMaxLines], &state->heads[0]);
+    lfo_.Save(&state->lfo);
+  }
+
+  void RestoreState(const State& state) {
+    write_ptr_ = state.write_ptr & mask();
+    written_ = std::clamp(state.written, 0, settled());
+    std::copy(&state.heads[0], &state.heads[kMaxLines], &heads_[0]);
+    lfo_.Restore(state.lfo);
+  }
+
+  // The d.length + 1 samples of d that later reads can reach (offsets 0 to
+  // d.length from the current write position), newest first, as reads see
+  // them. Lines laid out by Allocate() hold nothing else, so saving these
+  // for every line and restoring them, after RestoreState(), over zeroed
+  // memory gives the engine back exactly.
+  template<typename D>
+  void SaveLine(const D& d, T* out) const {
+    const Cursor c = cursor();
+    for (int32_t offset = 0; offset <= d.length; ++offset) {
+      out[offset] = c.Fetch(d, offset);
+    }
+  }
+
+  template<typename D>
+  void RestoreLine(const D& d, const T* in) {
+    Cursor c = cursor();
+    for (int32_t offset = 0; offset <= d.length; ++offset) {
+      c.Store(d, c.Position(d, offset), in[offset]);
+    }
+  }
+
+  // Silences d if any of the d.length + 1 samples reads can reach is not
+  // finite or reaches `limit` in magnitude. Returns true if it did.
+  template<typename D>
+  bool Sanitize(const D& d, float limit) {
+    Cursor c = cursor();
+    bool faulty = false;
+    for (int32_t offset = 0; offset <= d.length; ++offset) {
+      const float x = DataType<format>::Decompress(c.Fetch(d, offset));
+      faulty |= !(std::abs(x) < limit);
+    }
+    if (faulty) {
+      for (int32_t offset = 0; offset <= d.length; ++offset) {
+        c.Store(d, c.Position(d, offset), T(0));
+      }
+    }
+    return faulty;
   }
 
   struct Empty { };
@@ -140,10 +547,187 @@ class FxEngine {
     };
   };
 
-  class Context {
+  // Delay line whose length is chosen at runtime. Accepted wherever a
+  // DelayLine is.
+  struct DynamicDelayLine {
+    int32_t base;
+    int32_t length;
+    // Position in the list given to Allocate(), which picks the ring of a
+    // RING_PACKED line.
+    int32_t line = 0;
+  };
+
+  // Runtime counterpart of Reserve: lays out num_lines delay lines of the
+  // given lengths one after the other, exactly as DelayLine<Memory, i> would,
+  // and returns the number of buffer samples they span. With RING_PACKED,
+  // each line gets its own ring instead, and the return value is the size of
+  // the buffer to give to Init(). At most kMaxLines lines.
+  static int32_t Allocate(
+      const int32_t* lengths, size_t num_lines, DynamicDelayLine* lines) {
+    if constexpr (ring == RING_PACKED) {
+      constexpr int32_t kAlignment = static_cast<int32_t>(kCacheLineSize / sizeof(T));
+      int32_t base = 0;
+      for (size_t i = 0; i < num_lines; ++i) {
+        base = (base + kAlignment - 1) / kAlignment * kAlignment;
+        lines[i].base = base;
+        lines[i].length = lengths[i];
+        lines[i].line = static_cast<int32_t>(i);
+        base += PackedRingSize(lengths[i]) + static_cast<int32_t>(kGuardSize);
+      }
+      return base;
+    } else {
+      int32_t base = 0;
+      for (size_t i = 0; i < num_lines; ++i) {
+        lines[i].base = base;
+        lines[i].length = lengths[i];
+        lines[i].line = static_cast<int32_t>(i);
+        base += lengths[i] + 1;
+      }
+      return num_lines ? base - 1 : 0;
+    }
+  }
+
+  // For RING_PACKED. lines were laid out by Allocate(), and buffer holds the
+  // number of samples it returned, ideally aligned to kCacheLineSize. As
+  // above, a `zeroed` buffer is not cleared.
+  void Init(T* buffer, const DynamicDelayLine* lines, size_t num_lines,
+            bool zeroed = false) {
+    STATIC_ASSERT(ring == RING_PACKED, packed_rings_only);
+    buffer_ = buffer;
+    // The write position only paces the LFOs, which step every 32 samples.
+    mask_ = 31;
+    num_lines_ = std::min(num_lines, kMaxLines);
+    packed_size_ = 0;
+    for (size_t i = 0; i < num_lines_; ++i) {
+      ring_size_[i] = PackedRingSize(lines[i].length);
+      packed_size_ = static_cast<size_t>(lines[i].base + ring_size_[i]) + kGuardSize;
+    }
+    zeroed ? Rewind() : Clear();
+  }
+
+ private:
+  // Addressing of the delay memory, shared by Context and BlockContext.
+  // Positions are counted in the ring holding a line: the buffer shared by
+  // all lines, or the line's own ring with RING_PACKED.
+  class Cursor {
+   public:
+    Cursor()
+        : buffer_(nullptr),
+          heads_(nullptr),
+          write_ptr_(0),
+          mask_(kMask),
+          written_(0) { }
+
+    inline int32_t mask() const {
+      return size == kDynamicSize ? mask_ : kMask;
+    }
+
+    // Ring position of d's first sample (offset 0) for the current sample.
+    template<typename D>
+    inline int32_t Origin(const D& d) const {
+      if constexpr (ring == RING_PACKED) {
+        return heads_[d.line];
+      } else {
+        return write_ptr_ + d.base;
+      }
+    }
+
+    template<typename D>
+    inline int32_t RingStart(const D& d) const {
+      if constexpr (ring == RING_PACKED) {
+        return d.base;
+      } else {
+        return 0;
+      }
+    }
+
+    template<typename D>
+    inline int32_t RingSize(const D& d) const {
+      if constexpr (ring == RING_PACKED) {
+        return PackedRingSize(d.length);
+      } else {
+        return mask() + 1;
+      }
+    }
+
+    // Buffer index of ring position t. A packed ring takes t within one ring
+    // size on either side of it.
+    template<typename D>
+    inline int32_t Wrap(const D& d, int32_t t) const {
+      if constexpr (ring == RING_PACKED) {
+        const int32_t n = PackedRingSize(d.length);
+        t += t < 0 ? n : 0;
+        t -= t >= n ? n : 0;
+        return d.base + t;
+      } else {
+        return t & mask();
+      }
+    }
+
+    // Buffer index of d's sample at offset (not negative with RING_PACKED)
+    // for the current sample. Cheaper than Wrap(d, Origin(d) + offset).
+    template<typename D>
+    inline int32_t Position(const D& d, int32_t offset) const {
+      if constexpr (ring == RING_PACKED) {
+        const int32_t n = PackedRingSize(d.length);
+        int32_t t = heads_[d.line] + offset;
+        t -= t >= n ? n : 0;
+        return d.base + t;
+      } else {
+        return (write_ptr_ + d.base + offset) & mask();
+      }
+    }
+
+    // Buffer index of the ring position after t, contiguous with a guard
+    // zone.
+    template<typename D>
+    inline int32_t Next(const D& d, int32_t t) const {
+      return kGuardSize ? Wrap(d, t) + 1 : Wrap(d, t + 1);
+    }
+
+    // True when the sample at offset was written since Invalidate().
+    inline bool Written(int32_t offset) const {
+      return offset < written_;
+    }
+
+    // d's sample at offset, or silence if it was not written since
+    // Invalidate().
+    template<typename D>
+    inline T Fetch(const D& d, int32_t offset) const {
+      const T value = buffer_[Position(d, offset)];
+      return Written(offset) ? value : T(0);
+    }
+
+    template<typename D>
+    inline void Store(const D& d, int32_t index, T value) {
+      buffer_[index] = value;
+      if (kGuardSize &&
+          index - RingStart(d) < static_cast<int32_t>(kGuardSize)) {
+        buffer_[index + RingSize(d)] = value;
+      }
+    }
+
+    T* buffer_;
+    const int32_t* heads_;
+    int32_t write_ptr_;
+    int32_t mask_;
+    // Samples written since Invalidate(), counting the current one (for
+    // BlockContext, the first of the block); see FxEngine::settled().
+    int32_t written_;
+  };
+
+ public:
+  class PairContext;
+
+  class Context : private Cursor {
    friend class FxEngine;
+   friend class PairContext;
    public:
-    Context() : accumulator_(0.0f), previous_read_(0.0f), lfo_value_{0.0f, 0.0f}, buffer_(nullptr), write_ptr_(0) { }
+    // Runs two symmetric chains for the rest of the sample (see
+    // PairContext).
+    typedef typename FxEngine::PairContext Pair;
+
+    Context() : accumulator_(0.0f), previous_read_(0.0f), lfo_value_{0.0f, 0.0f} { }
     ~Context() { }
 
     inline void Load(float value) {
@@ -169,12 +753,12 @@ class FxEngine {
 
     template<typename D>
     inline void Write(D& d, int32_t offset, float scale) {
-      STATIC_ASSERT(D::base + D::length <= size, delay_memory_full);
+      STATIC_ASSERT(Fits<D>(), delay_memory_full);
       T w = DataType<format>::Compress(accumulator_);
       if (offset == -1) {
-        buffer_[(write_ptr_ + D::base + D::length - 1) & MASK] = w;
+        Store(d, Position(d, d.length - 1), w);
       } else {
-        buffer_[(write_ptr_ + D::base + offset) & MASK] = w;
+        Store(d, Position(d, offset), w);
       }
       accumulator_ *= scale;
     }
@@ -195,14 +779,26 @@ class FxEngine {
       WriteAllPass(d, 0, scale);
     }
 
+    // Equivalent to Read(d TAIL, read_scale) followed by
+    // WriteAllPass(d, write_scale), without the round trip through
+    // previous_read_.
+    template<typename D>
+    inline void AllPass(D& d, float read_scale, float write_scale) {
+      STATIC_ASSERT(Fits<D>(), delay_memory_full);
+      float r = DataType<format>::Decompress(Fetch(d, d.length - 1));
+      accumulator_ += r * read_scale;
+      Store(d, Position(d, 0), DataType<format>::Compress(accumulator_));
+      accumulator_ = accumulator_ * write_scale + r;
+    }
+
     template<typename D>
     inline void Read(D& d, int32_t offset, float scale) {
-      STATIC_ASSERT(D::base + D::length <= size, delay_memory_full);
+      STATIC_ASSERT(Fits<D>(), delay_memory_full);
       T r;
       if (offset == -1) {
-        r = buffer_[(write_ptr_ + D::base + D::length - 1) & MASK];
+        r = Fetch(d, d.length - 1);
       } else {
-        r = buffer_[(write_ptr_ + D::base + offset) & MASK];
+        r = Fetch(d, offset);
       }
       float r_f = DataType<format>::Decompress(r);
       previous_read_ = r_f;
@@ -226,12 +822,16 @@ class FxEngine {
 
     template<typename D>
     inline void Interpolate(D& d, float offset, float scale) {
-      STATIC_ASSERT(D::base + D::length <= size, delay_memory_full);
+      STATIC_ASSERT(Fits<D>(), delay_memory_full);
       MAKE_INTEGRAL_FRACTIONAL(offset);
+      const int32_t p = Position(d, offset_integral);
+      const T a_stored = buffer_[p];
+      const T b_stored =
+          buffer_[kGuardSize ? p + 1 : Position(d, offset_integral + 1)];
       float a = DataType<format>::Decompress(
-          buffer_[(write_ptr_ + offset_integral + D::base) & MASK]);
+          Written(offset_integral) ? a_stored : T(0));
       float b = DataType<format>::Decompress(
-          buffer_[(write_ptr_ + offset_integral + D::base + 1) & MASK]);
+          Written(offset_integral + 1) ? b_stored : T(0));
       float x = a + (b - a) * offset_fractional;
       previous_read_ = x;
       accumulator_ += x * scale;
@@ -240,59 +840,570 @@ class FxEngine {
     template<typename D>
     inline void Interpolate(
         D& d, float offset, LFOIndex index, float amplitude, float scale) {
-      STATIC_ASSERT(D::base + D::length <= size, delay_memory_full);
+      STATIC_ASSERT(Fits<D>(), delay_memory_full);
       offset += amplitude * lfo_value_[index];
       MAKE_INTEGRAL_FRACTIONAL(offset);
+      const int32_t p = Position(d, offset_integral);
+      const T a_stored = buffer_[p];
+      const T b_stored =
+          buffer_[kGuardSize ? p + 1 : Position(d, offset_integral + 1)];
       float a = DataType<format>::Decompress(
-          buffer_[(write_ptr_ + offset_integral + D::base) & MASK]);
+          Written(offset_integral) ? a_stored : T(0));
       float b = DataType<format>::Decompress(
-          buffer_[(write_ptr_ + offset_integral + D::base + 1) & MASK]);
+          Written(offset_integral + 1) ? b_stored : T(0));
       float x = a + (b - a) * offset_fractional;
       previous_read_ = x;
       accumulator_ += x * scale;
     }
 
    private:
+    using Cursor::buffer_;
+    using Cursor::heads_;
+    using Cursor::write_ptr_;
+    using Cursor::mask_;
+    using Cursor::written_;
+    using Cursor::Position;
+    using Cursor::Written;
+    using Cursor::Fetch;
+    using Cursor::Store;
+
     float accumulator_;
     float previous_read_;
     float lfo_value_[2];
-    T* buffer_;
-    int32_t write_ptr_;
 
     DISALLOW_COPY_AND_ASSIGN(Context);
   };
 
+  // Runs two chains of Context operations in lockstep, one in each lane of
+  // a Lanes<2>: the same operations on different lines and with different
+  // constants, as in the symmetric branches of a figure-of-eight tank. Each
+  // lane computes exactly what a Context running its chain would, and the
+  // two dependency chains are interleaved operation by operation. Picks up
+  // the position and LFOs of a started Context, and may run for the rest of
+  // its sample.
+  class PairContext : private Cursor {
+   public:
+    typedef Lanes<2> L;
+
+    explicit PairContext(const Context& c)
+        : accumulator_(0.0f),
+          previous_read_(0.0f),
+          lfo_value_{ c.lfo_value_[0], c.lfo_value_[1] } {
+      buffer_ = c.buffer_;
+      heads_ = c.heads_;
+      write_ptr_ = c.write_ptr_;
+      mask_ = c.mask_;
+      written_ = c.written_;
+    }
+    ~PairContext() { }
+
+    inline void Load(const L& value) {
+      accumulator_ = value;
+    }
+
+    inline void Write(L& value) {
+      value = accumulator_;
+    }
+
+    inline void Write(L& value, const L& scale) {
+      value = accumulator_;
+      accumulator_ *= scale;
+    }
+
+    inline void Write(float& value_0, float& value_1) {
+      value_0 = accumulator_[0];
+      value_1 = accumulator_[1];
+    }
+
+    // Writes lane 0 to the head of d0, lane 1 to the head of d1.
+    template<typename D0, typename D1>
+    inline void Write(D0& d0, D1& d1, const L& scale) {
+      STATIC_ASSERT(Fits<D0>() && Fits<D1>(), delay_memory_full);
+      Store(d0, Position(d0, 0), DataType<format>::Compress(accumulator_[0]));
+      Store(d1, Position(d1, 0), DataType<format>::Compress(accumulator_[1]));
+      accumulator_ *= scale;
+    }
+
+    // Context::AllPass() on d0 in lane 0 and on d1 in lane 1.
+    template<typename D0, typename D1>
+    inline void AllPass(D0& d0, D1& d1, const L& read_scale, const L& write_scale) {
+      STATIC_ASSERT(Fits<D0>() && Fits<D1>(), delay_memory_full);
+      const L r(
+          DataType<format>::Decompress(Fetch(d0, d0.length - 1)),
+          DataType<format>::Decompress(Fetch(d1, d1.length - 1)));
+      accumulator_ += r * read_scale;
+      Store(d0, Position(d0, 0), DataType<format>::Compress(accumulator_[0]));
+      Store(d1, Position(d1, 0), DataType<format>::Compress(accumulator_[1]));
+      accumulator_ = accumulator_ * write_scale + r;
+    }
+
+    inline void Lp(L& state, const L& coefficient) {
+      state += coefficient * (accumulator_ - state);
+      accumulator_ = state;
+    }
+
+    // Context::Interpolate() with an LFO, on d0 modulated by index0 in lane 0
+    // and on d1 modulated by index1 in lane 1.
+    template<typename D0, typename D1>
+    inline void Interpolate(
+        D0& d0, D1& d1, const L& offset, LFOIndex index0, LFOIndex index1,
+        const L& amplitude, const L& scale) {
+      STATIC_ASSERT(Fits<D0>() && Fits<D1>(), delay_memory_full);
+      const float position_0 = offset[0] + amplitude[0] * lfo_value_[index0];
+      const float position_1 = offset[1] + amplitude[1] * lfo_value_[index1];
+      const L position(position_0, position_1);
+      const int32_t integral_0 = static_cast<int32_t>(position_0);
+      const int32_t integral_1 = static_cast<int32_t>(position_1);
+      const int32_t p0 = Position(d0, integral_0);
+      const int32_t p1 = Position(d1, integral_1);
+      const T a_0 = buffer_[p0];
+      const T a_1 = buffer_[p1];
+      const T b_0 = buffer_[kGuardSize ? p0 + 1 : Position(d0, integral_0 + 1)];
+      const T b_1 = buffer_[kGuardSize ? p1 + 1 : Position(d1, integral_1 + 1)];
+      const L a(
+          DataType<format>::Decompress(Written(integral_0) ? a_0 : T(0)),
+          DataType<format>::Decompress(Written(integral_1) ? a_1 : T(0)));
+      const L b(
+          DataType<format>::Decompress(Written(integral_0 + 1) ? b_0 : T(0)),
+          DataType<format>::Decompress(Written(integral_1 + 1) ? b_1 : T(0)));
+      const L fractional = position - L(
+          static_cast<float>(integral_0), static_cast<float>(integral_1));
+      const L x = a + (b - a) * fractional;
+      previous_read_ = x;
+      accumulator_ += x * scale;
+    }
+
+   private:
+    using Cursor::buffer_;
+    using Cursor::heads_;
+    using Cursor::write_ptr_;
+    using Cursor::mask_;
+    using Cursor::written_;
+    using Cursor::Position;
+    using Cursor::Written;
+    using Cursor::Fetch;
+    using Cursor::Store;
+
+    L accumulator_;
+    L previous_read_;
+    float lfo_value_[2];
+
+    DISALLOW_COPY_AND_ASSIGN(PairContext);
+  };
+
+  // Block-major counterpart of Context. Instead of running the whole network
+  // once per sample, each operation runs over every sample of a block before
+  // the next operation starts, so that every stage is a short loop over a
+  // single delay line. Per-sample values flow between stages through plain
+  // float arrays ("io"), which play the role of the accumulator.
+  //
+  // Sample i of the block uses the write position Start() would have used for
+  // it, and the LFO values are those Start() would have produced, so the
+  // result matches the per-sample path exactly. The only requirement is on
+  // the caller: a stage must not read, within the same block, a sample that a
+  // later stage writes. In other words, blocks must not be longer than the
+  // shortest feedback path that crosses stages.
+  //
+  // Coefficients and scales can be given per sample (see CoefficientAt()).
+  class BlockContext : private Cursor {
+   friend class FxEngine;
+   public:
+    BlockContext() : size_(0) {
+      heads_ = block_heads_;
+    }
+    ~BlockContext() { }
+
+    inline size_t block_size() const { return size_; }
+
+    // Equivalent to Read(d TAIL, coefficient) followed by
+    // WriteAllPass(d, -coefficient) on each sample.
+    template<typename D, typename C>
+    inline void AllPass(D& d, float* io, C coefficient) {
+      STATIC_ASSERT(Fits<D>(), delay_memory_full);
+      const int32_t w = Origin(d);
+      const int32_t n = static_cast<int32_t>(size_);
+      if (!Written(d.length - 1)) {
+        // Reads samples not written since Invalidate().
+        for (int32_t i = 0; i < n; ++i) {
+          const float k = CoefficientAt(coefficient, i);
+          float r = Written(d.length - 1 - i) ? DataType<format>::Decompress(
+              buffer_[Wrap(d, w - i + d.length - 1)]) : 0.0f;
+          float a = io[i] + r * k;
+          Store(d, Wrap(d, w - i), DataType<format>::Compress(a));
+          io[i] = a * -k + r;
+        }
+      } else if (kCompact && n < d.length) {
+        // The block never reads what it writes: decompress the read span,
+        // run the filter on floats and compress the written span in bulk.
+        // Spans are in address order, which is reverse sample order.
+        float r[kMaxBlockSize];
+        float a[kMaxBlockSize];
+        Gather(d, w - n + d.length, r, size_);
+        for (int32_t i = 0; i < n; ++i) {
+          const float k = CoefficientAt(coefficient, i);
+          const float x = r[n - 1 - i];
+          const float y = io[i] + x * k;
+          a[n - 1 - i] = y;
+          io[i] = y * -k + x;
+        }
+        Scatter(d, a, w - n + 1, size_);
+      } else if (n < d.length &&
+                 Contiguous(d, w - n + 1, w) &&
+                 Contiguous(d, w - n + d.length, w + d.length - 1)) {
+        // Common case: neither span wraps and the block never reads what it
+        // writes, so the loop runs over plain (descending) pointers.
+        const int32_t start = Wrap(d, w - n + 1);
+        T* write = &buffer_[start] + (n - 1);
+        const T* read = &buffer_[Wrap(d, w - n + d.length)] + (n - 1);
+        for (int32_t i = 0; i < n; ++i) {
+          const float k = CoefficientAt(coefficient, i);
+          float r = DataType<format>::Decompress(read[-i]);
+          float a = io[i] + r * k;
+          write[-i] = DataType<format>::Compress(a);
+          io[i] = a * -k + r;
+        }
+        Sync(d, start, n);
+      } else {
+        for (int32_t i = 0; i < n; ++i) {
+          const float k = CoefficientAt(coefficient, i);
+          float r = DataType<format>::Decompress(buffer_[Wrap(d, w - i + d.length - 1)]);
+          float a = io[i] + r * k;
+          Store(d, Wrap(d, w - i), DataType<format>::Compress(a));
+          io[i] = a * -k + r;
+        }
+      }
+    }
+
+    // Equivalent to Interpolate(d, offset, index, amplitude, scale) on each
+    // sample, accumulating into io.
+    template<typename D, typename C>
+    inline void Interpolate(
+        D& d, float* io, float offset, LFOIndex index, float amplitude, C scale) {
+      STATIC_ASSERT(Fits<D>(), delay_memory_full);
+      const float* lfo = lfo_value_[index];
+      const int32_t w = Origin(d);
+      const int32_t n = static_cast<int32_t>(size_);
+      int32_t integral[kMaxBlockSize];
+      float fractional[kMaxBlockSize];
+      for (int32_t i = 0; i < n; ++i) {
+        float o = offset + amplitude * lfo[i];
+        MAKE_INTEGRAL_FRACTIONAL(o);
+        integral[i] = o_integral;
+        fractional[i] = o_fractional;
+      }
+      // The LFO moves by a small fraction of a sample per sample, so the
+      // integral part of the delay holds for long runs, during which the
+      // read is a plain span.
+      int32_t i = 0;
+      while (i < n) {
+        const int32_t o_integral = integral[i];
+        int32_t end = i + 1;
+        while (end < n && integral[end] == o_integral) {
+          ++end;
+        }
+        // Ring positions read by samples end - 1 down to i.
+        const int32_t first = w - (end - 1) + o_integral;
+        const int32_t last = w - i + o_integral + 1;
+        if (!Written(o_integral + 1 - i)) {
+          // Reads samples not written since Invalidate().
+          for (; i < end; ++i) {
+            const int32_t t = w - i + o_integral;
+            float a = Written(o_integral - i) ?
+                DataType<format>::Decompress(buffer_[Wrap(d, t)]) : 0.0f;
+            float b = Written(o_integral + 1 - i) ?
+                DataType<format>::Decompress(buffer_[Next(d, t)]) : 0.0f;
+            io[i] += (a + (b - a) * fractional[i]) * CoefficientAt(scale, i);
+          }
+        } else if (kCompact) {
+          float span[kMaxBlockSize + 1];
+          Gather(d, first, span, static_cast<size_t>(last - first + 1));
+          const float* p = &span[end - 1];
+          for (; i < end; ++i) {
+            float a = p[-i];
+            float b = p[1 - i];
+            io[i] += (a + (b - a) * fractional[i]) * CoefficientAt(scale, i);
+          }
+        } else if (Contiguous(d, first, last)) {
+          const T* p = &buffer_[Wrap(d, first)] + (end - 1);
+          for (; i < end; ++i) {
+            float a = DataType<format>::Decompress(p[-i]);
+            float b = DataType<format>::Decompress(p[1 - i]);
+            io[i] += (a + (b - a) * fractional[i]) * CoefficientAt(scale, i);
+          }
+        } else {
+          for (; i < end; ++i) {
+            const int32_t t = w - i + o_integral;
+            float a = DataType<format>::Decompress(buffer_[Wrap(d, t)]);
+            float b = DataType<format>::Decompress(buffer_[Next(d, t)]);
+            io[i] += (a + (b - a) * fractional[i]) * CoefficientAt(scale, i);
+          }
+        }
+      }
+    }
+
+    template<typename C>
+    inline void Lp(float* io, float& state, C coefficient) {
+      float s = state;
+      for (size_t i = 0; i < size_; ++i) {
+        s += CoefficientAt(coefficient, i) * (io[i] - s);
+        io[i] = s;
+      }
+      state = s;
+    }
+
+    // Two independent filters in one loop. Each recursion is latency bound,
+    // so interleaving them hides half of the cost.
+    template<typename C>
+    inline void Lp(
+        float* io_1, float& state_1, float* io_2, float& state_2, C coefficient) {
+      float s_1 = state_1;
+      float s_2 = state_2;
+      for (size_t i = 0; i < size_; ++i) {
+        const float k = CoefficientAt(coefficient, i);
+        s_1 += k * (io_1[i] - s_1);
+        s_2 += k * (io_2[i] - s_2);
+        io_1[i] = s_1;
+        io_2[i] = s_2;
+      }
+      state_1 = s_1;
+      state_2 = s_2;
+    }
+
+    // Equivalent to Write(d, scale) on each sample.
+    template<typename D>
+    inline void Write(D& d, float* io, float scale) {
+      STATIC_ASSERT(Fits<D>(), delay_memory_full);
+      const int32_t w = Origin(d);
+      const int32_t n = static_cast<int32_t>(size_);
+      if (kCompact) {
+        float a[kMaxBlockSize];
+        for (int32_t i = 0; i < n; ++i) {
+          a[n - 1 - i] = io[i];
+          io[i] *= scale;
+        }
+        Scatter(d, a, w - n + 1, size_);
+      } else if (Contiguous(d, w - n + 1, w)) {
+        const int32_t start = Wrap(d, w - n + 1);
+        T* write = &buffer_[start] + (n - 1);
+        for (int32_t i = 0; i < n; ++i) {
+          write[-i] = DataType<format>::Compress(io[i]);
+          io[i] *= scale;
+        }
+        Sync(d, start, n);
+      } else {
+        for (int32_t i = 0; i < n; ++i) {
+          Store(d, Wrap(d, w - i), DataType<format>::Compress(io[i]));
+          io[i] *= scale;
+        }
+      }
+    }
+
+   private:
+    using Cursor::buffer_;
+    using Cursor::heads_;
+    using Cursor::write_ptr_;
+    using Cursor::mask_;
+    using Cursor::written_;
+    using Cursor::Written;
+    using Cursor::Origin;
+    using Cursor::RingStart;
+    using Cursor::RingSize;
+    using Cursor::Wrap;
+    using Cursor::Next;
+    using Cursor::Store;
+
+    // True when ring positions first..last can be accessed through a plain
+    // pointer: they do not wrap around the end of the ring, or they end in
+    // the guard zone. Always true for blocks with a guard zone.
+    template<typename D>
+    inline bool Contiguous(const D& d, int32_t first, int32_t last) const {
+      return Wrap(d, first) - RingStart(d) + (last - first) <
+          RingSize(d) + static_cast<int32_t>(kGuardSize);
+    }
+
+    // After the n samples from buffer index start on were written in place,
+    // copies those that fall in the mirrored head of the ring or in the
+    // guard zone to their other copy.
+    template<typename D>
+    inline void Sync(const D& d, int32_t start, int32_t n) {
+      if (!kGuardSize) {
+        return;
+      }
+      const int32_t ring_start = RingStart(d);
+      const int32_t ring_size = RingSize(d);
+      const int32_t guard_end = ring_start + static_cast<int32_t>(kGuardSize);
+      const int32_t end = start + n;
+      if (start < guard_end) {
+        std::copy(
+            &buffer_[start], &buffer_[std::min(end, guard_end)],
+            &buffer_[start + ring_size]);
+      }
+      if (end > ring_start + ring_size) {
+        const int32_t from = std::max(start, ring_start + ring_size);
+        std::copy(&buffer_[from], &buffer_[end], &buffer_[from - ring_size]);
+      }
+    }
+
+    // Decompresses the n samples from ring position `first` on, and
+    // compresses n samples to them, wrapping around the end of the ring.
+    template<typename D>
+    inline void Gather(const D& d, int32_t first, float* out, size_t n) const {
+      const int32_t start = Wrap(d, first);
+      const size_t head = std::min(n, static_cast<size_t>(
+          RingStart(d) + RingSize(d) + static_cast<int32_t>(kGuardSize) - start));
+      DataType<format>::DecompressN(&buffer_[start], out, head);
+      DataType<format>::DecompressN(&buffer_[RingStart(d)], out + head, n - head);
+    }
+
+    template<typename D>
+    inline void Scatter(const D& d, const float* in, int32_t first, size_t n) {
+      const int32_t start = Wrap(d, first);
+      const size_t head = std::min(n, static_cast<size_t>(
+          RingStart(d) + RingSize(d) + static_cast<int32_t>(kGuardSize) - start));
+      DataType<format>::CompressN(in, &buffer_[start], head);
+      DataType<format>::CompressN(in + head, &buffer_[RingStart(d)], n - head);
+      Sync(d, start, static_cast<int32_t>(head));
+    }
+
+    // Compact formats go through Gather() and Scatter(), so that conversions
+    // run over whole spans. Floats are read and written in place.
+    static constexpr bool kCompact = !std::is_same<T, float>::value;
+
+    size_t size_;
+    float lfo_value_[2][kMaxBlockSize];
+    // Ring positions of the first sample of the block, with RING_PACKED.
+    int32_t block_heads_[kMaxLines];
+
+    DISALLOW_COPY_AND_ASSIGN(BlockContext);
+  };
+
   inline void SetLFOFrequency(LFOIndex index, float frequency) {
-    lfo_[index].template Init<stmlib::COSINE_OSCILLATOR_APPROXIMATE>(
-        frequency * 32.0f);
+    lfo_.Init(index, frequency);
   }
 
+  // The LFOs step on the samples whose write position is a multiple of
+  // LFOPair::kPeriod.
   inline void Start(Context* c) {
-    --write_ptr_;
-    if (write_ptr_ < 0) {
-      write_ptr_ += size;
+    write_ptr_ = (write_ptr_ - 1) & mask();
+    written_ = std::min(written_ + 1, settled());
+    if constexpr (ring == RING_PACKED) {
+      AdvanceHeads(1);
     }
+    const int32_t phase = -write_ptr_ & (LFOPair::kPeriod - 1);
+    lfo_.Tick(phase == 0);
     c->accumulator_ = 0.0f;
     c->previous_read_ = 0.0f;
     c->buffer_ = buffer_;
+    c->heads_ = heads_;
     c->write_ptr_ = write_ptr_;
-    if ((write_ptr_ & 31) == 0) {
-      c->lfo_value_[0] = lfo_[0].Next();
-      c->lfo_value_[1] = lfo_[1].Next();
-    } else {
-      c->lfo_value_[0] = lfo_[0].value();
-      c->lfo_value_[1] = lfo_[1].value();
+    c->mask_ = mask_;
+    c->written_ = written_;
+    c->lfo_value_[0] = lfo_.value(LFO_1, phase);
+    c->lfo_value_[1] = lfo_.value(LFO_2, phase);
+  }
+
+  // Advances the engine by `block_size` samples (at most kMaxBlockSize) and
+  // prepares c for processing them.
+  inline void StartBlock(BlockContext* c, size_t block_size) {
+    c->buffer_ = buffer_;
+    c->write_ptr_ = write_ptr_ - 1;
+    c->mask_ = mask_;
+    c->written_ = std::min(written_ + 1, settled());
+    c->size_ = block_size;
+    written_ = std::min(written_ + static_cast<int32_t>(block_size), settled());
+    if constexpr (ring == RING_PACKED) {
+      for (size_t k = 0; k < num_lines_; ++k) {
+        c->block_heads_[k] = heads_[k] - 1;
+      }
+      AdvanceHeads(static_cast<int32_t>(block_size));
+    }
+    // The LFO trajectories, exactly as Start() would produce them, one
+    // stretch between steps at a time.
+    size_t i = 0;
+    while (i < block_size) {
+      write_ptr_ = (write_ptr_ - 1) & mask();
+      const int32_t phase = -write_ptr_ & (LFOPair::kPeriod - 1);
+      lfo_.Tick(phase == 0);
+      const size_t run = std::min(
+          static_cast<size_t>(LFOPair::kPeriod - phase), block_size - i);
+      float* lfo_1 = &c->lfo_value_[0][i];
+      float* lfo_2 = &c->lfo_value_[1][i];
+      for (size_t j = 0; j < run; ++j) {
+        lfo_1[j] = lfo_.value(LFO_1, phase + static_cast<int32_t>(j));
+        lfo_2[j] = lfo_.value(LFO_2, phase + static_cast<int32_t>(j));
+      }
+      write_ptr_ = (write_ptr_ - static_cast<int32_t>(run - 1)) & mask();
+      i += run;
     }
   }
 
  private:
-  enum {
-    MASK = size - 1
-  };
+  // Buffer mask for a compile-time size. Dynamic engines use mask_.
+  static constexpr int32_t kMask = static_cast<int32_t>(size) - 1;
+
+  // Ring size of a RING_PACKED line: one more sample than its length, as
+  // between lines sharing a ring, and at least a block, so that positions
+  // within a block wrap at most once.
+  static constexpr int32_t PackedRingSize(int32_t length) {
+    return std::max(length + 1, static_cast<int32_t>(kMaxBlockSize));
+  }
+
+  inline int32_t mask() const {
+    return size == kDynamicSize ? mask_ : kMask;
+  }
+
+  // Samples written since Invalidate() after which every offset a line can
+  // read has been written over. Counts stop there.
+  inline int32_t settled() const {
+    return static_cast<int32_t>(buffer_size());
+  }
+
+  // Addressing at the current write position.
+  inline Cursor cursor() const {
+    Cursor c;
+    c.buffer_ = buffer_;
+    c.heads_ = heads_;
+    c.write_ptr_ = write_ptr_;
+    c.mask_ = mask_;
+    c.written_ = written_;
+    return c;
+  }
+
+  // Moves the write position of every RING_PACKED line n (at most
+  // kMaxBlockSize) samples back.
+  inline void AdvanceHeads(int32_t n) {
+    for (size_t k = 0; k < num_lines_; ++k) {
+      const int32_t h = heads_[k] - n;
+      heads_[k] = h < 0 ? h + ring_size_[k] : h;
+    }
+  }
+
+  // True when D's extent is known at compile time and fits in the buffer.
+  // Packed rings are only laid out at runtime.
+  template<typename D>
+  static constexpr bool Fits() {
+    if constexpr (std::is_same<std::remove_const_t<D>, DynamicDelayLine>::value) {
+      return true;
+    } else if constexpr (ring == RING_PACKED) {
+      return false;
+    } else if constexpr (size == kDynamicSize) {
+      return true;
+    } else {
+      return D::base + D::length <= static_cast<int32_t>(size);
+    }
+  }
 
   int32_t write_ptr_;
+  int32_t mask_;
   T* buffer_;
-  stmlib::CosineOscillator lfo_[2];
+  LFOPair lfo_;
+  int32_t written_;
+
+  // RING_PACKED state: write position and size of the ring of each line.
+  size_t num_lines_;
+  size_t packed_size_;
+  int32_t heads_[kMaxLines];
+  int32_t ring_size_[kMaxLines];
 
   DISALLOW_COPY_AND_ASSIGN(FxEngine);
 };
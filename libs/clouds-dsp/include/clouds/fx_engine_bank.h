@@ -0,0 +1,271 @@
+// FxEngineBank - lane-parallel variant of FxEngine.
+//
+// Runs `lanes` independent copies of the same delay network in the lanes of a
+// vector. The delay memory of all copies is interleaved, so that the samples
+// every copy reads or writes at a given position are adjacent and move in and
+// out of memory as one vector. Each lane has its own parameters, filter state
+// and LFO phase; only the write position is shared.
+//
+// The operations mirror FxEngine::Context one for one, with Lanes<> in place
+// of float, and each lane produces exactly what a FxEngine<size,
+// FORMAT_32_BIT> running the same program would.
+
+#ifndef CLOUDS_FX_ENGINE_BANK_H_
+#define CLOUDS_FX_ENGINE_BANK_H_
+
+#include <algorithm>
+#include <type_traits>
+
+#include "clouds/fx_engine.h"
+#include "clouds/lanes.h"
+#include "stmlib/stmlib.h"
+#include "stmlib/dsp/cosine_oscillator.h"
+
+namespace clouds {
+
+template<size_t size, size_t lanes>
+class FxEngineBank {
+ public:
+  typedef Lanes<lanes> L;
+
+  FxEngineBank() : write_ptr_(0), buffer_(nullptr) { }
+  ~FxEngineBank() { }
+
+  // buffer holds size * lanes floats, aligned to L::kAlignment. Sample t of
+  // lane k lives at buffer[t * lanes + k].
+  void Init(float* buffer) {
+    buffer_ = buffer;
+    Clear();
+  }
+
+  void Clear() {
+    std::fill(&buffer_[0], &buffer_[size * lanes], 0.0f);
+    write_ptr_ = 0;
+  }
+
+  // Clears the delay memory of a single lane.
+  void Clear(size_t lane) {
+    for (size_t i = 0; i < size; ++i) {
+      buffer_[i * lanes + lane] = 0.0f;
+    }
+  }
+
+  // Delay memory layout is described exactly as for FxEngine.
+  typedef FxEngine<size, FORMAT_32_BIT> Layout;
+  typedef typename Layout::Empty Empty;
+
+  template<int32_t l, typename Tail = Empty>
+  using Reserve = typename Layout::template Reserve<l, Tail>;
+
+  template<typename Memory, int32_t index>
+  using DelayLine = typename Layout::template DelayLine<Memory, index>;
+
+  // Lines chosen at runtime, laid out by Allocate() as for FxEngine; they
+  // must fit in `size` samples.
+  typedef typename Layout::DynamicDelayLine DynamicDelayLine;
+
+  static int32_t Allocate(
+      const int32_t* lengths, size_t num_lines, DynamicDelayLine* lines) {
+    return Layout::Allocate(lengths, num_lines, lines);
+  }
+
+  class Context {
+   friend class FxEngineBank;
+   public:
+    Context() : accumulator_(0.0f), previous_read_(0.0f), buffer_(nullptr), write_ptr_(0) {
+      lfo_value_[0] = 0.0f;
+      lfo_value_[1] = 0.0f;
+    }
+    ~Context() { }
+
+    inline void Load(const L& value) {
+      accumulator_ = value;
+    }
+
+    inline void Read(const L& value, const L& scale) {
+      accumulator_ += value * scale;
+    }
+
+    inline void Read(const L& value) {
+      accumulator_ += value;
+    }
+
+    inline void Write(L& value) {
+      value = accumulator_;
+    }
+
+    inline void Write(L& value, const L& scale) {
+      value = accumulator_;
+      accumulator_ *= scale;
+    }
+
+    template<typename D>
+    inline void Write(D& d, int32_t offset, const L& scale) {
+      STATIC_ASSERT(Fits<D>(), delay_memory_full);
+      if (offset == -1) {
+        accumulator_.Store(Slot(d.base + d.length - 1));
+      } else {
+        accumulator_.Store(Slot(d.base + offset));
+      }
+      accumulator_ *= scale;
+    }
+
+    template<typename D>
+    inline void Write(D& d, const L& scale) {
+      Write(d, 0, scale);
+    }
+
+    template<typename D>
+    inline void WriteAllPass(D& d, int32_t offset, const L& scale) {
+      Write(d, offset, scale);
+      accumulator_ += previous_read_;
+    }
+
+    template<typename D>
+    inline void WriteAllPass(D& d, const L& scale) {
+      WriteAllPass(d, 0, scale);
+    }
+
+    // Equivalent to Read(d TAIL, read_scale) followed by
+    // WriteAllPass(d, write_scale).
+    template<typename D>
+    inline void AllPass(D& d, const L& read_scale, const L& write_scale) {
+      STATIC_ASSERT(Fits<D>(), delay_memory_full);
+      L r = L::Load(Slot(d.base + d.length - 1));
+      accumulator_ += r * read_scale;
+      accumulator_.Store(Slot(d.base));
+      accumulator_ = accumulator_ * write_scale + r;
+    }
+
+    template<typename D>
+    inline void Read(D& d, int32_t offset, const L& scale) {
+      STATIC_ASSERT(Fits<D>(), delay_memory_full);
+      L r;
+      if (offset == -1) {
+        r = L::Load(Slot(d.base + d.length - 1));
+      } else {
+        r = L::Load(Slot(d.base + offset));
+      }
+      previous_read_ = r;
+      accumulator_ += r * scale;
+    }
+
+    template<typename D>
+    inline void Read(D& d, const L& scale) {
+      Read(d, 0, scale);
+    }
+
+    inline void Lp(L& state, const L& coefficient) {
+      state += coefficient * (accumulator_ - state);
+      accumulator_ = state;
+    }
+
+    inline void Hp(L& state, const L& coefficient) {
+      state += coefficient * (accumulator_ - state);
+      accumulator_ -= state;
+    }
+
+    // Modulated read. Every lane follows its own LFO, so the two taps of
+    // each lane are fetched separately.
+    template<typename D>
+    inline void Interpolate(
+        D& d, float offset, LFOIndex index, float amplitude, const L& scale) {
+      STATIC_ASSERT(Fits<D>(), delay_memory_full);
+      alignas(L::kAlignment) float position[lanes];
+      alignas(L::kAlignment) float a[lanes];
+      alignas(L::kAlignment) float b[lanes];
+      alignas(L::kAlignment) float fractional[lanes];
+      (L(offset) + L(amplitude) * lfo_value_[index]).Store(position);
+      for (size_t k = 0; k < lanes; ++k) {
+        int32_t integral = static_cast<int32_t>(position[k]);
+        fractional[k] = position[k] - static_cast<float>(integral);
+        int32_t t = write_ptr_ + integral + d.base;
+        a[k] = buffer_[static_cast<size_t>(t & MASK) * lanes + k];
+        b[k] = buffer_[static_cast<size_t>((t + 1) & MASK) * lanes + k];
+      }
+      L a_l = L::Load(a);
+      L x = a_l + (L::Load(b) - a_l) * L::Load(fractional);
+      previous_read_ = x;
+      accumulator_ += x * scale;
+    }
+
+   private:
+    inline float* Slot(int32_t offset) const {
+      return &buffer_[static_cast<size_t>((write_ptr_ + offset) & MASK) * lanes];
+    }
+
+    L accumulator_;
+    L previous_read_;
+    L lfo_value_[2];
+    float* buffer_;
+    int32_t write_ptr_;
+
+    DISALLOW_COPY_AND_ASSIGN(Context);
+  };
+
+  inline void SetLFOFrequency(LFOIndex index, float frequency) {
+    for (size_t k = 0; k < lanes; ++k) {
+      SetLFOFrequency(k, index, frequency);
+    }
+  }
+
+  inline void SetLFOFrequency(size_t lane, LFOIndex index, float frequency) {
+    lfo_[index][lane].template Init<stmlib::COSINE_OSCILLATOR_APPROXIMATE>(
+        frequency * LFOPair::kPeriod);
+    lfo_base_[index][lane] = lfo_[index][lane].value();
+    lfo_delta_[index][lane] = 0.0f;
+  }
+
+  inline void Start(Context* c) {
+    --write_ptr_;
+    if (write_ptr_ < 0) {
+      write_ptr_ += size;
+    }
+    c->accumulator_ = 0.0f;
+    c->previous_read_ = 0.0f;
+    c->buffer_ = buffer_;
+    c->write_ptr_ = write_ptr_;
+    // Same trajectory as LFOPair, lane by lane.
+    const int32_t phase = -write_ptr_ & (LFOPair::kPeriod - 1);
+    if (phase == 0) {
+      for (size_t i = 0; i < 2; ++i) {
+        for (size_t k = 0; k < lanes; ++k) {
+          lfo_base_[i][k] = lfo_[i][k].value();
+          lfo_delta_[i][k] = lfo_[i][k].Next() - lfo_base_[i][k];
+        }
+      }
+    }
+    const L ramp(static_cast<float>(phase) * (1.0f / LFOPair::kPeriod));
+    c->lfo_value_[0] = L::Load(lfo_base_[0]) + L::Load(lfo_delta_[0]) * ramp;
+    c->lfo_value_[1] = L::Load(lfo_base_[1]) + L::Load(lfo_delta_[1]) * ramp;
+  }
+
+ private:
+  enum {
+    MASK = size - 1
+  };
+
+  // True when D is laid out at runtime, or its extent, known at compile
+  // time, fits in the buffer.
+  template<typename D>
+  static constexpr bool Fits() {
+    if constexpr (std::is_same<std::remove_const_t<D>, DynamicDelayLine>::value) {
+      return true;
+    } else {
+      return D::base + D::length <= static_cast<int32_t>(size);
+    }
+  }
+
+  int32_t write_ptr_;
+  float* buffer_;
+  stmlib::CosineOscillator lfo_[2][lanes];
+  // Value before the last LFO step, and change at the last step.
+  alignas(L::kAlignment) float lfo_base_[2][lanes];
+  alignas(L::kAlignment) float lfo_delta_[2][lanes];
+
+  DISALLOW_COPY_AND_ASSIGN(FxEngineBank);
+};
+
+}  // namespace clouds
+
+#endif  // CLOUDS_FX_ENGINE_BANK_H_
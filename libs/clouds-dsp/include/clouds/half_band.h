@@ -0,0 +1,274 @@
+// Half-band FIR decimator and interpolator
+//
+// Resample by 2 around a network that runs at a reduced rate. The filters are
+// linear-phase half-band FIRs of 4 * kNumSides - 1 taps (Kaiser-windowed
+// sincs). Every other tap but the center one is zero, and both filters run in
+// polyphase form, one multiply-add per nonzero tap and low-rate sample. The
+// side taps are summed in two interleaved halves, by an SSE kernel on four
+// samples at a time where available and by scalar code for the rest, which
+// rounds the same way.
+
+#ifndef CLOUDS_HALF_BAND_H_
+#define CLOUDS_HALF_BAND_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__SSE__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define CLOUDS_HALF_BAND_SSE 1
+#endif
+
+#include "stmlib/stmlib.h"
+
+namespace clouds {
+
+namespace half_band {
+
+// Filter designs: the nonzero taps on each side of the center tap (which is
+// 0.5), at distance 1, 3, 5... from it. They sum to 0.25, so the gain at DC is
+// exactly 1.
+
+// Flat to within 0.0005 dB up to 0.19 of the high rate and at least 85 dB
+// down from 0.31, so that at 96 kHz the band up to 18 kHz is kept and nothing
+// folds back below it.
+struct Narrow {
+  static constexpr size_t kNumSides = 12;
+  static constexpr float kTaps[kNumSides] = {
+    3.158812086e-01f, -9.902379906e-02f, 5.247886758e-02f, -3.100836075e-02f,
+    1.859762629e-02f, -1.085963809e-02f, 6.003717022e-03f, -3.059670682e-03f,
+    1.388808087e-03f, -5.302962907e-04f, 1.499784584e-04f, -1.844112056e-05f
+  };
+};
+
+// Same flatness up to 0.095 and attenuation from 0.405: enough for the first
+// stage of a decimation by 4, ahead of a Narrow stage which removes what is
+// left between the two.
+struct Wide {
+  static constexpr size_t kNumSides = 5;
+  static constexpr float kTaps[kNumSides] = {
+    3.027718128e-01f, -6.688851128e-02f, 1.644485111e-02f, -2.375280452e-03f,
+    4.712785071e-05f
+  };
+};
+
+// Delay, in samples at the high rate, of a decimator followed by an
+// interpolator: each filter delays by 2 * kNumSides - 1, less the sample by
+// which the decimator's output runs ahead of the pair it completes.
+template<typename Filter>
+constexpr size_t Latency() {
+  return 4 * Filter::kNumSides - 3;
+}
+
+// Side taps of the filter centered between x[j + num_sides - 1] and
+// x[j + num_sides]: out[j] = sum over k of taps[k] * (x[j + num_sides + k] +
+// x[j + num_sides - 1 - k]). Even and odd taps are summed separately and then
+// added, both by the vector kernel and the scalar code.
+
+// Vector kernel on the longest prefix of whole pairs of vectors. Returns its
+// length.
+template<size_t num_sides>
+inline size_t SideTapsVector(const float* x, const float* taps, size_t size, float* out) {
+  size_t j = 0;
+#ifdef CLOUDS_HALF_BAND_SSE
+  __m128 t[num_sides];
+  for (size_t k = 0; k < num_sides; ++k) {
+    t[k] = _mm_set1_ps(taps[k]);
+  }
+  // Four sums in flight: two vectors of outputs, even and odd taps.
+  for (; j + 8 <= size; j += 8) {
+    const float* late = x + j + num_sides;
+    const float* early = x + j + num_sides - 1;
+    __m128 even_0 = _mm_setzero_ps();
+    __m128 even_1 = _mm_setzero_ps();
+    __m128 odd_0 = _mm_setzero_ps();
+    __m128 odd_1 = _mm_setzero_ps();
+    for (size_t k = 0; k < num_sides; k += 2) {
+      even_0 = _mm_add_ps(even_0, _mm_mul_ps(t[k], _mm_add_ps(
+          _mm_loadu_ps(late + k), _mm_loadu_ps(early - k))));
+      even_1 = _mm_add_ps(even_1, _mm_mul_ps(t[k], _mm_add_ps(
+          _mm_loadu_ps(late + k + 4), _mm_loadu_ps(early - k + 4))));
+      if (k + 1 < num_sides) {
+        odd_0 = _mm_add_ps(odd_0, _mm_mul_ps(t[k + 1], _mm_add_ps(
+            _mm_loadu_ps(late + k + 1), _mm_loadu_ps(early - k - 1))));
+        odd_1 = _mm_add_ps(odd_1, _mm_mul_ps(t[k + 1], _mm_add_ps(
+            _mm_loadu_ps(late + k + 5), _mm_loadu_ps(early - k + 3))));
+      }
+    }
+    _mm_storeu_ps(out + j, _mm_add_ps(even_0, odd_0));
+    _mm_storeu_ps(out + j + 4, _mm_add_ps(even_1, odd_1));
+  }
+#endif  // CLOUDS_HALF_BAND_SSE
+  return j;
+}
+
+// Side taps scaled by `gain`.
+template<typename Filter>
+inline void SideTaps(const float* x, float gain, size_t size, float* out) {
+  constexpr size_t num_sides = Filter::kNumSides;
+  float taps[num_sides];
+  for (size_t k = 0; k < num_sides; ++k) {
+    taps[k] = gain * Filter::kTaps[k];
+  }
+  const size_t done = SideTapsVector<num_sides>(x, taps, size, out);
+  x += done;
+  out += done;
+  for (size_t j = 0; j < size - done; ++j) {
+    float even = 0.0f;
+    float odd = 0.0f;
+    for (size_t k = 0; k < num_sides; k += 2) {
+      even += taps[k] * (x[j + num_sides + k] + x[j + num_sides - 1 - k]);
+      if (k + 1 < num_sides) {
+        odd += taps[k + 1] * (x[j + num_sides + k + 1] + x[j + num_sides - 2 - k]);
+      }
+    }
+    out[j] = even + odd;
+  }
+}
+
+}  // namespace half_band
+
+// Halves the rate of a stream. Calls may pass any number of samples, up to
+// max_size; an odd sample left over is kept for the next call.
+template<size_t max_size, typename Filter = half_band::Narrow>
+class HalfBandDecimator {
+ public:
+  HalfBandDecimator() { Init(); }
+  ~HalfBandDecimator() { }
+
+  HalfBandDecimator(HalfBandDecimator&&) = default;
+  HalfBandDecimator& operator=(HalfBandDecimator&&) = default;
+
+  void Init() {
+    std::fill(&even_[0], &even_[kEvenHistory], 0.0f);
+    std::fill(&odd_[0], &odd_[kOddHistory], 0.0f);
+    pending_ = 0.0f;
+    has_pending_ = false;
+  }
+
+  // Filters `size` samples of `in` and writes one sample per completed pair
+  // of inputs to `out`, which may be `in`. Returns the number written.
+  size_t Process(const float* in, size_t size, float* out) {
+    // Split the input into its even and odd phases.
+    size_t n = 0;
+    size_t i = 0;
+    if (has_pending_ && size) {
+      even_[kEvenHistory] = pending_;
+      odd_[kOddHistory] = in[0];
+      n = 1;
+      i = 1;
+      has_pending_ = false;
+    }
+    for (; i + 1 < size; i += 2, ++n) {
+      even_[kEvenHistory + n] = in[i];
+      odd_[kOddHistory + n] = in[i + 1];
+    }
+    if (i < size) {
+      pending_ = in[i];
+      has_pending_ = true;
+    }
+
+    // The center tap falls on the even phase, the others on the odd phase.
+    half_band::SideTaps<Filter>(odd_, 1.0f, n, out);
+    for (size_t j = 0; j < n; ++j) {
+      out[j] += 0.5f * even_[j];
+    }
+
+    std::copy(&even_[n], &even_[n + kEvenHistory], &even_[0]);
+    std::copy(&odd_[n], &odd_[n + kOddHistory], &odd_[0]);
+    return n;
+  }
+
+  // Everything Process() carries from one call to the next.
+  struct State {
+    float even[Filter::kNumSides - 1];
+    float odd[2 * Filter::kNumSides - 1];
+    float pending;
+    uint32_t has_pending;
+  };
+
+  void Save(State* state) const {
+    std::copy(&even_[0], &even_[kEvenHistory], &state->even[0]);
+    std::copy(&odd_[0], &odd_[kOddHistory], &state->odd[0]);
+    state->pending = pending_;
+    state->has_pending = has_pending_ ? 1 : 0;
+  }
+
+  void Restore(const State& state) {
+    std::copy(&state.even[0], &state.even[kEvenHistory], &even_[0]);
+    std::copy(&state.odd[0], &state.odd[kOddHistory], &odd_[0]);
+    pending_ = state.pending;
+    has_pending_ = state.has_pending != 0;
+  }
+
+ private:
+  static constexpr size_t kEvenHistory = Filter::kNumSides - 1;
+  static constexpr size_t kOddHistory = 2 * Filter::kNumSides - 1;
+  static constexpr size_t kMaxOutputs = max_size / 2 + 1;
+
+  float even_[kEvenHistory + kMaxOutputs];
+  float odd_[kOddHistory + kMaxOutputs];
+  float pending_;
+  bool has_pending_;
+
+  DISALLOW_COPY_AND_ASSIGN(HalfBandDecimator);
+};
+
+// Doubles the rate of a stream. Calls may pass up to max_size samples.
+template<size_t max_size, typename Filter = half_band::Narrow>
+class HalfBandInterpolator {
+ public:
+  HalfBandInterpolator() { Init(); }
+  ~HalfBandInterpolator() { }
+
+  HalfBandInterpolator(HalfBandInterpolator&&) = default;
+  HalfBandInterpolator& operator=(HalfBandInterpolator&&) = default;
+
+  void Init() {
+    std::fill(&history_[0], &history_[kHistory], 0.0f);
+  }
+
+  // Filters `size` samples of `in` and writes 2 * size samples to `out`,
+  // which must not overlap `in`.
+  void Process(const float* in, size_t size, float* out) {
+    std::copy(in, in + size, &history_[kHistory]);
+
+    // Zero-stuffing doubles the rate at half the gain: odd outputs get the
+    // center tap, scaled back to 1, and even outputs the other taps, times 2.
+    float even[max_size];
+    half_band::SideTaps<Filter>(history_, 2.0f, size, even);
+    const float* center = &history_[Filter::kNumSides];
+    for (size_t j = 0; j < size; ++j) {
+      out[2 * j] = even[j];
+      out[2 * j + 1] = center[j];
+    }
+
+    std::copy(&history_[size], &history_[size + kHistory], &history_[0]);
+  }
+
+  // Everything Process() carries from one call to the next.
+  struct State {
+    float history[2 * Filter::kNumSides - 1];
+  };
+
+  void Save(State* state) const {
+    std::copy(&history_[0], &history_[kHistory], &state->history[0]);
+  }
+
+  void Restore(const State& state) {
+    std::copy(&state.history[0], &state.history[kHistory], &history_[0]);
+  }
+
+ private:
+  static constexpr size_t kHistory = 2 * Filter::kNumSides - 1;
+
+  float history_[kHistory + max_size];
+
+  DISALLOW_COPY_AND_ASSIGN(HalfBandInterpolator);
+};
+
+}  // namespace clouds
+
+#endif  // CLOUDS_HALF_BAND_H_
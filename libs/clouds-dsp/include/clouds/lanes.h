@@ -0,0 +1,208 @@
+// Lanes - fixed-width float vector for running independent instances side by
+// side.
+//
+// Lanes<n> holds one float per instance. Arithmetic is done on the widest
+// native vector that divides n (AVX-512, AVX, SSE), falling back to plain
+// floats on other targets, so a bank of n instances costs about as many
+// instructions as a single one.
+
+#ifndef CLOUDS_LANES_H_
+#define CLOUDS_LANES_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#if defined(__AVX512F__) || defined(__AVX__) || defined(__SSE2__) || \
+    defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <immintrin.h>
+#define CLOUDS_LANES_SSE 1
+#endif
+
+namespace clouds {
+
+namespace lanes {
+
+// Native vector types and the operations Lanes<> needs on them.
+
+inline float Load(const float* p, float) { return *p; }
+inline void Store(float* p, float v) { *p = v; }
+inline float Broadcast(float v, float) { return v; }
+inline float Add(float a, float b) { return a + b; }
+inline float Sub(float a, float b) { return a - b; }
+inline float Mul(float a, float b) { return a * b; }
+
+#ifdef CLOUDS_LANES_SSE
+inline __m128 Load(const float* p, __m128) { return _mm_load_ps(p); }
+inline void Store(float* p, __m128 v) { _mm_store_ps(p, v); }
+inline __m128 Broadcast(float v, __m128) { return _mm_set1_ps(v); }
+inline __m128 Add(__m128 a, __m128 b) { return _mm_add_ps(a, b); }
+inline __m128 Sub(__m128 a, __m128 b) { return _mm_sub_ps(a, b); }
+inline __m128 Mul(__m128 a, __m128 b) { return _mm_mul_ps(a, b); }
+#endif  // CLOUDS_LANES_SSE
+
+#ifdef __AVX__
+inline __m256 Load(const float* p, __m256) { return _mm256_load_ps(p); }
+inline void Store(float* p, __m256 v) { _mm256_store_ps(p, v); }
+inline __m256 Broadcast(float v, __m256) { return _mm256_set1_ps(v); }
+inline __m256 Add(__m256 a, __m256 b) { return _mm256_add_ps(a, b); }
+inline __m256 Sub(__m256 a, __m256 b) { return _mm256_sub_ps(a, b); }
+inline __m256 Mul(__m256 a, __m256 b) { return _mm256_mul_ps(a, b); }
+#endif  // __AVX__
+
+#ifdef __AVX512F__
+inline __m512 Load(const float* p, __m512) { return _mm512_load_ps(p); }
+inline void Store(float* p, __m512 v) { _mm512_store_ps(p, v); }
+inline __m512 Broadcast(float v, __m512) { return _mm512_set1_ps(v); }
+inline __m512 Add(__m512 a, __m512 b) { return _mm512_add_ps(a, b); }
+inline __m512 Sub(__m512 a, __m512 b) { return _mm512_sub_ps(a, b); }
+inline __m512 Mul(__m512 a, __m512 b) { return _mm512_mul_ps(a, b); }
+#endif  // __AVX512F__
+
+// Widest native vector whose width divides n. Two lanes stay plain floats:
+// moving them in and out of an SSE register costs more than the vector
+// arithmetic saves.
+template<size_t n, typename Enable = void>
+struct Native {
+  typedef float Type;
+  enum { width = 1 };
+};
+
+#ifdef CLOUDS_LANES_SSE
+template<size_t n>
+struct Native<n, typename std::enable_if<n % 4 == 0 && n % 8 != 0>::type> {
+  typedef __m128 Type;
+  enum { width = 4 };
+};
+#endif  // CLOUDS_LANES_SSE
+
+#if defined(__AVX__)
+template<size_t n>
+struct Native<n, typename std::enable_if<n % 8 == 0 && n % 16 != 0>::type> {
+  typedef __m256 Type;
+  enum { width = 8 };
+};
+#elif defined(CLOUDS_LANES_SSE)
+template<size_t n>
+struct Native<n, typename std::enable_if<n % 8 == 0 && n % 16 != 0>::type> {
+  typedef __m128 Type;
+  enum { width = 4 };
+};
+#endif
+
+#if defined(__AVX512F__)
+template<size_t n>
+struct Native<n, typename std::enable_if<n % 16 == 0>::type> {
+  typedef __m512 Type;
+  enum { width = 16 };
+};
+#elif defined(__AVX__)
+template<size_t n>
+struct Native<n, typename std::enable_if<n % 16 == 0>::type> {
+  typedef __m256 Type;
+  enum { width = 8 };
+};
+#elif defined(CLOUDS_LANES_SSE)
+template<size_t n>
+struct Native<n, typename std::enable_if<n % 16 == 0>::type> {
+  typedef __m128 Type;
+  enum { width = 4 };
+};
+#endif
+
+}  // namespace lanes
+
+template<size_t n>
+class Lanes {
+ public:
+  typedef typename lanes::Native<n>::Type Native;
+  enum {
+    kWidth = lanes::Native<n>::width,
+    kNumChunks = n / kWidth
+  };
+
+  // Memory passed to Load() and Store() must have this alignment.
+  static constexpr size_t kAlignment = sizeof(Native);
+
+  Lanes() { }
+
+  // Broadcasts a scalar to every lane, so that constants can be passed where
+  // Lanes are expected.
+  Lanes(float value) {
+    for (size_t i = 0; i < kNumChunks; ++i) {
+      chunk_[i] = lanes::Broadcast(value, Native());
+    }
+  }
+
+  // One value per lane, for Lanes<2>.
+  Lanes(float a, float b) {
+    static_assert(n == 2 && kWidth == 1, "Lanes(a, b) needs two scalar lanes");
+    chunk_[0] = a;
+    chunk_[1] = b;
+  }
+
+  static inline Lanes Load(const float* p) {
+    Lanes r;
+    for (size_t i = 0; i < kNumChunks; ++i) {
+      r.chunk_[i] = lanes::Load(p + i * kWidth, Native());
+    }
+    return r;
+  }
+
+  inline void Store(float* p) const {
+    for (size_t i = 0; i < kNumChunks; ++i) {
+      lanes::Store(p + i * kWidth, chunk_[i]);
+    }
+  }
+
+  // Value of lane k. Meant for a few lanes at a time; Store() the whole
+  // vector to read many.
+  inline float operator[](size_t k) const {
+    if constexpr (kWidth == 1) {
+      return chunk_[k];
+    } else {
+      alignas(kAlignment) float values[n];
+      Store(values);
+      return values[k];
+    }
+  }
+
+  inline Lanes operator+(const Lanes& other) const {
+    Lanes r;
+    for (size_t i = 0; i < kNumChunks; ++i) {
+      r.chunk_[i] = lanes::Add(chunk_[i], other.chunk_[i]);
+    }
+    return r;
+  }
+
+  inline Lanes operator-(const Lanes& other) const {
+    Lanes r;
+    for (size_t i = 0; i < kNumChunks; ++i) {
+      r.chunk_[i] = lanes::Sub(chunk_[i], other.chunk_[i]);
+    }
+    return r;
+  }
+
+  inline Lanes operator*(const Lanes& other) const {
+    Lanes r;
+    for (size_t i = 0; i < kNumChunks; ++i) {
+      r.chunk_[i] = lanes::Mul(chunk_[i], other.chunk_[i]);
+    }
+    return r;
+  }
+
+  inline Lanes operator-() const {
+    return *this * Lanes(-1.0f);
+  }
+
+  inline Lanes& operator+=(const Lanes& other) { return *this = *this + other; }
+  inline Lanes& operator-=(const Lanes& other) { return *this = *this - other; }
+  inline Lanes& operator*=(const Lanes& other) { return *this = *this * other; }
+
+ private:
+  Native chunk_[kNumChunks];
+};
+
+}  // namespace clouds
+
+#endif  // CLOUDS_LANES_H_
@@ -0,0 +1,150 @@
+// Mailbox - hands a value from control threads to the audio thread
+//
+// The CloudsReverb setters write plain members that Process() reads, so they
+// must be called from the audio thread. A host that changes parameters from a
+// UI or network thread instead posts a complete ReverbParameters to a
+// ParameterMailbox, and the audio thread fetches the latest one before each
+// block:
+//
+//   // Any thread
+//   mailbox.Update([](ReverbParameters* p) { p->time = 0.8f; });
+//
+//   // Audio thread
+//   ReverbParameters parameters;
+//   if (mailbox.Fetch(&parameters)) {
+//     parameters.RampTo(&reverb);
+//   }
+//   reverb.Process(left, right, size);
+//
+// The mailbox is a triple buffer: the reader owns one slot, the last writer
+// another, and the third holds the latest value posted. Writers fill their
+// slot and swap it with the latest; the reader swaps its own slot with the
+// latest when a new value is flagged. Both swaps are one atomic exchange, so
+// Fetch() is wait-free and never allocates, and the reader always sees a
+// complete value: intermediate ones are dropped, never torn. Writers are
+// serialized among themselves by a mutex the reader never touches.
+
+#ifndef CLOUDS_PARAMETER_MAILBOX_H_
+#define CLOUDS_PARAMETER_MAILBOX_H_
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <type_traits>
+
+#include "clouds/clouds_reverb.h"
+#include "stmlib/stmlib.h"
+
+namespace clouds {
+
+// A complete set of CloudsReverb parameters, with the defaults of Init().
+struct ReverbParameters {
+  float amount = 0.5f;
+  float input_gain = 0.5f;
+  float time = 0.5f;
+  float diffusion = 0.625f;
+  float lp = 0.7f;
+
+  template<Format format, RingLayout ring>
+  void ApplyTo(BasicCloudsReverb<format, ring>* reverb) const {
+    reverb->SetParameters(amount, input_gain, time, diffusion, lp);
+  }
+
+  // Ramps to these values over the next Process() call, without zipper
+  // noise (see CloudsReverb::RampParameters()).
+  template<Format format, RingLayout ring>
+  void RampTo(BasicCloudsReverb<format, ring>* reverb) const {
+    reverb->RampParameters(amount, input_gain, time, diffusion, lp);
+  }
+};
+
+template<typename T>
+class Mailbox {
+ public:
+  static_assert(std::is_trivially_copyable<T>::value,
+                "Mailbox values are copied between threads");
+
+  explicit Mailbox(const T& initial = T())
+      : latest_(initial),
+        middle_(1),
+        back_(2),
+        front_(0) {
+    for (Slot& slot : slots_) {
+      slot.value = initial;
+    }
+  }
+  ~Mailbox() { }
+
+  // Any thread. Publishes `value`, replacing whatever the reader has not
+  // fetched yet.
+  void Post(const T& value) {
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    latest_ = value;
+    Publish();
+  }
+
+  // Any thread. Calls `update` on a copy of the last value posted, and posts
+  // the result, so that writers changing different fields do not undo each
+  // other's changes.
+  template<typename F>
+  void Update(F&& update) {
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    update(&latest_);
+    Publish();
+  }
+
+  // Any thread. The last value posted, which the reader may not have fetched
+  // yet.
+  T Latest() const {
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    return latest_;
+  }
+
+  // Reader thread only (one at a time). Copies the latest value to `value`
+  // and returns true if one was posted since the last call, or returns false.
+  bool Fetch(T* value) {
+    if (!(middle_.load(std::memory_order_relaxed) & kFresh)) {
+      return false;
+    }
+    front_ = middle_.exchange(front_, std::memory_order_acq_rel) & kIndexMask;
+    *value = slots_[front_].value;
+    return true;
+  }
+
+ private:
+  // The middle slot index, flagged when it holds a value not yet fetched.
+  static constexpr uint32_t kIndexMask = 3;
+  static constexpr uint32_t kFresh = 4;
+
+  // Slots on cache lines of their own, so that the reader and writers do
+  // not share one.
+  struct alignas(64) Slot {
+    T value;
+  };
+
+  // Called with writer_mutex_ held.
+  void Publish() {
+    slots_[back_].value = latest_;
+    back_ = middle_.exchange(back_ | kFresh, std::memory_order_acq_rel) & kIndexMask;
+  }
+
+  Slot slots_[3];
+
+  // Writer side
+  mutable std::mutex writer_mutex_;
+  T latest_;
+
+  std::atomic<uint32_t> middle_;
+  uint32_t back_;
+
+  // Reader side
+  alignas(64) uint32_t front_;
+
+  DISALLOW_COPY_AND_ASSIGN(Mailbox);
+};
+
+typedef Mailbox<ReverbParameters> ParameterMailbox;
+
+}  // namespace clouds
+
+#endif  // CLOUDS_PARAMETER_MAILBOX_H_
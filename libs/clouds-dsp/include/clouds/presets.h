@@ -0,0 +1,58 @@
+// Factory presets for CloudsReverb
+//
+// Shared by the plugin and the command-line tools so that a preset name means
+// the same sound everywhere.
+
+#ifndef CLOUDS_PRESETS_H_
+#define CLOUDS_PRESETS_H_
+
+#include <cstddef>
+#include <cstring>
+
+#include "clouds/clouds_reverb.h"
+
+namespace clouds {
+
+struct Preset {
+  const char* name;
+  float amount;
+  float input_gain;
+  float time;
+  float diffusion;
+  float lp;
+
+  template<Format format, RingLayout ring>
+  void ApplyTo(BasicCloudsReverb<format, ring>* reverb) const {
+    reverb->SetParameters(amount, input_gain, time, diffusion, lp);
+  }
+};
+
+inline constexpr Preset kFactoryPresets[] = {
+  { "Default",        0.50f, 0.50f, 0.50f, 0.625f, 0.70f },
+  { "Small Room",     0.30f, 0.40f, 0.20f, 0.50f,  0.50f },
+  { "Large Hall",     0.50f, 0.50f, 0.60f, 0.625f, 0.60f },
+  { "Cathedral",      0.60f, 0.45f, 0.80f, 0.70f,  0.50f },
+  { "Ambient Pad",    0.80f, 0.50f, 0.85f, 0.80f,  0.40f },
+  { "Shimmer",        0.60f, 0.60f, 0.75f, 0.70f,  0.90f },
+  { "Vintage Plate",  0.40f, 0.60f, 0.40f, 0.70f,  0.35f },
+  { "Tight Ambience", 0.25f, 0.45f, 0.15f, 0.55f,  0.65f },
+  { "Dark Space",     0.55f, 0.50f, 0.70f, 0.65f,  0.25f },
+  { "Infinite",       0.70f, 0.40f, 0.95f, 0.75f,  0.45f },
+};
+
+inline constexpr size_t kNumFactoryPresets =
+    sizeof(kFactoryPresets) / sizeof(kFactoryPresets[0]);
+
+// Returns the factory preset with the given name, or nullptr.
+inline const Preset* FindFactoryPreset(const char* name) {
+  for (const Preset& preset : kFactoryPresets) {
+    if (!std::strcmp(preset.name, name)) {
+      return &preset;
+    }
+  }
+  return nullptr;
+}
+
+}  // namespace clouds
+
+#endif  // CLOUDS_PRESETS_H_
@@ -0,0 +1,347 @@
+// RenderQueue - offline batch rendering of many independent jobs
+//
+// A RenderJob is one input buffer, its output buffers and the reverb
+// parameters to render it with. RenderQueue runs a batch of jobs on a pool of
+// worker threads, each owning one CloudsReverb that is cleared between jobs,
+// so every job renders exactly as it would through a freshly initialized
+// reverb regardless of which worker picks it up.
+//
+// Jobs are handed out by work stealing: each worker starts with a contiguous
+// share of the batch and, once it runs dry, takes the back half of the
+// largest remaining share. Batches of uneven jobs (one-shots of very
+// different lengths) keep every core busy without a shared queue that all
+// workers contend on.
+//
+// Progress is reported on the thread calling Render(), so a slow callback
+// (logging, a UI) delays the reports but never the workers.
+//
+// The pool is created once and reused by every Render() call. Consumers must
+// link with the platform thread library.
+
+#ifndef CLOUDS_RENDER_QUEUE_H_
+#define CLOUDS_RENDER_QUEUE_H_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "clouds/clouds_reverb.h"
+#include "stmlib/stmlib.h"
+
+namespace clouds {
+
+enum RenderStatus {
+  RENDER_STATUS_PENDING,
+  RENDER_STATUS_DONE,
+  RENDER_STATUS_INVALID  // Not rendered: see RenderQueue::IsValid()
+};
+
+struct RenderJob {
+  // `size` input frames. Mono input leaves input_right null and is rendered
+  // to stereo as with CloudsReverb::ProcessMono().
+  const float* input_left = nullptr;
+  const float* input_right = nullptr;
+  size_t size = 0;
+
+  // `size + tail` output frames: the processed input followed by the reverb
+  // tail rendered from silence. May alias the input.
+  float* output_left = nullptr;
+  float* output_right = nullptr;
+  size_t tail = 0;
+
+  float sample_rate = 48000.0f;
+  float amount = 0.5f;
+  float input_gain = 0.5f;
+  float time = 0.5f;
+  float diffusion = 0.625f;
+  float lp = 0.7f;
+
+  // Filled in by RenderQueue: whether the job was rendered, the worker that
+  // rendered it and how long it took, in seconds.
+  RenderStatus status = RENDER_STATUS_PENDING;
+  int worker = -1;
+  double seconds = 0.0;
+};
+
+class RenderQueue {
+ public:
+  // Called once per job completed, rejected jobs included, with the number
+  // completed so far. Calls come from the thread calling Render(), in
+  // order, as the workers go on.
+  typedef std::function<void(size_t completed, size_t total)> ProgressCallback;
+
+  // Highest job sample rate. The delay memory grows with the rate, so a
+  // wrong rate must not reach CloudsReverb::Init() on a worker, where a
+  // failed allocation would end the program.
+  static constexpr float kMaxSampleRate = 768000.0f;
+
+  // Starts `num_threads` workers (one per hardware thread if 0). With
+  // `pin_threads`, worker i is bound to CPU i (Linux only; ignored
+  // elsewhere).
+  explicit RenderQueue(size_t num_threads = 0, bool pin_threads = false)
+      : jobs_(nullptr),
+        report_progress_(false),
+        completed_(0),
+        active_(0),
+        generation_(0),
+        stop_(false) {
+    if (num_threads == 0) {
+      num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (size_t i = 0; i < num_threads; ++i) {
+      workers_.emplace_back(new Worker());
+    }
+    for (size_t i = 0; i < num_threads; ++i) {
+      workers_[i]->thread = std::thread(&RenderQueue::Run, this, i, pin_threads);
+    }
+  }
+
+  ~RenderQueue() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    start_.notify_all();
+    for (auto& worker : workers_) {
+      worker->thread.join();
+    }
+  }
+
+  // Whether `job` can be rendered: a sample rate in (0, kMaxSampleRate], and
+  // input and output buffers.
+  static bool IsValid(const RenderJob& job) {
+    return std::isfinite(job.sample_rate) && job.sample_rate > 0.0f &&
+        job.sample_rate <= kMaxSampleRate &&
+        (job.input_left || !job.size) &&
+        job.output_left && job.output_right;
+  }
+
+  // Renders `num_jobs` jobs and returns when all of them are done, with the
+  // number rendered. Invalid jobs (see IsValid()) are marked
+  // RENDER_STATUS_INVALID and skipped. Not reentrant: one batch at a time.
+  size_t Render(RenderJob* jobs, size_t num_jobs,
+                const ProgressCallback& progress = nullptr) {
+    size_t num_valid = 0;
+    for (size_t i = 0; i < num_jobs; ++i) {
+      jobs[i].status = IsValid(jobs[i]) ?
+          RENDER_STATUS_PENDING : RENDER_STATUS_INVALID;
+      num_valid += jobs[i].status == RENDER_STATUS_PENDING;
+    }
+    if (num_jobs == 0) {
+      return 0;
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    jobs_ = jobs;
+    completed_.store(0, std::memory_order_relaxed);
+    report_progress_ = static_cast<bool>(progress);
+
+    // Initial shares: contiguous, as even as possible.
+    const size_t n = workers_.size();
+    for (size_t i = 0; i < n; ++i) {
+      std::lock_guard<std::mutex> share_lock(workers_[i]->mutex);
+      workers_[i]->begin = num_jobs * i / n;
+      workers_[i]->end = num_jobs * (i + 1) / n;
+    }
+    active_ = n;
+    ++generation_;
+    start_.notify_all();
+
+    size_t reported = 0;
+    while (true) {
+      done_.wait(lock, [&] {
+        return active_ == 0 ||
+            (progress && completed_.load(std::memory_order_relaxed) != reported);
+      });
+      const bool done = active_ == 0;
+      if (progress) {
+        const size_t completed = completed_.load(std::memory_order_relaxed);
+        lock.unlock();
+        while (reported < completed) {
+          progress(++reported, num_jobs);
+        }
+        lock.lock();
+      }
+      if (done) {
+        break;
+      }
+    }
+    jobs_ = nullptr;
+    return num_valid;
+  }
+
+  size_t num_threads() const { return workers_.size(); }
+
+ private:
+  struct Worker {
+    std::thread thread;
+
+    // Share of the current batch still to be rendered: [begin, end).
+    std::mutex mutex;
+    size_t begin = 0;
+    size_t end = 0;
+  };
+
+  void Run(size_t index, bool pin_thread) {
+    if (pin_thread) {
+      Pin(index);
+    }
+
+    // Allocated here so the delay memory is first touched by this thread.
+    std::unique_ptr<CloudsReverb> reverb(new CloudsReverb());
+    reverb->Init(48000.0f);
+
+    size_t generation = 0;
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        start_.wait(lock, [&] { return stop_ || generation_ != generation; });
+        if (stop_) {
+          return;
+        }
+        generation = generation_;
+      }
+
+      size_t job;
+      while (Next(index, &job)) {
+        if (jobs_[job].status == RENDER_STATUS_PENDING) {
+          Process(reverb.get(), &jobs_[job], index);
+        }
+        completed_.fetch_add(1, std::memory_order_relaxed);
+        if (report_progress_) {
+          // Under the lock, so that Render() cannot miss the change between
+          // testing for it and waiting.
+          std::lock_guard<std::mutex> lock(mutex_);
+          done_.notify_one();
+        }
+      }
+
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (--active_ == 0) {
+        done_.notify_one();
+      }
+    }
+  }
+
+  // Takes the next job from the worker's own share, or steals the back half
+  // of the largest other share. Returns false when the batch is exhausted.
+  bool Next(size_t index, size_t* job) {
+    Worker* self = workers_[index].get();
+    {
+      std::lock_guard<std::mutex> lock(self->mutex);
+      if (self->begin < self->end) {
+        *job = self->begin++;
+        return true;
+      }
+    }
+
+    while (true) {
+      Worker* victim = nullptr;
+      size_t largest = 0;
+      for (auto& worker : workers_) {
+        std::lock_guard<std::mutex> lock(worker->mutex);
+        if (worker->end - worker->begin > largest) {
+          largest = worker->end - worker->begin;
+          victim = worker.get();
+        }
+      }
+      if (!victim) {
+        return false;
+      }
+
+      size_t begin, end;
+      {
+        std::lock_guard<std::mutex> lock(victim->mutex);
+        if (victim->begin == victim->end) {
+          continue;  // Emptied since the scan.
+        }
+        end = victim->end;
+        begin = victim->begin + (victim->end - victim->begin) / 2;
+        victim->end = begin;
+      }
+      std::lock_guard<std::mutex> lock(self->mutex);
+      self->begin = begin + 1;
+      self->end = end;
+      *job = begin;
+      return true;
+    }
+  }
+
+  static void Process(CloudsReverb* reverb, RenderJob* job, size_t index) {
+    auto start = std::chrono::steady_clock::now();
+
+    if (reverb->GetSampleRate() != job->sample_rate) {
+      reverb->Init(job->sample_rate);
+    } else {
+      reverb->Clear();
+    }
+    reverb->SetParameters(
+        job->amount, job->input_gain, job->time, job->diffusion, job->lp);
+
+    if (job->input_right) {
+      reverb->Process(job->input_left, job->input_right,
+                      job->output_left, job->output_right, job->size);
+    } else {
+      reverb->ProcessMono(
+          job->input_left, job->output_left, job->output_right, job->size);
+    }
+    if (job->tail) {
+      float* left = job->output_left + job->size;
+      float* right = job->output_right + job->size;
+      std::fill(left, left + job->tail, 0.0f);
+      std::fill(right, right + job->tail, 0.0f);
+      reverb->Process(left, right, job->tail);
+    }
+
+    job->status = RENDER_STATUS_DONE;
+    job->worker = static_cast<int>(index);
+    job->seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+  }
+
+  static void Pin(size_t index) {
+#if defined(__linux__)
+    size_t num_cpus = std::max(1u, std::thread::hardware_concurrency());
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(index % num_cpus, &cpus);
+    pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+#else
+    (void)index;
+#endif
+  }
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+
+  // Current batch, and jobs done in it (rendered or rejected).
+  RenderJob* jobs_;
+  bool report_progress_;
+  std::atomic<size_t> completed_;
+
+  // Batch hand-off: Render() bumps generation_ to start the workers, and
+  // waits for active_ to drop back to zero.
+  std::mutex mutex_;
+  std::condition_variable start_;
+  std::condition_variable done_;
+  size_t active_;
+  size_t generation_;
+  bool stop_;
+
+  DISALLOW_COPY_AND_ASSIGN(RenderQueue);
+};
+
+}  // namespace clouds
+
+#endif  // CLOUDS_RENDER_QUEUE_H_
@@ -27,6 +27,7 @@
 #define CLOUDS_DSP_FX_REVERB_H_
 
 #include "stmlib/stmlib.h"
+#include "clouds/denormals.h"
 #include "clouds/fx_engine.h"
 #include "clouds/frame.h"
 
@@ -71,6 +72,7 @@ class Reverb {
     E::DelayLine<Memory, 8> dap2b;
     E::DelayLine<Memory, 9> del2;
     E::Context c;
+    ScopedNoDenormals no_denormals;
 
     const float kap = diffusion_;
     const float klp = lp_;
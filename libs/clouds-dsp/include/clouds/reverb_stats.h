@@ -0,0 +1,308 @@
+// ReverbStats - run-time statistics of a CloudsReverb instance
+//
+// Built with CLOUDS_ENABLE_STATS defined (the VIBEMODULE_STATS CMake option
+// sets it for everything linking clouds::dsp), CloudsReverb can time its
+// Process() calls and count what happened to its tail:
+//
+//   // Setup, outside the audio thread
+//   reverb.EnableStats(true);
+//
+//   // Any thread, e.g. a UI timer
+//   clouds::ReverbStats::Snapshot stats;
+//   if (reverb.GetStats(&stats)) {
+//     printf("load %.1f%%, p99 %.1f us, %llu faults\n", 100.0 * stats.load(),
+//            stats.Percentile(0.99) * 1e-3, (unsigned long long) stats.faults);
+//   }
+//
+// Without it, CloudsReverb has no statistics members and no timing code. The
+// setting changes the layout of CloudsReverb, so the whole program must be
+// built with the same one.
+//
+// The audio thread is the only writer. It updates the counters in place
+// between two increments of a sequence count, which is odd while an update
+// is under way (a seqlock). Recording never waits or allocates; a reader
+// copies the counters and tries again if the count changed meanwhile, so it
+// always sees the totals of a whole number of calls. The counters are
+// atomics, written with release and read with acquire ordering (plain moves
+// on x86), so the reader notices any update it overlapped without fences,
+// which ThreadSanitizer does not model.
+
+#ifndef CLOUDS_REVERB_STATS_H_
+#define CLOUDS_REVERB_STATS_H_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define CLOUDS_STATS_RDTSC 1
+#elif defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#define CLOUDS_STATS_RDTSC 1
+#endif
+
+#include "stmlib/stmlib.h"
+
+namespace clouds {
+
+class ReverbStats {
+ public:
+  enum Event {
+    EVENT_SLEEP,  // Went to sleep (see CloudsReverb::SetSleepEnabled())
+    EVENT_CLEAR,  // Clear() called
+    EVENT_FAULT,  // Recovered from a fault (see CloudsReverb::GetFaultCount())
+    NUM_EVENTS
+  };
+
+  // Call durations are binned on a log scale: 4 buckets per octave of
+  // nanoseconds (12 to 25% wide), up to 7.5 s; the last bucket also takes
+  // longer calls.
+  static constexpr size_t kBucketsPerOctave = 4;
+  static constexpr size_t kNumBuckets = 128;
+
+  // Totals since the statistics were enabled, reset or the reverb
+  // initialized.
+  struct Snapshot {
+    uint64_t calls;             // Process() calls, including calls asleep
+    uint64_t samples;           // Samples they processed
+    uint64_t nanoseconds;       // Time spent in them
+    uint64_t audio_nanoseconds; // Duration of the audio they processed
+    uint64_t cycles;            // Timestamp counter ticks (0 without one)
+    uint64_t max_nanoseconds;   // Longest call
+    float max_load;             // Highest load of a single call
+    uint64_t sleeps;
+    uint64_t clears;
+    uint64_t faults;
+    uint64_t histogram[kNumBuckets];  // Calls per duration bucket
+
+    double mean_nanoseconds() const {
+      return calls ? static_cast<double>(nanoseconds) / calls : 0.0;
+    }
+
+    double nanoseconds_per_sample() const {
+      return samples ? static_cast<double>(nanoseconds) / samples : 0.0;
+    }
+
+    // Time spent processing per time of audio processed: the share of one
+    // core the instance takes in real time.
+    double load() const {
+      return audio_nanoseconds ?
+          static_cast<double>(nanoseconds) / audio_nanoseconds : 0.0;
+    }
+
+    // Duration in nanoseconds that a fraction `p` (in [0, 1]) of the calls
+    // did not exceed, rounded up to the end of its bucket.
+    double Percentile(double p) const {
+      const double rank = std::clamp(p, 0.0, 1.0) * calls;
+      uint64_t count = 0;
+      for (size_t bucket = 0; bucket < kNumBuckets && calls; ++bucket) {
+        count += histogram[bucket];
+        if (count && count >= rank) {
+          return static_cast<double>(std::min(
+              BucketStart(bucket + 1), max_nanoseconds));
+        }
+      }
+      return 0.0;
+    }
+  };
+
+  ReverbStats() : sequence_(0), reset_requested_(false) {
+    Update([this] { Zero(); });
+  }
+  ~ReverbStats() { }
+
+  // First duration in nanoseconds that falls into `bucket`.
+  static uint64_t BucketStart(size_t bucket) {
+    if (bucket < kBucketsPerOctave) {
+      return bucket;
+    }
+    const uint64_t mantissa = kBucketsPerOctave + bucket % kBucketsPerOctave;
+    return mantissa << (bucket / kBucketsPerOctave - 1);
+  }
+
+  static size_t Bucket(uint64_t nanoseconds) {
+    size_t octave = 0;
+    while (nanoseconds >= 2 * kBucketsPerOctave) {
+      nanoseconds >>= 1;
+      ++octave;
+    }
+    if (nanoseconds < kBucketsPerOctave) {
+      return static_cast<size_t>(nanoseconds);
+    }
+    const size_t bucket = (octave + 1) * kBucketsPerOctave +
+        static_cast<size_t>(nanoseconds - kBucketsPerOctave);
+    return std::min(bucket, kNumBuckets - 1);
+  }
+
+  // Times a Process() call from construction to destruction, and records it
+  // to `stats` unless null.
+  class Timer {
+   public:
+    Timer(ReverbStats* stats, size_t size, float sample_rate)
+        : stats_(stats), size_(size), sample_rate_(sample_rate), cycles_(0) {
+      if (stats_) {
+        cycles_ = Cycles();
+        start_ = std::chrono::steady_clock::now();
+      }
+    }
+
+    ~Timer() {
+      if (stats_) {
+        const auto end = std::chrono::steady_clock::now();
+        const uint64_t cycles = Cycles() - cycles_;
+        stats_->Record(static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                end - start_).count()), cycles, size_, sample_rate_);
+      }
+    }
+
+   private:
+    ReverbStats* stats_;
+    size_t size_;
+    float sample_rate_;
+    uint64_t cycles_;
+    std::chrono::steady_clock::time_point start_;
+
+    DISALLOW_COPY_AND_ASSIGN(Timer);
+  };
+
+  // The writer thread (the one calling Process()) records through the
+  // functions below.
+
+  // Records a call that took `nanoseconds` (and `cycles` ticks) for `size`
+  // samples at `sample_rate`.
+  void Record(uint64_t nanoseconds, uint64_t cycles, size_t size,
+              float sample_rate) {
+    const uint64_t audio = static_cast<uint64_t>(
+        static_cast<double>(size) * 1e9 / sample_rate);
+    const float load = audio ? static_cast<float>(
+        static_cast<double>(nanoseconds) / audio) : 0.0f;
+    const bool reset = reset_requested_.load(std::memory_order_relaxed) &&
+        reset_requested_.exchange(false, std::memory_order_acquire);
+    Update([&] {
+      if (reset) {
+        Zero();
+      }
+      Add(&calls_, 1);
+      Add(&samples_, size);
+      Add(&nanoseconds_, nanoseconds);
+      Add(&audio_nanoseconds_, audio);
+      Add(&cycles_, cycles);
+      Add(&histogram_[Bucket(nanoseconds)], 1);
+      if (nanoseconds > Load(max_nanoseconds_)) {
+        max_nanoseconds_.store(nanoseconds, std::memory_order_release);
+      }
+      if (load > max_load_.load(std::memory_order_relaxed)) {
+        max_load_.store(load, std::memory_order_release);
+      }
+    });
+  }
+
+  void Count(Event event) {
+    Update([&] { Add(&events_[event], 1); });
+  }
+
+  void Reset() {
+    reset_requested_.store(false, std::memory_order_relaxed);
+    Update([this] { Zero(); });
+  }
+
+  // Any thread. Resets the statistics at the next recorded call.
+  void RequestReset() {
+    reset_requested_.store(true, std::memory_order_release);
+  }
+
+  // Any thread. Copies a consistent set of totals to `snapshot`.
+  void Read(Snapshot* snapshot) const {
+    for (;;) {
+      const uint32_t sequence = sequence_.load(std::memory_order_acquire);
+      if (sequence & 1) {
+        continue;
+      }
+      snapshot->calls = Load(calls_);
+      snapshot->samples = Load(samples_);
+      snapshot->nanoseconds = Load(nanoseconds_);
+      snapshot->audio_nanoseconds = Load(audio_nanoseconds_);
+      snapshot->cycles = Load(cycles_);
+      snapshot->max_nanoseconds = Load(max_nanoseconds_);
+      snapshot->max_load = max_load_.load(std::memory_order_acquire);
+      snapshot->sleeps = Load(events_[EVENT_SLEEP]);
+      snapshot->clears = Load(events_[EVENT_CLEAR]);
+      snapshot->faults = Load(events_[EVENT_FAULT]);
+      for (size_t i = 0; i < kNumBuckets; ++i) {
+        snapshot->histogram[i] = Load(histogram_[i]);
+      }
+      // A value from an update that started after the first check implies
+      // that this load sees its odd count.
+      if (sequence_.load(std::memory_order_relaxed) == sequence) {
+        return;
+      }
+    }
+  }
+
+ private:
+  typedef std::atomic<uint64_t> Counter;
+
+  static uint64_t Cycles() {
+#ifdef CLOUDS_STATS_RDTSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+  }
+
+  static uint64_t Load(const Counter& counter) {
+    return counter.load(std::memory_order_acquire);
+  }
+
+  // Only the writer modifies the counters, so this needs no atomic
+  // read-modify-write.
+  static void Add(Counter* counter, uint64_t value) {
+    counter->store(Load(*counter) + value, std::memory_order_release);
+  }
+
+  // Runs `update` with the sequence count odd.
+  template<typename F>
+  void Update(F&& update) {
+    const uint32_t sequence = sequence_.load(std::memory_order_relaxed);
+    sequence_.store(sequence + 1, std::memory_order_relaxed);
+    update();
+    sequence_.store(sequence + 2, std::memory_order_release);
+  }
+
+  void Zero() {
+    for (Counter* counter : { &calls_, &samples_, &nanoseconds_,
+                              &audio_nanoseconds_, &cycles_,
+                              &max_nanoseconds_ }) {
+      counter->store(0, std::memory_order_release);
+    }
+    max_load_.store(0.0f, std::memory_order_release);
+    for (Counter& counter : events_) {
+      counter.store(0, std::memory_order_release);
+    }
+    for (Counter& counter : histogram_) {
+      counter.store(0, std::memory_order_release);
+    }
+  }
+
+  std::atomic<uint32_t> sequence_;
+  std::atomic<bool> reset_requested_;
+  Counter calls_;
+  Counter samples_;
+  Counter nanoseconds_;
+  Counter audio_nanoseconds_;
+  Counter cycles_;
+  Counter max_nanoseconds_;
+  std::atomic<float> max_load_;
+  Counter events_[NUM_EVENTS];
+  Counter histogram_[kNumBuckets];
+
+  DISALLOW_COPY_AND_ASSIGN(ReverbStats);
+};
+
+}  // namespace clouds
+
+#endif  // CLOUDS_REVERB_STATS_H_
@@ -0,0 +1,121 @@
+// Span conversions between float and the compact delay memory formats
+//
+// Vector kernels behind DataType<>::CompressN() and DataType<>::DecompressN().
+// Each converts the longest prefix of a span that fills whole vectors (AVX2,
+// or SSE2 otherwise) and returns its length; DataType<> converts the rest
+// with its scalar code. Every kernel is bit-exact with that scalar code:
+// truncating conversion plus saturating pack is Clip16(int32_t(x)), and
+// scaling by a power of 2 is exact, so multiplying by its inverse gives the
+// same float as dividing. On other targets the kernels convert nothing.
+
+#ifndef CLOUDS_SAMPLE_CONVERSION_H_
+#define CLOUDS_SAMPLE_CONVERSION_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <immintrin.h>
+#define CLOUDS_CONVERSION_SSE2 1
+#endif
+
+namespace clouds {
+
+namespace conversion {
+
+// out[i] = Clip16(int32_t(in[i] * scale)), stored as uint16_t.
+inline size_t FloatToFixed(const float* in, uint16_t* out, size_t n, float scale) {
+  size_t i = 0;
+#if defined(__AVX2__)
+  const __m256 s = _mm256_set1_ps(scale);
+  for (; i + 8 <= n; i += 8) {
+    __m256i x = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_loadu_ps(in + i), s));
+    __m128i packed = _mm_packs_epi32(
+        _mm256_castsi256_si128(x), _mm256_extracti128_si256(x, 1));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), packed);
+  }
+#elif defined(CLOUDS_CONVERSION_SSE2)
+  const __m128 s = _mm_set1_ps(scale);
+  for (; i + 8 <= n; i += 8) {
+    __m128i lo = _mm_cvttps_epi32(_mm_mul_ps(_mm_loadu_ps(in + i), s));
+    __m128i hi = _mm_cvttps_epi32(_mm_mul_ps(_mm_loadu_ps(in + i + 4), s));
+    _mm_storeu_si128(
+        reinterpret_cast<__m128i*>(out + i), _mm_packs_epi32(lo, hi));
+  }
+#else
+  (void)in;
+  (void)out;
+  (void)n;
+  (void)scale;
+#endif
+  return i;
+}
+
+// out[i] = float(int16_t(in[i])) * inverse_scale
+inline size_t FixedToFloat(
+    const uint16_t* in, float* out, size_t n, float inverse_scale) {
+  size_t i = 0;
+#if defined(__AVX2__)
+  const __m256 s = _mm256_set1_ps(inverse_scale);
+  for (; i + 8 <= n; i += 8) {
+    __m256i x = _mm256_cvtepi16_epi32(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i)));
+    _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(x), s));
+  }
+#elif defined(CLOUDS_CONVERSION_SSE2)
+  const __m128 s = _mm_set1_ps(inverse_scale);
+  for (; i + 8 <= n; i += 8) {
+    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+    // Sign-extend by moving each value to the top half and shifting back.
+    __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+    __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+    _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), s));
+    _mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), s));
+  }
+#else
+  (void)in;
+  (void)out;
+  (void)n;
+  (void)inverse_scale;
+#endif
+  return i;
+}
+
+// IEEE half precision, rounding to nearest even. Needs F16C.
+inline size_t FloatToHalf(const float* in, uint16_t* out, size_t n) {
+  size_t i = 0;
+#if defined(__F16C__)
+  for (; i + 8 <= n; i += 8) {
+    _mm_storeu_si128(
+        reinterpret_cast<__m128i*>(out + i),
+        _mm256_cvtps_ph(_mm256_loadu_ps(in + i), _MM_FROUND_TO_NEAREST_INT));
+  }
+#else
+  (void)in;
+  (void)out;
+  (void)n;
+#endif
+  return i;
+}
+
+inline size_t HalfToFloat(const uint16_t* in, float* out, size_t n) {
+  size_t i = 0;
+#if defined(__F16C__)
+  for (; i + 8 <= n; i += 8) {
+    _mm256_storeu_ps(out + i, _mm256_cvtph_ps(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i))));
+  }
+#else
+  (void)in;
+  (void)out;
+  (void)n;
+#endif
+  return i;
+}
+
+}  // namespace conversion
+
+}  // namespace clouds
+
+#endif  // CLOUDS_SAMPLE_CONVERSION_H_
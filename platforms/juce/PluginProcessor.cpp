@@ -1,19 +1,20 @@
 #include "PluginProcessor.h"
 #include "PluginEditor.h"
 
-// Factory presets
-static const std::vector<ReverbPreset> kFactoryPresets = {
-    {"Default",       0.50f, 0.50f, 0.50f, 0.625f, 0.70f},
-    {"Small Room",    0.30f, 0.40f, 0.20f, 0.50f,  0.50f},
-    {"Large Hall",    0.50f, 0.50f, 0.60f, 0.625f, 0.60f},
-    {"Cathedral",     0.60f, 0.45f, 0.80f, 0.70f,  0.50f},
-    {"Ambient Pad",   0.80f, 0.50f, 0.85f, 0.80f,  0.40f},
-    {"Shimmer",       0.60f, 0.60f, 0.75f, 0.70f,  0.90f},
-    {"Vintage Plate", 0.40f, 0.60f, 0.40f, 0.70f,  0.35f},
-    {"Tight Ambience",0.25f, 0.45f, 0.15f, 0.55f,  0.65f},
-    {"Dark Space",    0.55f, 0.50f, 0.70f, 0.65f,  0.25f},
-    {"Infinite",      0.70f, 0.40f, 0.95f, 0.75f,  0.45f},
-};
+#include <clouds/presets.h>
+
+// Factory presets (shared with the command-line tools)
+static std::vector<ReverbPreset> makeFactoryPresets()
+{
+    std::vector<ReverbPreset> presets;
+    for (const auto& preset : clouds::kFactoryPresets) {
+        presets.push_back({preset.name, preset.amount, preset.input_gain,
+                           preset.time, preset.diffusion, preset.lp});
+    }
+    return presets;
+}
+
+static const std::vector<ReverbPreset> kFactoryPresets = makeFactoryPresets();
 
 const std::vector<ReverbPreset>& CloudsReverbProcessor::getFactoryPresets()
 {
@@ -94,6 +95,11 @@ CloudsReverbProcessor::CloudsReverbProcessor()
     parameters.addParameterListener("time", this);
     parameters.addParameterListener("diffusion", this);
     parameters.addParameterListener("lp", this);
+
+#ifdef CLOUDS_ENABLE_STATS
+    reverb.EnableStats(true);
+#endif
+    tailLengthSeconds.store(reverb.GetTailLength());
 }
 
 CloudsReverbProcessor::~CloudsReverbProcessor()
@@ -113,7 +119,10 @@ const juce::String CloudsReverbProcessor::getName() const
 bool CloudsReverbProcessor::acceptsMidi() const { return false; }
 bool CloudsReverbProcessor::producesMidi() const { return false; }
 bool CloudsReverbProcessor::isMidiEffect() const { return false; }
-double CloudsReverbProcessor::getTailLengthSeconds() const { return 5.0; }
+double CloudsReverbProcessor::getTailLengthSeconds() const
+{
+    return static_cast<double>(tailLengthSeconds.load());
+}
 
 int CloudsReverbProcessor::getNumPrograms()
 {
@@ -159,7 +168,10 @@ void CloudsReverbProcessor::changeProgramName(int, const juce::String&)
 
 void CloudsReverbProcessor::prepareToPlay(double sampleRate, int)
 {
+    // Full-rate tank: with the block kernels a decimated tank saves little
+    // (see CloudsReverb::Init()), but whatever latency it has is reported.
     reverb.Init(static_cast<float>(sampleRate));
+    setLatencySamples(static_cast<int>(reverb.GetLatency()));
 
     // Initialize smoothed values with current parameter values
     smoothedAmount.reset(sampleRate, kSmoothingTimeSeconds);
@@ -183,6 +195,7 @@ void CloudsReverbProcessor::prepareToPlay(double sampleRate, int)
     reverb.SetTime(smoothedTime.getCurrentValue());
     reverb.SetDiffusion(smoothedDiffusion.getCurrentValue());
     reverb.SetLowpassCutoff(smoothedLp.getCurrentValue());
+    tailLengthSeconds.store(reverb.GetTailLength());
 }
 
 void CloudsReverbProcessor::releaseResources()
@@ -208,37 +221,21 @@ void CloudsReverbProcessor::processBlock(juce::AudioBuffer<float>& buffer, juce:
     auto* leftChannel = buffer.getWritePointer(0);
     auto* rightChannel = buffer.getWritePointer(1);
 
-    // Update smoothed parameters if they're still ramping
+    const int numSamples = buffer.getNumSamples();
+
+    // Ramp smoothed parameters across the whole block, one step per sample
     if (smoothedAmount.isSmoothing() || smoothedInputGain.isSmoothing() ||
         smoothedTime.isSmoothing() || smoothedDiffusion.isSmoothing() ||
         smoothedLp.isSmoothing()) {
-        // Process in small chunks to apply smoothed parameter updates
-        const int numSamples = buffer.getNumSamples();
-        constexpr int kChunkSize = 32;
-
-        for (int offset = 0; offset < numSamples; offset += kChunkSize) {
-            const int samplesToProcess = std::min(kChunkSize, numSamples - offset);
-
-            // Skip ahead in smoothing and apply current values
-            smoothedAmount.skip(samplesToProcess);
-            smoothedInputGain.skip(samplesToProcess);
-            smoothedTime.skip(samplesToProcess);
-            smoothedDiffusion.skip(samplesToProcess);
-            smoothedLp.skip(samplesToProcess);
-
-            reverb.SetAmount(smoothedAmount.getCurrentValue());
-            reverb.SetInputGain(smoothedInputGain.getCurrentValue());
-            reverb.SetTime(smoothedTime.getCurrentValue());
-            reverb.SetDiffusion(smoothedDiffusion.getCurrentValue());
-            reverb.SetLowpassCutoff(smoothedLp.getCurrentValue());
-
-            reverb.Process(leftChannel + offset, rightChannel + offset,
-                           static_cast<size_t>(samplesToProcess));
-        }
-    } else {
-        // No smoothing needed, process entire buffer at once
-        reverb.Process(leftChannel, rightChannel, static_cast<size_t>(buffer.getNumSamples()));
+        reverb.RampParameters(smoothedAmount.skip(numSamples),
+                              smoothedInputGain.skip(numSamples),
+                              smoothedTime.skip(numSamples),
+                              smoothedDiffusion.skip(numSamples),
+                              smoothedLp.skip(numSamples));
     }
+
+    reverb.Process(leftChannel, rightChannel, static_cast<size_t>(numSamples));
+    tailLengthSeconds.store(reverb.GetTailLength());
 }
 
 bool CloudsReverbProcessor::hasEditor() const { return true; }
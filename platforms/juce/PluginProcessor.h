@@ -1,5 +1,6 @@
 #pragma once
 
+#include <atomic>
 #include <JuceHeader.h>
 #include <clouds/clouds_reverb.h>
 
@@ -51,6 +52,12 @@ public:
 
     juce::AudioProcessorValueTreeState& getValueTreeState() { return parameters; }
 
+#ifdef CLOUDS_ENABLE_STATS
+    // Processing time of the reverb and counts of sleeps, clears and faults
+    // (see clouds/reverb_stats.h). Any thread.
+    bool getReverbStats(clouds::ReverbStats::Snapshot* stats) const { return reverb.GetStats(stats); }
+#endif
+
 private:
     juce::AudioProcessorValueTreeState parameters;
     clouds::CloudsReverb reverb;
@@ -70,6 +77,10 @@ private:
 
     static constexpr double kSmoothingTimeSeconds = 0.02;  // 20ms smoothing
 
+    // Tail length at the Time the audio thread last processed with. Hosts
+    // query it from the message thread, which must not read the reverb.
+    std::atomic<float> tailLengthSeconds { 0.0f };
+
     int currentProgram = 0;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(CloudsReverbProcessor)
@@ -1,7 +1,18 @@
 #include <catch2/catch_test_macros.hpp>
 #include <catch2/benchmark/catch_benchmark.hpp>
 #include <clouds/clouds_reverb.h>
+#include <clouds/clouds_reverb_bank.h>
+#include <clouds/render_queue.h>
+#include <algorithm>
+#include <chrono>
 #include <cmath>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "perf_counters.h"
 
 constexpr size_t kBenchmarkSampleRate = 48000;
 constexpr size_t kBenchmarkBlockSize = 512;
@@ -22,10 +33,14 @@ TEST_CASE("CloudsReverb performance benchmarks", "[benchmark][reverb]") {
         right[i] = std::sin(2.0f * 3.14159265f * 440.0f * t + 0.1f) * 0.5f;
     }
 
-    BENCHMARK("Process 512 samples (stereo)") {
+    auto process = [&] {
         reverb.Process(left.data(), right.data(), kBenchmarkBlockSize);
         return left[0] + right[0];  // Prevent optimization
     };
+    BENCHMARK("Process 512 samples (stereo)") {
+        return process();
+    };
+    perf::Measure("Process 512 samples (stereo)", kBenchmarkBlockSize, process);
 
     BENCHMARK("Process 512 samples at different Time settings") {
         reverb.SetTime(0.9f);  // Long reverb time
@@ -58,6 +73,309 @@ TEST_CASE("CloudsReverb per-sample performance", "[benchmark][reverb]") {
     }
 }
 
+TEST_CASE("CloudsReverb processing mode benchmark", "[benchmark][reverb][block]") {
+    clouds::CloudsReverb reverb;
+    reverb.Init(static_cast<float>(kBenchmarkSampleRate));
+
+    std::vector<float> left(kBenchmarkBlockSize);
+    std::vector<float> right(kBenchmarkBlockSize);
+    for (size_t i = 0; i < kBenchmarkBlockSize; ++i) {
+        left[i] = (static_cast<float>(i % 17) / 17.0f - 0.5f);
+        right[i] = (static_cast<float>(i % 13) / 13.0f - 0.5f);
+    }
+
+    auto process = [&](clouds::ProcessingMode mode) {
+        reverb.SetProcessingMode(mode);
+        reverb.Process(left.data(), right.data(), kBenchmarkBlockSize);
+        return left[0] + right[0];
+    };
+    auto per_sample = [&] { return process(clouds::PROCESSING_MODE_SAMPLE); };
+    auto block = [&] { return process(clouds::PROCESSING_MODE_BLOCK); };
+
+    BENCHMARK("Process 512 samples (per-sample mode)") {
+        return per_sample();
+    };
+
+    BENCHMARK("Process 512 samples (block mode)") {
+        return block();
+    };
+
+    perf::Measure("Process 512 samples (per-sample mode)", kBenchmarkBlockSize, per_sample);
+    perf::Measure("Process 512 samples (block mode)", kBenchmarkBlockSize, block);
+}
+
+TEST_CASE("CloudsReverb decimated tank benchmark", "[benchmark][reverb][decimation]") {
+    std::vector<float> left(kBenchmarkBlockSize);
+    std::vector<float> right(kBenchmarkBlockSize);
+    for (size_t i = 0; i < kBenchmarkBlockSize; ++i) {
+        left[i] = (static_cast<float>(i % 17) / 17.0f - 0.5f);
+        right[i] = (static_cast<float>(i % 13) / 13.0f - 0.5f);
+    }
+
+    for (float sample_rate : {96000.0f, 192000.0f}) {
+        const size_t recommended = clouds::CloudsReverb::RecommendedDecimation(sample_rate);
+        const std::string rate = std::to_string(static_cast<int>(sample_rate / 1000.0f));
+        for (auto mode : {clouds::PROCESSING_MODE_BLOCK, clouds::PROCESSING_MODE_SAMPLE}) {
+            const std::string mode_name =
+                mode == clouds::PROCESSING_MODE_BLOCK ? "block" : "per-sample";
+            for (size_t decimation : {size_t(1), recommended}) {
+                auto reverb = std::make_unique<clouds::CloudsReverb>();
+                reverb->Init(sample_rate, decimation);
+                reverb->SetSleepEnabled(false);
+                reverb->SetProcessingMode(mode);
+
+                const std::string name = "Process 512 samples at " + rate + " kHz, " +
+                    mode_name + " mode, decimation " + std::to_string(decimation);
+                auto process = [&] {
+                    reverb->Process(left.data(), right.data(), kBenchmarkBlockSize);
+                    return left[0] + right[0];
+                };
+                BENCHMARK(std::string(name)) {
+                    return process();
+                };
+                perf::Measure(name, kBenchmarkBlockSize, process);
+            }
+        }
+    }
+}
+
+TEST_CASE("CloudsReverb sleep benchmark", "[benchmark][reverb][sleep]") {
+    clouds::CloudsReverb awake;
+    clouds::CloudsReverb asleep;
+    awake.Init(static_cast<float>(kBenchmarkSampleRate));
+    asleep.Init(static_cast<float>(kBenchmarkSampleRate));
+    awake.SetSleepEnabled(false);
+
+    std::vector<float> left(kBenchmarkBlockSize, 0.0f);
+    std::vector<float> right(kBenchmarkBlockSize, 0.0f);
+
+    BENCHMARK("Process 512 samples of silence (sleep disabled)") {
+        awake.Process(left.data(), right.data(), kBenchmarkBlockSize);
+        return left[0] + right[0];
+    };
+
+    BENCHMARK("Process 512 samples of silence (asleep)") {
+        asleep.Process(left.data(), right.data(), kBenchmarkBlockSize);
+        return left[0] + right[0];
+    };
+}
+
+TEST_CASE("CloudsReverb decay benchmark", "[benchmark][reverb][denormals]") {
+    // An impulse left to decay for 50 s with sleep disabled: the tail goes
+    // through the denormal range on its way to silence, which without
+    // flush-to-zero costs several times the CPU of the first second.
+    constexpr size_t kDecayBlocks = 50 * kBenchmarkSampleRate / kBenchmarkBlockSize;
+    constexpr size_t kFirstSecondBlocks = kBenchmarkSampleRate / kBenchmarkBlockSize;
+    clouds::CloudsReverb reverb;
+    reverb.Init(static_cast<float>(kBenchmarkSampleRate));
+    reverb.SetSleepEnabled(false);
+
+    std::vector<float> left(kBenchmarkBlockSize, 0.0f);
+    std::vector<float> right(kBenchmarkBlockSize, 0.0f);
+    auto decay = [&](size_t blocks) {
+        reverb.Clear();
+        float sum = 0.0f;
+        for (size_t b = 0; b < blocks; ++b) {
+            std::fill(left.begin(), left.end(), 0.0f);
+            std::fill(right.begin(), right.end(), 0.0f);
+            if (b == 0) {
+                left[0] = right[0] = 1.0f;
+            }
+            reverb.Process(left.data(), right.data(), kBenchmarkBlockSize);
+            sum += left[0] + right[0];
+        }
+        return sum;
+    };
+
+    BENCHMARK("Process first second of an impulse tail") {
+        return decay(kFirstSecondBlocks);
+    };
+
+    BENCHMARK("Process 50 s of an impulse tail") {
+        return decay(kDecayBlocks);
+    };
+
+    auto per_sample = [&](size_t blocks) {
+        auto start = std::chrono::steady_clock::now();
+        volatile float sink = decay(blocks);
+        (void)sink;
+        std::chrono::duration<double, std::nano> elapsed =
+            std::chrono::steady_clock::now() - start;
+        return elapsed.count() / static_cast<double>(blocks * kBenchmarkBlockSize);
+    };
+    const double first_second = per_sample(kFirstSecondBlocks);
+    const double whole_decay = per_sample(kDecayBlocks);
+    WARN("Decay: " << first_second << " ns/sample in the first second, "
+         << whole_decay << " ns/sample over 50 s");
+}
+
+TEST_CASE("CloudsReverb modulation benchmark", "[benchmark][reverb][modulation]") {
+    clouds::CloudsReverb reverb;
+    reverb.Init(static_cast<float>(kBenchmarkSampleRate));
+
+    std::vector<float> left(kBenchmarkBlockSize);
+    std::vector<float> right(kBenchmarkBlockSize);
+    std::vector<float> cv(kBenchmarkBlockSize);
+    for (size_t i = 0; i < kBenchmarkBlockSize; ++i) {
+        left[i] = (static_cast<float>(i % 17) / 17.0f - 0.5f);
+        right[i] = (static_cast<float>(i % 13) / 13.0f - 0.5f);
+        cv[i] = 0.1f * std::sin(0.01f * static_cast<float>(i));
+    }
+
+    BENCHMARK("Process 512 samples with parameter ramp") {
+        reverb.RampParameters(0.5f, 0.5f, (left[0] > 0.0f) ? 0.6f : 0.4f, 0.625f, 0.7f);
+        reverb.Process(left.data(), right.data(), kBenchmarkBlockSize);
+        return left[0] + right[0];
+    };
+
+    BENCHMARK("Process 512 samples with Time and Diffusion CV") {
+        clouds::CloudsReverb::Modulation modulation;
+        modulation.time = cv.data();
+        modulation.diffusion = cv.data();
+        reverb.Process(left.data(), right.data(), kBenchmarkBlockSize, &modulation);
+        return left[0] + right[0];
+    };
+}
+
+TEST_CASE("CloudsReverbBank benchmark", "[benchmark][reverb][bank]") {
+    constexpr size_t kLanes = 8;
+    auto bank = std::make_unique<clouds::CloudsReverbBank<kLanes>>();
+    bank->Init(static_cast<float>(kBenchmarkSampleRate));
+    std::vector<std::unique_ptr<clouds::CloudsReverb>> reverbs;
+    for (size_t k = 0; k < kLanes; ++k) {
+        reverbs.push_back(std::make_unique<clouds::CloudsReverb>());
+        reverbs[k]->Init(static_cast<float>(kBenchmarkSampleRate));
+    }
+
+    std::vector<float> left(kBenchmarkBlockSize * kLanes);
+    std::vector<float> right(kBenchmarkBlockSize * kLanes);
+    for (size_t i = 0; i < left.size(); ++i) {
+        left[i] = (static_cast<float>(i % 17) / 17.0f - 0.5f);
+        right[i] = (static_cast<float>(i % 13) / 13.0f - 0.5f);
+    }
+    float* l[kLanes];
+    float* r[kLanes];
+    for (size_t k = 0; k < kLanes; ++k) {
+        l[k] = &left[k * kBenchmarkBlockSize];
+        r[k] = &right[k * kBenchmarkBlockSize];
+    }
+
+    auto instances = [&] {
+        for (size_t k = 0; k < kLanes; ++k) {
+            reverbs[k]->Process(l[k], r[k], kBenchmarkBlockSize);
+        }
+        return left[0] + right[0];
+    };
+    auto lanes = [&] {
+        bank->Process(l, r, kBenchmarkBlockSize);
+        return left[0] + right[0];
+    };
+
+    BENCHMARK("Process 512 samples x 8 streams (8 instances)") {
+        return instances();
+    };
+
+    BENCHMARK("Process 512 samples x 8 streams (CloudsReverbBank<8>)") {
+        return lanes();
+    };
+
+    perf::Measure("Process 512 samples x 8 streams (8 instances)",
+                  kBenchmarkBlockSize * kLanes, instances);
+    perf::Measure("Process 512 samples x 8 streams (CloudsReverbBank<8>)",
+                  kBenchmarkBlockSize * kLanes, lanes);
+}
+
+namespace {
+
+// Error of a reverb stored in `format` against FORMAT_32_BIT, in dB relative
+// to the output, on a second of white noise followed by a second of tail.
+template<clouds::Format format>
+double StorageNoiseFloor() {
+    clouds::CloudsReverb reference;
+    clouds::BasicCloudsReverb<format> reverb;
+    reference.Init(static_cast<float>(kBenchmarkSampleRate));
+    reverb.Init(static_cast<float>(kBenchmarkSampleRate));
+    reference.SetAmount(1.0f);
+    reverb.SetAmount(1.0f);
+
+    uint32_t seed = 1;
+    double error = 0.0;
+    double signal = 0.0;
+    std::vector<float> left(kBenchmarkBlockSize);
+    std::vector<float> right(kBenchmarkBlockSize);
+    std::vector<float> expected_left(kBenchmarkBlockSize);
+    std::vector<float> expected_right(kBenchmarkBlockSize);
+    const size_t num_blocks = 2 * kBenchmarkSampleRate / kBenchmarkBlockSize;
+    for (size_t block = 0; block < num_blocks; ++block) {
+        for (size_t i = 0; i < kBenchmarkBlockSize; ++i) {
+            seed = seed * 1664525 + 1013904223;
+            float noise = static_cast<float>(seed >> 8) / 16777216.0f - 0.5f;
+            left[i] = block < num_blocks / 2 ? noise * 0.5f : 0.0f;
+            right[i] = block < num_blocks / 2 ? -noise * 0.3f : 0.0f;
+        }
+        expected_left = left;
+        expected_right = right;
+        reference.Process(expected_left.data(), expected_right.data(), kBenchmarkBlockSize);
+        reverb.Process(left.data(), right.data(), kBenchmarkBlockSize);
+        for (size_t i = 0; i < kBenchmarkBlockSize; ++i) {
+            float e_l = left[i] - expected_left[i];
+            float e_r = right[i] - expected_right[i];
+            error += e_l * e_l + e_r * e_r;
+            signal += expected_left[i] * expected_left[i] +
+                expected_right[i] * expected_right[i];
+        }
+    }
+    return 10.0 * std::log10(error / signal);
+}
+
+// Processes 512 samples through each of `kInstances` reverbs in turn, as a
+// host running several instances per core would.
+template<clouds::Format format, clouds::RingLayout ring = clouds::RING_MIRRORED>
+void BenchmarkStorageFormat(const std::string& name) {
+    constexpr size_t kInstances = 8;
+    std::vector<std::unique_ptr<clouds::BasicCloudsReverb<format, ring>>> reverbs;
+    for (size_t k = 0; k < kInstances; ++k) {
+        reverbs.push_back(std::make_unique<clouds::BasicCloudsReverb<format, ring>>());
+        reverbs[k]->Init(static_cast<float>(kBenchmarkSampleRate));
+        reverbs[k]->SetSleepEnabled(false);
+    }
+    std::vector<float> left(kBenchmarkBlockSize);
+    std::vector<float> right(kBenchmarkBlockSize);
+    for (size_t i = 0; i < kBenchmarkBlockSize; ++i) {
+        left[i] = (static_cast<float>(i % 17) / 17.0f - 0.5f);
+        right[i] = (static_cast<float>(i % 13) / 13.0f - 0.5f);
+    }
+
+    auto process = [&] {
+        for (auto& reverb : reverbs) {
+            reverb->Process(left.data(), right.data(), kBenchmarkBlockSize);
+        }
+        return left[0] + right[0];
+    };
+    BENCHMARK("Process 512 samples x 8 instances (" + name + ")") {
+        return process();
+    };
+    perf::Measure("Process 512 samples x 8 instances (" + name + ")",
+                  kBenchmarkBlockSize * kInstances, process);
+
+    WARN(name << ": " << reverbs[0]->GetMemorySize() / 1024
+         << " KB per instance, error floor "
+         << StorageNoiseFloor<format>() << " dB");
+}
+
+}  // namespace
+
+TEST_CASE("CloudsReverb storage format benchmark", "[benchmark][reverb][format]") {
+    BenchmarkStorageFormat<clouds::FORMAT_32_BIT>("FORMAT_32_BIT");
+    BenchmarkStorageFormat<clouds::FORMAT_16_BIT_FLOAT>("FORMAT_16_BIT_FLOAT");
+    BenchmarkStorageFormat<clouds::FORMAT_16_BIT>("FORMAT_16_BIT");
+    BenchmarkStorageFormat<clouds::FORMAT_12_BIT>("FORMAT_12_BIT");
+    BenchmarkStorageFormat<clouds::FORMAT_32_BIT, clouds::RING_PACKED>(
+        "FORMAT_32_BIT, RING_PACKED");
+    BenchmarkStorageFormat<clouds::FORMAT_16_BIT, clouds::RING_PACKED>(
+        "FORMAT_16_BIT, RING_PACKED");
+}
+
 TEST_CASE("CloudsReverb initialization benchmark", "[benchmark][reverb]") {
     BENCHMARK("Init at 48kHz") {
         clouds::CloudsReverb reverb;
@@ -78,6 +396,33 @@ TEST_CASE("CloudsReverb initialization benchmark", "[benchmark][reverb]") {
     };
 }
 
+TEST_CASE("CloudsReverb session load benchmark", "[benchmark][reverb][memory]") {
+    // A project opening with 500 instances
+    constexpr size_t kInstances = 500;
+    BENCHMARK("Set up 500 instances (heap)") {
+        std::vector<clouds::CloudsReverb> reverbs(kInstances);
+        for (auto& reverb : reverbs) {
+            reverb.Init(48000.0f);
+        }
+        return reverbs.size();
+    };
+
+#ifdef CLOUDS_HAVE_PAGE_ALLOCATOR
+    BENCHMARK("Set up 500 instances (arena on huge pages)") {
+        clouds::PageAllocator pages(true);
+        clouds::ArenaAllocator arena(
+            &pages, kInstances * clouds::CloudsReverb::MemorySize(48000.0f));
+        std::vector<clouds::CloudsReverb> reverbs;
+        reverbs.reserve(kInstances);
+        for (size_t i = 0; i < kInstances; ++i) {
+            reverbs.emplace_back(&arena);
+            reverbs.back().Init(48000.0f);
+        }
+        return reverbs.size();
+    };
+#endif  // CLOUDS_HAVE_PAGE_ALLOCATOR
+}
+
 TEST_CASE("CloudsReverb Clear benchmark", "[benchmark][reverb]") {
     clouds::CloudsReverb reverb;
     reverb.Init(static_cast<float>(kBenchmarkSampleRate));
@@ -93,6 +438,34 @@ TEST_CASE("CloudsReverb Clear benchmark", "[benchmark][reverb]") {
     };
 }
 
+TEST_CASE("CloudsReverb snapshot benchmark", "[benchmark][reverb][snapshot]") {
+    clouds::CloudsReverb reverb;
+    reverb.Init(static_cast<float>(kBenchmarkSampleRate));
+    std::vector<float> left(kBenchmarkBlockSize, 1.0f);
+    std::vector<float> right(kBenchmarkBlockSize, 1.0f);
+    reverb.Process(left.data(), right.data(), kBenchmarkBlockSize);
+
+    clouds::CloudsReverb::Snapshot snapshot;
+    snapshot.Allocate(reverb);
+    std::vector<uint8_t> compact(reverb.GetCompactSnapshotSize());
+
+    BENCHMARK("SaveSnapshot") {
+        return reverb.SaveSnapshot(&snapshot);
+    };
+
+    BENCHMARK("RestoreSnapshot") {
+        return reverb.RestoreSnapshot(snapshot);
+    };
+
+    BENCHMARK("SaveCompactSnapshot") {
+        return reverb.SaveCompactSnapshot(compact.data(), compact.size());
+    };
+
+    BENCHMARK("RestoreCompactSnapshot") {
+        return reverb.RestoreCompactSnapshot(compact.data(), compact.size());
+    };
+}
+
 TEST_CASE("CloudsReverb parameter setting benchmark", "[benchmark][reverb]") {
     clouds::CloudsReverb reverb;
     reverb.Init(static_cast<float>(kBenchmarkSampleRate));
@@ -148,3 +521,59 @@ TEST_CASE("CloudsReverb mono to stereo benchmark", "[benchmark][reverb]") {
         return left[0] + right[0];
     };
 }
+
+TEST_CASE("RenderQueue scaling benchmark", "[benchmark][render]") {
+    // 64 one-shots of 0.1 to 1 s, each with a 0.2 s tail
+    constexpr size_t kNumJobs = 64;
+    constexpr size_t kTail = kBenchmarkSampleRate / 5;
+    std::vector<std::vector<float>> left(kNumJobs), right(kNumJobs);
+    std::vector<std::vector<float>> output_left(kNumJobs), output_right(kNumJobs);
+    std::vector<clouds::RenderJob> jobs(kNumJobs);
+    size_t total_samples = 0;
+    uint32_t seed = 1;
+    for (size_t j = 0; j < kNumJobs; ++j) {
+        const size_t size = kBenchmarkSampleRate / 10 +
+            (j * 7919) % (kBenchmarkSampleRate * 9 / 10);
+        left[j].resize(size);
+        right[j].resize(size);
+        output_left[j].resize(size + kTail);
+        output_right[j].resize(size + kTail);
+        for (size_t i = 0; i < size; ++i) {
+            seed = seed * 1664525u + 1013904223u;
+            left[j][i] = static_cast<float>(seed >> 8) / 16777216.0f - 0.5f;
+            right[j][i] = -left[j][i];
+        }
+        clouds::RenderJob& job = jobs[j];
+        job.input_left = left[j].data();
+        job.input_right = right[j].data();
+        job.output_left = output_left[j].data();
+        job.output_right = output_right[j].data();
+        job.size = size;
+        job.tail = kTail;
+        job.time = 0.3f + 0.6f * static_cast<float>(j % 8) / 8.0f;
+        total_samples += size + kTail;
+    }
+
+    // Throughput should grow with the workers up to the number of cores,
+    // with a progress callback as a batch tool would pass.
+    std::vector<size_t> thread_counts = { 1, 2, 4 };
+    const size_t num_cores = std::max(1u, std::thread::hardware_concurrency());
+    if (num_cores > 4) {
+        thread_counts.push_back(num_cores);
+    }
+    for (size_t num_threads : thread_counts) {
+        clouds::RenderQueue queue(num_threads);
+        size_t reports = 0;
+        auto render = [&] {
+            queue.Render(jobs.data(), jobs.size(),
+                         [&](size_t, size_t) { ++reports; });
+            return output_left[0][0] + static_cast<float>(reports);
+        };
+        const std::string name = "Render 64 one-shots (" +
+            std::to_string(total_samples / kBenchmarkSampleRate) + " s) on " +
+            std::to_string(num_threads) + " worker(s)";
+        BENCHMARK(std::string(name)) {
+            return render();
+        };
+    }
+}
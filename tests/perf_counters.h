@@ -0,0 +1,279 @@
+// Hardware performance counters for the benchmarks
+//
+// Catch2 only reports wall time, which cannot tell a layout change that
+// saves cache misses from one that happens to run on a quieter core. With
+// CLOUDS_PERF_COUNTERS set to a file name, benchmarks that call
+// perf::Measure() also run their body under the CPU's counters (Linux
+// perf_event_open) and write them, per processed sample, to that file as
+// JSON:
+//
+//   CLOUDS_PERF_COUNTERS=perf.json ./vibemodule_tests "[benchmark]"
+//
+// Each counter is opened on its own, so one the CPU or the kernel refuses
+// (no PMU in most VMs and containers, perf_event_paranoid above 2, other
+// systems) is only left out, and the report says why. Wall time is always
+// reported. Counters count user space only, which perf_event_paranoid 2 (the
+// usual default) allows.
+
+#ifndef VIBEMODULE_TESTS_PERF_COUNTERS_H_
+#define VIBEMODULE_TESTS_PERF_COUNTERS_H_
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#define VIBEMODULE_HAVE_PERF_EVENTS 1
+#endif
+
+namespace perf {
+
+struct Event {
+    const char* name;
+    uint32_t type;
+    uint64_t config;
+};
+
+#ifdef VIBEMODULE_HAVE_PERF_EVENTS
+
+constexpr uint64_t CacheMiss(uint64_t cache) {
+    return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+        (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+}
+
+inline std::vector<Event> DefaultEvents() {
+    return {
+        { "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+        { "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+        { "l1d_misses", PERF_TYPE_HW_CACHE, CacheMiss(PERF_COUNT_HW_CACHE_L1D) },
+        { "llc_misses", PERF_TYPE_HW_CACHE, CacheMiss(PERF_COUNT_HW_CACHE_LL) },
+        { "branch_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+        { "dtlb_misses", PERF_TYPE_HW_CACHE, CacheMiss(PERF_COUNT_HW_CACHE_DTLB) },
+    };
+}
+
+#else
+
+inline std::vector<Event> DefaultEvents() { return {}; }
+
+#endif  // VIBEMODULE_HAVE_PERF_EVENTS
+
+// A set of counters on the calling thread, each opened separately.
+class Counters {
+ public:
+    explicit Counters(const std::vector<Event>& events = DefaultEvents())
+        : events_(events), fds_(events.size(), -1) {
+#ifdef VIBEMODULE_HAVE_PERF_EVENTS
+        for (size_t i = 0; i < events_.size(); ++i) {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = events_[i].type;
+            attr.config = events_[i].config;
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            // When there are more counters than the PMU has, the kernel
+            // time-shares them; the times let Read() scale the counts up.
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+                PERF_FORMAT_TOTAL_TIME_RUNNING;
+            fds_[i] = static_cast<int>(
+                syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+            if (fds_[i] < 0 && error_.empty()) {
+                error_ = std::string(events_[i].name) + ": " + std::strerror(errno);
+            }
+        }
+#else
+        error_ = "perf_event_open is only available on Linux";
+#endif
+    }
+
+    ~Counters() {
+#ifdef VIBEMODULE_HAVE_PERF_EVENTS
+        for (int fd : fds_) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+#endif
+    }
+
+    Counters(const Counters&) = delete;
+    Counters& operator=(const Counters&) = delete;
+
+    size_t size() const { return events_.size(); }
+    const char* name(size_t i) const { return events_[i].name; }
+    bool available(size_t i) const { return fds_[i] >= 0; }
+
+    // Why the first counter that could not be opened was refused, or empty.
+    const std::string& error() const { return error_; }
+
+    void Start() {
+#ifdef VIBEMODULE_HAVE_PERF_EVENTS
+        for (int fd : fds_) {
+            if (fd >= 0) {
+                ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+                ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+#endif
+    }
+
+    void Stop() {
+#ifdef VIBEMODULE_HAVE_PERF_EVENTS
+        for (int fd : fds_) {
+            if (fd >= 0) {
+                ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+            }
+        }
+#endif
+    }
+
+    // Count of counter `i` between Start() and Stop(), scaled up if it only
+    // ran part of the time. False if it is not available or never ran.
+    bool Read(size_t i, double* value) const {
+#ifdef VIBEMODULE_HAVE_PERF_EVENTS
+        uint64_t data[3];  // Value, time enabled, time running
+        if (fds_[i] < 0 || read(fds_[i], data, sizeof(data)) != sizeof(data) ||
+            !data[2]) {
+            return false;
+        }
+        *value = static_cast<double>(data[0]) *
+            static_cast<double>(data[1]) / static_cast<double>(data[2]);
+        return true;
+#else
+        (void)i;
+        (void)value;
+        return false;
+#endif
+    }
+
+ private:
+    std::vector<Event> events_;
+    std::vector<int> fds_;
+    std::string error_;
+};
+
+// The JSON file named by CLOUDS_PERF_COUNTERS, rewritten after each
+// measurement so that an interrupted run keeps what it measured.
+class Report {
+ public:
+    static Report& Get() {
+        static Report report;
+        return report;
+    }
+
+    bool enabled() const { return !path_.empty(); }
+
+    void Add(const std::string& benchmark, const std::string& error) {
+        benchmarks_.push_back(benchmark);
+        if (error_.empty()) {
+            error_ = error;
+        }
+        std::FILE* file = std::fopen(path_.c_str(), "w");
+        if (!file) {
+            std::fprintf(stderr, "perf: cannot write %s\n", path_.c_str());
+            return;
+        }
+        std::fprintf(file, "{\n  \"unavailable\": %s,\n  \"benchmarks\": [\n",
+                     error_.empty() ? "null" : Quote(error_).c_str());
+        for (size_t i = 0; i < benchmarks_.size(); ++i) {
+            std::fprintf(file, "    %s%s\n", benchmarks_[i].c_str(),
+                         i + 1 < benchmarks_.size() ? "," : "");
+        }
+        std::fprintf(file, "  ]\n}\n");
+        std::fclose(file);
+    }
+
+    static std::string Quote(const std::string& s) {
+        std::string quoted = "\"";
+        for (char c : s) {
+            if (c == '"' || c == '\\') {
+                quoted += '\\';
+            }
+            quoted += c;
+        }
+        return quoted + "\"";
+    }
+
+ private:
+    Report() {
+        const char* path = std::getenv("CLOUDS_PERF_COUNTERS");
+        path_ = path ? path : "";
+    }
+
+    std::string path_;
+    std::string error_;
+    std::vector<std::string> benchmarks_;
+};
+
+// Runs `body` (which processes `samples` samples per call and returns a
+// value to keep the work alive) for about a tenth of a second under the
+// counters, and adds the counts per sample to the report as `name`. Does
+// nothing unless CLOUDS_PERF_COUNTERS is set.
+template<typename F>
+void Measure(const std::string& name, size_t samples, F&& body) {
+    Report& report = Report::Get();
+    if (!report.enabled()) {
+        return;
+    }
+    volatile float sink = body();  // Warm up caches and branch predictors
+
+    // Enough calls for about 100 ms, timed from one.
+    auto start = std::chrono::steady_clock::now();
+    sink = body();
+    const double once = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    const size_t calls = once > 0.01 ? 10 : static_cast<size_t>(0.1 / (once + 1e-9));
+
+    Counters counters;
+    counters.Start();
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < calls; ++i) {
+        sink = body();
+    }
+    const double nanoseconds = std::chrono::duration<double, std::nano>(
+        std::chrono::steady_clock::now() - start).count();
+    counters.Stop();
+    (void)sink;
+
+    const double total = static_cast<double>(calls * samples);
+    std::string json = "{ \"name\": " + Report::Quote(name) +
+        ", \"calls\": " + std::to_string(calls) +
+        ", \"samples\": " + std::to_string(calls * samples) +
+        ", \"per_sample\": { \"nanoseconds\": " + std::to_string(nanoseconds / total);
+    double cycles = 0.0;
+    double instructions = 0.0;
+    for (size_t i = 0; i < counters.size(); ++i) {
+        double value;
+        if (!counters.Read(i, &value)) {
+            continue;
+        }
+        json += std::string(", \"") + counters.name(i) + "\": " +
+            std::to_string(value / total);
+        if (!std::strcmp(counters.name(i), "cycles")) {
+            cycles = value;
+        } else if (!std::strcmp(counters.name(i), "instructions")) {
+            instructions = value;
+        }
+    }
+    json += " }";
+    if (cycles > 0.0 && instructions > 0.0) {
+        json += ", \"ipc\": " + std::to_string(instructions / cycles);
+    }
+    json += " }";
+    report.Add(json, counters.error());
+}
+
+}  // namespace perf
+
+#endif  // VIBEMODULE_TESTS_PERF_COUNTERS_H_
@@ -0,0 +1,129 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/catch_approx.hpp>
+#include "audio_io.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// clouds-render's WAV reader (tools/clouds-render/audio_io.cpp)
+
+namespace {
+
+void PutU16(std::vector<uint8_t>* bytes, uint16_t value) {
+    bytes->push_back(static_cast<uint8_t>(value));
+    bytes->push_back(static_cast<uint8_t>(value >> 8));
+}
+
+void PutU32(std::vector<uint8_t>* bytes, uint32_t value) {
+    PutU16(bytes, static_cast<uint16_t>(value));
+    PutU16(bytes, static_cast<uint16_t>(value >> 16));
+}
+
+void PutTag(std::vector<uint8_t>* bytes, const char* tag) {
+    for (int i = 0; i < 4; ++i) {
+        bytes->push_back(static_cast<uint8_t>(tag[i]));
+    }
+}
+
+// A stereo 16-bit file of `frames` silent frames at `rate`.
+std::vector<uint8_t> Wav(uint32_t rate, uint32_t frames) {
+    std::vector<uint8_t> bytes;
+    PutTag(&bytes, "RIFF");
+    PutU32(&bytes, 36 + frames * 4);
+    PutTag(&bytes, "WAVE");
+    PutTag(&bytes, "fmt ");
+    PutU32(&bytes, 16);
+    PutU16(&bytes, 1);  // PCM
+    PutU16(&bytes, 2);
+    PutU32(&bytes, rate);
+    PutU32(&bytes, rate * 4);
+    PutU16(&bytes, 4);
+    PutU16(&bytes, 16);
+    PutTag(&bytes, "data");
+    PutU32(&bytes, frames * 4);
+    bytes.resize(bytes.size() + frames * 4, 0);
+    return bytes;
+}
+
+class TemporaryFile {
+ public:
+    explicit TemporaryFile(const std::vector<uint8_t>& bytes)
+        : path_((std::filesystem::temp_directory_path() /
+                 ("vibemodule_test_" + std::to_string(next_++) + ".wav"))
+                    .string()) {
+        std::FILE* file = std::fopen(path_.c_str(), "wb");
+        if (file) {
+            std::fwrite(bytes.data(), 1, bytes.size(), file);
+            std::fclose(file);
+        }
+    }
+    ~TemporaryFile() { std::remove(path_.c_str()); }
+
+    const std::string& path() const { return path_; }
+
+ private:
+    static int next_;
+    std::string path_;
+};
+
+int TemporaryFile::next_ = 0;
+
+}  // namespace
+
+TEST_CASE("WAV reader reads a well-formed file", "[audio_io]") {
+    TemporaryFile file(Wav(96000, 100));
+    std::string error;
+    auto reader = clouds_render::OpenWavReader(file.path(), &error);
+    REQUIRE(reader);
+    CHECK(reader->num_channels() == 2);
+    CHECK(reader->sample_rate() == Catch::Approx(96000.0f));
+    CHECK(reader->num_frames() == 100);
+    std::vector<float> l(128, 1.0f);
+    std::vector<float> r(128, 1.0f);
+    CHECK(reader->Read(l.data(), r.data(), l.size()) == 100);
+    CHECK(l[99] == 0.0f);
+}
+
+TEST_CASE("WAV reader rejects truncated and garbage headers", "[audio_io]") {
+    const std::vector<uint8_t> valid = Wav(48000, 16);
+    std::vector<std::vector<uint8_t>> invalid;
+    invalid.push_back({});
+    invalid.push_back(std::vector<uint8_t>(valid.begin(), valid.begin() + 8));
+    // Cut inside the fmt chunk
+    invalid.push_back(std::vector<uint8_t>(valid.begin(), valid.begin() + 30));
+    // No data chunk
+    invalid.push_back(std::vector<uint8_t>(valid.begin(), valid.begin() + 36));
+    std::vector<uint8_t> garbage(256);
+    uint32_t seed = 1;
+    for (uint8_t& byte : garbage) {
+        seed = seed * 1664525u + 1013904223u;
+        byte = static_cast<uint8_t>(seed >> 24);
+    }
+    invalid.push_back(garbage);
+    // A RIFF/WAVE signature followed by garbage
+    std::copy(valid.begin(), valid.begin() + 12, garbage.begin());
+    invalid.push_back(garbage);
+
+    for (const auto& bytes : invalid) {
+        TemporaryFile file(bytes);
+        std::string error;
+        CHECK_FALSE(clouds_render::OpenWavReader(file.path(), &error));
+        CHECK_FALSE(error.empty());
+    }
+}
+
+TEST_CASE("WAV reader rejects implausible sample rates", "[audio_io]") {
+    // Such a rate would size the reverb's delay memory in gigabytes.
+    for (uint32_t rate : { 0u, 768001u, 0xFFFFFFFFu }) {
+        TemporaryFile file(Wav(rate, 16));
+        std::string error;
+        CHECK_FALSE(clouds_render::OpenWavReader(file.path(), &error));
+        CHECK(error.find("sample rate") != std::string::npos);
+    }
+    TemporaryFile file(Wav(768000, 16));
+    std::string error;
+    CHECK(clouds_render::OpenWavReader(file.path(), &error));
+}
@@ -0,0 +1,261 @@
+#include <catch2/catch_test_macros.hpp>
+#include "audio_io.h"
+#include "checkpoints.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+// clouds-render's checkpoints (tools/clouds-render/checkpoints.cpp) and,
+// through the tool itself, incremental re-renders.
+
+namespace {
+
+class TemporaryPath {
+ public:
+    explicit TemporaryPath(const char* suffix)
+        : path_((std::filesystem::temp_directory_path() /
+                 ("vibemodule_checkpoints_" + std::to_string(next_++) + suffix))
+                    .string()) { }
+    ~TemporaryPath() { std::remove(path_.c_str()); }
+
+    const std::string& path() const { return path_; }
+
+ private:
+    static int next_;
+    std::string path_;
+};
+
+int TemporaryPath::next_ = 0;
+
+clouds_render::CheckpointSettings TestSettings() {
+    clouds_render::CheckpointSettings settings;
+    settings.interval = 100;
+    settings.num_frames = 250;
+    settings.snapshot_size = 16;
+    settings.sample_rate = 48000.0f;
+    settings.num_channels = 2;
+    settings.parameters[2] = 0.5f;
+    return settings;
+}
+
+std::vector<uint8_t> Snapshot(uint8_t value) {
+    return std::vector<uint8_t>(16, value);
+}
+
+}  // namespace
+
+TEST_CASE("HashFrames covers the channels in use", "[checkpoints]") {
+    using clouds_render::HashFrames;
+    using clouds_render::kHashSeed;
+    std::vector<float> l = { 0.1f, -0.2f, 0.3f, 0.0f };
+    std::vector<float> r = { 0.5f, 0.6f, -0.7f, 0.8f };
+
+    const uint64_t stereo = HashFrames(kHashSeed, l.data(), r.data(), 2, 4);
+    const uint64_t mono = HashFrames(kHashSeed, l.data(), r.data(), 1, 4);
+    CHECK(stereo != mono);
+    // Hashing in pieces equals hashing at once
+    CHECK(HashFrames(HashFrames(kHashSeed, l.data(), r.data(), 2, 1),
+                     &l[1], &r[1], 2, 3) == stereo);
+
+    // Mono ignores the right channel; any change to a used sample shows
+    r[2] = 0.0f;
+    CHECK(HashFrames(kHashSeed, l.data(), r.data(), 1, 4) == mono);
+    CHECK(HashFrames(kHashSeed, l.data(), r.data(), 2, 4) != stereo);
+    l[3] = -0.0f;
+    CHECK(HashFrames(kHashSeed, l.data(), r.data(), 1, 4) != mono);
+}
+
+TEST_CASE("CheckpointFile is only valid once finalized", "[checkpoints]") {
+    using clouds_render::CheckpointFile;
+    TemporaryPath path(".ckpt");
+    const clouds_render::CheckpointSettings settings = TestSettings();
+    REQUIRE(settings.num_checkpoints() == 3);
+    std::string error;
+
+    {
+        CheckpointFile file;
+        REQUIRE(file.Create(path.path(), settings, &error));
+        for (uint64_t i = 0; i < 3; ++i) {
+            CHECK(file.Write(i, 1000 + i, Snapshot(static_cast<uint8_t>(i)).data()));
+        }
+        CHECK_FALSE(file.Write(3, 0, Snapshot(0).data()));
+
+        // An interrupted render leaves no checkpoint file
+        CheckpointFile reader;
+        CHECK_FALSE(reader.Open(path.path(), &error));
+        CHECK(file.Finalize());
+    }
+
+    {
+        CheckpointFile file;
+        REQUIRE(file.Open(path.path(), &error));
+        CHECK(file.settings().Matches(settings));
+        uint64_t hash = 0;
+        std::vector<uint8_t> snapshot(16);
+        CHECK(file.ReadHash(1, &hash));
+        CHECK(hash == 1001);
+        CHECK(file.ReadSnapshot(2, snapshot.data()));
+        CHECK(snapshot == Snapshot(2));
+        CHECK_FALSE(file.ReadHash(3, &hash));
+        CHECK(file.Write(1, 2001, Snapshot(7).data()));
+        // Nor does an interrupted update
+    }
+    clouds_render::CheckpointFile interrupted;
+    CHECK_FALSE(interrupted.Open(path.path(), &error));
+
+    {
+        CheckpointFile file;
+        REQUIRE(file.Create(path.path(), settings, &error));
+        CHECK(file.Finalize());
+    }
+    {
+        CheckpointFile file;
+        REQUIRE(file.Open(path.path(), &error));
+        CHECK(file.Finalize());
+    }
+    clouds_render::CheckpointFile finalized;
+    CHECK(finalized.Open(path.path(), &error));
+
+    // Any difference in the settings rules the checkpoints out
+    clouds_render::CheckpointSettings other = settings;
+    other.parameters[2] = 0.6f;
+    CHECK_FALSE(other.Matches(settings));
+    other = settings;
+    other.num_frames += 1;
+    CHECK_FALSE(other.Matches(settings));
+    other = settings;
+    other.mode = 1;
+    CHECK_FALSE(other.Matches(settings));
+}
+
+#ifdef CLOUDS_RENDER_PATH
+
+namespace {
+
+const size_t kFrames = 150000;
+
+// Noise bursts, changed from `edit_start` for `edit_size` frames.
+std::vector<float> Input(size_t edit_start = 0, size_t edit_size = 0) {
+    std::vector<float> samples(2 * kFrames);
+    uint32_t seed = 1;
+    for (size_t i = 0; i < kFrames; ++i) {
+        seed = seed * 1664525u + 1013904223u;
+        const float noise = static_cast<float>(seed >> 8) / 16777216.0f - 0.5f;
+        const float envelope = (i / 12000) % 2 ? 0.0f : 0.5f;
+        const bool edited = i >= edit_start && i < edit_start + edit_size;
+        samples[2 * i] = edited ? 0.25f : noise * envelope;
+        samples[2 * i + 1] = edited ? -0.25f : -noise * envelope;
+    }
+    return samples;
+}
+
+void WriteWav(const std::string& path, const std::vector<float>& samples) {
+    std::string error;
+    auto writer = clouds_render::OpenWavWriter(
+        path, clouds_render::SampleFormat::kFloat32, 48000.0f, &error);
+    REQUIRE(writer);
+    std::vector<float> l(samples.size() / 2), r(samples.size() / 2);
+    for (size_t i = 0; i < l.size(); ++i) {
+        l[i] = samples[2 * i];
+        r[i] = samples[2 * i + 1];
+    }
+    REQUIRE(writer->Write(l.data(), r.data(), l.size()));
+    REQUIRE(writer->Finalize());
+}
+
+std::vector<float> ReadWav(const std::string& path) {
+    std::string error;
+    auto reader = clouds_render::OpenWavReader(path, &error);
+    REQUIRE(reader);
+    const size_t frames = static_cast<size_t>(reader->num_frames());
+    std::vector<float> l(frames), r(frames);
+    REQUIRE(reader->Read(l.data(), r.data(), frames) == frames);
+    std::vector<float> samples(2 * frames);
+    for (size_t i = 0; i < frames; ++i) {
+        samples[2 * i] = l[i];
+        samples[2 * i + 1] = r[i];
+    }
+    return samples;
+}
+
+float MaxDifference(const std::vector<float>& a, const std::vector<float>& b) {
+    REQUIRE(a.size() == b.size());
+    float difference = 0.0f;
+    for (size_t i = 0; i < a.size(); ++i) {
+        difference = std::max(difference, std::abs(a[i] - b[i]));
+    }
+    return difference;
+}
+
+// Runs clouds-render and returns what it printed to stderr.
+std::string Render(const std::string& arguments) {
+    TemporaryPath log(".log");
+    const std::string command = std::string(CLOUDS_RENDER_PATH) +
+        " --tail 1 --interval 0.35 " + arguments + " 2> " + log.path();
+    CHECK(std::system(command.c_str()) == 0);
+    std::ifstream stream(log.path());
+    return std::string(std::istreambuf_iterator<char>(stream),
+                       std::istreambuf_iterator<char>());
+}
+
+}  // namespace
+
+TEST_CASE("clouds-render re-renders only what an edit changed", "[checkpoints]") {
+    TemporaryPath input(".wav");
+    TemporaryPath edited(".wav");
+    TemporaryPath output(".wav");
+    TemporaryPath reference(".wav");
+    TemporaryPath checkpoints(".ckpt");
+    const std::string options = "--checkpoints " + checkpoints.path() + " ";
+    WriteWav(input.path(), Input());
+    WriteWav(edited.path(), Input(70000, 2000));
+
+    // The default tolerance, -120 dB, for float output
+    const float tolerance = 1e-6f;
+
+    Render(options + input.path() + " " + output.path());
+    Render(edited.path() + " " + reference.path());
+    REQUIRE(MaxDifference(ReadWav(output.path()), ReadWav(reference.path())) > 0.01f);
+
+    SECTION("incrementally") {
+        const std::string log =
+            Render(options + edited.path() + " " + output.path());
+        CHECK(log.find("re-rendered") != std::string::npos);
+        CHECK(log.find("rendering in full") == std::string::npos);
+        CHECK(MaxDifference(ReadWav(output.path()), ReadWav(reference.path())) <=
+              tolerance);
+
+        // Nothing changed since: nothing is rendered
+        const std::string again =
+            Render(options + edited.path() + " " + output.path());
+        CHECK(again.find("re-rendered 0 frames") != std::string::npos);
+    }
+
+    SECTION("in full after an interrupted update") {
+        {
+            clouds_render::CheckpointFile file;
+            std::string error;
+            REQUIRE(file.Open(checkpoints.path(), &error));
+            uint64_t hash;
+            REQUIRE(file.ReadHash(0, &hash));
+            // Destroyed without Finalize(), as by a kill
+        }
+        const std::string log =
+            Render(options + edited.path() + " " + output.path());
+        CHECK(log.find("rendering in full") != std::string::npos);
+        CHECK(MaxDifference(ReadWav(output.path()), ReadWav(reference.path())) == 0.0f);
+
+        // The full render left valid checkpoints
+        CHECK(Render(options + edited.path() + " " + output.path())
+                  .find("re-rendered 0 frames") != std::string::npos);
+    }
+}
+
+#endif  // CLOUDS_RENDER_PATH
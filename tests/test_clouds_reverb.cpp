@@ -1,7 +1,12 @@
 #include <catch2/catch_test_macros.hpp>
 #include <catch2/catch_approx.hpp>
 #include <clouds/clouds_reverb.h>
+#include <clouds/presets.h>
+#include <algorithm>
 #include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
 
 using Catch::Approx;
 
@@ -188,3 +193,1093 @@ TEST_CASE("CloudsReverb dry signal passthrough", "[reverb]") {
         CHECK(frames[i].r == Approx(originalR[i]).margin(0.0001f));
     }
 }
+
+TEST_CASE("CloudsReverb block mode matches per-sample mode", "[reverb][block]") {
+    clouds::CloudsReverb sample_reverb;
+    clouds::CloudsReverb block_reverb;
+    sample_reverb.Init(48000.0f);
+    block_reverb.Init(48000.0f);
+    sample_reverb.SetProcessingMode(clouds::PROCESSING_MODE_SAMPLE);
+    block_reverb.SetProcessingMode(clouds::PROCESSING_MODE_BLOCK);
+    CHECK(block_reverb.GetProcessingMode() == clouds::PROCESSING_MODE_BLOCK);
+
+    sample_reverb.SetParameters(0.8f, 0.6f, 0.9f, 0.7f, 0.6f);
+    block_reverb.SetParameters(0.8f, 0.6f, 0.9f, 0.7f, 0.6f);
+
+    // Run long enough for the tank to recirculate several times, with host
+    // block sizes that do not line up with kBlockSize.
+    uint32_t seed = 1;
+    float max_error = 0.0f;
+    size_t total = 0;
+    for (size_t block_size : {1, 7, 64, 128, 129, 500, 1024, 4000}) {
+        std::vector<clouds::FloatFrame> a(block_size);
+        for (int repeat = 0; repeat < 8; ++repeat) {
+            for (auto& frame : a) {
+                seed = seed * 1664525u + 1013904223u;
+                frame.l = static_cast<float>(seed >> 8) / 16777216.0f - 0.5f;
+                seed = seed * 1664525u + 1013904223u;
+                frame.r = static_cast<float>(seed >> 8) / 16777216.0f - 0.5f;
+            }
+            std::vector<clouds::FloatFrame> b = a;
+            sample_reverb.Process(a.data(), block_size);
+            block_reverb.Process(b.data(), block_size);
+            for (size_t i = 0; i < block_size; ++i) {
+                max_error = std::max(max_error, std::abs(a[i].l - b[i].l));
+                max_error = std::max(max_error, std::abs(a[i].r - b[i].r));
+            }
+            total += block_size;
+        }
+    }
+
+    CHECK(total > 40000);
+    CHECK(max_error <= clouds::CloudsReverb::kBlockModeTolerance);
+}
+
+TEST_CASE("CloudsReverb planar block mode matches per-sample mode", "[reverb][block]") {
+    clouds::CloudsReverb sample_reverb;
+    clouds::CloudsReverb block_reverb;
+    sample_reverb.Init(48000.0f);
+    block_reverb.Init(48000.0f);
+    sample_reverb.SetProcessingMode(clouds::PROCESSING_MODE_SAMPLE);
+    sample_reverb.SetAmount(1.0f);
+    block_reverb.SetAmount(1.0f);
+
+    constexpr size_t bufferSize = 300;
+    std::vector<float> left_a(bufferSize), right_a(bufferSize);
+    float max_error = 0.0f;
+    for (int block = 0; block < 64; ++block) {
+        for (size_t i = 0; i < bufferSize; ++i) {
+            left_a[i] = std::sin(0.01f * static_cast<float>(block * bufferSize + i));
+            right_a[i] = (i % 50 == 0) ? 1.0f : 0.0f;
+        }
+        std::vector<float> left_b = left_a;
+        std::vector<float> right_b = right_a;
+        sample_reverb.Process(left_a.data(), right_a.data(), bufferSize);
+        block_reverb.Process(left_b.data(), right_b.data(), bufferSize);
+        for (size_t i = 0; i < bufferSize; ++i) {
+            max_error = std::max(max_error, std::abs(left_a[i] - left_b[i]));
+            max_error = std::max(max_error, std::abs(right_a[i] - right_b[i]));
+        }
+    }
+    CHECK(max_error <= clouds::CloudsReverb::kBlockModeTolerance);
+}
+
+TEST_CASE("CloudsReverb delay memory scales with sample rate", "[reverb]") {
+    clouds::CloudsReverb reverb;
+
+    reverb.Init(32000.0f);
+    CHECK(reverb.GetBufferSize() == 16384);
+    reverb.Init(44100.0f);
+    CHECK(reverb.GetBufferSize() == 32768);
+    reverb.Init(48000.0f);
+    CHECK(reverb.GetBufferSize() == clouds::CloudsReverb::kBufferSize);
+    reverb.Init(96000.0f);
+    CHECK(reverb.GetBufferSize() == 65536);
+    reverb.Init(192000.0f);
+    CHECK(reverb.GetBufferSize() == 131072);
+}
+
+namespace {
+
+// Renders one second of noise and one of tail through a reverb stored in
+// `format`, and returns the error against FORMAT_32_BIT in dB relative to
+// the output.
+template<clouds::Format format>
+double StorageNoiseFloor() {
+    clouds::CloudsReverb reference;
+    clouds::BasicCloudsReverb<format> reverb;
+    reference.Init(48000.0f);
+    reverb.Init(48000.0f);
+    reference.SetParameters(1.0f, 0.5f, 0.7f, 0.625f, 0.7f);
+    reverb.SetParameters(1.0f, 0.5f, 0.7f, 0.625f, 0.7f);
+    CHECK(reverb.GetMemorySize() == reference.GetMemorySize() / 2);
+
+    uint32_t seed = 1;
+    double error = 0.0;
+    double signal = 0.0;
+    for (int block = 0; block < 2 * 375; ++block) {
+        float left[128];
+        float right[128];
+        for (size_t i = 0; i < 128; ++i) {
+            seed = seed * 1664525 + 1013904223;
+            float noise = static_cast<float>(seed >> 8) / 16777216.0f - 0.5f;
+            left[i] = block < 375 ? noise * 0.5f : 0.0f;
+            right[i] = block < 375 ? -noise * 0.3f : 0.0f;
+        }
+        float expected_left[128];
+        float expected_right[128];
+        std::copy(left, left + 128, expected_left);
+        std::copy(right, right + 128, expected_right);
+        reference.Process(expected_left, expected_right, 128);
+        reverb.Process(left, right, 128);
+        for (size_t i = 0; i < 128; ++i) {
+            error += (left[i] - expected_left[i]) * (left[i] - expected_left[i]) +
+                (right[i] - expected_right[i]) * (right[i] - expected_right[i]);
+            signal += expected_left[i] * expected_left[i] +
+                expected_right[i] * expected_right[i];
+        }
+    }
+    return 10.0 * std::log10(error / signal);
+}
+
+}  // namespace
+
+TEST_CASE("CloudsReverb 16-bit storage formats", "[reverb][format]") {
+    double half = StorageNoiseFloor<clouds::FORMAT_16_BIT_FLOAT>();
+    double fixed_16 = StorageNoiseFloor<clouds::FORMAT_16_BIT>();
+    double fixed_12 = StorageNoiseFloor<clouds::FORMAT_12_BIT>();
+    CHECK(half < -60.0);
+    CHECK(fixed_16 < -40.0);
+    CHECK(fixed_12 < -25.0);
+}
+
+TEST_CASE("CloudsReverb compact formats match across processing modes", "[reverb][format][block]") {
+    clouds::BasicCloudsReverb<clouds::FORMAT_12_BIT> sample_reverb;
+    clouds::BasicCloudsReverb<clouds::FORMAT_12_BIT> block_reverb;
+    sample_reverb.Init(48000.0f);
+    block_reverb.Init(48000.0f);
+    sample_reverb.SetProcessingMode(clouds::PROCESSING_MODE_SAMPLE);
+    block_reverb.SetProcessingMode(clouds::PROCESSING_MODE_BLOCK);
+
+    float max_error = 0.0f;
+    for (int block = 0; block < 200; ++block) {
+        float sample_left[300];
+        float sample_right[300];
+        for (size_t i = 0; i < 300; ++i) {
+            float t = static_cast<float>(block * 300 + i);
+            sample_left[i] = block < 100 ? 0.5f * std::sin(0.05f * t) : 0.0f;
+            sample_right[i] = block < 100 ? 0.5f * std::sin(0.031f * t) : 0.0f;
+        }
+        float block_left[300];
+        float block_right[300];
+        std::copy(sample_left, sample_left + 300, block_left);
+        std::copy(sample_right, sample_right + 300, block_right);
+        sample_reverb.Process(sample_left, sample_right, 300);
+        block_reverb.Process(block_left, block_right, 300);
+        for (size_t i = 0; i < 300; ++i) {
+            max_error = std::max(max_error, std::abs(block_left[i] - sample_left[i]));
+            max_error = std::max(max_error, std::abs(block_right[i] - sample_right[i]));
+        }
+    }
+    CHECK(max_error <= clouds::CloudsReverb::kBlockModeTolerance);
+}
+
+TEST_CASE("CloudsReverb packed rings", "[reverb][block]") {
+    for (auto mode : {clouds::PROCESSING_MODE_SAMPLE, clouds::PROCESSING_MODE_BLOCK}) {
+        for (float sample_rate : {44100.0f, 48000.0f}) {
+            clouds::CloudsReverb reference;
+            clouds::BasicCloudsReverb<clouds::FORMAT_32_BIT, clouds::RING_PACKED> reverb;
+            reference.Init(sample_rate);
+            reverb.Init(sample_rate);
+            reference.SetProcessingMode(mode);
+            reverb.SetProcessingMode(mode);
+            // Each line has a ring of its own length rather than a share of a
+            // power of 2.
+            CHECK(reverb.GetMemorySize() < reference.GetMemorySize() * 3 / 4);
+
+            // The layout does not change the arithmetic.
+            int mismatches = 0;
+            for (int block = 0; block < 400; ++block) {
+                float left[300];
+                float right[300];
+                for (size_t i = 0; i < 300; ++i) {
+                    float t = static_cast<float>(block * 300 + i);
+                    left[i] = block < 200 ? 0.5f * std::sin(0.05f * t) : 0.0f;
+                    right[i] = block < 200 ? 0.5f * std::sin(0.031f * t) : 0.0f;
+                }
+                float packed_left[300];
+                float packed_right[300];
+                std::copy(left, left + 300, packed_left);
+                std::copy(right, right + 300, packed_right);
+                reference.Process(left, right, 300);
+                reverb.Process(packed_left, packed_right, 300);
+                for (size_t i = 0; i < 300; ++i) {
+                    mismatches += packed_left[i] != left[i];
+                    mismatches += packed_right[i] != right[i];
+                }
+            }
+            CHECK(mismatches == 0);
+        }
+    }
+}
+
+TEST_CASE("CloudsNetwork layout", "[reverb]") {
+    using clouds::CloudsNetwork;
+    STATIC_REQUIRE(CloudsNetwork::kNumLines == 10);
+    STATIC_REQUIRE(CloudsNetwork::kMemory == 21626);
+    STATIC_REQUIRE(CloudsNetwork::kBufferSize == clouds::CloudsReverb::kBufferSize);
+    STATIC_REQUIRE(CloudsNetwork::kBufferSize == 32768);
+    STATIC_REQUIRE(CloudsNetwork::kMinFeedbackLatency == 4400 - 30);
+}
+
+TEST_CASE("CloudsReverb delays are constant in seconds", "[reverb]") {
+    // With no diffusion the allpasses are plain delays, so the first wet
+    // output on the right channel arrives after ap1-ap4, dap2a and dap2b.
+    // That should happen at the same time whatever the sample rate.
+    std::vector<float> delays;
+    for (float sample_rate : {24000.0f, 48000.0f, 96000.0f}) {
+        clouds::CloudsReverb reverb;
+        reverb.Init(sample_rate);
+        reverb.SetAmount(1.0f);
+        reverb.SetDiffusion(0.0f);
+
+        const size_t size = static_cast<size_t>(sample_rate * 0.2f);
+        std::vector<float> left(size, 0.0f);
+        std::vector<float> right(size, 0.0f);
+        left[0] = 1.0f;
+        reverb.Process(left.data(), right.data(), size);
+
+        size_t first = 0;
+        while (first < size && std::abs(right[first]) < 1e-4f) {
+            ++first;
+        }
+        delays.push_back(static_cast<float>(first) / sample_rate);
+    }
+    CHECK(delays[1] == Approx((150 + 214 + 319 + 527 + 2525 + 2197) / 48000.0f).margin(0.0002f));
+    CHECK(delays[0] == Approx(delays[1]).margin(0.0002f));
+    CHECK(delays[2] == Approx(delays[1]).margin(0.0002f));
+}
+
+TEST_CASE("CloudsReverb block mode matches per-sample mode at other rates", "[reverb][block]") {
+    for (float sample_rate : {1000.0f, 22050.0f, 44100.0f, 96000.0f}) {
+        clouds::CloudsReverb sample_reverb;
+        clouds::CloudsReverb block_reverb;
+        sample_reverb.Init(sample_rate);
+        block_reverb.Init(sample_rate);
+        sample_reverb.SetProcessingMode(clouds::PROCESSING_MODE_SAMPLE);
+        sample_reverb.SetParameters(1.0f, 0.6f, 0.9f, 0.7f, 0.6f);
+        block_reverb.SetParameters(1.0f, 0.6f, 0.9f, 0.7f, 0.6f);
+
+        uint32_t seed = 1;
+        float max_error = 0.0f;
+        std::vector<clouds::FloatFrame> a(777);
+        for (int block = 0; block < 40; ++block) {
+            for (auto& frame : a) {
+                seed = seed * 1664525u + 1013904223u;
+                frame.l = static_cast<float>(seed >> 8) / 16777216.0f - 0.5f;
+                frame.r = -frame.l;
+            }
+            std::vector<clouds::FloatFrame> b = a;
+            sample_reverb.Process(a.data(), a.size());
+            block_reverb.Process(b.data(), b.size());
+            for (size_t i = 0; i < a.size(); ++i) {
+                max_error = std::max(max_error, std::abs(a[i].l - b[i].l));
+                max_error = std::max(max_error, std::abs(a[i].r - b[i].r));
+            }
+        }
+        CHECK(max_error <= clouds::CloudsReverb::kBlockModeTolerance);
+    }
+}
+
+TEST_CASE("CloudsReverb out-of-place processing matches in-place", "[reverb][io]") {
+    for (auto mode : {clouds::PROCESSING_MODE_SAMPLE, clouds::PROCESSING_MODE_BLOCK}) {
+        clouds::CloudsReverb in_place;
+        clouds::CloudsReverb planar;
+        clouds::CloudsReverb frames;
+        for (auto* reverb : {&in_place, &planar, &frames}) {
+            reverb->Init(48000.0f);
+            reverb->SetProcessingMode(mode);
+            reverb->SetAmount(0.7f);
+        }
+
+        constexpr size_t bufferSize = 1000;
+        std::vector<float> left(bufferSize), right(bufferSize);
+        std::vector<clouds::FloatFrame> in_frames(bufferSize);
+        for (size_t i = 0; i < bufferSize; ++i) {
+            left[i] = std::sin(0.05f * static_cast<float>(i));
+            right[i] = (i % 100 == 0) ? 1.0f : 0.0f;
+            in_frames[i].l = left[i];
+            in_frames[i].r = right[i];
+        }
+        const std::vector<float> in_left = left;
+        const std::vector<float> in_right = right;
+
+        std::vector<float> out_left(bufferSize), out_right(bufferSize);
+        std::vector<clouds::FloatFrame> out_frames(bufferSize);
+        in_place.Process(left.data(), right.data(), bufferSize);
+        planar.Process(in_left.data(), in_right.data(), out_left.data(), out_right.data(), bufferSize);
+        frames.Process(in_frames.data(), out_frames.data(), bufferSize);
+
+        for (size_t i = 0; i < bufferSize; ++i) {
+            CHECK(out_left[i] == left[i]);
+            CHECK(out_right[i] == right[i]);
+            CHECK(out_frames[i].l == left[i]);
+            CHECK(out_frames[i].r == right[i]);
+        }
+        // Inputs are left untouched
+        CHECK(in_frames[1].l == in_left[1]);
+    }
+}
+
+TEST_CASE("CloudsReverb mono output may alias the input", "[reverb][io]") {
+    clouds::CloudsReverb reference;
+    clouds::CloudsReverb aliased;
+    reference.Init(48000.0f);
+    aliased.Init(48000.0f);
+    reference.SetAmount(0.5f);
+    aliased.SetAmount(0.5f);
+
+    constexpr size_t bufferSize = 512;
+    std::vector<float> mono(bufferSize);
+    for (size_t i = 0; i < bufferSize; ++i) {
+        mono[i] = std::sin(0.1f * static_cast<float>(i));
+    }
+    std::vector<float> left(bufferSize), right(bufferSize);
+    reference.ProcessMono(mono.data(), left.data(), right.data(), bufferSize);
+
+    std::vector<float> io = mono;
+    std::vector<float> right_aliased(bufferSize);
+    aliased.ProcessMono(io.data(), io.data(), right_aliased.data(), bufferSize);
+
+    for (size_t i = 0; i < bufferSize; ++i) {
+        CHECK(io[i] == left[i]);
+        CHECK(right_aliased[i] == right[i]);
+    }
+}
+
+TEST_CASE("CloudsReverb parameter ramps are applied per sample", "[reverb][modulation]") {
+    for (auto mode : {clouds::PROCESSING_MODE_SAMPLE, clouds::PROCESSING_MODE_BLOCK}) {
+        clouds::CloudsReverb ramped;
+        clouds::CloudsReverb stepped;
+        for (auto* reverb : {&ramped, &stepped}) {
+            reverb->Init(48000.0f);
+            reverb->SetProcessingMode(mode);
+            reverb->SetParameters(0.2f, 0.3f, 0.4f, 0.5f, 0.6f);
+        }
+
+        // Warm up the tank so that every parameter matters
+        constexpr size_t bufferSize = 1024;
+        std::vector<float> warm_l(6000, 0.0f), warm_r(6000, 0.0f);
+        for (size_t i = 0; i < warm_l.size(); i += 97) {
+            warm_l[i] = 1.0f;
+        }
+        std::vector<float> warm_l2 = warm_l, warm_r2 = warm_r;
+        ramped.Process(warm_l.data(), warm_r.data(), warm_l.size());
+        stepped.Process(warm_l2.data(), warm_r2.data(), warm_l2.size());
+
+        std::vector<float> left(bufferSize), right(bufferSize);
+        for (size_t i = 0; i < bufferSize; ++i) {
+            left[i] = std::sin(0.03f * static_cast<float>(i));
+            right[i] = std::cos(0.05f * static_cast<float>(i));
+        }
+        std::vector<float> left2 = left, right2 = right;
+
+        ramped.RampParameters(0.9f, 0.8f, 0.95f, 0.1f, 0.2f);
+        ramped.Process(left.data(), right.data(), bufferSize);
+
+        // Reference: one sample at a time, setting the interpolated values
+        const float start[5] = {0.2f, 0.3f, 0.4f, 0.5f, 0.6f};
+        const float end[5] = {0.9f, 0.8f, 0.95f, 0.1f, 0.2f};
+        for (size_t i = 0; i < bufferSize; ++i) {
+            float v[5];
+            float t = static_cast<float>(i + 1) / static_cast<float>(bufferSize);
+            for (int p = 0; p < 5; ++p) {
+                v[p] = start[p] + (end[p] - start[p]) * t;
+            }
+            stepped.SetParameters(v[0], v[1], v[2], v[3], v[4]);
+            stepped.Process(&left2[i], &right2[i], 1);
+        }
+
+        float max_error = 0.0f;
+        for (size_t i = 0; i < bufferSize; ++i) {
+            max_error = std::max(max_error, std::abs(left[i] - left2[i]));
+            max_error = std::max(max_error, std::abs(right[i] - right2[i]));
+        }
+        CHECK(max_error < 1e-4f);
+        CHECK(ramped.GetAmount() == 0.9f);
+        CHECK(ramped.GetTime() == 0.95f);
+        CHECK(ramped.GetDiffusion() == 0.1f);
+    }
+}
+
+TEST_CASE("CloudsReverb audio-rate modulation", "[reverb][modulation]") {
+    clouds::CloudsReverb modulated;
+    clouds::CloudsReverb stepped;
+    clouds::CloudsReverb block;
+    modulated.Init(48000.0f);
+    stepped.Init(48000.0f);
+    block.Init(48000.0f);
+    modulated.SetProcessingMode(clouds::PROCESSING_MODE_SAMPLE);
+    stepped.SetProcessingMode(clouds::PROCESSING_MODE_SAMPLE);
+    for (auto* reverb : {&modulated, &stepped, &block}) {
+        reverb->SetParameters(0.8f, 0.5f, 0.7f, 0.6f, 0.7f);
+    }
+
+    constexpr size_t bufferSize = 10000;
+    std::vector<float> time_cv(bufferSize), diffusion_cv(bufferSize);
+    std::vector<float> left(bufferSize, 0.0f), right(bufferSize, 0.0f);
+    for (size_t i = 0; i < bufferSize; ++i) {
+        time_cv[i] = 0.5f * std::sin(0.001f * static_cast<float>(i));
+        diffusion_cv[i] = (i / 300) % 2 ? 0.6f : -0.6f;  // hits both clamps
+        left[i] = (i % 211 == 0) ? 1.0f : 0.0f;
+    }
+    std::vector<float> left2 = left, right2 = right;
+    std::vector<float> left3 = left, right3 = right;
+
+    clouds::CloudsReverb::Modulation modulation;
+    modulation.time = time_cv.data();
+    modulation.diffusion = diffusion_cv.data();
+    modulated.Process(left.data(), right.data(), bufferSize, &modulation);
+    block.Process(left3.data(), right3.data(), bufferSize, &modulation);
+
+    for (size_t i = 0; i < bufferSize; ++i) {
+        stepped.SetTime(0.7f + time_cv[i]);
+        stepped.SetDiffusion(0.6f + diffusion_cv[i]);
+        stepped.Process(&left2[i], &right2[i], 1);
+    }
+
+    float max_error = 0.0f;
+    float max_block_error = 0.0f;
+    for (size_t i = 0; i < bufferSize; ++i) {
+        max_error = std::max(max_error, std::abs(left[i] - left2[i]));
+        max_error = std::max(max_error, std::abs(right[i] - right2[i]));
+        max_block_error = std::max(max_block_error, std::abs(left[i] - left3[i]));
+        max_block_error = std::max(max_block_error, std::abs(right[i] - right3[i]));
+    }
+    CHECK(max_error == 0.0f);
+    CHECK(max_block_error <= clouds::CloudsReverb::kBlockModeTolerance);
+
+    // Modulation does not change the base values
+    CHECK(modulated.GetTime() == Approx(0.7f));
+    CHECK(modulated.GetDiffusion() == Approx(0.6f));
+}
+
+TEST_CASE("CloudsReverb factory presets", "[reverb]") {
+    clouds::CloudsReverb reverb;
+    reverb.Init(48000.0f);
+
+    // The first preset is the state Init() leaves the reverb in
+    const clouds::Preset* preset = clouds::FindFactoryPreset("Default");
+    REQUIRE(preset == &clouds::kFactoryPresets[0]);
+    CHECK(preset->amount == Approx(reverb.GetAmount()));
+    CHECK(preset->input_gain == Approx(reverb.GetInputGain()));
+    CHECK(preset->time == Approx(reverb.GetTime()));
+    CHECK(preset->diffusion == Approx(reverb.GetDiffusion()));
+    CHECK(preset->lp == Approx(reverb.GetLowpassCutoff()));
+
+    for (const clouds::Preset& p : clouds::kFactoryPresets) {
+        CHECK(clouds::FindFactoryPreset(p.name) == &p);
+        for (float value : {p.amount, p.input_gain, p.time, p.diffusion, p.lp}) {
+            CHECK(value >= 0.0f);
+            CHECK(value <= 1.0f);
+        }
+    }
+    CHECK(clouds::FindFactoryPreset("No Such Preset") == nullptr);
+
+    clouds::FindFactoryPreset("Dark Space")->ApplyTo(&reverb);
+    CHECK(reverb.GetLowpassCutoff() == Approx(0.25f));
+}
+
+TEST_CASE("CloudsReverb Clear restores the initial state", "[reverb]") {
+    constexpr size_t bufferSize = 3000;
+    std::vector<float> input(bufferSize);
+    for (size_t i = 0; i < bufferSize; ++i) {
+        input[i] = std::sin(static_cast<float>(i) * 0.05f) * ((i / 200) % 2 ? 1.0f : 0.2f);
+    }
+
+    clouds::CloudsReverb fresh;
+    fresh.Init(48000.0f);
+    fresh.SetParameters(0.8f, 0.6f, 0.9f, 0.7f, 0.5f);
+    std::vector<float> expected_l = input, expected_r = input;
+    fresh.Process(expected_l.data(), expected_r.data(), bufferSize);
+
+    // Run long enough to move the write pointer and LFOs, then clear.
+    clouds::CloudsReverb reused;
+    reused.Init(48000.0f);
+    reused.SetParameters(0.8f, 0.6f, 0.9f, 0.7f, 0.5f);
+    std::vector<float> l = input, r = input;
+    for (int block = 0; block < 7; ++block) {
+        reused.Process(l.data(), r.data(), bufferSize);
+    }
+    reused.Clear();
+    l = input;
+    r = input;
+    reused.Process(l.data(), r.data(), bufferSize);
+
+    CHECK(l == expected_l);
+    CHECK(r == expected_r);
+}
+
+TEST_CASE("CloudsReverb sleeps once the tail has decayed", "[reverb][sleep]") {
+    constexpr size_t bufferSize = 256;
+    clouds::CloudsReverb reverb;
+    clouds::CloudsReverb reference;
+    reverb.Init(48000.0f);
+    reference.Init(48000.0f);
+    reference.SetSleepEnabled(false);
+    for (auto* r : {&reverb, &reference}) {
+        r->SetParameters(0.7f, 0.5f, 0.6f, 0.625f, 0.7f);
+    }
+    CHECK(reverb.IsSleeping());
+    CHECK_FALSE(reference.IsSleeping());
+
+    // An impulse wakes the reverb within the call it arrives in
+    std::vector<float> l(bufferSize, 0.0f), r(bufferSize, 0.0f);
+    std::vector<float> ref_l(bufferSize, 0.0f), ref_r(bufferSize, 0.0f);
+    l[10] = r[10] = ref_l[10] = ref_r[10] = 1.0f;
+    reverb.Process(l.data(), r.data(), bufferSize);
+    reference.Process(ref_l.data(), ref_r.data(), bufferSize);
+    CHECK_FALSE(reverb.IsSleeping());
+    CHECK(l == ref_l);
+    CHECK(r == ref_r);
+    CHECK(reverb.GetRemainingTail() > 0.0f);
+    CHECK(reverb.GetRemainingTail() <= reverb.GetTailLength());
+
+    // Process silence until asleep; the output never strays from the
+    // reference by more than the sleep threshold.
+    const float tail = reverb.GetTailLength();
+    size_t samples = bufferSize;
+    float max_error = 0.0f;
+    while (!reverb.IsSleeping() && samples < 48000 * 60) {
+        std::fill(l.begin(), l.end(), 0.0f);
+        std::fill(r.begin(), r.end(), 0.0f);
+        std::fill(ref_l.begin(), ref_l.end(), 0.0f);
+        std::fill(ref_r.begin(), ref_r.end(), 0.0f);
+        reverb.Process(l.data(), r.data(), bufferSize);
+        reference.Process(ref_l.data(), ref_r.data(), bufferSize);
+        for (size_t i = 0; i < bufferSize; ++i) {
+            max_error = std::max(max_error, std::abs(l[i] - ref_l[i]));
+            max_error = std::max(max_error, std::abs(r[i] - ref_r[i]));
+        }
+        samples += bufferSize;
+    }
+    REQUIRE(reverb.IsSleeping());
+    CHECK(max_error <= clouds::CloudsReverb::kSleepThreshold);
+    CHECK(reverb.GetRemainingTail() == 0.0f);
+
+    // The estimate is an upper bound, and not a wildly loose one
+    const float slept_after = static_cast<float>(samples) / 48000.0f;
+    CHECK(slept_after <= tail + 0.5f);
+    CHECK(slept_after >= tail * 0.25f);
+
+    // Asleep, the output is the dry part of the mix
+    for (size_t i = 0; i < bufferSize; ++i) {
+        l[i] = 1e-6f;
+        r[i] = -2e-6f;
+    }
+    reverb.Process(l.data(), r.data(), bufferSize);
+    CHECK(reverb.IsSleeping());
+    CHECK(l[0] == Approx(1e-6f * 0.3f));
+    CHECK(r[0] == Approx(-2e-6f * 0.3f));
+
+    // Waking starts from an empty tank, like a freshly initialized reverb
+    clouds::CloudsReverb fresh;
+    fresh.Init(48000.0f);
+    fresh.SetParameters(0.7f, 0.5f, 0.6f, 0.625f, 0.7f);
+    std::vector<float> fresh_l(bufferSize), fresh_r(bufferSize);
+    for (size_t i = 0; i < bufferSize; ++i) {
+        l[i] = r[i] = fresh_l[i] = fresh_r[i] = std::sin(static_cast<float>(i) * 0.1f);
+    }
+    reverb.Process(l.data(), r.data(), bufferSize);
+    fresh.Process(fresh_l.data(), fresh_r.data(), bufferSize);
+    CHECK_FALSE(reverb.IsSleeping());
+    CHECK(l == fresh_l);
+    CHECK(r == fresh_r);
+}
+
+TEST_CASE("CloudsReverb tail length estimate", "[reverb][sleep]") {
+    clouds::CloudsReverb reverb;
+    reverb.Init(48000.0f);
+
+    float previous = 0.0f;
+    for (float time : {0.0f, 0.2f, 0.5f, 0.8f, 0.95f}) {
+        reverb.SetTime(time);
+        float tail = reverb.GetTailLength();
+        CHECK(tail > previous);
+        previous = tail;
+    }
+
+    // Constant in seconds across sample rates
+    reverb.SetTime(0.5f);
+    float tail = reverb.GetTailLength();
+    reverb.Init(96000.0f);
+    reverb.SetTime(0.5f);
+    CHECK(reverb.GetTailLength() == Approx(tail).epsilon(0.01));
+
+    // Time = 1 never decays, and never sleeps
+    reverb.SetTime(1.0f);
+    CHECK(std::isinf(reverb.GetTailLength()));
+    std::vector<float> l(512, 0.0f), r(512, 0.0f);
+    l[0] = 1.0f;
+    for (int block = 0; block < 500; ++block) {
+        reverb.Process(l.data(), r.data(), l.size());
+        std::fill(l.begin(), l.end(), 0.0f);
+        std::fill(r.begin(), r.end(), 0.0f);
+    }
+    CHECK_FALSE(reverb.IsSleeping());
+}
+
+TEST_CASE("ScopedNoDenormals flushes denormals and restores the mode", "[reverb][denormals]") {
+    if (!clouds::ScopedNoDenormals::kSupported) {
+        WARN("No FPU flush-to-zero control on this target");
+        return;
+    }
+    volatile float tiny = 1e-38f;
+    const float before = tiny * 0.5f;
+    {
+        clouds::ScopedNoDenormals no_denormals;
+        {
+            clouds::ScopedNoDenormals nested;
+            CHECK(tiny * 0.5f == 0.0f);
+        }
+        CHECK(tiny * 0.5f == 0.0f);
+    }
+    CHECK(tiny * 0.5f == before);
+}
+
+TEST_CASE("CloudsReverb tail never goes denormal", "[reverb][denormals]") {
+    if (!clouds::ScopedNoDenormals::kSupported) {
+        WARN("No FPU flush-to-zero control on this target");
+        return;
+    }
+    // An impulse decaying for a minute with sleep disabled takes the network
+    // through the denormal range (about 45 s at Time 0.5) down to silence.
+    for (auto mode : { clouds::PROCESSING_MODE_BLOCK, clouds::PROCESSING_MODE_SAMPLE }) {
+        clouds::CloudsReverb reverb;
+        reverb.Init(48000.0f);
+        reverb.SetSleepEnabled(false);
+        reverb.SetProcessingMode(mode);
+        std::vector<float> l(512, 0.0f), r(512, 0.0f);
+        l[0] = 1.0f;
+        r[0] = 1.0f;
+        size_t denormals = 0;
+        bool silent = false;
+        for (int block = 0; block < 60 * 48000 / 512 && !silent; ++block) {
+            reverb.Process(l.data(), r.data(), l.size());
+            silent = true;
+            for (size_t i = 0; i < l.size(); ++i) {
+                denormals += std::fpclassify(l[i]) == FP_SUBNORMAL;
+                denormals += std::fpclassify(r[i]) == FP_SUBNORMAL;
+                silent = silent && l[i] == 0.0f && r[i] == 0.0f;
+            }
+            std::fill(l.begin(), l.end(), 0.0f);
+            std::fill(r.begin(), r.end(), 0.0f);
+        }
+        CHECK(silent);
+        CHECK(denormals == 0);
+    }
+}
+
+TEST_CASE("CloudsReverb decimation settings", "[reverb][decimation]") {
+    using clouds::CloudsReverb;
+    CHECK(CloudsReverb::RecommendedDecimation(44100.0f) == 1);
+    CHECK(CloudsReverb::RecommendedDecimation(48000.0f) == 1);
+    CHECK(CloudsReverb::RecommendedDecimation(88200.0f) == 2);
+    CHECK(CloudsReverb::RecommendedDecimation(96000.0f) == 2);
+    CHECK(CloudsReverb::RecommendedDecimation(176400.0f) == 4);
+    CHECK(CloudsReverb::RecommendedDecimation(192000.0f) == 4);
+    CHECK(CloudsReverb::RecommendedDecimation(384000.0f) == 4);
+
+    CloudsReverb reverb;
+    reverb.Init(96000.0f);
+    CHECK(reverb.GetDecimation() == 1);
+    CHECK(reverb.GetLatency() == 0);
+    size_t previous = 0;
+    for (auto [requested, decimation] : {std::pair<size_t, size_t>{0, 1}, {3, 2}, {8, 4}}) {
+        reverb.Init(192000.0f, requested);
+        CHECK(reverb.GetDecimation() == decimation);
+        CHECK(reverb.GetLatency() >= previous);
+        previous = reverb.GetLatency();
+    }
+    CHECK(previous > 0);
+
+    // Delay memory is sized for the tank rate
+    CloudsReverb full_rate;
+    full_rate.Init(48000.0f);
+    reverb.Init(96000.0f, 2);
+    CHECK(reverb.GetBufferSize() == full_rate.GetBufferSize());
+    CHECK(reverb.GetTailLength() ==
+          Approx(full_rate.GetTailLength() + reverb.GetLatency() / 96000.0f).epsilon(0.01));
+}
+
+TEST_CASE("CloudsReverb decimated dry signal is delayed by the latency", "[reverb][decimation]") {
+    for (size_t decimation : {2, 4}) {
+        clouds::CloudsReverb reverb;
+        reverb.Init(48000.0f * decimation, decimation);
+        reverb.SetParameters(0.0f, 0.5f, 0.7f, 0.6f, 0.7f);
+        const size_t latency = reverb.GetLatency();
+
+        // Host block sizes that do not line up with the decimation
+        std::vector<float> in(20000);
+        for (size_t i = 0; i < in.size(); ++i) {
+            in[i] = std::sin(static_cast<float>(i) * 0.05f);
+        }
+        std::vector<float> l = in, r = in;
+        size_t i = 0;
+        for (size_t block_size : {1, 3, 100, 129, 600, 1023, 5000}) {
+            for (int repeat = 0; repeat < 2 && i < in.size(); ++repeat) {
+                const size_t n = std::min(block_size, in.size() - i);
+                reverb.Process(&l[i], &r[i], n);
+                i += n;
+            }
+        }
+        reverb.Process(&l[i], &r[i], in.size() - i);
+        bool delayed = true;
+        for (size_t j = 0; j < in.size(); ++j) {
+            const float expected = j < latency ? 0.0f : in[j - latency];
+            delayed = delayed && l[j] == expected && r[j] == expected;
+        }
+        CHECK(delayed);
+    }
+}
+
+TEST_CASE("CloudsReverb decimated tank matches the full-rate tank", "[reverb][decimation]") {
+    // Without diffusion or feedback, the wet signal is a sum of delayed taps
+    // of the input, so it is the same at any tank rate but for the delays,
+    // rounded to whole samples of the tank rate, and the filters.
+    for (size_t decimation : {2, 4}) {
+        const float sample_rate = 48000.0f * decimation;
+        const size_t size = static_cast<size_t>(sample_rate / 4);
+        std::vector<float> burst(size, 0.0f);
+        for (size_t i = 0; i < 2000; ++i) {
+            const float window = 0.5f - 0.5f * std::cos(6.2831853f * i / 2000.0f);
+            burst[i] = window * std::sin(6.2831853f * 1000.0f * i / sample_rate);
+        }
+
+        std::vector<float> outputs[2];
+        size_t latency = 0;
+        for (size_t d : {size_t(1), decimation}) {
+            clouds::CloudsReverb reverb;
+            reverb.Init(sample_rate, d);
+            reverb.SetSleepEnabled(false);
+            reverb.SetParameters(1.0f, 0.5f, 0.0f, 0.0f, 1.0f);
+            std::vector<float> l = burst, r = burst;
+            for (size_t i = 0; i < size; i += 100) {
+                reverb.Process(&l[i], &r[i], std::min(size_t(100), size - i));
+            }
+            outputs[d != 1] = l;
+            latency = reverb.GetLatency();
+        }
+
+        // Best alignment, a few tank samples short of the latency
+        const std::vector<float>& a = outputs[0];
+        const std::vector<float>& b = outputs[1];
+        size_t lag = 0;
+        double best = 0.0;
+        for (size_t candidate = 0; candidate <= latency; ++candidate) {
+            double correlation = 0.0;
+            for (size_t i = 0; i + candidate < size; ++i) {
+                correlation += a[i] * b[i + candidate];
+            }
+            if (correlation > best) {
+                best = correlation;
+                lag = candidate;
+            }
+        }
+        CHECK(lag + 8 * decimation >= latency);
+
+        double energy = 0.0;
+        double error = 0.0;
+        for (size_t i = 0; i + lag < size; ++i) {
+            energy += a[i] * a[i];
+            error += (a[i] - b[i + lag]) * (a[i] - b[i + lag]);
+        }
+        CHECK(energy > 0.0);
+        CHECK(10.0 * std::log10(error / energy) < -80.0);
+    }
+}
+
+TEST_CASE("CloudsReverb decimated block mode matches per-sample mode", "[reverb][decimation][block]") {
+    for (size_t decimation : {2, 4}) {
+        clouds::CloudsReverb sample_reverb;
+        clouds::CloudsReverb block_reverb;
+        sample_reverb.Init(48000.0f * decimation, decimation);
+        block_reverb.Init(48000.0f * decimation, decimation);
+        sample_reverb.SetProcessingMode(clouds::PROCESSING_MODE_SAMPLE);
+        for (auto* r : {&sample_reverb, &block_reverb}) {
+            r->SetParameters(0.8f, 0.6f, 0.9f, 0.7f, 0.6f);
+        }
+
+        uint32_t seed = 1;
+        float max_error = 0.0f;
+        for (size_t block_size : {1, 7, 64, 129, 500, 1024, 4000}) {
+            std::vector<clouds::FloatFrame> a(block_size);
+            for (int repeat = 0; repeat < 8; ++repeat) {
+                for (auto& frame : a) {
+                    seed = seed * 1664525u + 1013904223u;
+                    frame.l = static_cast<float>(seed >> 8) / 16777216.0f - 0.5f;
+                    seed = seed * 1664525u + 1013904223u;
+                    frame.r = static_cast<float>(seed >> 8) / 16777216.0f - 0.5f;
+                }
+                std::vector<clouds::FloatFrame> b = a;
+                sample_reverb.Process(a.data(), block_size);
+                block_reverb.Process(b.data(), block_size);
+                for (size_t i = 0; i < block_size; ++i) {
+                    max_error = std::max(max_error, std::abs(a[i].l - b[i].l));
+                    max_error = std::max(max_error, std::abs(a[i].r - b[i].r));
+                }
+            }
+        }
+        CHECK(max_error <= clouds::CloudsReverb::kBlockModeTolerance);
+    }
+}
+
+TEST_CASE("CloudsReverb decimated reverb sleeps and wakes in step", "[reverb][decimation][sleep]") {
+    constexpr size_t bufferSize = 256;
+    clouds::CloudsReverb reverb;
+    clouds::CloudsReverb reference;
+    for (auto* r : {&reverb, &reference}) {
+        r->Init(96000.0f, 2);
+        r->SetParameters(0.7f, 0.5f, 0.5f, 0.625f, 0.7f);
+    }
+    reference.SetSleepEnabled(false);
+    const size_t latency = reverb.GetLatency();
+
+    // An impulse, silence until asleep, a tone too quiet to wake the tank and
+    // then a loud one. The output stays within the sleep threshold of the
+    // reference throughout, and the quiet tone comes out of the dry delay.
+    std::vector<float> in;
+    std::vector<float> out;
+    std::vector<float> l(bufferSize), r(bufferSize), ref_l(bufferSize), ref_r(bufferSize);
+    float max_error = 0.0f;
+    size_t asleep_at = 0;
+    size_t woke_at = 0;
+    for (size_t block = 0; block < 96000 * 30 / bufferSize && !woke_at; ++block) {
+        const size_t start = block * bufferSize;
+        for (size_t i = 0; i < bufferSize; ++i) {
+            const float level = !asleep_at ? 0.0f
+                : start < asleep_at + 4 * bufferSize ? 2e-6f : 0.5f;
+            l[i] = r[i] = ref_l[i] = ref_r[i] =
+                level * std::sin(static_cast<float>(start + i) * 0.03f);
+        }
+        if (block == 0) {
+            l[10] = r[10] = ref_l[10] = ref_r[10] = 1.0f;
+        }
+        in.insert(in.end(), l.begin(), l.end());
+        const bool sleeping = reverb.IsSleeping();
+        reverb.Process(l.data(), r.data(), bufferSize);
+        reference.Process(ref_l.data(), ref_r.data(), bufferSize);
+        out.insert(out.end(), l.begin(), l.end());
+        for (size_t i = 0; i < bufferSize; ++i) {
+            max_error = std::max(max_error, std::abs(l[i] - ref_l[i]));
+            max_error = std::max(max_error, std::abs(r[i] - ref_r[i]));
+        }
+        if (sleeping && !asleep_at) {
+            asleep_at = start;
+        } else if (asleep_at && !reverb.IsSleeping()) {
+            woke_at = start;
+        }
+    }
+    REQUIRE(asleep_at > 0);
+    CHECK(woke_at == asleep_at + 4 * bufferSize);
+    CHECK(max_error <= clouds::CloudsReverb::kSleepThreshold);
+    float dry_error = 0.0f;
+    for (size_t i = asleep_at + latency; i < woke_at; ++i) {
+        dry_error = std::max(dry_error, std::abs(out[i] - in[i - latency] * 0.3f));
+    }
+    CHECK(dry_error < 1e-12f);
+}
+
+namespace {
+
+// Renders `blocks` blocks of 301 samples of noise (an odd size, so that the
+// decimators keep a sample over between calls).
+template<typename Reverb>
+std::vector<float> RenderNoise(Reverb& reverb, uint32_t seed, int blocks) {
+    std::vector<float> out;
+    for (int block = 0; block < blocks; ++block) {
+        float left[301];
+        float right[301];
+        for (size_t i = 0; i < 301; ++i) {
+            seed = seed * 1664525 + 1013904223;
+            float noise = static_cast<float>(seed >> 8) / 16777216.0f - 0.5f;
+            left[i] = noise * 0.5f;
+            right[i] = -noise * 0.3f;
+        }
+        reverb.Process(left, right, 301);
+        out.insert(out.end(), left, left + 301);
+        out.insert(out.end(), right, right + 301);
+    }
+    return out;
+}
+
+// Takes both kinds of snapshot of a warmed-up reverb with a ramp pending,
+// and checks that restoring either, into the reverb itself or into another
+// instance, renders exactly what the reverb rendered after the snapshot.
+template<typename Reverb>
+void CheckSnapshots(float sample_rate, size_t decimation, clouds::ProcessingMode mode) {
+    Reverb reverb;
+    Reverb copy;
+    Reverb compact_copy;
+    for (Reverb* r : {&reverb, &copy, &compact_copy}) {
+        r->Init(sample_rate, decimation);
+        r->SetProcessingMode(mode);
+    }
+    reverb.SetParameters(0.8f, 0.6f, 0.9f, 0.7f, 0.5f);
+    RenderNoise(reverb, 1, 40);
+    reverb.RampParameters(0.6f, 0.5f, 0.95f, 0.4f, 0.6f);
+
+    typename Reverb::Snapshot snapshot;
+    snapshot.Allocate(reverb);
+    REQUIRE(reverb.SaveSnapshot(&snapshot));
+    std::vector<uint8_t> compact(reverb.GetCompactSnapshotSize());
+    REQUIRE(reverb.SaveCompactSnapshot(compact.data(), compact.size()) == compact.size());
+    CHECK(compact.size() < snapshot.size());
+
+    const std::vector<float> expected = RenderNoise(reverb, 2, 40);
+    REQUIRE(reverb.RestoreSnapshot(snapshot));
+    CHECK(RenderNoise(reverb, 2, 40) == expected);
+    REQUIRE(copy.RestoreSnapshot(snapshot));
+    CHECK(copy.GetTime() == 0.9f);
+    CHECK(RenderNoise(copy, 2, 40) == expected);
+    REQUIRE(compact_copy.RestoreCompactSnapshot(compact.data(), compact.size()));
+    CHECK(RenderNoise(compact_copy, 2, 40) == expected);
+}
+
+// Clears a reverb that has been running, which leaves stale samples in the
+// delay memory for the network to write over, and checks that it renders
+// exactly what a fresh instance does, also through snapshots taken before
+// the stale samples are gone.
+template<typename Reverb>
+void CheckClear(float sample_rate, size_t decimation, clouds::ProcessingMode mode) {
+    Reverb fresh;
+    Reverb reused;
+    Reverb copy;
+    Reverb compact_copy;
+    for (Reverb* r : {&fresh, &reused, &copy, &compact_copy}) {
+        r->Init(sample_rate, decimation);
+        r->SetProcessingMode(mode);
+        r->SetSleepEnabled(false);
+        r->SetParameters(0.8f, 0.6f, 0.9f, 0.7f, 0.5f);
+    }
+    RenderNoise(reused, 1, 40);
+    reused.Clear();
+    const std::vector<float> expected = RenderNoise(fresh, 2, 3);
+    CHECK(RenderNoise(reused, 2, 3) == expected);
+
+    typename Reverb::Snapshot snapshot;
+    snapshot.Allocate(reused);
+    REQUIRE(reused.SaveSnapshot(&snapshot));
+    std::vector<uint8_t> compact(reused.GetCompactSnapshotSize());
+    REQUIRE(reused.SaveCompactSnapshot(compact.data(), compact.size()) == compact.size());
+    const std::vector<float> tail = RenderNoise(fresh, 3, 200);
+    CHECK(RenderNoise(reused, 3, 200) == tail);
+    REQUIRE(copy.RestoreSnapshot(snapshot));
+    CHECK(RenderNoise(copy, 3, 200) == tail);
+    REQUIRE(compact_copy.RestoreCompactSnapshot(compact.data(), compact.size()));
+    CHECK(RenderNoise(compact_copy, 3, 200) == tail);
+}
+
+}  // namespace
+
+TEST_CASE("CloudsReverb snapshots restore the exact state", "[reverb][snapshot]") {
+    using clouds::PROCESSING_MODE_BLOCK;
+    using clouds::PROCESSING_MODE_SAMPLE;
+    typedef clouds::BasicCloudsReverb<clouds::FORMAT_32_BIT, clouds::RING_PACKED> PackedReverb;
+    typedef clouds::BasicCloudsReverb<clouds::FORMAT_16_BIT> FixedReverb;
+
+    CheckSnapshots<clouds::CloudsReverb>(48000.0f, 1, PROCESSING_MODE_BLOCK);
+    CheckSnapshots<clouds::CloudsReverb>(48000.0f, 1, PROCESSING_MODE_SAMPLE);
+    CheckSnapshots<PackedReverb>(44100.0f, 1, PROCESSING_MODE_BLOCK);
+    CheckSnapshots<PackedReverb>(44100.0f, 1, PROCESSING_MODE_SAMPLE);
+    CheckSnapshots<FixedReverb>(48000.0f, 1, PROCESSING_MODE_BLOCK);
+    CheckSnapshots<clouds::CloudsReverb>(96000.0f, 2, PROCESSING_MODE_BLOCK);
+    CheckSnapshots<clouds::CloudsReverb>(192000.0f, 4, PROCESSING_MODE_SAMPLE);
+}
+
+TEST_CASE("CloudsReverb snapshots only restore into the same configuration", "[reverb][snapshot]") {
+    clouds::CloudsReverb reverb;
+    reverb.Init(48000.0f);
+    reverb.SetParameters(0.8f, 0.6f, 0.9f, 0.7f, 0.5f);
+    RenderNoise(reverb, 1, 10);
+    clouds::CloudsReverb::Snapshot snapshot;
+    snapshot.Allocate(reverb);
+    REQUIRE(reverb.SaveSnapshot(&snapshot));
+    std::vector<uint8_t> compact(reverb.GetCompactSnapshotSize());
+    CHECK(reverb.SaveCompactSnapshot(compact.data(), compact.size() - 1) == 0);
+    REQUIRE(reverb.SaveCompactSnapshot(compact.data(), compact.size()) == compact.size());
+
+    // Other sample rates and decimations leave the instance as it was.
+    clouds::CloudsReverb other;
+    for (auto config : {std::make_pair(44100.0f, size_t(1)), std::make_pair(96000.0f, size_t(2))}) {
+        other.Init(config.first, config.second);
+        CHECK_FALSE(other.RestoreSnapshot(snapshot));
+        CHECK_FALSE(other.RestoreCompactSnapshot(compact.data(), compact.size()));
+        CHECK(other.GetTime() == 0.5f);
+        CHECK(other.IsSleeping());
+    }
+
+    // Same size, wrong sample rate: the header is checked.
+    other.Init(48001.0f);
+    REQUIRE(other.GetSnapshotSize() == snapshot.size());
+    CHECK_FALSE(other.RestoreSnapshot(snapshot));
+    CHECK_FALSE(other.RestoreCompactSnapshot(compact.data(), compact.size()));
+
+    // A full snapshot is not a compact one.
+    other.Init(48000.0f);
+    CHECK_FALSE(other.RestoreCompactSnapshot(snapshot.data(), compact.size()));
+    CHECK(other.RestoreCompactSnapshot(compact.data(), compact.size()));
+    CHECK(other.GetTime() == 0.9f);
+}
+
+TEST_CASE("CloudsReverb Clear is exact without clearing the memory", "[reverb][clear]") {
+    using clouds::PROCESSING_MODE_BLOCK;
+    using clouds::PROCESSING_MODE_SAMPLE;
+    typedef clouds::BasicCloudsReverb<clouds::FORMAT_32_BIT, clouds::RING_PACKED> PackedReverb;
+    typedef clouds::BasicCloudsReverb<clouds::FORMAT_16_BIT> FixedReverb;
+
+    CheckClear<clouds::CloudsReverb>(48000.0f, 1, PROCESSING_MODE_BLOCK);
+    CheckClear<clouds::CloudsReverb>(48000.0f, 1, PROCESSING_MODE_SAMPLE);
+    CheckClear<PackedReverb>(44100.0f, 1, PROCESSING_MODE_BLOCK);
+    CheckClear<PackedReverb>(44100.0f, 1, PROCESSING_MODE_SAMPLE);
+    CheckClear<FixedReverb>(48000.0f, 1, PROCESSING_MODE_BLOCK);
+    CheckClear<clouds::CloudsReverb>(96000.0f, 2, PROCESSING_MODE_BLOCK);
+    CheckClear<clouds::CloudsReverb>(192000.0f, 4, PROCESSING_MODE_SAMPLE);
+}
+
+TEST_CASE("CloudsReverb recovers from non-finite and runaway input", "[reverb][fault]") {
+    using clouds::PROCESSING_MODE_BLOCK;
+    using clouds::PROCESSING_MODE_SAMPLE;
+    struct Config {
+        float sample_rate;
+        size_t decimation;
+        clouds::ProcessingMode mode;
+        float fault;
+    };
+    const Config configs[] = {
+        { 48000.0f, 1, PROCESSING_MODE_BLOCK, std::nanf("") },
+        { 48000.0f, 1, PROCESSING_MODE_SAMPLE, std::numeric_limits<float>::infinity() },
+        { 48000.0f, 1, PROCESSING_MODE_BLOCK, 1e30f },
+        { 96000.0f, 2, PROCESSING_MODE_BLOCK, std::nanf("") },
+        { 192000.0f, 4, PROCESSING_MODE_SAMPLE, -std::numeric_limits<float>::infinity() },
+    };
+    for (const Config& config : configs) {
+        clouds::CloudsReverb reverb;
+        reverb.Init(config.sample_rate, config.decimation);
+        reverb.SetProcessingMode(config.mode);
+        reverb.SetParameters(0.8f, 0.6f, 0.9f, 0.7f, 0.5f);
+        RenderNoise(reverb, 1, 10);
+        CHECK(reverb.GetFaultCount() == 0);
+
+        // One corrupt frame in a 64-sample call
+        constexpr size_t kSize = 64;
+        float left[kSize];
+        float right[kSize];
+        std::fill(left, left + kSize, 0.1f);
+        std::fill(right, right + kSize, 0.1f);
+        left[20] = config.fault;
+        reverb.Process(left, right, kSize);
+        CHECK(std::all_of(left, left + kSize, [](float x) { return std::isfinite(x); }));
+        CHECK(std::all_of(right, right + kSize, [](float x) { return std::isfinite(x); }));
+
+        // Caught in that call, or the next one with the latency of the
+        // decimated tank. The reverb keeps working, and goes to sleep after
+        // its tail.
+        const std::vector<float> out = RenderNoise(reverb, 2, 40);
+        CHECK(reverb.GetFaultCount() == 1);
+        CHECK(std::all_of(out.begin(), out.end(), [](float x) { return std::isfinite(x); }));
+        CHECK(*std::max_element(out.begin(), out.end()) > 0.01f);
+        reverb.SetTime(0.3f);
+        const std::vector<float> silence(48000, 0.0f);
+        std::vector<float> tail_l(silence.size());
+        std::vector<float> tail_r(silence.size());
+        for (int i = 0; i < 60 && !reverb.IsSleeping(); ++i) {
+            reverb.Process(silence.data(), silence.data(), tail_l.data(), tail_r.data(),
+                           silence.size());
+        }
+        CHECK(reverb.IsSleeping());
+
+        reverb.Init(config.sample_rate, config.decimation);
+        CHECK(reverb.GetFaultCount() == 0);
+    }
+}
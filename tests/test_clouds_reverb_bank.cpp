@@ -0,0 +1,135 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/catch_approx.hpp>
+#include <clouds/clouds_reverb.h>
+#include <clouds/clouds_reverb_bank.h>
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+using Catch::Approx;
+
+namespace {
+
+// Runs a bank against N independent per-sample reverbs, with different
+// parameters and input on every lane, and returns the largest difference.
+template<size_t N>
+float MaxBankError(size_t block_size, int num_blocks, float sample_rate = 48000.0f) {
+    auto bank = std::make_unique<clouds::CloudsReverbBank<N>>();
+    std::vector<std::unique_ptr<clouds::CloudsReverb>> reverbs;
+    bank->Init(sample_rate);
+    for (size_t k = 0; k < N; ++k) {
+        reverbs.push_back(std::make_unique<clouds::CloudsReverb>());
+        reverbs[k]->Init(sample_rate);
+        reverbs[k]->SetProcessingMode(clouds::PROCESSING_MODE_SAMPLE);
+        float x = static_cast<float>(k) / static_cast<float>(N);
+        reverbs[k]->SetParameters(0.3f + 0.7f * x, 0.2f + 0.6f * x, 0.95f - 0.5f * x,
+                                  0.5f + 0.4f * x, 0.9f - 0.6f * x);
+        bank->SetParameters(k, 0.3f + 0.7f * x, 0.2f + 0.6f * x, 0.95f - 0.5f * x,
+                            0.5f + 0.4f * x, 0.9f - 0.6f * x);
+    }
+
+    uint32_t seed = 1;
+    float max_error = 0.0f;
+    std::vector<std::vector<clouds::FloatFrame>> a(N, std::vector<clouds::FloatFrame>(block_size));
+    for (int block = 0; block < num_blocks; ++block) {
+        std::vector<clouds::FloatFrame*> pointers;
+        for (size_t k = 0; k < N; ++k) {
+            for (auto& frame : a[k]) {
+                seed = seed * 1664525u + 1013904223u;
+                frame.l = static_cast<float>(seed >> 8) / 16777216.0f - 0.5f;
+                seed = seed * 1664525u + 1013904223u;
+                frame.r = static_cast<float>(seed >> 8) / 16777216.0f - 0.5f;
+            }
+        }
+        std::vector<std::vector<clouds::FloatFrame>> b = a;
+        for (size_t k = 0; k < N; ++k) {
+            reverbs[k]->Process(a[k].data(), block_size);
+            pointers.push_back(b[k].data());
+        }
+        bank->Process(pointers.data(), block_size);
+        for (size_t k = 0; k < N; ++k) {
+            for (size_t i = 0; i < block_size; ++i) {
+                max_error = std::max(max_error, std::abs(a[k][i].l - b[k][i].l));
+                max_error = std::max(max_error, std::abs(a[k][i].r - b[k][i].r));
+            }
+        }
+    }
+    return max_error;
+}
+
+}  // namespace
+
+TEST_CASE("CloudsReverbBank initialization", "[reverb][bank]") {
+    auto bank = std::make_unique<clouds::CloudsReverbBank<4>>();
+    bank->Init(44100.0f);
+
+    CHECK(bank->GetSampleRate() == 44100.0f);
+    for (size_t k = 0; k < 4; ++k) {
+        CHECK(bank->GetAmount(k) == Approx(0.5f));
+        CHECK(bank->GetInputGain(k) == Approx(0.5f));
+        CHECK(bank->GetTime(k) == Approx(0.5f));
+        CHECK(bank->GetDiffusion(k) == Approx(0.625f));
+        CHECK(bank->GetLowpassCutoff(k) == Approx(0.7f));
+    }
+
+    bank->SetTime(2, 2.0f);
+    bank->SetAmount(3, -1.0f);
+    CHECK(bank->GetTime(2) == 1.0f);
+    CHECK(bank->GetAmount(3) == 0.0f);
+    CHECK(bank->GetTime(1) == Approx(0.5f));
+}
+
+TEST_CASE("CloudsReverbBank lanes match independent reverbs", "[reverb][bank]") {
+    // Long enough for the tank to recirculate several times.
+    CHECK(MaxBankError<4>(300, 40) <= clouds::CloudsReverb::kBlockModeTolerance);
+    CHECK(MaxBankError<8>(1000, 12) <= clouds::CloudsReverb::kBlockModeTolerance);
+    CHECK(MaxBankError<16>(97, 30) <= clouds::CloudsReverb::kBlockModeTolerance);
+    CHECK(MaxBankError<3>(128, 10) <= clouds::CloudsReverb::kBlockModeTolerance);
+
+    // Lines scaled as CloudsReverb scales them, at and below the largest
+    // rate the bank holds
+    CHECK(MaxBankError<4>(500, 40, 96000.0f) <= clouds::CloudsReverb::kBlockModeTolerance);
+    CHECK(MaxBankError<8>(256, 20, 44100.0f) <= clouds::CloudsReverb::kBlockModeTolerance);
+}
+
+TEST_CASE("CloudsReverbBank clearing one lane leaves the others", "[reverb][bank]") {
+    auto bank = std::make_unique<clouds::CloudsReverbBank<4>>();
+    bank->Init(48000.0f);
+
+    constexpr size_t bufferSize = 256;
+    std::vector<float> left[4], right[4];
+    float* l[4];
+    float* r[4];
+    for (size_t k = 0; k < 4; ++k) {
+        bank->SetAmount(k, 1.0f);
+        bank->SetTime(k, 0.9f);
+        left[k].assign(bufferSize, 0.0f);
+        right[k].assign(bufferSize, 0.0f);
+        left[k][0] = 1.0f;
+        right[k][0] = 1.0f;
+        l[k] = left[k].data();
+        r[k] = right[k].data();
+    }
+    bank->Process(l, r, bufferSize);
+    bank->Clear(1);
+
+    // Process silence - only the cleared lane should be silent
+    for (size_t k = 0; k < 4; ++k) {
+        std::fill(left[k].begin(), left[k].end(), 0.0f);
+        std::fill(right[k].begin(), right[k].end(), 0.0f);
+    }
+    for (int block = 0; block < 20; ++block) {
+        bank->Process(l, r, bufferSize);
+    }
+
+    float energy[4] = {};
+    for (size_t k = 0; k < 4; ++k) {
+        for (size_t i = 0; i < bufferSize; ++i) {
+            energy[k] += left[k][i] * left[k][i] + right[k][i] * right[k][i];
+        }
+    }
+    CHECK(energy[0] > 0.0001f);
+    CHECK(energy[1] == 0.0f);
+    CHECK(energy[2] > 0.0001f);
+}
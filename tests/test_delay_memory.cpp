@@ -0,0 +1,172 @@
+#include <catch2/catch_test_macros.hpp>
+#include <clouds/clouds_reverb.h>
+#include <clouds/delay_memory.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace {
+
+std::vector<float> Render(clouds::CloudsReverb& reverb, int blocks) {
+    std::vector<float> out;
+    uint32_t seed = 1;
+    for (int block = 0; block < blocks; ++block) {
+        float left[256];
+        float right[256];
+        for (size_t i = 0; i < 256; ++i) {
+            seed = seed * 1664525 + 1013904223;
+            float noise = static_cast<float>(seed >> 8) / 16777216.0f - 0.5f;
+            left[i] = noise * 0.5f;
+            right[i] = -noise * 0.3f;
+        }
+        reverb.Process(left, right, 256);
+        out.insert(out.end(), left, left + 256);
+        out.insert(out.end(), right, right + 256);
+    }
+    return out;
+}
+
+// Heap memory filled with a pattern, but reported as zeroed: whatever Init()
+// clears shows up as zeros.
+class PatternAllocator : public clouds::DelayMemoryAllocator {
+ public:
+    void* Allocate(size_t size) override {
+        ++allocations;
+        void* memory = clouds::HeapAllocator::Default()->Allocate(size);
+        std::memset(memory, 0x5a, size);
+        return memory;
+    }
+
+    void Free(void* memory, size_t size) override {
+        ++frees;
+        clouds::HeapAllocator::Default()->Free(memory, size);
+    }
+
+    bool zeroed() const override { return true; }
+
+    int allocations = 0;
+    int frees = 0;
+};
+
+}  // namespace
+
+TEST_CASE("Moved reverbs keep running", "[reverb][memory]") {
+    clouds::CloudsReverb reference;
+    reference.Init(48000.0f);
+    const std::vector<float> expected = Render(reference, 20);
+
+    std::vector<clouds::CloudsReverb> reverbs;
+    for (int i = 0; i < 8; ++i) {
+        reverbs.emplace_back();
+        reverbs.back().Init(48000.0f);
+    }
+    for (auto& reverb : reverbs) {
+        CHECK(Render(reverb, 20) == expected);
+    }
+
+    // Moving mid-render, by construction and by assignment, carries the tail
+    clouds::CloudsReverb a;
+    a.Init(48000.0f);
+    Render(a, 10);
+    clouds::CloudsReverb b(std::move(a));
+    clouds::CloudsReverb c;
+    c.Init(32000.0f);
+    c = std::move(b);
+    reference.Init(48000.0f);
+    Render(reference, 10);
+    CHECK(Render(c, 10) == Render(reference, 10));
+
+    // A moved-from instance is usable again after Init()
+    a.Init(48000.0f);
+    reference.Init(48000.0f);
+    CHECK(Render(a, 10) == Render(reference, 10));
+}
+
+TEST_CASE("Arena hands out delay memory from one block", "[reverb][memory]") {
+    const size_t size = clouds::CloudsReverb::MemorySize(48000.0f);
+    CHECK(size % sizeof(float) == 0);
+    CHECK(clouds::CloudsReverb::MemorySize(96000.0f, 2) == size);
+    CHECK(clouds::CloudsReverb::MemorySize(96000.0f) > size);
+
+    std::vector<float> memory(3 * size / sizeof(float) + 16);
+    void* start = memory.data();
+    size_t space = memory.size() * sizeof(float);
+    REQUIRE(std::align(clouds::kDelayMemoryAlignment, 3 * size, start, space));
+    clouds::ArenaAllocator arena(start, 3 * size, false);
+
+    clouds::CloudsReverb reference;
+    reference.Init(48000.0f);
+    const std::vector<float> expected = Render(reference, 20);
+    std::vector<clouds::CloudsReverb> reverbs;
+    for (int i = 0; i < 3; ++i) {
+        reverbs.emplace_back(&arena);
+        reverbs.back().Init(48000.0f);
+        CHECK(arena.used() == (i + 1) * size);
+    }
+    for (auto& reverb : reverbs) {
+        CHECK(Render(reverb, 20) == expected);
+    }
+
+    // Same size again: the memory is kept
+    reverbs[0].Init(48000.0f);
+    CHECK(arena.used() == 3 * size);
+    CHECK(Render(reverbs[0], 20) == expected);
+
+    clouds::CloudsReverb one_too_many(&arena);
+    CHECK_THROWS_AS(one_too_many.Init(48000.0f), std::bad_alloc);
+}
+
+TEST_CASE("Zeroed delay memory is not cleared", "[reverb][memory]") {
+    PatternAllocator allocator;
+    {
+        clouds::CloudsReverb reverb(&allocator);
+        reverb.Init(48000.0f);
+        CHECK(allocator.allocations == 1);
+
+        // Init() only cleared memory it did not just allocate
+        clouds::CloudsReverb::Snapshot snapshot;
+        snapshot.Allocate(reverb);
+        REQUIRE(reverb.SaveSnapshot(&snapshot));
+        const uint8_t pattern[4] = { 0x5a, 0x5a, 0x5a, 0x5a };
+        const uint8_t* begin = snapshot.data();
+        const uint8_t* end = begin + snapshot.size();
+        CHECK(std::search(begin, end, pattern, pattern + 4) != end);
+
+        reverb.Init(48000.0f);
+        REQUIRE(reverb.SaveSnapshot(&snapshot));
+        CHECK(std::search(begin, end, pattern, pattern + 4) == end);
+
+        reverb.Init(96000.0f);
+        CHECK(allocator.allocations == 2);
+        CHECK(allocator.frees == 1);
+    }
+    CHECK(allocator.frees == 2);
+}
+
+#ifdef CLOUDS_HAVE_PAGE_ALLOCATOR
+TEST_CASE("Page allocator maps aligned zeroed memory", "[reverb][memory]") {
+    for (bool huge_pages : { false, true }) {
+        clouds::PageAllocator pages(huge_pages);
+        CHECK(pages.zeroed());
+        const size_t size = size_t(3) << 20;
+        uint8_t* block = static_cast<uint8_t*>(pages.Allocate(size));
+        CHECK(reinterpret_cast<uintptr_t>(block) % clouds::kDelayMemoryAlignment == 0);
+        if (huge_pages) {
+            CHECK(reinterpret_cast<uintptr_t>(block) % (size_t(2) << 20) == 0);
+        }
+        CHECK(std::all_of(block, block + size, [](uint8_t x) { return x == 0; }));
+        pages.Free(block, size);
+
+        clouds::ArenaAllocator arena(&pages, 2 * clouds::CloudsReverb::MemorySize(48000.0f));
+        clouds::CloudsReverb reverb(&arena);
+        reverb.Init(48000.0f);
+        clouds::CloudsReverb reference;
+        reference.Init(48000.0f);
+        CHECK(Render(reverb, 20) == Render(reference, 20));
+    }
+}
+#endif  // CLOUDS_HAVE_PAGE_ALLOCATOR
@@ -1,7 +1,10 @@
 #include <catch2/catch_test_macros.hpp>
 #include <catch2/catch_approx.hpp>
+#include <algorithm>
+#include <clouds/delay_network.h>
 #include <clouds/fx_engine.h>
 #include <cmath>
+#include <vector>
 
 using Catch::Approx;
 
@@ -293,6 +296,39 @@ TEST_CASE("FxEngine LFO", "[fxengine][lfo]") {
         // No crash = success
         CHECK(true);
     }
+
+    SECTION("LFO glides between steps") {
+        engine.SetLFOFrequency(clouds::LFO_1, 0.01f);
+        using DL = TestEngine::DelayLine<TestMemory::Line1, 0>;
+        DL delay_line;
+
+        // A ramp written to the line reads back as t - 40 - 8 * lfo(t), which
+        // recovers the LFO from the modulated read.
+        std::vector<float> lfo;
+        for (int t = 0; t < 400; ++t) {
+            TestEngine::Context c;
+            engine.Start(&c);
+            c.Load(static_cast<float>(t));
+            c.Write(delay_line, 0.0f);
+            c.Interpolate(delay_line, 40.0f, clouds::LFO_1, 8.0f, 1.0f);
+            float value = 0.0f;
+            c.Write(value);
+            if (t >= 64) {
+                lfo.push_back((static_cast<float>(t) - 40.0f - value) / 8.0f);
+            }
+        }
+
+        // At 0.01 cycles per sample the LFO moves by at most ~0.03 per
+        // sample; holding it for 32 samples would jump by up to ~1.
+        float lowest = lfo[0];
+        float highest = lfo[0];
+        for (size_t i = 1; i < lfo.size(); ++i) {
+            CHECK(std::fabs(lfo[i] - lfo[i - 1]) < 0.05f);
+            lowest = std::min(lowest, lfo[i]);
+            highest = std::max(highest, lfo[i]);
+        }
+        CHECK(highest - lowest > 0.5f);
+    }
 }
 
 TEST_CASE("FxEngine DataType compression", "[fxengine][datatype]") {
@@ -327,6 +363,256 @@ TEST_CASE("FxEngine DataType compression", "[fxengine][datatype]") {
         auto decompressed = clouds::DataType<clouds::FORMAT_16_BIT>::Decompress(compressed);
         CHECK(decompressed == Approx(1.0f).margin(0.001f));
     }
+
+    SECTION("FORMAT_16_BIT_FLOAT is IEEE half precision") {
+        using Half = clouds::DataType<clouds::FORMAT_16_BIT_FLOAT>;
+        CHECK(Half::Compress(1.0f) == 0x3c00);
+        CHECK(Half::Compress(-2.0f) == 0xc000);
+        CHECK(Half::Compress(65504.0f) == 0x7bff);
+        CHECK(Half::Compress(1e6f) == 0x7c00);
+        CHECK(Half::Compress(5.9604645e-8f) == 0x0001);  // Smallest subnormal
+        CHECK(Half::Compress(1.0f + 1.0f / 4096.0f) == 0x3c00);  // Ties to even
+        CHECK(Half::Decompress(0x3555) == Approx(0.333251953f));
+
+        // Every finite half survives a round trip.
+        int mismatches = 0;
+        for (uint32_t h = 0; h < 0x10000; ++h) {
+            uint16_t value = static_cast<uint16_t>(h);
+            if ((h & 0x7c00) != 0x7c00 && Half::Compress(Half::Decompress(value)) != value) {
+                ++mismatches;
+            }
+        }
+        CHECK(mismatches == 0);
+    }
+}
+
+namespace {
+
+// CompressN and DecompressN must match Compress and Decompress exactly, for
+// any span length (vector body plus scalar tail) and out-of-range input.
+template<clouds::Format format>
+void CheckSpanConversions() {
+    using Type = clouds::DataType<format>;
+    using T = typename Type::T;
+    constexpr size_t kSize = 1000;
+    std::vector<float> input(kSize);
+    uint32_t seed = 1;
+    for (size_t i = 0; i < kSize; ++i) {
+        seed = seed * 1664525 + 1013904223;
+        float x = static_cast<float>(seed >> 8) / 16777216.0f - 0.5f;
+        input[i] = x * (i % 3 == 0 ? 20.0f : 2.0f) * std::pow(10.0f, -static_cast<float>(i % 7));
+    }
+
+    for (size_t n : { size_t(0), size_t(1), size_t(7), size_t(8), size_t(13), kSize }) {
+        std::vector<T> compressed(n);
+        std::vector<float> decompressed(n);
+        Type::CompressN(input.data(), compressed.data(), n);
+        Type::DecompressN(compressed.data(), decompressed.data(), n);
+        int mismatches = 0;
+        for (size_t i = 0; i < n; ++i) {
+            if (compressed[i] != Type::Compress(input[i]) ||
+                decompressed[i] != Type::Decompress(compressed[i])) {
+                ++mismatches;
+            }
+        }
+        CHECK(mismatches == 0);
+    }
+}
+
+}  // namespace
+
+TEST_CASE("FxEngine DataType span conversions", "[fxengine][datatype]") {
+    CheckSpanConversions<clouds::FORMAT_12_BIT>();
+    CheckSpanConversions<clouds::FORMAT_16_BIT>();
+    CheckSpanConversions<clouds::FORMAT_16_BIT_FLOAT>();
+    CheckSpanConversions<clouds::FORMAT_32_BIT>();
+}
+
+TEST_CASE("FxEngine BlockContext matches Context with compact formats", "[fxengine][block]") {
+    using Engine = clouds::FxEngine<128, clouds::FORMAT_12_BIT>;
+    using Memory = Engine::Reserve<40, Engine::Reserve<50>>;
+    Engine::DelayLine<Memory, 0> ap;
+    Engine::DelayLine<Memory, 1> del;
+
+    Engine sample_engine;
+    Engine block_engine;
+    uint16_t sample_buffer[128] = {};
+    uint16_t block_buffer[128] = {};
+    sample_engine.Init(sample_buffer);
+    block_engine.Init(block_buffer);
+    sample_engine.SetLFOFrequency(clouds::LFO_1, 0.01f);
+    block_engine.SetLFOFrequency(clouds::LFO_1, 0.01f);
+
+    // Blocks of 24 make every span wrap around the 128-sample ring at some
+    // point.
+    constexpr size_t kBlock = 24;
+    for (int block = 0; block < 40; ++block) {
+        float input[kBlock];
+        float expected[kBlock];
+        for (size_t i = 0; i < kBlock; ++i) {
+            input[i] = std::sin(0.37f * static_cast<float>(block * kBlock + i));
+            Engine::Context c;
+            sample_engine.Start(&c);
+            c.Load(input[i]);
+            c.Interpolate(del, 30.0f, clouds::LFO_1, 10.0f, 0.5f);
+            c.Read(ap TAIL, 0.6f);
+            c.WriteAllPass(ap, -0.6f);
+            c.Write(del, 0.5f);
+            c.Write(expected[i]);
+        }
+
+        Engine::BlockContext c;
+        block_engine.StartBlock(&c, kBlock);
+        c.Interpolate(del, input, 30.0f, clouds::LFO_1, 10.0f, 0.5f);
+        c.AllPass(ap, input, 0.6f);
+        c.Write(del, input, 0.5f);
+        for (size_t i = 0; i < kBlock; ++i) {
+            CHECK(input[i] == Approx(expected[i]).margin(1e-6f));
+        }
+    }
+
+    int mismatches = 0;
+    for (size_t i = 0; i < 128; ++i) {
+        mismatches += block_buffer[i] != sample_buffer[i];
+    }
+    CHECK(mismatches == 0);
+}
+
+namespace {
+
+// Runs blocks of a small network on engine, with an allpass of 150 samples
+// and a delay of 200, per sample or through BlockContext, and returns the
+// output.
+template<typename Engine, typename AllPass, typename Delay>
+std::vector<float> RunRingNetwork(
+    Engine& engine, const AllPass& ap, const Delay& del, bool block_mode) {
+    // Blocks of 100 make every span wrap around the 512-sample ring at some
+    // point.
+    constexpr size_t kBlock = 100;
+    std::vector<float> output;
+    for (int block = 0; block < 30; ++block) {
+        float io[kBlock];
+        for (size_t i = 0; i < kBlock; ++i) {
+            io[i] = std::sin(0.37f * static_cast<float>(block * kBlock + i));
+        }
+        if (block_mode) {
+            typename Engine::BlockContext c;
+            engine.StartBlock(&c, kBlock);
+            c.Interpolate(del, io, 110.0f, clouds::LFO_1, 10.0f, 0.5f);
+            c.AllPass(ap, io, 0.6f);
+            c.Write(del, io, 0.5f);
+        } else {
+            for (size_t i = 0; i < kBlock; ++i) {
+                typename Engine::Context c;
+                engine.Start(&c);
+                c.Load(io[i]);
+                c.Interpolate(del, 110.0f, clouds::LFO_1, 10.0f, 0.5f);
+                c.Read(ap TAIL, 0.6f);
+                c.WriteAllPass(ap, -0.6f);
+                c.Write(del, 0.5f);
+                c.Write(io[i]);
+            }
+        }
+        output.insert(output.end(), io, io + kBlock);
+    }
+    return output;
+}
+
+template<clouds::Format format>
+void CheckMirroredRing() {
+    using Plain = clouds::FxEngine<512, format>;
+    using Mirrored = clouds::FxEngine<512, format, clouds::RING_MIRRORED>;
+    using T = typename Plain::T;
+    using Memory = typename Mirrored::template Reserve<150,
+        typename Mirrored::template Reserve<200>>;
+    typename Mirrored::template DelayLine<Memory, 0> ap;
+    typename Mirrored::template DelayLine<Memory, 1> del;
+    STATIC_REQUIRE(Mirrored::StorageSize(512) == 512 + Mirrored::kGuardSize);
+
+    std::vector<T> reference_buffer(512);
+    Plain reference;
+    reference.Init(reference_buffer.data());
+    reference.SetLFOFrequency(clouds::LFO_1, 0.01f);
+    const std::vector<float> expected = RunRingNetwork(reference, ap, del, false);
+
+    for (bool block_mode : {false, true}) {
+        std::vector<T> buffer(Mirrored::StorageSize(512));
+        Mirrored engine;
+        engine.Init(buffer.data());
+        engine.SetLFOFrequency(clouds::LFO_1, 0.01f);
+        const std::vector<float> output = RunRingNetwork(engine, ap, del, block_mode);
+
+        int mismatches = 0;
+        for (size_t i = 0; i < output.size(); ++i) {
+            mismatches += std::abs(output[i] - expected[i]) > 1e-6f;
+        }
+        // The ring holds the same samples, and the guard zone mirrors its
+        // head.
+        for (size_t i = 0; i < buffer.size(); ++i) {
+            mismatches += buffer[i] != reference_buffer[i % 512];
+        }
+        CHECK(mismatches == 0);
+    }
+}
+
+template<clouds::Format format>
+void CheckPackedRings() {
+    using Plain = clouds::FxEngine<512, format>;
+    using Packed = clouds::FxEngine<clouds::kDynamicSize, format, clouds::RING_PACKED>;
+    using T = typename Plain::T;
+    using Memory = typename Plain::template Reserve<150,
+        typename Plain::template Reserve<200>>;
+
+    std::vector<T> reference_buffer(512);
+    Plain reference;
+    reference.Init(reference_buffer.data());
+    reference.SetLFOFrequency(clouds::LFO_1, 0.01f);
+    const std::vector<float> expected = RunRingNetwork(
+        reference,
+        typename Plain::template DelayLine<Memory, 0>(),
+        typename Plain::template DelayLine<Memory, 1>(),
+        false);
+
+    // Each line gets a ring one sample longer than itself, plus a guard
+    // zone, starting on a cache line.
+    const int32_t lengths[] = { 150, 200 };
+    typename Packed::DynamicDelayLine lines[2];
+    const int32_t used = Packed::Allocate(lengths, 2, lines);
+    constexpr int32_t kAlignment = Packed::kCacheLineSize / sizeof(T);
+    const int32_t guard = static_cast<int32_t>(Packed::kGuardSize);
+    CHECK(lines[0].base == 0);
+    CHECK(lines[1].base % kAlignment == 0);
+    CHECK(lines[1].base >= 151 + guard);
+    CHECK(lines[1].base < 151 + guard + kAlignment);
+    CHECK(used == lines[1].base + 201 + guard);
+
+    for (bool block_mode : {false, true}) {
+        std::vector<T> buffer(Packed::StorageSize(used));
+        Packed engine;
+        engine.Init(buffer.data(), lines, 2);
+        engine.SetLFOFrequency(clouds::LFO_1, 0.01f);
+        CHECK(engine.buffer_size() == static_cast<size_t>(used));
+        const std::vector<float> output =
+            RunRingNetwork(engine, lines[0], lines[1], block_mode);
+
+        int mismatches = 0;
+        for (size_t i = 0; i < output.size(); ++i) {
+            mismatches += std::abs(output[i] - expected[i]) > 1e-6f;
+        }
+        CHECK(mismatches == 0);
+    }
+}
+
+}  // namespace
+
+TEST_CASE("FxEngine mirrored ring matches the plain ring", "[fxengine][block]") {
+    CheckMirroredRing<clouds::FORMAT_32_BIT>();
+    CheckMirroredRing<clouds::FORMAT_12_BIT>();
+}
+
+TEST_CASE("FxEngine packed rings match the shared ring", "[fxengine][block]") {
+    CheckPackedRings<clouds::FORMAT_32_BIT>();
+    CheckPackedRings<clouds::FORMAT_12_BIT>();
 }
 
 TEST_CASE("FxEngine multiple delay lines", "[fxengine][delay]") {
@@ -392,3 +678,370 @@ TEST_CASE("FxEngine multiple delay lines", "[fxengine][delay]") {
         CHECK(val3 == Approx(0.9f));
     }
 }
+
+TEST_CASE("FxEngine Sanitize silences only faulty lines", "[fxengine][delay]") {
+    TestEngine engine;
+    float buffer[kTestBufferSize] = {};
+    engine.Init(buffer);
+    using Memory = TestMemory::Line3;
+    TestEngine::DelayLine<Memory, 2> delay1;
+    TestEngine::DelayLine<Memory, 1> delay2;
+    TestEngine::DelayLine<Memory, 0> delay3;
+
+    for (int i = 0; i < 40; ++i) {
+        TestEngine::Context c;
+        engine.Start(&c);
+        c.Load(i == 30 ? std::nanf("") : 0.25f);
+        c.Write(delay1, 0.0f);
+        c.Load(i == 35 ? 1e9f : 0.5f);
+        c.Write(delay2, 0.0f);
+        c.Load(0.75f);
+        c.Write(delay3, 0.0f);
+    }
+    // delay3 is 16 samples long and has forgotten nothing but 0.75.
+    CHECK(engine.Sanitize(delay1, 1e8f));
+    CHECK(engine.Sanitize(delay2, 1e8f));
+    CHECK_FALSE(engine.Sanitize(delay3, 1e8f));
+    CHECK_FALSE(engine.Sanitize(delay1, 1e8f));
+
+    TestEngine::Context c;
+    engine.Start(&c);
+    for (int offset = 1; offset <= 16; ++offset) {
+        c.Load(0.0f);
+        c.Read(delay1, offset, 1.0f);
+        c.Read(delay2, offset, 1.0f);
+        c.Read(delay3, offset, 1.0f);
+        float value;
+        c.Write(value);
+        CHECK(value == 0.75f);
+    }
+}
+
+TEST_CASE("FxEngine BlockContext matches per-sample Context", "[fxengine][block]") {
+    using Memory = TestMemory::Line3;
+    using DL1 = TestEngine::DelayLine<Memory, 2>;
+    using DL2 = TestEngine::DelayLine<Memory, 1>;
+    DL1 delay1;
+    DL2 delay2;
+
+    TestEngine sample_engine;
+    TestEngine block_engine;
+    float sample_buffer[kTestBufferSize] = {};
+    float block_buffer[kTestBufferSize] = {};
+    sample_engine.Init(sample_buffer);
+    block_engine.Init(block_buffer);
+    sample_engine.SetLFOFrequency(clouds::LFO_1, 0.001f);
+    block_engine.SetLFOFrequency(clouds::LFO_1, 0.001f);
+
+    constexpr size_t kBlock = 16;  // Shorter than the 32-sample feedback read
+    float sample_state = 0.0f;
+    float block_state = 0.0f;
+    for (int block = 0; block < 40; ++block) {
+        float input[kBlock];
+        for (size_t i = 0; i < kBlock; ++i) {
+            input[i] = std::sin(0.37f * static_cast<float>(block * kBlock + i));
+        }
+
+        float expected[kBlock];
+        for (size_t i = 0; i < kBlock; ++i) {
+            TestEngine::Context c;
+            sample_engine.Start(&c);
+            c.Load(input[i]);
+            c.Interpolate(delay2, 20.0f, clouds::LFO_1, 8.0f, 0.5f);
+            c.Lp(sample_state, 0.3f);
+            c.Read(delay1 TAIL, 0.6f);
+            c.WriteAllPass(delay1, -0.6f);
+            c.Write(delay2, 0.5f);
+            c.Write(expected[i]);
+        }
+
+        TestEngine::BlockContext c;
+        block_engine.StartBlock(&c, kBlock);
+        CHECK(c.block_size() == kBlock);
+        c.Interpolate(delay2, input, 20.0f, clouds::LFO_1, 8.0f, 0.5f);
+        c.Lp(input, block_state, 0.3f);
+        c.AllPass(delay1, input, 0.6f);
+        c.Write(delay2, input, 0.5f);
+
+        for (size_t i = 0; i < kBlock; ++i) {
+            CHECK(input[i] == Approx(expected[i]).margin(1e-6f));
+        }
+    }
+
+    CHECK(block_state == Approx(sample_state).margin(1e-6f));
+    for (size_t i = 0; i < kTestBufferSize; ++i) {
+        CHECK(block_buffer[i] == Approx(sample_buffer[i]).margin(1e-6f));
+    }
+}
+
+TEST_CASE("FxEngine Invalidate reads silence until lines are rewritten", "[fxengine][block]") {
+    using Memory = TestMemory::Line3;
+    using DL1 = TestEngine::DelayLine<Memory, 2>;
+    using DL2 = TestEngine::DelayLine<Memory, 1>;
+    DL1 delay1;
+    DL2 delay2;
+
+    // Stale memory, at another write position, with the LFO running.
+    float stale[kTestBufferSize];
+    for (size_t i = 0; i < kTestBufferSize; ++i) {
+        stale[i] = std::sin(1.3f * static_cast<float>(i));
+    }
+    for (bool block : { false, true }) {
+        TestEngine cleared;
+        TestEngine invalidated;
+        float cleared_buffer[kTestBufferSize];
+        float invalidated_buffer[kTestBufferSize];
+        cleared.Init(cleared_buffer);
+        invalidated.Init(invalidated_buffer);
+        for (TestEngine* engine : { &cleared, &invalidated }) {
+            engine->SetLFOFrequency(clouds::LFO_1, 0.001f);
+            for (int i = 0; i < 77; ++i) {
+                TestEngine::Context c;
+                engine->Start(&c);
+            }
+        }
+        std::copy(stale, stale + kTestBufferSize, cleared_buffer);
+        std::copy(stale, stale + kTestBufferSize, invalidated_buffer);
+        cleared.Clear();
+        invalidated.Invalidate();
+        CHECK(std::equal(stale, stale + kTestBufferSize, invalidated_buffer));
+
+        // Past the longest line, every read has been written over.
+        constexpr size_t kBlock = 16;
+        float cleared_state = 0.0f;
+        float invalidated_state = 0.0f;
+        for (int b = 0; b < 8; ++b) {
+            float input[2][kBlock];
+            for (size_t i = 0; i < kBlock; ++i) {
+                input[0][i] = input[1][i] =
+                    std::sin(0.37f * static_cast<float>(b * kBlock + i));
+            }
+            TestEngine* engines[2] = { &cleared, &invalidated };
+            float* states[2] = { &cleared_state, &invalidated_state };
+            for (int e = 0; e < 2; ++e) {
+                if (block) {
+                    TestEngine::BlockContext c;
+                    engines[e]->StartBlock(&c, kBlock);
+                    c.Interpolate(delay2, input[e], 20.0f, clouds::LFO_1, 8.0f, 0.5f);
+                    c.Lp(input[e], *states[e], 0.3f);
+                    c.AllPass(delay1, input[e], 0.6f);
+                    c.Write(delay2, input[e], 0.5f);
+                } else {
+                    for (size_t i = 0; i < kBlock; ++i) {
+                        TestEngine::Context c;
+                        engines[e]->Start(&c);
+                        c.Load(input[e][i]);
+                        c.Interpolate(delay2, 20.0f, clouds::LFO_1, 8.0f, 0.5f);
+                        c.Lp(*states[e], 0.3f);
+                        c.AllPass(delay1, 0.6f, -0.6f);
+                        c.Write(delay2, 0.5f);
+                        c.Write(input[e][i]);
+                    }
+                }
+            }
+            CHECK(std::equal(input[0], input[0] + kBlock, input[1]));
+        }
+    }
+}
+
+namespace test_network {
+
+using namespace clouds::network;
+
+struct A; struct B; struct C; struct D;
+
+// Branches of different lengths, so the block kernel runs them one after the
+// other.
+using Network = DelayNetwork<
+    Lines<Line<A, 24>, Line<B, 20>, Line<C, 16>, Line<D, 30>>,
+    Diffuser<AllPass<A>>,
+    Branch<ModulatedRead<D, 24, 4, clouds::LFO_2>, LowPass<0>,
+           AllPass<B, true>, WriteDelay<C>>,
+    Branch<ModulatedRead<C, 12, 2, clouds::LFO_1>, LowPass<1>, WriteDelay<D>>>;
+
+using Engine = clouds::FxEngine<Network::kBufferSize, clouds::FORMAT_32_BIT>;
+using Memory = Engine::Reserve<24, Engine::Reserve<20, Engine::Reserve<16, Engine::Reserve<30>>>>;
+
+struct E;
+
+// Branches of the same shape, which the per-sample kernel runs as a pair.
+using SymmetricNetwork = DelayNetwork<
+    Lines<Line<A, 24>, Line<B, 20>, Line<C, 16>, Line<D, 30>, Line<E, 18>>,
+    Diffuser<AllPass<A>>,
+    Branch<ModulatedRead<D, 24, 4, clouds::LFO_2>, LowPass<0>,
+           AllPass<B, true>, WriteDelay<C>>,
+    Branch<ModulatedRead<C, 12, 2, clouds::LFO_1>, LowPass<1>,
+           AllPass<E>, WriteDelay<D>>>;
+
+}  // namespace test_network
+
+TEST_CASE("DelayNetwork derives the memory layout", "[fxengine][network]") {
+    using namespace test_network;
+
+    STATIC_REQUIRE(Network::kNumLines == 4);
+    STATIC_REQUIRE(Network::kNumOutputs == 2);
+    STATIC_REQUIRE(Network::kNumLowPass == 2);
+    STATIC_REQUIRE(Network::kMemory == 93);
+    STATIC_REQUIRE(Network::kBufferSize == 128);
+    STATIC_REQUIRE(Network::kMinFeedbackLatency == 10);
+    STATIC_REQUIRE(Network::kLoadsPerSample == 6);
+    STATIC_REQUIRE(Network::kStoresPerSample == 4);
+
+    // Same layout as FxEngine::Reserve and FxEngine::Allocate
+    STATIC_REQUIRE(Network::DelayLine<B>::base == Engine::DelayLine<Memory, 1>::base);
+    STATIC_REQUIRE(Network::DelayLine<D>::base == Engine::DelayLine<Memory, 3>::base);
+    STATIC_REQUIRE(Network::DelayLine<D>::length == 30);
+
+    Engine::DynamicDelayLine lines[Network::kNumLines];
+    CHECK(Engine::Allocate(Network::kLengths, Network::kNumLines, lines) ==
+          static_cast<int32_t>(Network::kMemory));
+    CHECK(lines[Network::kIndex<C>].base == Network::DelayLine<C>::base);
+}
+
+TEST_CASE("DelayNetwork kernels match the hand-written network", "[fxengine][network]") {
+    using namespace test_network;
+    Engine::DelayLine<Memory, 0> a;
+    Engine::DelayLine<Memory, 1> b;
+    Engine::DelayLine<Memory, 2> c_line;
+    Engine::DelayLine<Memory, 3> d;
+
+    Engine reference_engine;
+    Engine sample_engine;
+    Engine block_engine;
+    float reference_buffer[Network::kBufferSize] = {};
+    float sample_buffer[Network::kBufferSize] = {};
+    float block_buffer[Network::kBufferSize] = {};
+    reference_engine.Init(reference_buffer);
+    sample_engine.Init(sample_buffer);
+    block_engine.Init(block_buffer);
+    for (Engine* engine : { &reference_engine, &sample_engine, &block_engine }) {
+        engine->SetLFOFrequency(clouds::LFO_1, 0.002f);
+        engine->SetLFOFrequency(clouds::LFO_2, 0.003f);
+    }
+
+    const auto k = MakeCoefficients(0.5f, 0.6f, -0.6f, 0.7f, 0.4f);
+    float reference_lp[2] = {};
+    float sample_lp[2] = {};
+    float block_lp[2] = {};
+
+    constexpr size_t kBlock = 8;
+    static_assert(kBlock <= Network::kMinFeedbackLatency, "Block too long");
+    for (int block = 0; block < 50; ++block) {
+        float input[kBlock];
+        float expected[2][kBlock];
+        for (size_t i = 0; i < kBlock; ++i) {
+            input[i] = std::sin(0.37f * static_cast<float>(block * kBlock + i));
+
+            Engine::Context c;
+            float apout;
+            reference_engine.Start(&c);
+            c.Read(input[i], k.gain);
+            c.Read(a TAIL, k.kap);
+            c.WriteAllPass(a, k.minus_kap);
+            c.Write(apout);
+            c.Load(apout);
+            c.Interpolate(d, 24.0f, clouds::LFO_2, 4.0f, k.krt);
+            c.Lp(reference_lp[0], k.klp);
+            c.Read(b TAIL, k.minus_kap);
+            c.WriteAllPass(b, k.kap);
+            c.Write(c_line, 1.0f);
+            c.Write(expected[0][i], 0.0f);
+            c.Load(apout);
+            c.Interpolate(c_line, 12.0f, clouds::LFO_1, 2.0f, k.krt);
+            c.Lp(reference_lp[1], k.klp);
+            c.Write(d, 1.0f);
+            c.Write(expected[1][i], 0.0f);
+
+            float wet[2];
+            Engine::Context generated;
+            sample_engine.Start(&generated);
+            Network::Process(&generated, Network::StaticLayout(), k, input[i], sample_lp, wet);
+            CHECK(wet[0] == expected[0][i]);
+            CHECK(wet[1] == expected[1][i]);
+        }
+
+        float io[kBlock];
+        float wet_1[kBlock];
+        float wet_2[kBlock];
+        float* const wet[2] = { wet_1, wet_2 };
+        for (size_t i = 0; i < kBlock; ++i) {
+            io[i] = input[i] * k.gain;
+        }
+        Engine::BlockContext c;
+        block_engine.StartBlock(&c, kBlock);
+        Network::ProcessBlock(&c, Network::StaticLayout(), k, io, block_lp, wet);
+        for (size_t i = 0; i < kBlock; ++i) {
+            CHECK(wet_1[i] == Approx(expected[0][i]).margin(1e-6f));
+            CHECK(wet_2[i] == Approx(expected[1][i]).margin(1e-6f));
+        }
+    }
+
+    for (size_t i = 0; i < Network::kBufferSize; ++i) {
+        CHECK(sample_buffer[i] == reference_buffer[i]);
+        CHECK(block_buffer[i] == Approx(reference_buffer[i]).margin(1e-6f));
+    }
+}
+
+template<clouds::Format format, clouds::RingLayout ring>
+void CheckPairedBranches() {
+    using namespace test_network;
+    using Engine = clouds::FxEngine<clouds::kDynamicSize, format, ring>;
+    using T = typename Engine::T;
+    using Layout = typename SymmetricNetwork::template ScaledLayout<
+        typename Engine::DynamicDelayLine>;
+
+    typename Engine::DynamicDelayLine lines[SymmetricNetwork::kNumLines];
+    size_t size = static_cast<size_t>(Engine::Allocate(
+        SymmetricNetwork::kLengths, SymmetricNetwork::kNumLines, lines));
+    if (ring != clouds::RING_PACKED) {
+        size = 512;
+    }
+    std::vector<T> paired_buffer(Engine::StorageSize(size));
+    std::vector<T> unpaired_buffer(Engine::StorageSize(size));
+    Engine paired_engine;
+    Engine unpaired_engine;
+    if constexpr (ring == clouds::RING_PACKED) {
+        paired_engine.Init(paired_buffer.data(), lines, SymmetricNetwork::kNumLines);
+        unpaired_engine.Init(unpaired_buffer.data(), lines, SymmetricNetwork::kNumLines);
+    } else {
+        paired_engine.Init(paired_buffer.data(), size);
+        unpaired_engine.Init(unpaired_buffer.data(), size);
+    }
+    for (Engine* engine : { &paired_engine, &unpaired_engine }) {
+        engine->SetLFOFrequency(clouds::LFO_1, 0.002f);
+        engine->SetLFOFrequency(clouds::LFO_2, 0.003f);
+    }
+
+    const Layout layout{ lines, 1.0f };
+    const auto k = clouds::network::MakeCoefficients(0.5f, 0.6f, -0.6f, 0.7f, 0.4f);
+    float paired_lp[2] = {};
+    float unpaired_lp[2] = {};
+    for (int i = 0; i < 400; ++i) {
+        const float input = 0.5f * std::sin(0.37f * static_cast<float>(i));
+        float paired_wet[2];
+        float unpaired_wet[2];
+        typename Engine::Context paired;
+        typename Engine::Context unpaired;
+        paired_engine.Start(&paired);
+        unpaired_engine.Start(&unpaired);
+        SymmetricNetwork::Process(&paired, layout, k, input, paired_lp, paired_wet);
+        SymmetricNetwork::ProcessUnpaired(
+            &unpaired, layout, k, input, unpaired_lp, unpaired_wet);
+        CHECK(paired_wet[0] == Approx(unpaired_wet[0]).margin(1e-6f));
+        CHECK(paired_wet[1] == Approx(unpaired_wet[1]).margin(1e-6f));
+    }
+    CHECK(paired_lp[0] == Approx(unpaired_lp[0]).margin(1e-6f));
+    CHECK(paired_lp[1] == Approx(unpaired_lp[1]).margin(1e-6f));
+}
+
+TEST_CASE("DelayNetwork pairs symmetric branches", "[fxengine][network]") {
+    using namespace test_network;
+
+    STATIC_REQUIRE(SymmetricNetwork::kPairedBranches);
+    STATIC_REQUIRE_FALSE(Network::kPairedBranches);
+
+    CheckPairedBranches<clouds::FORMAT_32_BIT, clouds::RING_PLAIN>();
+    CheckPairedBranches<clouds::FORMAT_32_BIT, clouds::RING_MIRRORED>();
+    CheckPairedBranches<clouds::FORMAT_16_BIT, clouds::RING_MIRRORED>();
+    CheckPairedBranches<clouds::FORMAT_32_BIT, clouds::RING_PACKED>();
+}
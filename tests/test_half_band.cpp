@@ -0,0 +1,97 @@
+#include <catch2/catch_test_macros.hpp>
+#include <clouds/half_band.h>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace {
+
+constexpr size_t kMaxSize = 256;
+
+std::vector<float> Sine(float frequency, size_t size) {
+    std::vector<float> x(size);
+    for (size_t i = 0; i < size; ++i) {
+        x[i] = static_cast<float>(
+            std::sin(6.283185307179586 * frequency * static_cast<double>(i)));
+    }
+    return x;
+}
+
+// Decimates `in` in chunks of `chunk` samples.
+template<typename Filter>
+std::vector<float> Decimate(const std::vector<float>& in, size_t chunk) {
+    clouds::HalfBandDecimator<kMaxSize, Filter> decimator;
+    std::vector<float> out(in.size() / 2 + 1);
+    size_t n = 0;
+    for (size_t i = 0; i < in.size(); i += chunk) {
+        n += decimator.Process(&in[i], std::min(chunk, in.size() - i), &out[n]);
+    }
+    out.resize(n);
+    return out;
+}
+
+template<typename Filter>
+std::vector<float> Interpolate(const std::vector<float>& in, size_t chunk) {
+    clouds::HalfBandInterpolator<kMaxSize, Filter> interpolator;
+    std::vector<float> out(2 * in.size());
+    for (size_t i = 0; i < in.size(); i += chunk) {
+        interpolator.Process(&in[i], std::min(chunk, in.size() - i), &out[2 * i]);
+    }
+    return out;
+}
+
+template<typename Filter>
+float RoundTripError(float frequency) {
+    const size_t latency = clouds::half_band::Latency<Filter>();
+    const std::vector<float> in = Sine(frequency, 4096);
+    const std::vector<float> out = Interpolate<Filter>(Decimate<Filter>(in, 200), 100);
+    float error = 0.0f;
+    for (size_t i = 2 * latency; i < in.size(); ++i) {
+        error = std::max(error, std::abs(out[i] - in[i - latency]));
+    }
+    return error;
+}
+
+template<typename Filter>
+float StopbandLevel(float frequency) {
+    const std::vector<float> out = Decimate<Filter>(Sine(frequency, 4096), 200);
+    float level = 0.0f;
+    for (size_t i = 2 * Filter::kNumSides; i < out.size(); ++i) {
+        level = std::max(level, std::abs(out[i]));
+    }
+    return level;
+}
+
+}  // namespace
+
+TEST_CASE("Half-band filters pass the band with their stated latency", "[half_band]") {
+    // Within the ripple of two filters (0.0005 dB, about 6e-5, each):
+    // aliasing of the decimator and images of the interpolator are far below.
+    CHECK(RoundTripError<clouds::half_band::Narrow>(0.01f) < 2e-4f);
+    CHECK(RoundTripError<clouds::half_band::Narrow>(0.18f) < 2e-4f);
+    CHECK(RoundTripError<clouds::half_band::Wide>(0.01f) < 2e-4f);
+    CHECK(RoundTripError<clouds::half_band::Wide>(0.09f) < 2e-4f);
+}
+
+TEST_CASE("Half-band decimators reject what would alias into the band", "[half_band]") {
+    const float floor = std::pow(10.0f, -84.0f / 20.0f);
+    for (float f : {0.32f, 0.4f, 0.49f}) {
+        CHECK(StopbandLevel<clouds::half_band::Narrow>(f) < floor);
+    }
+    for (float f : {0.41f, 0.45f, 0.49f}) {
+        CHECK(StopbandLevel<clouds::half_band::Wide>(f) < floor);
+    }
+}
+
+TEST_CASE("Half-band filters do not depend on how calls split the stream", "[half_band]") {
+    const std::vector<float> in = Sine(0.123f, 1000);
+    const std::vector<float> decimated = Decimate<clouds::half_band::Narrow>(in, kMaxSize);
+    for (size_t chunk : {1, 3, 7, 17, 255}) {
+        CHECK(Decimate<clouds::half_band::Narrow>(in, chunk) == decimated);
+    }
+    const std::vector<float> interpolated =
+        Interpolate<clouds::half_band::Narrow>(decimated, kMaxSize);
+    for (size_t chunk : {1, 5, 8, 9, 100}) {
+        CHECK(Interpolate<clouds::half_band::Narrow>(decimated, chunk) == interpolated);
+    }
+}
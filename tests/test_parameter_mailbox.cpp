@@ -0,0 +1,120 @@
+#include <catch2/catch_test_macros.hpp>
+#include <clouds/parameter_mailbox.h>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// The threaded tests are meant to run under ThreadSanitizer as well (see the
+// tsan preset), which reports any unsynchronized access they make.
+
+TEST_CASE("Mailbox hands over the latest value once", "[mailbox]") {
+    clouds::ParameterMailbox mailbox;
+    clouds::ReverbParameters parameters;
+    CHECK_FALSE(mailbox.Fetch(&parameters));
+
+    clouds::ReverbParameters posted;
+    posted.time = 0.9f;
+    mailbox.Post(posted);
+    posted.time = 0.8f;
+    posted.lp = 0.1f;
+    mailbox.Post(posted);
+    REQUIRE(mailbox.Fetch(&parameters));
+    CHECK(parameters.time == 0.8f);
+    CHECK(parameters.lp == 0.1f);
+    CHECK(parameters.amount == 0.5f);
+    CHECK_FALSE(mailbox.Fetch(&parameters));
+
+    // Updates apply to the last value posted, fetched or not
+    mailbox.Update([](clouds::ReverbParameters* p) { p->amount = 0.2f; });
+    mailbox.Update([](clouds::ReverbParameters* p) { p->diffusion = 0.3f; });
+    CHECK(mailbox.Latest().amount == 0.2f);
+    REQUIRE(mailbox.Fetch(&parameters));
+    CHECK(parameters.amount == 0.2f);
+    CHECK(parameters.diffusion == 0.3f);
+    CHECK(parameters.time == 0.8f);
+}
+
+TEST_CASE("Mailbox values are never torn across threads", "[mailbox]") {
+    // Each writer posts sets whose fields all hold the same value, unique to
+    // the writer and increasing.
+    constexpr int kWriters = 3;
+    constexpr int kPosts = 20000;
+    clouds::ParameterMailbox mailbox;
+    std::atomic<int> running(kWriters);
+    std::vector<std::thread> writers;
+    for (int w = 0; w < kWriters; ++w) {
+        writers.emplace_back([&mailbox, &running, w] {
+            for (int i = 1; i <= kPosts; ++i) {
+                const float value = static_cast<float>(w * kPosts + i);
+                mailbox.Post({ value, value, value, value, value });
+            }
+            running.fetch_sub(1);
+        });
+    }
+
+    bool consistent = true;
+    bool in_order = true;
+    size_t fetched = 0;
+    float last[kWriters] = {};
+    clouds::ReverbParameters p;
+    while (true) {
+        const bool writing = running.load() > 0;
+        if (!mailbox.Fetch(&p)) {
+            if (!writing) {
+                break;
+            }
+            continue;
+        }
+        ++fetched;
+        consistent = consistent && p.input_gain == p.amount &&
+            p.time == p.amount && p.diffusion == p.amount && p.lp == p.amount;
+        const int writer = (static_cast<int>(p.amount) - 1) / kPosts;
+        in_order = in_order && p.amount > last[writer];
+        last[writer] = p.amount;
+    }
+    for (auto& writer : writers) {
+        writer.join();
+    }
+    CHECK(fetched > 0);
+    CHECK(consistent);
+    CHECK(in_order);
+}
+
+TEST_CASE("ParameterMailbox drives a reverb from another thread", "[mailbox][reverb]") {
+    auto reverb = std::make_unique<clouds::CloudsReverb>();
+    reverb->Init(48000.0f);
+    clouds::ParameterMailbox mailbox;
+    std::atomic<bool> done(false);
+
+    // Audio thread: fetches once per block, then processes.
+    std::thread audio([&] {
+        std::vector<float> l(256), r(256);
+        clouds::ReverbParameters parameters;
+        bool last_block = false;
+        while (!last_block) {
+            last_block = done.load();
+            if (mailbox.Fetch(&parameters)) {
+                parameters.RampTo(reverb.get());
+            }
+            for (size_t i = 0; i < l.size(); ++i) {
+                l[i] = r[i] = (i % 32) / 32.0f - 0.5f;
+            }
+            reverb->Process(l.data(), r.data(), l.size());
+        }
+    });
+
+    // Control thread: sweeps Time and Diffusion.
+    for (int i = 0; i <= 1000; ++i) {
+        const float x = static_cast<float>(i) / 1000.0f;
+        mailbox.Update([x](clouds::ReverbParameters* p) { p->time = x; });
+        mailbox.Update([x](clouds::ReverbParameters* p) { p->diffusion = 1.0f - x; });
+    }
+    done.store(true);
+    audio.join();
+
+    // The last block applied the last set posted.
+    CHECK(reverb->GetTime() == 1.0f);
+    CHECK(reverb->GetDiffusion() == 0.0f);
+    CHECK(reverb->GetAmount() == 0.5f);
+}
@@ -0,0 +1,202 @@
+#include <catch2/catch_test_macros.hpp>
+#include <clouds/clouds_reverb.h>
+#include <clouds/render_queue.h>
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct Buffers {
+    std::vector<float> input_left, input_right;
+    std::vector<float> output_left, output_right;
+};
+
+// Builds jobs of varied length, channel count, sample rate and parameters.
+void MakeJobs(size_t num_jobs, std::vector<Buffers>* buffers,
+              std::vector<clouds::RenderJob>* jobs) {
+    uint32_t seed = 1;
+    buffers->resize(num_jobs);
+    jobs->resize(num_jobs);
+    for (size_t j = 0; j < num_jobs; ++j) {
+        Buffers& b = (*buffers)[j];
+        clouds::RenderJob& job = (*jobs)[j];
+        float x = static_cast<float>(j) / static_cast<float>(num_jobs);
+        bool mono = j % 3 == 0;
+
+        job.size = 100 + (j * 997) % 3000;
+        job.tail = (j % 4) * 500;
+        job.sample_rate = j % 5 == 0 ? 44100.0f : 48000.0f;
+        job.amount = 0.3f + 0.7f * x;
+        job.time = 0.95f - 0.5f * x;
+        job.lp = 0.9f - 0.6f * x;
+
+        b.input_left.resize(job.size);
+        b.input_right.resize(mono ? 0 : job.size);
+        for (size_t i = 0; i < job.size; ++i) {
+            seed = seed * 1664525u + 1013904223u;
+            b.input_left[i] = static_cast<float>(seed >> 8) / 16777216.0f - 0.5f;
+            if (!mono) {
+                b.input_right[i] = -b.input_left[i] * x;
+            }
+        }
+        b.output_left.assign(job.size + job.tail, 1.0f);
+        b.output_right.assign(job.size + job.tail, 1.0f);
+
+        job.input_left = b.input_left.data();
+        job.input_right = mono ? nullptr : b.input_right.data();
+        job.output_left = b.output_left.data();
+        job.output_right = b.output_right.data();
+    }
+}
+
+// Renders a job through a freshly initialized reverb.
+void RenderReference(const clouds::RenderJob& job, std::vector<float>* left,
+                     std::vector<float>* right) {
+    auto reverb = std::make_unique<clouds::CloudsReverb>();
+    reverb->Init(job.sample_rate);
+    reverb->SetParameters(job.amount, job.input_gain, job.time, job.diffusion, job.lp);
+    left->assign(job.size + job.tail, 0.0f);
+    right->assign(job.size + job.tail, 0.0f);
+    if (job.input_right) {
+        reverb->Process(job.input_left, job.input_right, left->data(), right->data(), job.size);
+    } else {
+        reverb->ProcessMono(job.input_left, left->data(), right->data(), job.size);
+    }
+    reverb->Process(left->data() + job.size, right->data() + job.size, job.tail);
+}
+
+}  // namespace
+
+TEST_CASE("RenderQueue jobs match a fresh reverb", "[render]") {
+    std::vector<Buffers> buffers;
+    std::vector<clouds::RenderJob> jobs;
+    MakeJobs(40, &buffers, &jobs);
+
+    clouds::RenderQueue queue(4);
+    CHECK(queue.num_threads() == 4);
+
+    size_t calls = 0;
+    size_t last_completed = 0;
+    queue.Render(jobs.data(), jobs.size(), [&](size_t completed, size_t total) {
+        ++calls;
+        CHECK(completed == last_completed + 1);
+        CHECK(total == jobs.size());
+        last_completed = completed;
+    });
+    CHECK(calls == jobs.size());
+
+    std::vector<float> left, right;
+    for (size_t j = 0; j < jobs.size(); ++j) {
+        INFO("job " << j);
+        CHECK(jobs[j].worker >= 0);
+        CHECK(jobs[j].worker < 4);
+        CHECK(jobs[j].seconds >= 0.0);
+        RenderReference(jobs[j], &left, &right);
+        CHECK(buffers[j].output_left == left);
+        CHECK(buffers[j].output_right == right);
+    }
+}
+
+TEST_CASE("RenderQueue reuses its workers across batches", "[render]") {
+    clouds::RenderQueue queue(3);
+    queue.Render(nullptr, 0);
+
+    for (int batch = 0; batch < 5; ++batch) {
+        std::vector<Buffers> buffers;
+        std::vector<clouds::RenderJob> jobs;
+        MakeJobs(7 + batch, &buffers, &jobs);
+        queue.Render(jobs.data(), jobs.size());
+
+        std::vector<float> left, right;
+        for (size_t j = 0; j < jobs.size(); ++j) {
+            RenderReference(jobs[j], &left, &right);
+            CHECK(buffers[j].output_left == left);
+            CHECK(buffers[j].output_right == right);
+        }
+    }
+}
+
+TEST_CASE("RenderQueue renders in place", "[render]") {
+    std::vector<float> left(2000), right(2000);
+    for (size_t i = 0; i < 1000; ++i) {
+        left[i] = (i % 100) ? 0.0f : 1.0f;
+        right[i] = (i % 70) ? 0.0f : -1.0f;
+    }
+    clouds::RenderJob job;
+    job.input_left = left.data();
+    job.input_right = right.data();
+    job.output_left = left.data();
+    job.output_right = right.data();
+    job.size = 1000;
+    job.tail = 1000;
+
+    std::vector<float> expected_left, expected_right;
+    RenderReference(job, &expected_left, &expected_right);
+
+    clouds::RenderQueue queue(2, true);
+    queue.Render(&job, 1);
+    CHECK(left == expected_left);
+    CHECK(right == expected_right);
+}
+
+TEST_CASE("RenderQueue rejects jobs it cannot render", "[render]") {
+    std::vector<Buffers> buffers;
+    std::vector<clouds::RenderJob> jobs;
+    MakeJobs(10, &buffers, &jobs);
+    jobs[1].sample_rate = 0.0f;
+    jobs[3].sample_rate = -48000.0f;
+    jobs[5].sample_rate = std::numeric_limits<float>::quiet_NaN();
+    jobs[7].sample_rate = 4294967296.0f;
+    jobs[9].output_right = nullptr;
+
+    clouds::RenderQueue queue(3);
+    size_t calls = 0;
+    CHECK(queue.Render(jobs.data(), jobs.size(), [&](size_t, size_t) {
+        ++calls;
+    }) == 5);
+    CHECK(calls == jobs.size());
+
+    std::vector<float> left, right;
+    for (size_t j = 0; j < jobs.size(); ++j) {
+        INFO("job " << j);
+        if (j % 2) {
+            CHECK(jobs[j].status == clouds::RENDER_STATUS_INVALID);
+            CHECK(jobs[j].worker == -1);
+            CHECK(buffers[j].output_left[0] == 1.0f);
+        } else {
+            CHECK(jobs[j].status == clouds::RENDER_STATUS_DONE);
+            RenderReference(jobs[j], &left, &right);
+            CHECK(buffers[j].output_left == left);
+        }
+    }
+}
+
+TEST_CASE("RenderQueue reports progress in order on the calling thread", "[render]") {
+    std::vector<Buffers> buffers;
+    std::vector<clouds::RenderJob> jobs;
+    MakeJobs(24, &buffers, &jobs);
+
+    // The workers go on while a slow callback runs; it still sees every
+    // completion, in order.
+    clouds::RenderQueue queue(4);
+    std::vector<size_t> reports;
+    std::thread::id caller = std::this_thread::get_id();
+    bool on_caller = true;
+    queue.Render(jobs.data(), jobs.size(), [&](size_t completed, size_t) {
+        on_caller = on_caller && std::this_thread::get_id() == caller;
+        reports.push_back(completed);
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    });
+    CHECK(on_caller);
+    REQUIRE(reports.size() == jobs.size());
+    for (size_t i = 0; i < reports.size(); ++i) {
+        CHECK(reports[i] == i + 1);
+    }
+    for (const auto& job : jobs) {
+        CHECK(job.status == clouds::RENDER_STATUS_DONE);
+    }
+}
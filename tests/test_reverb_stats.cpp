@@ -0,0 +1,186 @@
+#include <catch2/catch_test_macros.hpp>
+#include <clouds/clouds_reverb.h>
+#include <clouds/reverb_stats.h>
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// ReverbStats itself is always available; the CloudsReverb hooks are only
+// compiled with CLOUDS_ENABLE_STATS (the VIBEMODULE_STATS option, on in the
+// tsan preset).
+
+TEST_CASE("ReverbStats bins calls on a log scale", "[stats]") {
+    using clouds::ReverbStats;
+    for (uint64_t ns = 0; ns < 4096; ++ns) {
+        const size_t bucket = ReverbStats::Bucket(ns);
+        CHECK(ReverbStats::BucketStart(bucket) <= ns);
+        CHECK(ns < ReverbStats::BucketStart(bucket + 1));
+    }
+    CHECK(ReverbStats::Bucket(950000) == ReverbStats::Bucket(1040000));
+    CHECK(ReverbStats::Bucket(950000) < ReverbStats::Bucket(1100000));
+    CHECK(ReverbStats::Bucket(std::numeric_limits<uint64_t>::max()) ==
+          ReverbStats::kNumBuckets - 1);
+
+    // 90 calls of 10 us and 10 of 200 us, for 256 samples at 48 kHz each
+    ReverbStats stats;
+    for (int i = 0; i < 100; ++i) {
+        stats.Record(i < 90 ? 10000 : 200000, 1000, 256, 48000.0f);
+    }
+    stats.Count(ReverbStats::EVENT_CLEAR);
+    stats.Count(ReverbStats::EVENT_SLEEP);
+    stats.Count(ReverbStats::EVENT_SLEEP);
+
+    ReverbStats::Snapshot snapshot;
+    stats.Read(&snapshot);
+    CHECK(snapshot.calls == 100);
+    CHECK(snapshot.samples == 25600);
+    CHECK(snapshot.nanoseconds == 2900000);
+    CHECK(snapshot.cycles == 100000);
+    CHECK(snapshot.max_nanoseconds == 200000);
+    CHECK(snapshot.clears == 1);
+    CHECK(snapshot.sleeps == 2);
+    CHECK(snapshot.faults == 0);
+    CHECK(snapshot.mean_nanoseconds() == 29000.0);
+    CHECK(snapshot.nanoseconds_per_sample() > 113.0);
+    CHECK(snapshot.nanoseconds_per_sample() < 114.0);
+
+    // 256 samples last 5.33 ms: loads of 0.54% on average, 3.75% at most
+    CHECK(snapshot.load() > 0.0054);
+    CHECK(snapshot.load() < 0.0055);
+    CHECK(snapshot.max_load > 0.0374f);
+    CHECK(snapshot.max_load < 0.0376f);
+
+    // Percentiles round up by less than a bucket
+    CHECK(snapshot.Percentile(0.5) >= 10000.0);
+    CHECK(snapshot.Percentile(0.9) < 10000.0 * 1.2);
+    CHECK(snapshot.Percentile(0.95) >= 200000.0);
+    CHECK(snapshot.Percentile(1.0) == 200000.0);
+
+    // A reset requested from any thread applies at the next call
+    stats.RequestReset();
+    stats.Read(&snapshot);
+    CHECK(snapshot.calls == 100);
+    stats.Record(5000, 0, 32, 48000.0f);
+    stats.Read(&snapshot);
+    CHECK(snapshot.calls == 1);
+    CHECK(snapshot.samples == 32);
+    CHECK(snapshot.sleeps == 0);
+    CHECK(snapshot.max_nanoseconds == 5000);
+
+    stats.Reset();
+    stats.Read(&snapshot);
+    CHECK(snapshot.calls == 0);
+    CHECK(snapshot.Percentile(0.5) == 0.0);
+    CHECK(snapshot.load() == 0.0);
+}
+
+TEST_CASE("ReverbStats readers see whole calls", "[stats]") {
+    // Every call records the same amounts, so the totals of a consistent
+    // snapshot are multiples of the call count.
+    constexpr uint64_t kCalls = 100000;
+    clouds::ReverbStats stats;
+    std::atomic<bool> done(false);
+    std::atomic<bool> reading(false);
+    std::thread writer([&] {
+        while (!reading.load()) {
+            std::this_thread::yield();
+        }
+        for (uint64_t i = 0; i < kCalls; ++i) {
+            stats.Record(3000, 7, 64, 48000.0f);
+        }
+        done.store(true);
+    });
+
+    bool consistent = true;
+    uint64_t reads = 0;
+    uint64_t last_calls = 0;
+    clouds::ReverbStats::Snapshot snapshot;
+    while (!done.load()) {
+        stats.Read(&snapshot);
+        reading.store(true);
+        ++reads;
+        const uint64_t calls = snapshot.calls;
+        consistent = consistent && calls >= last_calls &&
+            snapshot.samples == 64 * calls &&
+            snapshot.nanoseconds == 3000 * calls &&
+            snapshot.cycles == 7 * calls &&
+            snapshot.histogram[clouds::ReverbStats::Bucket(3000)] == calls;
+        last_calls = calls;
+    }
+    writer.join();
+    stats.Read(&snapshot);
+    CHECK(reads > 0);
+    CHECK(consistent);
+    CHECK(snapshot.calls == kCalls);
+}
+
+#ifdef CLOUDS_ENABLE_STATS
+TEST_CASE("CloudsReverb records its calls when enabled", "[stats][reverb]") {
+    auto reverb = std::make_unique<clouds::CloudsReverb>();
+    reverb->Init(48000.0f);
+    clouds::ReverbStats::Snapshot stats;
+    CHECK_FALSE(reverb->GetStats(&stats));
+    reverb->EnableStats(true);
+    REQUIRE(reverb->IsStatsEnabled());
+
+    // A UI thread polls while the audio thread runs.
+    std::atomic<bool> done(false);
+    std::atomic<uint64_t> polls(0);
+    std::thread ui([&] {
+        clouds::ReverbStats::Snapshot polled;
+        while (!done.load()) {
+            reverb->GetStats(&polled);
+            polls.fetch_add(1);
+        }
+    });
+    while (polls.load() == 0) {
+        std::this_thread::yield();
+    }
+
+    std::vector<float> l(128);
+    std::vector<float> r(128);
+    reverb->SetTime(0.3f);
+    uint64_t calls = 0;
+    for (; calls < 4000 && (calls < 10 || !reverb->IsSleeping()); ++calls) {
+        for (size_t i = 0; i < l.size(); ++i) {
+            l[i] = r[i] = calls < 10 ? 0.5f : 0.0f;
+        }
+        reverb->Process(l.data(), r.data(), l.size());
+    }
+    REQUIRE(reverb->IsSleeping());
+    reverb->Clear();
+    l[0] = std::numeric_limits<float>::quiet_NaN();
+    reverb->Process(l.data(), r.data(), l.size());
+    ++calls;
+    done.store(true);
+    ui.join();
+
+    REQUIRE(reverb->GetStats(&stats));
+    CHECK(stats.calls == calls);
+    CHECK(stats.samples == calls * 128);
+    CHECK(stats.nanoseconds > 0);
+    CHECK(stats.max_nanoseconds >= stats.mean_nanoseconds());
+    CHECK(stats.Percentile(0.99) <= stats.max_nanoseconds);
+    CHECK(stats.load() > 0.0);
+    CHECK(stats.sleeps == 1);
+    CHECK(stats.clears == 1);
+    CHECK(stats.faults == 1);
+    CHECK(stats.faults == reverb->GetFaultCount());
+
+    // Init() starts over, and a requested reset applies at the next call
+    reverb->Init(48000.0f);
+    REQUIRE(reverb->GetStats(&stats));
+    CHECK(stats.calls == 0);
+    reverb->Process(l.data(), r.data(), l.size());
+    reverb->ResetStats();
+    reverb->Process(l.data(), r.data(), l.size());
+    REQUIRE(reverb->GetStats(&stats));
+    CHECK(stats.calls == 1);
+
+    reverb->EnableStats(false);
+    CHECK_FALSE(reverb->GetStats(&stats));
+}
+#endif  // CLOUDS_ENABLE_STATS
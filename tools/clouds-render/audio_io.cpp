@@ -0,0 +1,472 @@
+#include "audio_io.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+namespace clouds_render {
+
+namespace {
+
+const uint16_t kWaveFormatPcm = 0x0001;
+const uint16_t kWaveFormatFloat = 0x0003;
+const uint16_t kWaveFormatExtensible = 0xfffe;
+
+// Size of the ds64 chunk body written by WavWriter: RIFF size, data size,
+// sample count and an empty table.
+const uint32_t kDs64Size = 28;
+
+// Consumed input is handed back to the kernel in steps of this many bytes.
+const size_t kReleaseGranularity = 8 << 20;
+
+inline uint16_t ReadU16(const uint8_t* p) {
+  return uint16_t(p[0] | (p[1] << 8));
+}
+
+inline uint32_t ReadU32(const uint8_t* p) {
+  return uint32_t(p[0]) | (uint32_t(p[1]) << 8) |
+      (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+}
+
+inline uint64_t ReadU64(const uint8_t* p) {
+  return uint64_t(ReadU32(p)) | (uint64_t(ReadU32(p + 4)) << 32);
+}
+
+inline void WriteU16(uint8_t* p, uint16_t x) {
+  p[0] = uint8_t(x);
+  p[1] = uint8_t(x >> 8);
+}
+
+inline void WriteU32(uint8_t* p, uint32_t x) {
+  p[0] = uint8_t(x);
+  p[1] = uint8_t(x >> 8);
+  p[2] = uint8_t(x >> 16);
+  p[3] = uint8_t(x >> 24);
+}
+
+inline void WriteU64(uint8_t* p, uint64_t x) {
+  WriteU32(p, uint32_t(x));
+  WriteU32(p + 4, uint32_t(x >> 32));
+}
+
+// A memory-mapped RIFF/WAVE or RF64 file, and the layout of its samples.
+class MappedWav {
+ public:
+  MappedWav() { }
+
+  ~MappedWav() {
+    if (map_) {
+      munmap(map_, map_size_);
+    }
+    if (fd_ >= 0) {
+      close(fd_);
+    }
+  }
+
+  // Maps the file read-only, or shared and writable so that stores to the
+  // samples go to the file.
+  bool Open(const std::string& path, bool writable, std::string* error) {
+    fd_ = open(path.c_str(), writable ? O_RDWR : O_RDONLY);
+    if (fd_ < 0) {
+      *error = "cannot open " + path + ": " + std::strerror(errno);
+      return false;
+    }
+    struct stat st;
+    if (fstat(fd_, &st) != 0 || st.st_size < 12) {
+      *error = path + " is not a WAV file";
+      return false;
+    }
+    map_size_ = static_cast<size_t>(st.st_size);
+    void* map = mmap(nullptr, map_size_,
+                     writable ? PROT_READ | PROT_WRITE : PROT_READ,
+                     writable ? MAP_SHARED : MAP_PRIVATE, fd_, 0);
+    if (map == MAP_FAILED) {
+      *error = "cannot map " + path + ": " + std::strerror(errno);
+      return false;
+    }
+    map_ = static_cast<uint8_t*>(map);
+    if (!ParseHeader(error)) {
+      *error = path + ": " + *error;
+      return false;
+    }
+    return true;
+  }
+
+  // Writes stores back to the file.
+  bool Sync() {
+    return msync(map_, map_size_, MS_SYNC) == 0;
+  }
+
+  uint8_t* map() const { return map_; }
+  size_t map_size() const { return map_size_; }
+  SampleFormat format() const { return format_; }
+  size_t num_channels() const { return num_channels_; }
+  float sample_rate() const { return sample_rate_; }
+  uint64_t num_frames() const { return num_frames_; }
+  size_t frame_bytes() const { return BytesPerSample(format_) * num_channels_; }
+
+  // Byte offsets of the first sample and of the end of the samples.
+  size_t data_start() const { return data_start_; }
+  size_t data_end() const { return data_end_; }
+
+ private:
+  bool ParseHeader(std::string* error) {
+    const uint8_t* p = map_;
+    bool rf64 = !std::memcmp(p, "RF64", 4);
+    if ((!rf64 && std::memcmp(p, "RIFF", 4)) || std::memcmp(p + 8, "WAVE", 4)) {
+      *error = "not a WAV file";
+      return false;
+    }
+
+    uint64_t ds64_data_size = 0;
+    bool have_format = false;
+    size_t position = 12;
+    while (position + 8 <= map_size_) {
+      const uint8_t* chunk = p + position;
+      uint64_t chunk_size = ReadU32(chunk + 4);
+      size_t body = position + 8;
+
+      if (!std::memcmp(chunk, "ds64", 4) && body + 16 <= map_size_) {
+        ds64_data_size = ReadU64(p + body + 8);
+      } else if (!std::memcmp(chunk, "fmt ", 4)) {
+        if (chunk_size < 16 || body + chunk_size > map_size_) {
+          *error = "truncated fmt chunk";
+          return false;
+        }
+        if (!ParseFormat(p + body, static_cast<size_t>(chunk_size), error)) {
+          return false;
+        }
+        have_format = true;
+      } else if (!std::memcmp(chunk, "data", 4)) {
+        if (!have_format) {
+          *error = "data chunk before fmt chunk";
+          return false;
+        }
+        if (rf64 && chunk_size == 0xffffffff) {
+          chunk_size = ds64_data_size;
+        }
+        // Tolerate files whose writer never patched the header.
+        uint64_t available = map_size_ - body;
+        if (chunk_size == 0 || chunk_size > available) {
+          chunk_size = available;
+        }
+        size_t frame_bytes = BytesPerSample(format_) * num_channels_;
+        num_frames_ = chunk_size / frame_bytes;
+        data_start_ = body;
+        data_end_ = body + num_frames_ * frame_bytes;
+        return true;
+      }
+      position = body + static_cast<size_t>(chunk_size) + (chunk_size & 1);
+    }
+    *error = "no data chunk";
+    return false;
+  }
+
+  bool ParseFormat(const uint8_t* p, size_t size, std::string* error) {
+    uint16_t tag = ReadU16(p);
+    uint16_t channels = ReadU16(p + 2);
+    uint32_t rate = ReadU32(p + 4);
+    uint16_t block_align = ReadU16(p + 12);
+    uint16_t bits = ReadU16(p + 14);
+    if (tag == kWaveFormatExtensible && size >= 26) {
+      // The sub-format GUID starts with the plain format tag.
+      tag = ReadU16(p + 24);
+    }
+
+    if (tag == kWaveFormatPcm && bits == 16) {
+      format_ = SampleFormat::kInt16;
+    } else if (tag == kWaveFormatPcm && bits == 24) {
+      format_ = SampleFormat::kInt24;
+    } else if (tag == kWaveFormatPcm && bits == 32) {
+      format_ = SampleFormat::kInt32;
+    } else if (tag == kWaveFormatFloat && bits == 32) {
+      format_ = SampleFormat::kFloat32;
+    } else {
+      *error = "unsupported sample format (tag " + std::to_string(tag) +
+          ", " + std::to_string(bits) + " bits)";
+      return false;
+    }
+    if (channels != 1 && channels != 2) {
+      *error = "only mono and stereo files are supported";
+      return false;
+    }
+    if (block_align != BytesPerSample(format_) * channels) {
+      *error = "inconsistent fmt chunk";
+      return false;
+    }
+    if (rate == 0 || rate > kMaxSampleRate) {
+      *error = "unsupported sample rate " + std::to_string(rate) + " Hz";
+      return false;
+    }
+    num_channels_ = channels;
+    sample_rate_ = static_cast<float>(rate);
+    return true;
+  }
+
+  int fd_ = -1;
+  uint8_t* map_ = nullptr;
+  size_t map_size_ = 0;
+  SampleFormat format_ = SampleFormat::kFloat32;
+  size_t num_channels_ = 0;
+  float sample_rate_ = 0.0f;
+  uint64_t num_frames_ = 0;
+  size_t data_start_ = 0;
+  size_t data_end_ = 0;
+
+  MappedWav(const MappedWav&) = delete;
+  MappedWav& operator=(const MappedWav&) = delete;
+};
+
+class MappedWavReader : public AudioReader {
+ public:
+  MappedWavReader() { }
+
+  bool Open(const std::string& path, std::string* error) {
+    if (!wav_.Open(path, false, error)) {
+      return false;
+    }
+    madvise(wav_.map(), wav_.map_size(), MADV_SEQUENTIAL);
+    format_ = wav_.format();
+    num_channels_ = wav_.num_channels();
+    sample_rate_ = wav_.sample_rate();
+    num_frames_ = wav_.num_frames();
+    position_ = wav_.data_start();
+    released_ = 0;
+    return true;
+  }
+
+  size_t Read(float* left, float* right, size_t size) override {
+    size_t frame_bytes = wav_.frame_bytes();
+    size = static_cast<size_t>(
+        std::min<uint64_t>(size, (wav_.data_end() - position_) / frame_bytes));
+    DecodeFrames(format_, wav_.map() + position_, num_channels_, size, left,
+                 right);
+    position_ += size * frame_bytes;
+
+    // Drop the pages already decoded. They are clean, so this only bounds
+    // the resident size; nothing is written back.
+    size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t consumed = position_ / page_size * page_size;
+    if (consumed - released_ >= kReleaseGranularity) {
+      madvise(wav_.map() + released_, consumed - released_, MADV_DONTNEED);
+      released_ = consumed;
+    }
+    return size;
+  }
+
+ private:
+  MappedWav wav_;
+  size_t position_ = 0;
+  size_t released_ = 0;
+};
+
+class MappedWavUpdater : public AudioUpdater {
+ public:
+  MappedWavUpdater() { }
+
+  bool Open(const std::string& path, std::string* error) {
+    if (!wav_.Open(path, true, error)) {
+      return false;
+    }
+    format_ = wav_.format();
+    num_channels_ = wav_.num_channels();
+    sample_rate_ = wav_.sample_rate();
+    num_frames_ = wav_.num_frames();
+    return true;
+  }
+
+  void Read(uint64_t frame, float* left, float* right, size_t size) override {
+    DecodeFrames(format_, Frame(frame), num_channels_, size, left, right);
+  }
+
+  void Write(uint64_t frame, const float* left, const float* right,
+             size_t size) override {
+    EncodeFrames(format_, left, right, size, Frame(frame));
+  }
+
+  bool Finalize() override {
+    return wav_.Sync();
+  }
+
+ private:
+  uint8_t* Frame(uint64_t frame) const {
+    return wav_.map() + wav_.data_start() + frame * wav_.frame_bytes();
+  }
+
+  MappedWav wav_;
+};
+
+class RawReader : public AudioReader {
+ public:
+  RawReader(std::FILE* stream, SampleFormat format, size_t num_channels,
+            float sample_rate) : stream_(stream) {
+    format_ = format;
+    num_channels_ = num_channels;
+    sample_rate_ = sample_rate;
+  }
+
+  size_t Read(float* left, float* right, size_t size) override {
+    size_t frame_bytes = BytesPerSample(format_) * num_channels_;
+    buffer_.resize(size * frame_bytes);
+    size_t bytes = std::fread(buffer_.data(), 1, buffer_.size(), stream_);
+    // A trailing partial frame is dropped.
+    size = bytes / frame_bytes;
+    DecodeFrames(format_, buffer_.data(), num_channels_, size, left, right);
+    return size;
+  }
+
+ private:
+  std::FILE* stream_;
+  std::vector<uint8_t> buffer_;
+};
+
+class StreamWriter : public AudioWriter {
+ public:
+  StreamWriter(std::FILE* stream, SampleFormat format)
+      : stream_(stream), format_(format), data_size_(0) { }
+
+  bool Write(const float* left, const float* right, size_t size) override {
+    buffer_.resize(size * 2 * BytesPerSample(format_));
+    EncodeFrames(format_, left, right, size, buffer_.data());
+    data_size_ += buffer_.size();
+    return std::fwrite(buffer_.data(), 1, buffer_.size(), stream_) ==
+        buffer_.size();
+  }
+
+  bool Finalize() override {
+    return std::fflush(stream_) == 0;
+  }
+
+ protected:
+  std::FILE* stream_;
+  SampleFormat format_;
+  uint64_t data_size_;
+
+ private:
+  std::vector<uint8_t> buffer_;
+};
+
+class WavWriter : public StreamWriter {
+ public:
+  WavWriter(std::FILE* file, SampleFormat format, float sample_rate)
+      : StreamWriter(file, format), sample_rate_(sample_rate) { }
+
+  ~WavWriter() override {
+    std::fclose(stream_);
+  }
+
+  // Writes a RIFF header with a JUNK chunk the size of a ds64 chunk, so that
+  // Finalize() can turn it into RF64 in place if needed.
+  bool WriteHeader() {
+    uint8_t* p = header_;
+    uint16_t bytes = static_cast<uint16_t>(BytesPerSample(format_));
+    std::memcpy(p, "RIFF", 4);
+    WriteU32(p + 4, 0);
+    std::memcpy(p + 8, "WAVE", 4);
+    std::memcpy(p + 12, "JUNK", 4);
+    WriteU32(p + 16, kDs64Size);
+    std::memset(p + 20, 0, kDs64Size);
+    p += 20 + kDs64Size;
+    std::memcpy(p, "fmt ", 4);
+    WriteU32(p + 4, 16);
+    WriteU16(p + 8, IsFloat(format_) ? kWaveFormatFloat : kWaveFormatPcm);
+    WriteU16(p + 10, 2);
+    WriteU32(p + 12, static_cast<uint32_t>(sample_rate_));
+    WriteU32(p + 16, static_cast<uint32_t>(sample_rate_) * 2 * bytes);
+    WriteU16(p + 20, 2 * bytes);
+    WriteU16(p + 22, 8 * bytes);
+    std::memcpy(p + 24, "data", 4);
+    WriteU32(p + 28, 0);
+    return std::fwrite(header_, 1, kHeaderSize, stream_) == kHeaderSize;
+  }
+
+  bool Finalize() override {
+    if (data_size_ & 1) {
+      std::fputc(0, stream_);
+    }
+    uint64_t riff_size = kHeaderSize - 8 + data_size_ + (data_size_ & 1);
+    if (riff_size <= 0xffffffff) {
+      WriteU32(header_ + 4, static_cast<uint32_t>(riff_size));
+      WriteU32(header_ + kHeaderSize - 4, static_cast<uint32_t>(data_size_));
+    } else {
+      std::memcpy(header_, "RF64", 4);
+      WriteU32(header_ + 4, 0xffffffff);
+      std::memcpy(header_ + 12, "ds64", 4);
+      WriteU64(header_ + 20, riff_size);
+      WriteU64(header_ + 28, data_size_);
+      WriteU64(header_ + 36, data_size_ / (2 * BytesPerSample(format_)));
+      WriteU32(header_ + kHeaderSize - 4, 0xffffffff);
+    }
+    return std::fflush(stream_) == 0 &&
+        fseeko(stream_, 0, SEEK_SET) == 0 &&
+        std::fwrite(header_, 1, kHeaderSize, stream_) == kHeaderSize &&
+        std::fflush(stream_) == 0;
+  }
+
+ private:
+  static constexpr size_t kHeaderSize = 12 + 8 + kDs64Size + 8 + 16 + 8;
+
+  float sample_rate_;
+  uint8_t header_[kHeaderSize];
+};
+
+}  // namespace
+
+std::unique_ptr<AudioReader> OpenWavReader(
+    const std::string& path, std::string* error) {
+  std::unique_ptr<MappedWavReader> reader(new MappedWavReader());
+  if (!reader->Open(path, error)) {
+    return nullptr;
+  }
+  return reader;
+}
+
+std::unique_ptr<AudioUpdater> OpenWavUpdater(
+    const std::string& path, std::string* error) {
+  std::unique_ptr<MappedWavUpdater> updater(new MappedWavUpdater());
+  if (!updater->Open(path, error)) {
+    return nullptr;
+  }
+  if (updater->num_channels() != 2) {
+    *error = path + " is not a stereo file";
+    return nullptr;
+  }
+  return updater;
+}
+
+std::unique_ptr<AudioReader> OpenRawReader(
+    std::FILE* stream, SampleFormat format, size_t num_channels,
+    float sample_rate) {
+  return std::unique_ptr<AudioReader>(
+      new RawReader(stream, format, num_channels, sample_rate));
+}
+
+std::unique_ptr<AudioWriter> OpenWavWriter(
+    const std::string& path, SampleFormat format, float sample_rate,
+    std::string* error) {
+  std::FILE* file = std::fopen(path.c_str(), "wb");
+  if (!file) {
+    *error = "cannot create " + path + ": " + std::strerror(errno);
+    return nullptr;
+  }
+  std::setvbuf(file, nullptr, _IOFBF, 1 << 20);
+  std::unique_ptr<WavWriter> writer(new WavWriter(file, format, sample_rate));
+  if (!writer->WriteHeader()) {
+    *error = "cannot write " + path + ": " + std::strerror(errno);
+    return nullptr;
+  }
+  return writer;
+}
+
+std::unique_ptr<AudioWriter> OpenRawWriter(
+    std::FILE* stream, SampleFormat format) {
+  return std::unique_ptr<AudioWriter>(new StreamWriter(stream, format));
+}
+
+}  // namespace clouds_render
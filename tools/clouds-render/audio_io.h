@@ -0,0 +1,115 @@
+// Streaming audio readers and writers for clouds-render
+//
+// Readers decode successive runs of frames into planar float buffers; writers
+// take stereo planar buffers and encode them; updaters rewrite runs of frames
+// of an existing file. WAV input is memory-mapped and the pages behind the
+// read position are released as it advances, so the resident size stays
+// bounded however long the file is. Raw PCM is read from and written to stdio
+// streams.
+
+#ifndef CLOUDS_RENDER_AUDIO_IO_H_
+#define CLOUDS_RENDER_AUDIO_IO_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "sample_format.h"
+
+namespace clouds_render {
+
+class AudioReader {
+ public:
+  virtual ~AudioReader() = default;
+
+  // Decodes up to `size` frames. Mono sources fill `left` only. Returns the
+  // number of frames read; fewer than `size` only at the end of the input.
+  virtual size_t Read(float* left, float* right, size_t size) = 0;
+
+  size_t num_channels() const { return num_channels_; }
+  float sample_rate() const { return sample_rate_; }
+  SampleFormat format() const { return format_; }
+
+  // Number of frames in the input, or 0 if unknown (streams).
+  uint64_t num_frames() const { return num_frames_; }
+
+ protected:
+  size_t num_channels_ = 0;
+  float sample_rate_ = 0.0f;
+  SampleFormat format_ = SampleFormat::kFloat32;
+  uint64_t num_frames_ = 0;
+};
+
+class AudioWriter {
+ public:
+  virtual ~AudioWriter() = default;
+
+  // Encodes and writes `size` stereo frames. Returns false on I/O error.
+  virtual bool Write(const float* left, const float* right, size_t size) = 0;
+
+  // Flushes the output and completes any header. Returns false on I/O error.
+  virtual bool Finalize() = 0;
+};
+
+// Rewrites parts of an existing file in place, e.g. a previous render (see
+// --checkpoints). Frames are addressed from the start of the file.
+class AudioUpdater {
+ public:
+  virtual ~AudioUpdater() = default;
+
+  // Decodes or encodes `size` frames from `frame` on, all within the file.
+  virtual void Read(uint64_t frame, float* left, float* right,
+                    size_t size) = 0;
+  virtual void Write(uint64_t frame, const float* left, const float* right,
+                     size_t size) = 0;
+
+  // Writes the changes back to the file. Returns false on I/O error.
+  virtual bool Finalize() = 0;
+
+  size_t num_channels() const { return num_channels_; }
+  float sample_rate() const { return sample_rate_; }
+  SampleFormat format() const { return format_; }
+  uint64_t num_frames() const { return num_frames_; }
+
+ protected:
+  size_t num_channels_ = 0;
+  float sample_rate_ = 0.0f;
+  SampleFormat format_ = SampleFormat::kFloat32;
+  uint64_t num_frames_ = 0;
+};
+
+// Highest sample rate accepted from a file header or --rate. The reverb's
+// delay memory grows with the rate, so a corrupt header must not reach
+// CloudsReverb::Init().
+constexpr float kMaxSampleRate = 768000.0f;
+
+// Opens a RIFF/WAVE or RF64 file holding 16/24/32-bit PCM or 32-bit float
+// samples, mono or stereo. Returns nullptr and sets `error` on failure.
+std::unique_ptr<AudioReader> OpenWavReader(
+    const std::string& path, std::string* error);
+
+// Opens a stereo WAV file, as read by OpenWavReader(), for updating.
+std::unique_ptr<AudioUpdater> OpenWavUpdater(
+    const std::string& path, std::string* error);
+
+// Reads headerless interleaved samples from `stream`.
+std::unique_ptr<AudioReader> OpenRawReader(
+    std::FILE* stream, SampleFormat format, size_t num_channels,
+    float sample_rate);
+
+// Creates a stereo WAV file. Files whose data outgrows the 4 GB RIFF limit
+// are promoted to RF64 when finalized.
+std::unique_ptr<AudioWriter> OpenWavWriter(
+    const std::string& path, SampleFormat format, float sample_rate,
+    std::string* error);
+
+// Writes headerless interleaved stereo samples to `stream`.
+std::unique_ptr<AudioWriter> OpenRawWriter(
+    std::FILE* stream, SampleFormat format);
+
+}  // namespace clouds_render
+
+#endif  // CLOUDS_RENDER_AUDIO_IO_H_
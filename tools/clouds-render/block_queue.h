@@ -0,0 +1,62 @@
+// Hand-off queue between the stages of the clouds-render pipeline
+//
+// The reader, reverb and writer stages run on their own threads and pass
+// fixed-size blocks along a ring of queues. Blocks are allocated once and
+// recycled by the last stage, so the number of blocks in flight - and the
+// memory used - is fixed however long the input is.
+
+#ifndef CLOUDS_RENDER_BLOCK_QUEUE_H_
+#define CLOUDS_RENDER_BLOCK_QUEUE_H_
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+namespace clouds_render {
+
+struct Block {
+  explicit Block(size_t capacity) : left(capacity), right(capacity) { }
+
+  std::vector<float> left;
+  std::vector<float> right;
+  size_t size = 0;
+
+  // Set on the final block of the stream.
+  bool last = false;
+};
+
+class BlockQueue {
+ public:
+  BlockQueue() { }
+
+  void Push(Block* block) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      blocks_.push_back(block);
+    }
+    ready_.notify_one();
+  }
+
+  // Waits for the next block.
+  Block* Pop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    ready_.wait(lock, [this] { return !blocks_.empty(); });
+    Block* block = blocks_.front();
+    blocks_.pop_front();
+    return block;
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable ready_;
+  std::deque<Block*> blocks_;
+
+  BlockQueue(const BlockQueue&) = delete;
+  BlockQueue& operator=(const BlockQueue&) = delete;
+};
+
+}  // namespace clouds_render
+
+#endif  // CLOUDS_RENDER_BLOCK_QUEUE_H_
@@ -0,0 +1,122 @@
+#include "checkpoints.h"
+
+#include <sys/types.h>
+
+#include <cerrno>
+#include <cstring>
+
+namespace clouds_render {
+
+namespace {
+
+const char kMagic[8] = { 'C', 'L', 'D', 'C', 'K', 'P', 'T', '1' };
+const size_t kHeaderSize = sizeof(kMagic) + sizeof(CheckpointSettings);
+
+const uint64_t kHashPrime = 1099511628211ull;
+
+}  // namespace
+
+bool CheckpointSettings::Matches(const CheckpointSettings& other) const {
+  return interval == other.interval && num_frames == other.num_frames &&
+      snapshot_size == other.snapshot_size &&
+      sample_rate == other.sample_rate &&
+      num_channels == other.num_channels && mode == other.mode &&
+      format == other.format &&
+      !std::memcmp(parameters, other.parameters, sizeof(parameters));
+}
+
+CheckpointFile::~CheckpointFile() {
+  if (file_) {
+    std::fclose(file_);
+  }
+}
+
+bool CheckpointFile::Create(const std::string& path,
+                            const CheckpointSettings& settings,
+                            std::string* error) {
+  file_ = std::fopen(path.c_str(), "w+b");
+  if (!file_) {
+    *error = "cannot create " + path + ": " + std::strerror(errno);
+    return false;
+  }
+  settings_ = settings;
+  const char no_magic[sizeof(kMagic)] = { };
+  if (std::fwrite(no_magic, 1, sizeof(no_magic), file_) != sizeof(no_magic) ||
+      std::fwrite(&settings_, sizeof(settings_), 1, file_) != 1) {
+    *error = "cannot write " + path + ": " + std::strerror(errno);
+    return false;
+  }
+  return true;
+}
+
+bool CheckpointFile::Open(const std::string& path, std::string* error) {
+  file_ = std::fopen(path.c_str(), "r+b");
+  if (!file_) {
+    *error = "cannot open " + path + ": " + std::strerror(errno);
+    return false;
+  }
+  char magic[sizeof(kMagic)];
+  if (std::fread(magic, 1, sizeof(magic), file_) != sizeof(magic) ||
+      std::memcmp(magic, kMagic, sizeof(kMagic)) ||
+      std::fread(&settings_, sizeof(settings_), 1, file_) != 1) {
+    *error = path + " is not a complete checkpoint file";
+    return false;
+  }
+  const char no_magic[sizeof(kMagic)] = { };
+  if (fseeko(file_, 0, SEEK_SET) != 0 ||
+      std::fwrite(no_magic, 1, sizeof(no_magic), file_) != sizeof(no_magic) ||
+      std::fflush(file_) != 0) {
+    *error = "cannot write " + path + ": " + std::strerror(errno);
+    return false;
+  }
+  return true;
+}
+
+bool CheckpointFile::Seek(uint64_t index, size_t offset) {
+  const uint64_t record_size = sizeof(uint64_t) + settings_.snapshot_size;
+  return index < settings_.num_checkpoints() &&
+      fseeko(file_, static_cast<off_t>(
+          kHeaderSize + index * record_size + offset), SEEK_SET) == 0;
+}
+
+bool CheckpointFile::ReadHash(uint64_t index, uint64_t* hash) {
+  return Seek(index, 0) && std::fread(hash, sizeof(*hash), 1, file_) == 1;
+}
+
+bool CheckpointFile::ReadSnapshot(uint64_t index, uint8_t* snapshot) {
+  const size_t size = static_cast<size_t>(settings_.snapshot_size);
+  return Seek(index, sizeof(uint64_t)) &&
+      std::fread(snapshot, 1, size, file_) == size;
+}
+
+bool CheckpointFile::Write(uint64_t index, uint64_t hash,
+                           const uint8_t* snapshot) {
+  const size_t size = static_cast<size_t>(settings_.snapshot_size);
+  return Seek(index, 0) &&
+      std::fwrite(&hash, sizeof(hash), 1, file_) == 1 &&
+      std::fwrite(snapshot, 1, size, file_) == size;
+}
+
+bool CheckpointFile::Finalize() {
+  return std::fflush(file_) == 0 &&
+      fseeko(file_, 0, SEEK_SET) == 0 &&
+      std::fwrite(kMagic, 1, sizeof(kMagic), file_) == sizeof(kMagic) &&
+      std::fflush(file_) == 0;
+}
+
+uint64_t HashFrames(uint64_t hash, const float* left, const float* right,
+                    size_t num_channels, size_t size) {
+  // FNV-1a over whole samples.
+  for (size_t i = 0; i < size; ++i) {
+    uint32_t bits;
+    std::memcpy(&bits, &left[i], sizeof(bits));
+    hash = (hash ^ bits) * kHashPrime;
+    if (num_channels == 2) {
+      std::memcpy(&bits, &right[i], sizeof(bits));
+      hash = (hash ^ bits) * kHashPrime;
+    }
+  }
+  return hash;
+}
+
+}  // namespace clouds_render
@@ -0,0 +1,95 @@
+// Reverb checkpoints for incremental re-renders in clouds-render
+//
+// With --checkpoints, a render records the complete reverb state at the start
+// of every interval of frames (a compact CloudsReverb snapshot), along with a
+// hash of the input of the interval. A later render of an edited input with
+// the same settings restores the reverb from the checkpoint of the first
+// interval whose input changed, and stops once its output is back to the
+// previous render, so that its cost depends on the edit and not on the
+// length of the file.
+//
+// The file is a header followed by one record per interval, each holding the
+// input hash and the snapshot. Like the snapshots, it is in the byte order of
+// the machine that wrote it.
+
+#ifndef CLOUDS_RENDER_CHECKPOINTS_H_
+#define CLOUDS_RENDER_CHECKPOINTS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+namespace clouds_render {
+
+// What a render depends on besides its input. Checkpoints are only used by a
+// render with the same settings.
+struct CheckpointSettings {
+  uint64_t interval = 0;      // Frames per checkpoint
+  uint64_t num_frames = 0;    // Frames rendered, tail included
+  uint64_t snapshot_size = 0;
+  float sample_rate = 0.0f;
+  uint32_t num_channels = 0;  // Input channels
+  uint32_t mode = 0;          // clouds::ProcessingMode
+  uint32_t format = 0;        // Output SampleFormat
+  float parameters[5] = { };
+  uint32_t reserved = 0;
+
+  bool Matches(const CheckpointSettings& other) const;
+
+  uint64_t num_checkpoints() const {
+    return interval ? (num_frames + interval - 1) / interval : 0;
+  }
+};
+
+static_assert(sizeof(CheckpointSettings) == 64,
+              "CheckpointSettings is written as is");
+
+class CheckpointFile {
+ public:
+  CheckpointFile() { }
+  ~CheckpointFile();
+
+  // Starts a file for a render with `settings`. Until Finalize() it is not
+  // recognized as a checkpoint file, so an interrupted render leaves none.
+  bool Create(const std::string& path, const CheckpointSettings& settings,
+              std::string* error);
+
+  // Opens a finalized file for reading and updating records. The file is
+  // marked incomplete again before any record changes, and only becomes a
+  // checkpoint file again with Finalize(), so an interrupted update leaves
+  // none.
+  bool Open(const std::string& path, std::string* error);
+
+  const CheckpointSettings& settings() const { return settings_; }
+
+  // Record `index`: the hash of the input of the interval, and the snapshot
+  // of the reverb at its start (settings().snapshot_size bytes). Write a
+  // record once the output of its interval is written, so that its hash
+  // never describes output the file does not hold.
+  bool ReadHash(uint64_t index, uint64_t* hash);
+  bool ReadSnapshot(uint64_t index, uint8_t* snapshot);
+  bool Write(uint64_t index, uint64_t hash, const uint8_t* snapshot);
+
+  // Marks the file as complete and flushes it.
+  bool Finalize();
+
+ private:
+  bool Seek(uint64_t index, size_t offset);
+
+  std::FILE* file_ = nullptr;
+  CheckpointSettings settings_;
+
+  CheckpointFile(const CheckpointFile&) = delete;
+  CheckpointFile& operator=(const CheckpointFile&) = delete;
+};
+
+// Hash of decoded input frames (the left channel only for mono), continued
+// from `hash`; start from kHashSeed.
+const uint64_t kHashSeed = 14695981039346656037ull;
+uint64_t HashFrames(uint64_t hash, const float* left, const float* right,
+                    size_t num_channels, size_t size);
+
+}  // namespace clouds_render
+
+#endif  // CLOUDS_RENDER_CHECKPOINTS_H_
@@ -0,0 +1,584 @@
+// clouds-render - offline CloudsReverb renderer
+//
+// Streams a WAV file (or raw PCM on stdin) through CloudsReverb and writes a
+// stereo WAV file (or raw PCM on stdout). Reading, processing and writing run
+// on three threads connected by BlockQueues, so decoding and disk I/O overlap
+// with the reverb and memory use does not depend on the input length.
+//
+// With --checkpoints, a render also saves the reverb state at regular
+// intervals (see checkpoints.h). Rendering an edited input again then only
+// re-renders the output of the intervals from the first changed one until
+// the output is back within --tolerance of the previous render, in place.
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <clouds/clouds_reverb.h>
+#include <clouds/presets.h>
+
+#include "audio_io.h"
+#include "block_queue.h"
+#include "checkpoints.h"
+
+using namespace clouds_render;
+
+namespace {
+
+// Frames per pipeline block, and blocks in flight: one per stage plus one so
+// that the reader can run ahead while the writer drains.
+const size_t kBlockSize = 16384;
+const size_t kNumBlocks = 4;
+
+struct Options {
+  std::string input;
+  std::string output;
+
+  float amount = 0.5f;
+  float input_gain = 0.5f;
+  float time = 0.5f;
+  float diffusion = 0.625f;
+  float lp = 0.7f;
+
+  // Seconds of silence rendered after the input so the tail can decay.
+  float tail = 5.0f;
+
+  bool has_format = false;
+  SampleFormat format = SampleFormat::kFloat32;
+
+  // Layout of raw input read from stdin.
+  SampleFormat raw_format = SampleFormat::kFloat32;
+  size_t channels = 2;
+  float sample_rate = 48000.0f;
+
+  clouds::ProcessingMode mode = clouds::PROCESSING_MODE_BLOCK;
+  bool quiet = false;
+
+  // Incremental re-rendering. The interval is rounded to whole blocks.
+  std::string checkpoints;
+  float interval = 10.0f;
+  float tolerance = -120.0f;
+};
+
+void PrintUsage(std::FILE* stream) {
+  std::fprintf(stream,
+      "Usage: clouds-render [options] INPUT OUTPUT\n"
+      "\n"
+      "Renders INPUT through the Clouds reverb into OUTPUT. INPUT is a mono or\n"
+      "stereo WAV file (16/24/32-bit PCM or 32-bit float) and OUTPUT a stereo\n"
+      "WAV file. Use - for raw interleaved samples on stdin or stdout.\n"
+      "\n"
+      "Parameters (0..1, applied after --preset):\n"
+      "  --amount X         Dry/wet mix\n"
+      "  --input-gain X     Input gain\n"
+      "  --time X           Reverb time\n"
+      "  --diffusion X      Diffusion\n"
+      "  --lp X             Low-pass cutoff\n"
+      "  --preset NAME      Start from a factory preset\n"
+      "  --list-presets     List the factory presets and exit\n"
+      "\n"
+      "Output:\n"
+      "  --format FMT       s16, s24, s32 or f32 (default: input format)\n"
+      "  --tail SECONDS     Silence rendered after the input (default: 5)\n"
+      "  --mode MODE        block or sample processing (default: block)\n"
+      "\n"
+      "Raw input:\n"
+      "  --raw-format FMT   s16, s24, s32 or f32 (default: f32)\n"
+      "  --channels N       1 or 2 (default: 2)\n"
+      "  --rate HZ          Sample rate, up to 768000 (default: 48000)\n"
+      "\n"
+      "Incremental re-rendering (WAV files only):\n"
+      "  --checkpoints FILE Save the reverb state to FILE every --interval. If\n"
+      "                     FILE and OUTPUT are from a render with the same\n"
+      "                     settings, only re-render OUTPUT from the first\n"
+      "                     changed interval of INPUT until it converges\n"
+      "  --interval SECONDS Time between checkpoints (default: 10)\n"
+      "  --tolerance DB     Largest difference to the previous render that\n"
+      "                     counts as converged, at least one step of the\n"
+      "                     output format (default: -120)\n"
+      "\n"
+      "  --quiet            Do not print a summary\n"
+      "  --help             Show this message\n");
+}
+
+void ListPresets() {
+  std::printf("%-16s %7s %7s %7s %7s %7s\n",
+              "name", "amount", "gain", "time", "diff", "lp");
+  for (const clouds::Preset& preset : clouds::kFactoryPresets) {
+    std::printf("%-16s %7.3f %7.3f %7.3f %7.3f %7.3f\n",
+                preset.name, preset.amount, preset.input_gain, preset.time,
+                preset.diffusion, preset.lp);
+  }
+}
+
+bool ParseFloat(const char* text, float* value) {
+  char* end;
+  *value = std::strtof(text, &end);
+  return end != text && *end == '\0';
+}
+
+// Returns false if the program should exit with `exit_code` instead of
+// rendering.
+bool ParseArguments(int argc, char** argv, Options* options, int* exit_code) {
+  *exit_code = EXIT_FAILURE;
+  std::vector<std::string> positional;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+    bool ok = true;
+
+    if (arg == "--help" || arg == "-h") {
+      PrintUsage(stdout);
+      *exit_code = EXIT_SUCCESS;
+      return false;
+    } else if (arg == "--list-presets") {
+      ListPresets();
+      *exit_code = EXIT_SUCCESS;
+      return false;
+    } else if (arg == "--quiet" || arg == "-q") {
+      options->quiet = true;
+      continue;
+    } else if (arg == "-" || arg[0] != '-') {
+      positional.push_back(arg);
+      continue;
+    }
+
+    if (!value) {
+      std::fprintf(stderr, "clouds-render: %s needs a value\n", arg.c_str());
+      return false;
+    }
+    ++i;
+    if (arg == "--amount") {
+      ok = ParseFloat(value, &options->amount);
+    } else if (arg == "--input-gain") {
+      ok = ParseFloat(value, &options->input_gain);
+    } else if (arg == "--time") {
+      ok = ParseFloat(value, &options->time);
+    } else if (arg == "--diffusion") {
+      ok = ParseFloat(value, &options->diffusion);
+    } else if (arg == "--lp") {
+      ok = ParseFloat(value, &options->lp);
+    } else if (arg == "--preset") {
+      const clouds::Preset* preset = clouds::FindFactoryPreset(value);
+      if (!preset) {
+        std::fprintf(stderr, "clouds-render: unknown preset '%s' "
+                     "(see --list-presets)\n", value);
+        return false;
+      }
+      options->amount = preset->amount;
+      options->input_gain = preset->input_gain;
+      options->time = preset->time;
+      options->diffusion = preset->diffusion;
+      options->lp = preset->lp;
+    } else if (arg == "--format") {
+      ok = ParseSampleFormat(value, &options->format);
+      options->has_format = true;
+    } else if (arg == "--tail") {
+      ok = ParseFloat(value, &options->tail) && options->tail >= 0.0f;
+    } else if (arg == "--mode") {
+      if (!std::strcmp(value, "block")) {
+        options->mode = clouds::PROCESSING_MODE_BLOCK;
+      } else if (!std::strcmp(value, "sample")) {
+        options->mode = clouds::PROCESSING_MODE_SAMPLE;
+      } else {
+        ok = false;
+      }
+    } else if (arg == "--raw-format") {
+      ok = ParseSampleFormat(value, &options->raw_format);
+    } else if (arg == "--channels") {
+      options->channels = static_cast<size_t>(std::atoi(value));
+      ok = options->channels == 1 || options->channels == 2;
+    } else if (arg == "--rate") {
+      ok = ParseFloat(value, &options->sample_rate) &&
+          options->sample_rate > 0.0f &&
+          options->sample_rate <= kMaxSampleRate;
+    } else if (arg == "--checkpoints") {
+      options->checkpoints = value;
+    } else if (arg == "--interval") {
+      ok = ParseFloat(value, &options->interval) && options->interval > 0.0f;
+    } else if (arg == "--tolerance") {
+      ok = ParseFloat(value, &options->tolerance);
+    } else {
+      std::fprintf(stderr, "clouds-render: unknown option %s\n", arg.c_str());
+      return false;
+    }
+    if (!ok) {
+      std::fprintf(stderr, "clouds-render: invalid value '%s' for %s\n",
+                   value, arg.c_str());
+      return false;
+    }
+  }
+
+  if (positional.size() != 2) {
+    PrintUsage(stderr);
+    return false;
+  }
+  options->input = positional[0];
+  options->output = positional[1];
+  if (!options->checkpoints.empty() &&
+      (options->input == "-" || options->output == "-")) {
+    std::fprintf(stderr, "clouds-render: --checkpoints needs WAV input and "
+                 "output files\n");
+    return false;
+  }
+  return true;
+}
+
+// Processes a run of frames of the input, in place.
+void Process(clouds::CloudsReverb* reverb, bool mono, float* left,
+             float* right, size_t size) {
+  if (mono) {
+    reverb->ProcessMono(left, left, right, size);
+  } else {
+    reverb->Process(left, right, size);
+  }
+}
+
+// Prints the summary of a render that started at `start`.
+void PrintSummary(const char* prefix, uint64_t frames, float sample_rate,
+                  std::chrono::steady_clock::time_point start) {
+  double elapsed = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+  double duration = double(frames) / sample_rate;
+  std::fprintf(stderr,
+               "clouds-render: %s%llu frames (%.1f s) in %.2f s, %.0fx realtime\n",
+               prefix, static_cast<unsigned long long>(frames), duration,
+               elapsed, elapsed > 0.0 ? duration / elapsed : 0.0);
+}
+
+// Reports blocks the reverb had to recover from (see
+// CloudsReverb::GetFaultCount()): their output was muted.
+void WarnFaults(const clouds::CloudsReverb& reverb) {
+  if (reverb.GetFaultCount()) {
+    std::fprintf(stderr,
+                 "clouds-render: warning: muted %u block(s) with non-finite or "
+                 "runaway output; check the input\n",
+                 reverb.GetFaultCount());
+  }
+}
+
+// Re-renders, in place, the parts of the previous render in options.output
+// that depend on input changed since, using the checkpoints it saved. Each
+// run of changed intervals is rendered from the checkpoint before it, and
+// rendering goes on past it until an interval whose input is unchanged comes
+// out within the tolerance of the previous render. Intervals are processed
+// in blocks of kBlockSize, as in a full render, so that unchanged input
+// renders exactly as it did then.
+//
+// Returns false, having left the output as it was, when there are no
+// checkpoints or no previous render for these settings; a full render is
+// then needed.
+bool RenderIncrementally(const Options& options,
+                         const CheckpointSettings& settings,
+                         AudioReader* reader, clouds::CloudsReverb* reverb,
+                         int* exit_code) {
+  std::string error;
+  CheckpointFile checkpoints;
+  if (access(options.checkpoints.c_str(), F_OK) != 0) {
+    return false;
+  }
+  const char* mismatch = nullptr;
+  std::unique_ptr<AudioUpdater> output;
+  if (!checkpoints.Open(options.checkpoints, &error)) {
+    mismatch = error.c_str();
+  } else if (!checkpoints.settings().Matches(settings)) {
+    mismatch = "checkpoints were saved with other settings";
+  } else if (!(output = OpenWavUpdater(options.output, &error))) {
+    mismatch = error.c_str();
+  } else if (output->format() != static_cast<SampleFormat>(settings.format) ||
+             output->sample_rate() != settings.sample_rate ||
+             output->num_frames() != settings.num_frames) {
+    mismatch = "previous render does not match the checkpoints";
+  }
+  if (mismatch) {
+    if (!options.quiet) {
+      std::fprintf(stderr, "clouds-render: %s, rendering in full\n", mismatch);
+    }
+    return false;
+  }
+
+  *exit_code = EXIT_FAILURE;
+  const bool mono = settings.num_channels == 1;
+  const size_t interval = static_cast<size_t>(settings.interval);
+  // Renders of the same signal can round to adjacent output values.
+  const float tolerance = std::max(
+      std::pow(10.0f, options.tolerance / 20.0f),
+      QuantizationStep(static_cast<SampleFormat>(settings.format)));
+  std::vector<float> left(interval), right(interval);
+  std::vector<float> previous_left(interval), previous_right(interval);
+  std::vector<uint8_t> snapshot(static_cast<size_t>(settings.snapshot_size));
+  uint64_t frames_rendered = 0;
+  bool input_done = false;
+  bool rendering = false;
+  auto start = std::chrono::steady_clock::now();
+
+  for (uint64_t index = 0; index < settings.num_checkpoints(); ++index) {
+    const uint64_t position = index * interval;
+    const size_t size = static_cast<size_t>(
+        std::min<uint64_t>(interval, settings.num_frames - position));
+    size_t read = input_done ? 0 : reader->Read(left.data(), right.data(), size);
+    input_done = read < size;
+    std::fill(left.begin() + read, left.begin() + size, 0.0f);
+    std::fill(right.begin() + read, right.begin() + size, 0.0f);
+
+    uint64_t hash = HashFrames(kHashSeed, left.data(), right.data(),
+                               settings.num_channels, size);
+    uint64_t previous_hash;
+    if (!checkpoints.ReadHash(index, &previous_hash)) {
+      std::fprintf(stderr, "clouds-render: error reading %s\n",
+                   options.checkpoints.c_str());
+      return true;
+    }
+    const bool changed = hash != previous_hash;
+    if (changed && !rendering) {
+      if (!checkpoints.ReadSnapshot(index, snapshot.data()) ||
+          !reverb->RestoreCompactSnapshot(snapshot.data(), snapshot.size())) {
+        std::fprintf(stderr, "clouds-render: error reading %s\n",
+                     options.checkpoints.c_str());
+        return true;
+      }
+      rendering = true;
+    }
+    if (!rendering) {
+      continue;
+    }
+
+    reverb->SaveCompactSnapshot(snapshot.data(), snapshot.size());
+    for (size_t i = 0; i < size; i += kBlockSize) {
+      const size_t n = std::min(kBlockSize, size - i);
+      Process(reverb, mono, &left[i], &right[i], n);
+    }
+
+    // Compare what the file holds before and after, so that differences
+    // below the resolution of the output format do not count.
+    output->Read(position, previous_left.data(), previous_right.data(), size);
+    output->Write(position, left.data(), right.data(), size);
+    output->Read(position, left.data(), right.data(), size);
+    float difference = 0.0f;
+    for (size_t i = 0; i < size; ++i) {
+      difference = std::max(difference, std::abs(left[i] - previous_left[i]));
+      difference = std::max(difference, std::abs(right[i] - previous_right[i]));
+    }
+    frames_rendered += size;
+    rendering = changed || difference > tolerance;
+
+    // The record follows the output it describes. Open() marked the file
+    // incomplete, so until Finalize() an interrupted update only costs a
+    // full render next time.
+    if (!checkpoints.Write(index, hash, snapshot.data())) {
+      std::fprintf(stderr, "clouds-render: error writing %s: %s\n",
+                   options.checkpoints.c_str(), std::strerror(errno));
+      return true;
+    }
+  }
+
+  if (!output->Finalize() || !checkpoints.Finalize()) {
+    std::fprintf(stderr, "clouds-render: error updating %s: %s\n",
+                 options.output.c_str(), std::strerror(errno));
+    return true;
+  }
+  WarnFaults(*reverb);
+  if (!options.quiet) {
+    PrintSummary("re-rendered ", frames_rendered, settings.sample_rate, start);
+  }
+  *exit_code = EXIT_SUCCESS;
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options options;
+  int exit_code;
+  if (!ParseArguments(argc, argv, &options, &exit_code)) {
+    return exit_code;
+  }
+
+  std::string error;
+  std::unique_ptr<AudioReader> reader;
+  if (options.input == "-") {
+    reader = OpenRawReader(stdin, options.raw_format, options.channels,
+                           options.sample_rate);
+  } else {
+    reader = OpenWavReader(options.input, &error);
+  }
+  if (!reader) {
+    std::fprintf(stderr, "clouds-render: %s\n", error.c_str());
+    return EXIT_FAILURE;
+  }
+
+  SampleFormat format = options.has_format ? options.format : reader->format();
+  std::unique_ptr<clouds::CloudsReverb> reverb(new clouds::CloudsReverb());
+  reverb->Init(reader->sample_rate());
+  reverb->SetProcessingMode(options.mode);
+  reverb->SetParameters(options.amount, options.input_gain, options.time,
+                        options.diffusion, options.lp);
+
+  const bool mono = reader->num_channels() == 1;
+  const uint64_t tail_frames = static_cast<uint64_t>(
+      options.tail * reader->sample_rate() + 0.5f);
+
+  // Checkpoints are taken at block boundaries.
+  const bool checkpointing = !options.checkpoints.empty();
+  CheckpointSettings settings;
+  if (checkpointing) {
+    settings.interval = kBlockSize * std::max<uint64_t>(1, static_cast<uint64_t>(
+        std::lround(options.interval * reader->sample_rate() / kBlockSize)));
+    settings.num_frames = reader->num_frames() + tail_frames;
+    settings.snapshot_size = reverb->GetCompactSnapshotSize();
+    settings.sample_rate = reader->sample_rate();
+    settings.num_channels = static_cast<uint32_t>(reader->num_channels());
+    settings.mode = options.mode;
+    settings.format = static_cast<uint32_t>(format);
+    const float parameters[] = { options.amount, options.input_gain,
+                                 options.time, options.diffusion, options.lp };
+    std::copy(parameters, parameters + 5, settings.parameters);
+    int exit_code;
+    if (RenderIncrementally(options, settings, reader.get(), reverb.get(),
+                            &exit_code)) {
+      return exit_code;
+    }
+  }
+
+  std::unique_ptr<AudioWriter> writer;
+  if (options.output == "-") {
+    writer = OpenRawWriter(stdout, format);
+  } else {
+    writer = OpenWavWriter(options.output, format, reader->sample_rate(),
+                           &error);
+  }
+  if (!writer) {
+    std::fprintf(stderr, "clouds-render: %s\n", error.c_str());
+    return EXIT_FAILURE;
+  }
+
+  CheckpointFile checkpoints;
+  std::vector<uint8_t> snapshot(static_cast<size_t>(settings.snapshot_size));
+  if (checkpointing &&
+      !checkpoints.Create(options.checkpoints, settings, &error)) {
+    std::fprintf(stderr, "clouds-render: %s\n", error.c_str());
+    return EXIT_FAILURE;
+  }
+
+  std::vector<std::unique_ptr<Block>> blocks;
+  BlockQueue free_blocks;
+  BlockQueue read_blocks;
+  BlockQueue processed_blocks;
+  for (size_t i = 0; i < kNumBlocks; ++i) {
+    blocks.emplace_back(new Block(kBlockSize));
+    free_blocks.Push(blocks.back().get());
+  }
+
+  std::atomic<bool> write_failed(false);
+  uint64_t frames_written = 0;
+
+  auto start = std::chrono::steady_clock::now();
+
+  // Read stage: decode input, then pad with silence for the tail.
+  std::thread read_thread([&] {
+    uint64_t tail_remaining = tail_frames;
+    bool input_done = false;
+    bool last = false;
+    while (!last) {
+      Block* block = free_blocks.Pop();
+      float* left = block->left.data();
+      float* right = block->right.data();
+      size_t size = 0;
+      if (!input_done) {
+        size = reader->Read(left, right, kBlockSize);
+        input_done = size < kBlockSize;
+      }
+      size_t silence = static_cast<size_t>(
+          std::min<uint64_t>(kBlockSize - size, tail_remaining));
+      std::fill(left + size, left + size + silence, 0.0f);
+      std::fill(right + size, right + size + silence, 0.0f);
+      tail_remaining -= silence;
+      block->size = size + silence;
+      last = (input_done && tail_remaining == 0) || write_failed;
+      block->last = last;
+      read_blocks.Push(block);
+    }
+  });
+
+  // Write stage: encode and hand the block back to the reader.
+  std::thread write_thread([&] {
+    bool last = false;
+    while (!last) {
+      Block* block = processed_blocks.Pop();
+      if (!write_failed &&
+          !writer->Write(block->left.data(), block->right.data(),
+                         block->size)) {
+        write_failed = true;
+      }
+      frames_written += block->size;
+      last = block->last;
+      free_blocks.Push(block);
+    }
+  });
+
+  // Process stage, on this thread. A checkpoint records the state before
+  // the first block of its interval and the hash of the input up to the
+  // last one.
+  bool last = false;
+  uint64_t position = 0;
+  uint64_t hash = kHashSeed;
+  bool checkpoint_open = false;
+  bool checkpoints_failed = false;
+  while (!last) {
+    Block* block = read_blocks.Pop();
+    float* left = block->left.data();
+    float* right = block->right.data();
+    if (checkpointing && block->size) {
+      if (position % settings.interval == 0) {
+        reverb->SaveCompactSnapshot(snapshot.data(), snapshot.size());
+        hash = kHashSeed;
+        checkpoint_open = true;
+      }
+      hash = HashFrames(hash, left, right, settings.num_channels, block->size);
+    }
+    Process(reverb.get(), mono, left, right, block->size);
+    position += block->size;
+    last = block->last;
+    if (checkpoint_open && (position % settings.interval == 0 || last)) {
+      checkpoints_failed = checkpoints_failed ||
+          !checkpoints.Write((position - 1) / settings.interval, hash,
+                             snapshot.data());
+      checkpoint_open = false;
+    }
+    processed_blocks.Push(block);
+  }
+
+  read_thread.join();
+  write_thread.join();
+
+  if (write_failed || !writer->Finalize()) {
+    std::fprintf(stderr, "clouds-render: error writing %s: %s\n",
+                 options.output.c_str(), std::strerror(errno));
+    return EXIT_FAILURE;
+  }
+  // A partial set of checkpoints is left unfinalized, and ignored later.
+  if (checkpointing && (checkpoints_failed ||
+                        position != settings.num_frames ||
+                        !checkpoints.Finalize())) {
+    std::fprintf(stderr, "clouds-render: error writing %s: %s\n",
+                 options.checkpoints.c_str(), std::strerror(errno));
+    return EXIT_FAILURE;
+  }
+
+  WarnFaults(*reverb);
+  if (!options.quiet) {
+    PrintSummary("", frames_written, reader->sample_rate(), start);
+  }
+  return EXIT_SUCCESS;
+}
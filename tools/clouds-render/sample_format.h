@@ -0,0 +1,184 @@
+// Sample formats read and written by clouds-render
+//
+// Conversion between interleaved little-endian PCM / float samples and the
+// planar float channels CloudsReverb processes. Mono data is decoded to the
+// left channel only.
+
+#ifndef CLOUDS_RENDER_SAMPLE_FORMAT_H_
+#define CLOUDS_RENDER_SAMPLE_FORMAT_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace clouds_render {
+
+enum class SampleFormat {
+  kInt16,
+  kInt24,
+  kInt32,
+  kFloat32,
+};
+
+inline size_t BytesPerSample(SampleFormat format) {
+  switch (format) {
+    case SampleFormat::kInt16: return 2;
+    case SampleFormat::kInt24: return 3;
+    case SampleFormat::kInt32: return 4;
+    case SampleFormat::kFloat32: return 4;
+  }
+  return 0;
+}
+
+inline bool IsFloat(SampleFormat format) {
+  return format == SampleFormat::kFloat32;
+}
+
+// Difference between adjacent sample values, relative to full scale (0 for
+// floats).
+inline float QuantizationStep(SampleFormat format) {
+  switch (format) {
+    case SampleFormat::kInt16: return 1.0f / 32767.0f;
+    case SampleFormat::kInt24: return 1.0f / 8388607.0f;
+    case SampleFormat::kInt32: return 1.0f / 2147483647.0f;
+    case SampleFormat::kFloat32: return 0.0f;
+  }
+  return 0.0f;
+}
+
+// Parses the names used on the command line ("s16", "s24", "s32", "f32").
+inline bool ParseSampleFormat(const char* name, SampleFormat* format) {
+  static const struct { const char* name; SampleFormat format; } kNames[] = {
+    { "s16", SampleFormat::kInt16 },
+    { "s24", SampleFormat::kInt24 },
+    { "s32", SampleFormat::kInt32 },
+    { "f32", SampleFormat::kFloat32 },
+  };
+  for (const auto& entry : kNames) {
+    if (!std::strcmp(entry.name, name)) {
+      *format = entry.format;
+      return true;
+    }
+  }
+  return false;
+}
+
+template<SampleFormat format>
+inline float DecodeSample(const uint8_t* p) {
+  if constexpr (format == SampleFormat::kInt16) {
+    int16_t s = static_cast<int16_t>(p[0] | (p[1] << 8));
+    return static_cast<float>(s) * (1.0f / 32768.0f);
+  } else if constexpr (format == SampleFormat::kInt24) {
+    int32_t s = static_cast<int32_t>(
+        (uint32_t(p[0]) << 8) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 24));
+    return static_cast<float>(s >> 8) * (1.0f / 8388608.0f);
+  } else if constexpr (format == SampleFormat::kInt32) {
+    int32_t s = static_cast<int32_t>(
+        uint32_t(p[0]) | (uint32_t(p[1]) << 8) |
+        (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24));
+    return static_cast<float>(s) * (1.0f / 2147483648.0f);
+  } else {
+    float s;
+    std::memcpy(&s, p, sizeof(s));
+    return s;
+  }
+}
+
+template<SampleFormat format>
+inline void EncodeSample(float x, uint8_t* p) {
+  if constexpr (format == SampleFormat::kFloat32) {
+    std::memcpy(p, &x, sizeof(x));
+  } else {
+    x = std::clamp(x, -1.0f, 1.0f);
+    if constexpr (format == SampleFormat::kInt16) {
+      int32_t s = static_cast<int32_t>(std::lrint(x * 32767.0f));
+      p[0] = uint8_t(s);
+      p[1] = uint8_t(s >> 8);
+    } else if constexpr (format == SampleFormat::kInt24) {
+      int32_t s = static_cast<int32_t>(std::lrint(x * 8388607.0f));
+      p[0] = uint8_t(s);
+      p[1] = uint8_t(s >> 8);
+      p[2] = uint8_t(s >> 16);
+    } else {
+      // 2^31 - 1 is not representable as a float; go through double.
+      int32_t s = static_cast<int32_t>(std::lrint(double(x) * 2147483647.0));
+      p[0] = uint8_t(s);
+      p[1] = uint8_t(s >> 8);
+      p[2] = uint8_t(s >> 16);
+      p[3] = uint8_t(s >> 24);
+    }
+  }
+}
+
+template<SampleFormat format>
+inline void DecodeFrames(
+    const uint8_t* data, size_t num_channels, size_t size,
+    float* left, float* right) {
+  const size_t stride = BytesPerSample(format) * num_channels;
+  if (num_channels == 1) {
+    for (size_t i = 0; i < size; ++i, data += stride) {
+      left[i] = DecodeSample<format>(data);
+    }
+  } else {
+    for (size_t i = 0; i < size; ++i, data += stride) {
+      left[i] = DecodeSample<format>(data);
+      right[i] = DecodeSample<format>(data + BytesPerSample(format));
+    }
+  }
+}
+
+template<SampleFormat format>
+inline void EncodeFrames(
+    const float* left, const float* right, size_t size, uint8_t* data) {
+  const size_t bytes = BytesPerSample(format);
+  for (size_t i = 0; i < size; ++i, data += 2 * bytes) {
+    EncodeSample<format>(left[i], data);
+    EncodeSample<format>(right[i], data + bytes);
+  }
+}
+
+// Decodes `size` interleaved frames of one or two channels.
+inline void DecodeFrames(
+    SampleFormat format, const uint8_t* data, size_t num_channels, size_t size,
+    float* left, float* right) {
+  switch (format) {
+    case SampleFormat::kInt16:
+      DecodeFrames<SampleFormat::kInt16>(data, num_channels, size, left, right);
+      break;
+    case SampleFormat::kInt24:
+      DecodeFrames<SampleFormat::kInt24>(data, num_channels, size, left, right);
+      break;
+    case SampleFormat::kInt32:
+      DecodeFrames<SampleFormat::kInt32>(data, num_channels, size, left, right);
+      break;
+    case SampleFormat::kFloat32:
+      DecodeFrames<SampleFormat::kFloat32>(data, num_channels, size, left, right);
+      break;
+  }
+}
+
+// Encodes `size` stereo frames, interleaved.
+inline void EncodeFrames(
+    SampleFormat format, const float* left, const float* right, size_t size,
+    uint8_t* data) {
+  switch (format) {
+    case SampleFormat::kInt16:
+      EncodeFrames<SampleFormat::kInt16>(left, right, size, data);
+      break;
+    case SampleFormat::kInt24:
+      EncodeFrames<SampleFormat::kInt24>(left, right, size, data);
+      break;
+    case SampleFormat::kInt32:
+      EncodeFrames<SampleFormat::kInt32>(left, right, size, data);
+      break;
+    case SampleFormat::kFloat32:
+      EncodeFrames<SampleFormat::kFloat32>(left, right, size, data);
+      break;
+  }
+}
+
+}  // namespace clouds_render
+
+#endif  // CLOUDS_RENDER_SAMPLE_FORMAT_H_